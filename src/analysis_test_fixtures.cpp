@@ -1,9 +1,43 @@
 #include "analysis_test_fixtures.hpp"
 
+#include <llvm/Support/xxhash.h>
+
+#include <boost/range/iterator_range.hpp>
+
 namespace IncludeGuardian {
 
 using namespace boost::units::information;
 
+file_node stamped(const std::filesystem::path &path,
+                  const std::filesystem::path &location,
+                  const std::int64_t modified,
+                  const std::string_view contents) {
+  file_node node(path);
+  node.stamp.location = interned_path(location);
+  node.stamp.modified = modified;
+  node.stamp.content_hash = llvm::xxHash64(contents);
+  return node;
+}
+
+std::vector<std::string> paths(const Graph &graph) {
+  std::vector<std::string> results;
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    results.push_back(graph[v].path.string());
+  }
+  return results;
+}
+
+std::vector<std::string> children(const Graph &graph,
+                                  const Graph::vertex_descriptor v) {
+  std::vector<std::string> results;
+  for (const Graph::vertex_descriptor child :
+       boost::make_iterator_range(adjacent_vertices(v, graph))) {
+    results.push_back(graph[child].path.string());
+  }
+  return results;
+}
+
 DiamondGraph::DiamondGraph()
     : graph(), A(1, 2000000000.0 * bytes), B(10, 200000000.0 * bytes),
       C(100, 20000000.0 * bytes), D(1000, 2000000.0 * bytes),
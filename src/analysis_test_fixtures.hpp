@@ -5,10 +5,30 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <filesystem>
 #include <span>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace IncludeGuardian {
 
+/// Return a `file_node` with the specified `path` that was read from the
+/// specified `location`, was last modified at the specified `modified` and
+/// has the specified `contents`.
+file_node stamped(const std::filesystem::path &path,
+                  const std::filesystem::path &location,
+                  std::int64_t modified = 0, std::string_view contents = "");
+
+/// Return the path of each vertex of the specified `graph` in order.
+std::vector<std::string> paths(const Graph &graph);
+
+/// Return the path of each file included by the specified `v` in the
+/// specified `graph` in order.
+std::vector<std::string> children(const Graph &graph,
+                                  Graph::vertex_descriptor v);
+
 //      a
 //     / \
 //    b   c
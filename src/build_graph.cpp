@@ -1,4 +1,6 @@
 #include "build_graph.hpp"
+#include "cost_cache.hpp"
+#include "crawl.hpp"
 
 #include <clang/AST/ASTConsumer.h>
 #include <clang/ASTMatchers/ASTMatchFinder.h>
@@ -7,27 +9,48 @@
 #include <clang/Basic/TargetInfo.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendActions.h>
+#include <clang/Frontend/Utils.h>
 #include <clang/Lex/HeaderSearch.h>
 #include <clang/Lex/HeaderSearchOptions.h>
 #include <clang/Lex/Lexer.h>
 #include <clang/Lex/Preprocessor.h>
 #include <clang/Lex/PreprocessorOptions.h>
+#include <clang/Tooling/ArgumentsAdjusters.h>
 #include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/Tooling.h>
 
 #include <llvm/ADT/ScopeExit.h>
+#include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/Triple.h>
 #include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/xxhash.h>
+
+#include <boost/predef.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <charconv>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <initializer_list>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 namespace IncludeGuardian {
@@ -39,8 +62,19 @@ struct Hasher {
     // NOTE: Not a good hash, but our devices should probably be the same
     return key.getFile() ^ key.getDevice();
   }
+
+  std::size_t operator()(
+      const std::pair<llvm::sys::fs::UniqueID, std::uint64_t> &key) const
+      noexcept {
+    return (*this)(key.first) ^ (key.second * 0x9E3779B97F4A7C15u);
+  }
 };
 
+// A map of the `UniqueID` of a replacement file to the `UniqueID` of the
+// file it replaced.
+using ReplacedIds = std::unordered_map<llvm::sys::fs::UniqueID,
+                                       llvm::sys::fs::UniqueID, Hasher>;
+
 const bool LOG = false;
 
 // This function gives us a way to restrict ourselves to a subset of
@@ -56,6 +90,98 @@ bool allowed(const clang::FileEntry *f) {
          }) != allow_list.end();
 }
 
+// The definition of each macro tested by a file, sorted by name, where an
+// empty definition means that the macro was not defined.
+using TestedMacros = std::vector<std::pair<std::string, std::string>>;
+
+// Return a hash of the specified `macros`.
+std::uint64_t hash_macros(const TestedMacros &macros) {
+  std::string buffer;
+  for (const auto &[name, definition] : macros) {
+    buffer += name;
+    buffer += '\0';
+    buffer += definition;
+    buffer += '\0';
+  }
+  return llvm::xxHash64(buffer);
+}
+
+/// This component is a thread-safe store of the replacement contents for
+/// files that have been fully processed.  Replacements are never modified
+/// once published and each one remembers the index of the translation unit
+/// that created it.
+///
+/// A file may define different macros depending on the macros that it tests,
+/// e.g. in its `#if` directives, so a replacement is only equivalent to the
+/// original file when those macros have the same definitions.  Each file may
+/// have several replacements, one for each environment of tested macros.
+class ReplacementStore {
+public:
+  /// The maximum number of replacements for a single file.
+  static constexpr std::size_t max_variants = 16u;
+
+  struct entry {
+    std::string path;
+    std::string contents;
+    TestedMacros macros; //< The macros the original file tested
+    std::uint64_t environment; //< The hash of `macros`
+    std::size_t variant; //< The number of earlier replacements of the file
+    std::size_t index; //< The translation unit that published this
+    std::size_t sequence; //< The number of entries published before this
+  };
+
+private:
+  mutable std::shared_mutex m_mutex;
+  std::unordered_map<llvm::sys::fs::UniqueID,
+                     std::vector<std::shared_ptr<const entry>>, Hasher>
+      m_entries;
+  std::size_t m_count;
+
+public:
+  ReplacementStore() : m_mutex(), m_entries(), m_count(0u) {}
+
+  /// Publish the specified `contents` as the replacement for the file with
+  /// the specified `id` located at `path` when the specified `macros` have
+  /// the same definitions, unless one has already been published for these
+  /// `macros`.  Return the replacement for `macros`, or `nullptr` if the
+  /// file already has `max_variants` replacements.
+  std::shared_ptr<const entry> publish(llvm::sys::fs::UniqueID id,
+                                       std::string path, std::string contents,
+                                       TestedMacros macros, std::size_t index) {
+    const std::uint64_t environment = hash_macros(macros);
+    std::unique_lock lock(m_mutex);
+    std::vector<std::shared_ptr<const entry>> &variants = m_entries[id];
+    for (const std::shared_ptr<const entry> &e : variants) {
+      if (e->environment == environment && e->macros == macros) {
+        return e;
+      }
+    }
+
+    if (variants.size() == max_variants) {
+      return nullptr;
+    }
+
+    return variants.emplace_back(std::make_shared<const entry>(
+        entry{std::move(path), std::move(contents), std::move(macros),
+              environment, variants.size(), index, m_count++}));
+  }
+
+  /// Return the replacements for the file with the specified `id`.
+  std::vector<std::shared_ptr<const entry>>
+  find(llvm::sys::fs::UniqueID id) const {
+    std::shared_lock lock(m_mutex);
+    const auto it = m_entries.find(id);
+    return it == m_entries.end() ? std::vector<std::shared_ptr<const entry>>()
+                                 : it->second;
+  }
+
+  /// Return the number of replacements published.
+  std::size_t size() const {
+    std::shared_lock lock(m_mutex);
+    return m_count;
+  }
+};
+
 /* This component is needed on Windows because if we include a file
    from using both <> and "" we will get a backslash or forward slash
    respectively between the path and the filename.  This is because of
@@ -73,38 +199,146 @@ bool allowed(const clang::FileEntry *f) {
    This `FileSystem` allows us to overwrite a file in the underlying
    `FileSystem` by `UniqueID`, which means that we continue to use the
    underlying `FileSystem` to decide what paths map to which path.
+
+   Replacements are shared with other instances through a `ReplacementStore`.
+   An instance created for the `index`th translation unit only uses
+   replacements published by earlier translation units, and that were
+   published before it was created, so that the files it sees do not change
+   part way through preprocessing.
+
+   A file can have several replacements, so before each translation unit
+   we are given a way to look up the current definition of a macro.  The
+   first time a file is looked up in that translation unit, we choose the
+   replacement whose tested macros all have their current definitions, or
+   the original file if there is none, and keep this choice until the end
+   of the translation unit.  Each replacement is stored in a separate
+   `InMemoryFileSystem` layer so that they can share the original path.
 */
 class OverwriteFileSystem : public llvm::vfs::FileSystem {
+  using Entry = std::shared_ptr<const ReplacementStore::entry>;
 
   llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_underlying;
-  llvm::vfs::InMemoryFileSystem m_overwrites;
-  std::unordered_map<llvm::sys::fs::UniqueID, std::string, Hasher> m_lookup;
+  std::shared_ptr<ReplacementStore> m_store;
+  std::size_t m_index;
+  std::size_t m_visible;
+  std::deque<llvm::vfs::InMemoryFileSystem> m_layers; // variant -> files
+  std::unordered_set<const ReplacementStore::entry *> m_published;
+  std::unordered_map<llvm::sys::fs::UniqueID, Entry, Hasher> m_loaded;
+  std::unordered_map<llvm::sys::fs::UniqueID, Entry, Hasher> m_chosen;
+  std::function<std::string(llvm::StringRef)> m_definition;
+  ReplacedIds m_replaced_ids;
+
+  // Add the specified replacement `e` of the file with the specified `id`
+  // to its layer, if it is not already there, and return its `UniqueID`.
+  llvm::sys::fs::UniqueID load(const Entry &e, llvm::sys::fs::UniqueID id) {
+    while (m_layers.size() <= e->variant) {
+      m_layers.emplace_back();
+    }
+
+    llvm::vfs::InMemoryFileSystem &layer = m_layers[e->variant];
+    if (!layer.exists(e->path)) {
+      [[maybe_unused]] const bool inserted = layer.addFile(
+          e->path, 0, llvm::MemoryBuffer::getMemBufferCopy(e->contents, ""));
+      assert(inserted);
+    }
+
+    const llvm::sys::fs::UniqueID new_id = layer.status(e->path)->getUniqueID();
+    m_replaced_ids.emplace(new_id, id);
+    m_loaded.emplace(new_id, e);
+    return new_id;
+  }
+
+  // Return whether we can use the specified `e` for this translation unit.
+  bool is_visible(const ReplacementStore::entry &e) const {
+    return m_published.count(&e) > 0 ||
+           (e.index < m_index && e.sequence < m_visible);
+  }
+
+  // Return the replacement chosen for `id` in this translation unit, or
+  // `nullptr` if there is none.
+  const ReplacementStore::entry *find(llvm::sys::fs::UniqueID id) {
+    if (!m_definition) {
+      return nullptr;
+    }
+
+    const auto [it, inserted] = m_chosen.emplace(id, nullptr);
+    if (!inserted) {
+      return it->second.get();
+    }
+
+    for (const Entry &e : m_store->find(id)) {
+      if (is_visible(*e) &&
+          std::all_of(e->macros.begin(), e->macros.end(),
+                      [&](const std::pair<std::string, std::string> &m) {
+                        return m_definition(m.first) == m.second;
+                      })) {
+        load(e, id);
+        it->second = e;
+        break;
+      }
+    }
+    return it->second.get();
+  }
 
 public:
+  /// Create an `OverwriteFileSystem` for the `index`th translation unit that
+  /// uses the replacements in `store`.  If `index` is not specified, then
+  /// all replacements are used.
   explicit OverwriteFileSystem(
-      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
-      : m_underlying(std::move(underlying)), m_overwrites(), m_lookup() {}
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying,
+      std::shared_ptr<ReplacementStore> store =
+          std::make_shared<ReplacementStore>(),
+      std::size_t index = std::numeric_limits<std::size_t>::max())
+      : m_underlying(std::move(underlying)), m_store(std::move(store)),
+        m_index(index), m_visible(m_store->size()), m_layers(), m_published(),
+        m_loaded(), m_chosen(), m_definition(), m_replaced_ids() {}
+
+  /// Start a new translation unit, where the specified `definition` returns
+  /// the current definition of the macro with the specified name in the
+  /// form used by `ReplacementStore`.  If `definition` is empty, then no
+  /// replacements are used.
+  void set_environment(std::function<std::string(llvm::StringRef)> definition) {
+    m_definition = std::move(definition);
+    m_chosen.clear();
+  }
+
+  /// Publish the specified `contents` as the replacement for the file with
+  /// the specified `id` at `path` when the specified `macros` have the same
+  /// definitions.  Return the `UniqueID` of the replacement, or an empty
+  /// optional if the file has too many replacements.
+  std::optional<llvm::sys::fs::UniqueID> replace(const std::string &path,
+                                                 llvm::sys::fs::UniqueID id,
+                                                 std::string contents,
+                                                 TestedMacros macros) {
+    const Entry e = m_store->publish(id, path, std::move(contents),
+                                     std::move(macros), m_index);
+    if (!e) {
+      return std::nullopt;
+    }
+
+    m_published.insert(e.get());
+    return load(e, id);
+  }
 
-  llvm::sys::fs::UniqueID replace(const llvm::Twine &path,
-                                  llvm::sys::fs::UniqueID id,
-                                  std::unique_ptr<llvm::MemoryBuffer> buffer) {
-    assert(m_lookup.count(id) == 0);
-    [[maybe_unused]] const bool inserted =
-        m_overwrites.addFile(path, 0, std::move(buffer));
-    assert(inserted);
-    m_lookup.emplace(id, path.str());
-    return m_overwrites.status(path)->getUniqueID();
+  /// Return the replacement with the specified `id` that has been used,
+  /// or `nullptr` if `id` is not a replacement.
+  const ReplacementStore::entry *replacement(llvm::sys::fs::UniqueID id) const {
+    const auto it = m_loaded.find(id);
+    return it == m_loaded.end() ? nullptr : it->second.get();
   }
 
+  /// Return a map of the `UniqueID` of all replacements used to the
+  /// `UniqueID` of the file they replace.
+  const ReplacedIds &replaced_ids() const { return m_replaced_ids; }
+
   llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) final {
     llvm::ErrorOr<llvm::vfs::Status> s = m_underlying->status(path);
     if (!s) {
       return s;
     }
 
-    const auto it = m_lookup.find(s->getUniqueID());
-    if (it != m_lookup.end()) {
-      return m_overwrites.status(it->second);
+    if (const ReplacementStore::entry *e = find(s->getUniqueID())) {
+      return m_layers[e->variant].status(e->path);
     }
 
     return s;
@@ -127,9 +361,8 @@ public:
       return f;
     }
 
-    const auto it = m_lookup.find(s->getUniqueID());
-    if (it != m_lookup.end()) {
-      return m_overwrites.openFileForRead(it->second);
+    if (const ReplacementStore::entry *e = find(s->getUniqueID())) {
+      return m_layers[e->variant].openFileForRead(e->path);
     }
 
     return f;
@@ -159,6 +392,289 @@ protected:
   virtual void anchor() {}
 };
 
+// The cost of a file measured by lexing it once, along with a copy of it
+// that only contains its preprocessor directives.
+struct RawFile {
+  cost c;
+  std::uint64_t content_hash;
+  std::string directives; //< The contents with only the directives kept
+};
+
+// Return a fingerprint of the specified `lang_options` that includes every
+// option that changes how a file is lexed without being preprocessed, so
+// that files lexed with the same fingerprint have the same `RawFile`.
+std::uint64_t lexer_fingerprint(const clang::LangOptions &lang_options) {
+  std::uint64_t fingerprint = 0u;
+  for (const bool option :
+       {bool(lang_options.CPlusPlus), bool(lang_options.CPlusPlus11),
+        bool(lang_options.CPlusPlus14), bool(lang_options.CPlusPlus17),
+        bool(lang_options.CPlusPlus20), bool(lang_options.C99),
+        bool(lang_options.C11), bool(lang_options.C17),
+        bool(lang_options.C2x), bool(lang_options.Digraphs),
+        bool(lang_options.Trigraphs), bool(lang_options.LineComment),
+        bool(lang_options.DollarIdents), bool(lang_options.MicrosoftExt),
+        bool(lang_options.AsmPreprocessor), bool(lang_options.ObjC),
+        bool(lang_options.OpenCL), bool(lang_options.CUDA),
+        bool(lang_options.Char8)}) {
+    fingerprint = (fingerprint << 1) | option;
+  }
+  return fingerprint;
+}
+
+// Return the `RawFile` for the specified null-terminated `contents` that
+// have the specified `content_hash`, lexed with the specified
+// `lang_options` of the translation unit that first read it.  Any
+// `#pragma override_file_size` or `#pragma override_token_count` is kept
+// as a directive and applied by `IncludeScanner` only where it is active.
+std::shared_ptr<RawFile> lex_raw_file(llvm::StringRef contents,
+                                      std::uint64_t content_hash,
+                                      const clang::LangOptions &lang_options) {
+  auto raw = std::make_shared<RawFile>();
+  raw->content_hash = content_hash;
+  raw->c.file_size = contents.size() * boost::units::information::bytes;
+  raw->directives.assign(contents.size(), ' ');
+
+  // Copy across each directive, which starts with a `#` at the beginning
+  // of a line and ends at the last token before the next line.  Keep all
+  // line endings so that line numbers are unchanged.  Each run of code
+  // between directives is replaced by a single `;` so that clang detects
+  // exactly the same include guards.
+  clang::Lexer lexer(clang::SourceLocation(), lang_options, contents.begin(),
+                     contents.begin(), contents.end());
+  const auto copy_directive = [&](std::size_t begin, std::size_t end) {
+    std::copy(contents.begin() + begin, contents.begin() + end,
+              raw->directives.begin() + begin);
+  };
+  std::optional<std::size_t> directive_begin;
+  std::size_t directive_end = 0u;
+  bool in_code = false;
+  clang::Token token;
+  while (true) {
+    lexer.LexFromRawLexer(token);
+    if (token.is(clang::tok::eof)) {
+      break;
+    }
+
+    ++raw->c.token_count;
+    const std::size_t end = lexer.getBufferLocation() - contents.begin();
+    const std::size_t offset = end - token.getLength();
+    if (token.isAtStartOfLine()) {
+      if (directive_begin) {
+        copy_directive(*directive_begin, directive_end);
+        directive_begin.reset();
+      }
+      if (token.is(clang::tok::hash)) {
+        directive_begin = offset;
+        in_code = false;
+      }
+    }
+    if (!directive_begin && !in_code) {
+      raw->directives[offset] = ';';
+      in_code = true;
+    }
+    directive_end = end;
+  }
+  if (directive_begin) {
+    copy_directive(*directive_begin, directive_end);
+  }
+
+  for (std::size_t i = 0; i != contents.size(); ++i) {
+    if (contents[i] == '\n' || contents[i] == '\r') {
+      raw->directives[i] = contents[i];
+    }
+  }
+
+  return raw;
+}
+
+/// This component is a thread-safe store of the `RawFile` of every file
+/// that has been read, shared between all translation units.  A file is
+/// stored separately for each `lexer_fingerprint` it is read with.  If it
+/// has a `cost_cache`, then files found in the cache are not lexed and files
+/// that are lexed are added to the cache.
+class DirectiveStore {
+  using Key = std::pair<llvm::sys::fs::UniqueID, std::uint64_t>;
+
+  mutable std::shared_mutex m_mutex;
+  std::unordered_map<Key, std::shared_ptr<const RawFile>, Hasher> m_files;
+  std::shared_ptr<const cost_cache> m_cache;
+
+public:
+  explicit DirectiveStore(std::shared_ptr<const cost_cache> cache = nullptr)
+      : m_mutex(), m_files(), m_cache(std::move(cache)) {}
+
+  /// Return the `RawFile` for the file with the specified `id` read with
+  /// the specified `fingerprint`, or `nullptr` if it has not been read.
+  std::shared_ptr<const RawFile> find(llvm::sys::fs::UniqueID id,
+                                      std::uint64_t fingerprint) const {
+    std::shared_lock lock(m_mutex);
+    const auto it = m_files.find(Key(id, fingerprint));
+    return it == m_files.end() ? nullptr : it->second;
+  }
+
+  /// Store the specified `raw` for the file with the specified `id` read
+  /// with the specified `fingerprint` unless one is already stored, and
+  /// return the stored `RawFile`.
+  std::shared_ptr<const RawFile> insert(llvm::sys::fs::UniqueID id,
+                                        std::uint64_t fingerprint,
+                                        std::shared_ptr<const RawFile> raw) {
+    std::unique_lock lock(m_mutex);
+    return m_files.emplace(Key(id, fingerprint), std::move(raw))
+        .first->second;
+  }
+
+  /// Return the `RawFile` for the file with the specified `id` and
+  /// null-terminated `contents` lexed with the specified `lang_options`,
+  /// taking it from the cache if possible.  Files that are lexed are added
+  /// to the cache.
+  std::shared_ptr<const RawFile> read(llvm::sys::fs::UniqueID id,
+                                      llvm::StringRef contents,
+                                      const clang::LangOptions &lang_options) {
+    const std::uint64_t content_hash = llvm::xxHash64(contents);
+    const std::uint64_t fingerprint = lexer_fingerprint(lang_options);
+    const std::uint64_t key[] = {content_hash, fingerprint};
+    const std::uint64_t cache_key = llvm::xxHash64(
+        llvm::StringRef(reinterpret_cast<const char *>(key), sizeof(key)));
+    std::optional<cost_cache::entry> e;
+    if (m_cache) {
+      e = m_cache->find(cache_key);
+    }
+    if (!e || e->directives.size() != contents.size()) {
+      const std::shared_ptr<const RawFile> raw =
+          lex_raw_file(contents, content_hash, lang_options);
+      const std::shared_ptr<const RawFile> stored =
+          insert(id, fingerprint, raw);
+
+      // Only write the entry if another thread didn't read it first
+      if (m_cache && stored == raw) {
+        m_cache->insert(cache_key, {raw->c, raw->directives});
+      }
+      return stored;
+    }
+
+    auto raw = std::make_shared<RawFile>();
+    raw->c = e->c;
+    raw->content_hash = content_hash;
+    raw->directives = std::move(e->directives);
+    return insert(id, fingerprint, std::move(raw));
+  }
+};
+
+/// This component is a read-only `File` with the directives of a `RawFile`.
+class DirectivesFile : public llvm::vfs::File {
+  llvm::vfs::Status m_status;
+  std::shared_ptr<const RawFile> m_raw;
+
+public:
+  DirectivesFile(llvm::vfs::Status status, std::shared_ptr<const RawFile> raw)
+      : m_status(std::move(status)), m_raw(std::move(raw)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status() final { return m_status; }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+  getBuffer(const llvm::Twine &name, int64_t file_size,
+            bool requires_null_terminator, bool is_volatile) final {
+    return llvm::MemoryBuffer::getMemBuffer(m_raw->directives, name.str(),
+                                            requires_null_terminator);
+  }
+
+  std::error_code close() final { return {}; }
+};
+
+/* Most of the time spent preprocessing is lexing the bodies of headers,
+   even though we only need their token count and directives.  This
+   `FileSystem` reads and lexes each file once, storing the result in a
+   shared `DirectiveStore`, and afterwards returns a copy of the file that
+   only contains its directives.  `IncludeScanner` then takes the cost of
+   each file from the `DirectiveStore`.
+
+   Code outside of the directives is replaced by whitespace, instead of
+   being removed, so that the line numbers and sizes of files do not
+   change (see `lex_raw_file`).
+
+   Files are lexed with the language options of the current translation
+   unit, which must be set with `set_lang_options` before it is
+   preprocessed.  This is not thread-safe, so each thread that preprocesses
+   translation units needs its own `DirectivesOnlyFileSystem`.
+*/
+class DirectivesOnlyFileSystem : public llvm::vfs::FileSystem {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_underlying;
+  std::shared_ptr<DirectiveStore> m_store;
+  clang::LangOptions m_lang_options;
+  std::uint64_t m_fingerprint;
+
+public:
+  DirectivesOnlyFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying,
+      std::shared_ptr<DirectiveStore> store)
+      : m_underlying(std::move(underlying)), m_store(std::move(store)),
+        m_lang_options(), m_fingerprint(lexer_fingerprint(m_lang_options)) {}
+
+  /// Lex files with the specified `lang_options` from now on.
+  void set_lang_options(const clang::LangOptions &lang_options) {
+    m_lang_options = lang_options;
+    m_fingerprint = lexer_fingerprint(lang_options);
+  }
+
+  /// Return the store of the files that have been read.
+  const DirectiveStore &store() const { return *m_store; }
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) final {
+    return m_underlying->status(path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine &path) final {
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> f =
+        m_underlying->openFileForRead(path);
+    if (!f || f.get() == nullptr) {
+      return f;
+    }
+
+    const llvm::ErrorOr<llvm::vfs::Status> s = f->get()->status();
+    if (!s) {
+      return f;
+    }
+
+    std::shared_ptr<const RawFile> raw =
+        m_store->find(s->getUniqueID(), m_fingerprint);
+    if (!raw) {
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+          f->get()->getBuffer(path, s->getSize(), true, false);
+      if (!buffer) {
+        return buffer.getError();
+      }
+      raw = m_store->read(s->getUniqueID(), buffer.get()->getBuffer(),
+                          m_lang_options);
+    }
+
+    return std::make_unique<DirectivesFile>(*s, std::move(raw));
+  }
+
+  llvm::vfs::directory_iterator dir_begin(const llvm::Twine &Dir,
+                                          std::error_code &EC) final {
+    return m_underlying->dir_begin(Dir, EC);
+  }
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const final {
+    return m_underlying->getCurrentWorkingDirectory();
+  }
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &Path) final {
+    return m_underlying->setCurrentWorkingDirectory(Path);
+  }
+  std::error_code getRealPath(const llvm::Twine &Path,
+                              llvm::SmallVectorImpl<char> &Output) const final {
+    return m_underlying->getRealPath(Path, Output);
+  }
+  std::error_code isLocal(const llvm::Twine &Path, bool &Result) final {
+    return m_underlying->isLocal(Path, Result);
+  }
+
+protected:
+  FileSystem &getUnderlyingFS() { return *m_underlying; }
+
+  virtual void anchor() {}
+};
+
 class LoggingFileSystem : public llvm::vfs::FileSystem {
 public:
   explicit LoggingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS)
@@ -211,6 +727,448 @@ private:
   virtual void anchor() {}
 };
 
+/* `run_tool` changes the working directory of its `FileSystem` for each
+   translation unit that it processes.  For the real file system this
+   changes the working directory of the whole process, which will not work
+   when running multiple `run_tool` calls at the same time.
+
+   This `FileSystem` keeps track of its own working directory and makes all
+   paths absolute before passing them on to the underlying `FileSystem`,
+   whose working directory is never changed.
+*/
+class WorkingDirectoryFileSystem : public llvm::vfs::FileSystem {
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_underlying;
+  std::string m_working_dir;
+
+  std::string absolute(const llvm::Twine &path) const {
+    llvm::SmallString<256> out;
+    path.toVector(out);
+    llvm::sys::fs::make_absolute(m_working_dir, out);
+    return out.str().str();
+  }
+
+public:
+  explicit WorkingDirectoryFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+      : m_underlying(std::move(underlying)), m_working_dir() {
+    if (llvm::ErrorOr<std::string> cwd =
+            m_underlying->getCurrentWorkingDirectory()) {
+      m_working_dir = std::move(*cwd);
+    }
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) final {
+    return m_underlying->status(absolute(path));
+  }
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine &path) final {
+    return m_underlying->openFileForRead(absolute(path));
+  }
+  llvm::vfs::directory_iterator dir_begin(const llvm::Twine &Dir,
+                                          std::error_code &EC) final {
+    return m_underlying->dir_begin(absolute(Dir), EC);
+  }
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const final {
+    return m_working_dir;
+  }
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &Path) final {
+    m_working_dir = absolute(Path);
+    return {};
+  }
+  std::error_code getRealPath(const llvm::Twine &Path,
+                              llvm::SmallVectorImpl<char> &Output) const final {
+    return m_underlying->getRealPath(absolute(Path), Output);
+  }
+  std::error_code isLocal(const llvm::Twine &Path, bool &Result) final {
+    return m_underlying->isLocal(absolute(Path), Result);
+  }
+
+protected:
+  FileSystem &getUnderlyingFS() { return *m_underlying; }
+
+private:
+  virtual void anchor() {}
+};
+
+/// This component is an iterator over a list of directory entries that is
+/// shared between all iterators over the same directory.
+class CachedDirIterImpl : public llvm::vfs::detail::DirIterImpl {
+  std::shared_ptr<const std::vector<llvm::vfs::directory_entry>> m_entries;
+  std::size_t m_next;
+
+public:
+  explicit CachedDirIterImpl(
+      std::shared_ptr<const std::vector<llvm::vfs::directory_entry>> entries)
+      : m_entries(std::move(entries)), m_next(0u) {
+    increment();
+  }
+
+  std::error_code increment() final {
+    CurrentEntry = m_next < m_entries->size() ? (*m_entries)[m_next++]
+                                              : llvm::vfs::directory_entry();
+    return {};
+  }
+};
+
+/* When `replace_file_optimization` is enabled, each translation unit gets a
+   new `clang::FileManager` (see `find_graph_factory::runInvocation`) and so
+   it looks up every include directory and every candidate path for each
+   include again.  On a slow or network file system this is the majority of
+   the time spent preprocessing.
+
+   This `FileSystem` remembers the result of `status`, failed calls to
+   `openFileForRead` (header search opens each candidate path instead of
+   calling `status`), directory listings and real paths for the whole run.
+   It is thread-safe and is shared between all translation units.
+
+   All paths are expected to be absolute, so this should be used beneath a
+   `WorkingDirectoryFileSystem`.  This also sits beneath any
+   `OverwriteFileSystem`, which swaps files by `UniqueID` after looking them
+   up here, so replacing a file never needs to invalidate what is stored.
+*/
+class StatCacheFileSystem : public llvm::vfs::FileSystem {
+  using Entries = std::vector<llvm::vfs::directory_entry>;
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_underlying;
+  mutable std::shared_mutex m_mutex;
+  std::unordered_map<std::string, llvm::ErrorOr<llvm::vfs::Status>> m_status;
+  std::unordered_map<std::string, std::error_code> m_open_failures;
+  std::unordered_map<std::string,
+                     std::pair<std::shared_ptr<const Entries>, std::error_code>>
+      m_directories;
+  mutable std::unordered_map<std::string,
+                             std::pair<std::string, std::error_code>>
+      m_real_paths;
+
+  template <typename Map>
+  const typename Map::mapped_type *find(const Map &map,
+                                        const std::string &key) const {
+    std::shared_lock lock(m_mutex);
+    const auto it = map.find(key);
+    return it == map.end() ? nullptr : &it->second;
+  }
+
+  template <typename Map, typename Value>
+  void insert(Map &map, std::string key, Value &&value) const {
+    std::unique_lock lock(m_mutex);
+    map.emplace(std::move(key), std::forward<Value>(value));
+  }
+
+public:
+  explicit StatCacheFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+      : m_underlying(std::move(underlying)), m_mutex(), m_status(),
+        m_open_failures(), m_directories(), m_real_paths() {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) final {
+    std::string key = path.str();
+    if (const auto *s = find(m_status, key)) {
+      return *s;
+    }
+
+    llvm::ErrorOr<llvm::vfs::Status> s = m_underlying->status(key);
+    insert(m_status, std::move(key), s);
+    return s;
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine &path) final {
+    std::string key = path.str();
+    if (const std::error_code *ec = find(m_open_failures, key)) {
+      return *ec;
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> f =
+        m_underlying->openFileForRead(key);
+    if (!f) {
+      insert(m_open_failures, std::move(key), f.getError());
+    }
+    return f;
+  }
+
+  llvm::vfs::directory_iterator dir_begin(const llvm::Twine &Dir,
+                                          std::error_code &EC) final {
+    std::string key = Dir.str();
+    if (const auto *d = find(m_directories, key)) {
+      EC = d->second;
+      return llvm::vfs::directory_iterator(
+          std::make_shared<CachedDirIterImpl>(d->first));
+    }
+
+    auto entries = std::make_shared<Entries>();
+    const llvm::vfs::directory_iterator end;
+    for (llvm::vfs::directory_iterator it = m_underlying->dir_begin(key, EC);
+         !EC && it != end; it.increment(EC)) {
+      entries->push_back(*it);
+    }
+    insert(m_directories, std::move(key), std::pair(entries, EC));
+    return llvm::vfs::directory_iterator(
+        std::make_shared<CachedDirIterImpl>(std::move(entries)));
+  }
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const final {
+    return m_underlying->getCurrentWorkingDirectory();
+  }
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &Path) final {
+    return m_underlying->setCurrentWorkingDirectory(Path);
+  }
+  std::error_code getRealPath(const llvm::Twine &Path,
+                              llvm::SmallVectorImpl<char> &Output) const final {
+    std::string key = Path.str();
+    if (const auto *r = find(m_real_paths, key)) {
+      Output.assign(r->first.begin(), r->first.end());
+      return r->second;
+    }
+
+    const std::error_code ec = m_underlying->getRealPath(key, Output);
+    insert(m_real_paths, std::move(key),
+           std::pair(std::string(Output.begin(), Output.end()), ec));
+    return ec;
+  }
+  std::error_code isLocal(const llvm::Twine &Path, bool &Result) final {
+    return m_underlying->isLocal(Path, Result);
+  }
+
+protected:
+  FileSystem &getUnderlyingFS() { return *m_underlying; }
+
+private:
+  virtual void anchor() {}
+};
+
+/* Each include is searched for in every include directory in turn, so with
+   many include directories most lookups are for paths that do not exist.
+
+   This `FileSystem` lists each directory beneath the specified include
+   directories the first time a path within it is probed, one level at a
+   time, and keeps that listing for the whole run, similar in spirit to a
+   clang header map.  Afterwards any path whose name is not in the listing
+   of its directory is known not to exist without asking the underlying
+   `FileSystem`.  Other paths, and paths in directories that cannot be
+   listed, are passed through unchanged.
+
+   clang's `HeaderSearch` still decides the order in which directories are
+   searched, and whether they are system directories, so the result is
+   identical to not using an index.  It is thread-safe and all paths are
+   expected to be absolute.
+*/
+class HeaderIndexFileSystem : public llvm::vfs::FileSystem {
+  using Names = std::unordered_set<std::string>;
+
+  static constexpr char separator = std::filesystem::path::preferred_separator;
+
+  llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_underlying;
+  std::vector<std::string> m_roots; // with a trailing separator
+  mutable std::shared_mutex m_mutex;
+  // directory with a trailing separator -> the names within it, or null if
+  // it could not be listed, which is ready once the first thread to ask for
+  // it has listed it
+  std::unordered_map<std::string,
+                     std::shared_future<std::shared_ptr<const Names>>>
+      m_directories;
+
+  static std::string normalize(const llvm::Twine &path) {
+    std::string normalized = std::filesystem::path(path.str())
+                                 .lexically_normal()
+                                 .make_preferred()
+                                 .string();
+#if BOOST_OS_WINDOWS
+    // Windows file systems are case insensitive
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+#endif
+    return normalized;
+  }
+
+  // Return the names within the specified `directory`, listing it if this
+  // is the first time it has been asked for, or null if it cannot be
+  // listed.
+  std::shared_ptr<const Names> list(const std::string &directory) {
+    std::shared_future<std::shared_ptr<const Names>> listed;
+    {
+      std::shared_lock lock(m_mutex);
+      const auto it = m_directories.find(directory);
+      if (it != m_directories.end()) {
+        listed = it->second;
+      }
+    }
+    if (listed.valid()) {
+      return listed.get();
+    }
+
+    // Publish a placeholder so that each directory is listed once, but list
+    // it without holding the lock so that other directories can be read
+    std::promise<std::shared_ptr<const Names>> promise;
+    {
+      std::unique_lock lock(m_mutex);
+      const auto [it, inserted] =
+          m_directories.emplace(directory, promise.get_future().share());
+      if (!inserted) {
+        listed = it->second;
+      }
+    }
+    if (listed.valid()) {
+      return listed.get();
+    }
+
+    auto names = std::make_shared<Names>();
+    std::error_code ec;
+    for (llvm::vfs::directory_iterator entry =
+             m_underlying->dir_begin(directory, ec),
+         end;
+         !ec && entry != end; entry.increment(ec)) {
+      names->insert(normalize(llvm::sys::path::filename(entry->path())));
+    }
+    std::shared_ptr<const Names> result;
+    if (!ec) {
+      result = std::move(names);
+    }
+    promise.set_value(result);
+    return result;
+  }
+
+  bool is_missing(const std::string &path) {
+    const auto root =
+        std::find_if(m_roots.begin(), m_roots.end(), [&](const auto &root) {
+          return std::string_view(path).starts_with(root);
+        });
+    if (root == m_roots.end()) {
+      return false;
+    }
+
+    // Check each component in the listing of its parent directory
+    std::size_t begin = root->size();
+    while (begin < path.size()) {
+      const std::size_t end = path.find(separator, begin);
+      const std::shared_ptr<const Names> names = list(path.substr(0, begin));
+      if (!names) {
+        return false;
+      }
+      if (names->count(path.substr(begin, end - begin)) == 0) {
+        return true;
+      }
+      if (end == std::string::npos) {
+        return false;
+      }
+      begin = end + 1;
+    }
+    return false;
+  }
+
+public:
+  HeaderIndexFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying,
+      std::span<const std::string> directories)
+      : m_underlying(std::move(underlying)), m_roots(), m_mutex(),
+        m_directories() {
+    for (const std::string &directory : directories) {
+      std::string root = normalize(directory);
+      if (!root.ends_with(separator)) {
+        root += separator;
+      }
+      m_roots.push_back(std::move(root));
+    }
+  }
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) final {
+    if (is_missing(normalize(path))) {
+      return std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+    return m_underlying->status(path);
+  }
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine &path) final {
+    if (is_missing(normalize(path))) {
+      return std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+    return m_underlying->openFileForRead(path);
+  }
+  llvm::vfs::directory_iterator dir_begin(const llvm::Twine &Dir,
+                                          std::error_code &EC) final {
+    return m_underlying->dir_begin(Dir, EC);
+  }
+  llvm::ErrorOr<std::string> getCurrentWorkingDirectory() const final {
+    return m_underlying->getCurrentWorkingDirectory();
+  }
+  std::error_code setCurrentWorkingDirectory(const llvm::Twine &Path) final {
+    return m_underlying->setCurrentWorkingDirectory(Path);
+  }
+  std::error_code getRealPath(const llvm::Twine &Path,
+                              llvm::SmallVectorImpl<char> &Output) const final {
+    return m_underlying->getRealPath(Path, Output);
+  }
+  std::error_code isLocal(const llvm::Twine &Path, bool &Result) final {
+    return m_underlying->isLocal(Path, Result);
+  }
+
+protected:
+  FileSystem &getUnderlyingFS() { return *m_underlying; }
+
+private:
+  virtual void anchor() {}
+};
+
+// Return whether the specified `args` run the compiler in cl driver mode,
+// which clang decides from the last `--driver-mode` or else from the name
+// of the program.
+bool is_cl_driver_mode(const std::vector<std::string> &args) {
+  const std::string_view driver_mode = "--driver-mode=";
+  for (auto it = args.rbegin(); it != args.rend(); ++it) {
+    if (it->starts_with(driver_mode)) {
+      return it->substr(driver_mode.size()) == "cl";
+    }
+  }
+
+  if (args.empty()) {
+    return false;
+  }
+  const std::string program =
+      llvm::sys::path::stem(args.front(), llvm::sys::path::Style::windows)
+          .lower();
+  return program == "cl" || program.ends_with("clang-cl");
+}
+
+// Return the absolute path of every include directory in the commands for
+// the specified `source_paths` in the specified `compilation_db`.
+std::vector<std::string>
+include_directories(const clang::tooling::CompilationDatabase &compilation_db,
+                    std::span<const std::filesystem::path> source_paths) {
+  const std::initializer_list<std::string_view> gcc_flags = {
+      "-I", "-isystem", "-iquote", "-idirafter"};
+  const std::initializer_list<std::string_view> cl_flags = {
+      "-I", "-isystem", "-iquote", "-idirafter", "/I"};
+  std::vector<std::string> directories;
+  for (const std::filesystem::path &source : source_paths) {
+    for (const clang::tooling::CompileCommand &command :
+         compilation_db.getCompileCommands(source.string())) {
+      const std::vector<std::string> &args = command.CommandLine;
+      const std::initializer_list<std::string_view> &flags =
+          is_cl_driver_mode(args) ? cl_flags : gcc_flags;
+      for (auto it = args.begin(); it != args.end(); ++it) {
+        for (const std::string_view flag : flags) {
+          std::optional<std::string> directory;
+          if (*it == flag && std::next(it) != args.end()) {
+            directory = *++it;
+          } else if (it->size() > flag.size() && it->starts_with(flag)) {
+            directory = it->substr(flag.size());
+          } else {
+            continue;
+          }
+
+          directories.push_back(
+              (std::filesystem::path(command.Directory) / *directory)
+                  .string());
+          break;
+        }
+      }
+    }
+  }
+
+  std::sort(directories.begin(), directories.end());
+  directories.erase(std::unique(directories.begin(), directories.end()),
+                    directories.end());
+  return directories;
+}
+
 class FakeCompilationDatabase : public clang::tooling::CompilationDatabase {
 public:
   std::filesystem::path m_working_directory;
@@ -297,15 +1255,25 @@ struct FileState {
   bool fully_processed = false;
   // A file becomes fully processed once it has been exited and the
   // corresponding entry in the `Graph` is complete.
-  std::string replacement_contents = INCLUDEGUARDIAN_WORKAROUND
-      "#pragma once\n"; //< If we are `fully_processed` this will
-                        //< contain a C++ file that is equivalent
-                        //< when this is included by another file
-                        //< (i.e. only the preprocessor definitions)
+  std::unordered_set<interned_string> missing_includes; //< The
+                                                        //< `missing_includes`
+                                                        //< of `v`
+  std::unordered_set<interned_path> absent_paths; //< The `absent_paths` of `v`
 
   FileState(Graph::vertex_descriptor v) : v(v) {}
 };
 
+// Add the specified `lookup` to the specified `to`, which is either the
+// `missing_includes` or `absent_paths` of a file, unless it is in the
+// specified `seen`, which holds the same elements as `to`.
+template <typename T>
+void add_lookup(std::unordered_set<T> &seen, std::vector<T> &to,
+                const T &lookup) {
+  if (seen.insert(lookup).second) {
+    to.push_back(lookup);
+  }
+}
+
 using UniqueIdToNode =
     std::unordered_map<llvm::sys::fs::UniqueID, FileState, Hasher>;
 
@@ -315,6 +1283,13 @@ enum class SeenFirst {
   Ifndef,
 };
 
+// A macro tested by a file, e.g. in an `#if` directive.
+struct TestedMacro {
+  std::string definition; //< The definition when tested, or empty if none
+  std::size_t modified_at; //< When the macro was last defined or undefined
+                           //< before the test, see `IncludeScanner`
+};
+
 struct InProgress {
   UniqueIdToNode::iterator it;
   cost c;
@@ -322,28 +1297,55 @@ struct InProgress {
   std::optional<boost::units::quantity<boost::units::information::info>>
       overridden_file_size;
   SeenFirst seen_first = SeenFirst::None;
+  std::size_t entered_at = 0u; //< When we entered this file
+  bool is_replacement = false; //< Whether this is a replacement file
+  std::string replacement_contents = INCLUDEGUARDIAN_WORKAROUND
+      "#pragma once\n"; //< A C++ file that is equivalent when this is
+                        //< included by another file (i.e. only the
+                        //< preprocessor definitions)
+  std::map<std::string, TestedMacro> tested; //< The macros tested by this
+                                             //< file and the files it
+                                             //< includes
 
   InProgress(UniqueIdToNode::iterator it) : it(it) {}
 };
 
 struct ReplaceWith {
-  std::unique_ptr<llvm::MemoryBuffer> contents;
+  std::string contents;
   std::string path;
-  Graph::vertex_descriptor v;
+  TestedMacros macros;
 
-  ReplaceWith(std::unique_ptr<llvm::MemoryBuffer> &&contents,
-              std::string_view path, Graph::vertex_descriptor v)
-      : contents(std::move(contents)), path(path), v(v) {}
+  ReplaceWith(std::string_view contents, std::string_view path,
+              TestedMacros macros)
+      : contents(contents), path(path), macros(std::move(macros)) {}
 };
 
 using NeedsReplacing =
     std::unordered_map<llvm::sys::fs::UniqueID, ReplaceWith, Hasher>;
 
+// When preprocessing in parallel, each translation unit is scanned into its
+// own graph and later merged into the final result.  The path of a new file
+// depends on the file that first included it, which may be different after
+// merging, so we keep enough information to redo this calculation.
+struct IncludeRecord {
+  Graph::edge_descriptor e;
+  std::string relative_path;
+  bool is_angled;
+  bool is_system;
+};
+
+struct TranslationUnitGraph {
+  build_graph::result r;
+  std::vector<IncludeRecord> includes; //< In the order they were added
+  std::vector<llvm::sys::fs::UniqueID> ids; // vertex_descriptor -> UniqueID
+  std::vector<bool> processed; // vertex_descriptor -> fully_processed
+  bool failed = false;
+};
+
 struct IncludeScanner : public clang::PPCallbacks {
   clang::SourceManager *m_sm;
   UniqueIdToNode &m_id_to_node;
   NeedsReplacing &m_needs_replacing;
-  std::vector<bool> &m_replaced;
   build_graph::result &m_r;
   std::function<build_graph::file_type(std::string_view)> m_file_type;
   std::vector<InProgress> m_stack;
@@ -351,23 +1353,148 @@ struct IncludeScanner : public clang::PPCallbacks {
   clang::Preprocessor *m_pp;
   std::filesystem::path m_working_dir;
   build_graph::options &m_options;
+  std::vector<IncludeRecord> *m_includes;
+  const OverwriteFileSystem *m_replacements;
+  const DirectiveStore *m_directives;
+  std::uint64_t m_fingerprint; //< `lexer_fingerprint` of the language options
   int m_skip_count = 0;
 
+  // To know which tested macros were set before entering a file, we count
+  // the number of times any macro is defined or undefined and record this
+  // count in `InProgress::entered_at` and `m_last_modified`.
+  std::size_t m_modifications = 0u;
+  std::unordered_map<std::string, std::size_t> m_last_modified;
+
   void update_cost_when_leaving_file(const clang::FileEntry *file) {
     InProgress &p = m_stack.back();
+    const std::uint64_t token_count = m_pp->getTokenCount();
+    cost c;
+    if (m_directives) {
+      // Only the directives of `file` were preprocessed, so use the cost
+      // measured when it was first read.  Replacement files will not be
+      // found, but their cost is never used.
+      if (const std::shared_ptr<const RawFile> raw =
+              m_directives->find(file->getUniqueID(), m_fingerprint)) {
+        c = raw->c;
+      }
+    } else {
+      c.file_size = file->getSize() * boost::units::information::bytes;
+      c.token_count = token_count - m_accounted_for_token_count;
+    }
+    m_accounted_for_token_count = token_count;
+
     if (p.overridden_file_size) {
       p.c.file_size = *p.overridden_file_size;
     } else {
-      p.c.file_size += file->getSize() * boost::units::information::bytes;
+      p.c.file_size += c.file_size;
     }
 
-    const std::uint64_t token_count = m_pp->getTokenCount();
     if (p.overridden_token_count) {
       p.c.token_count = *p.overridden_token_count;
     } else {
-      p.c.token_count += token_count - m_accounted_for_token_count;
+      p.c.token_count += c.token_count;
+    }
+  }
+
+  // Record where the specified `file` was read from and a hash of its
+  // contents the first time that we enter it.
+  void record_stamp(Graph::vertex_descriptor v, const clang::FileEntry *file,
+                    clang::FileID id) {
+    file_stamp &stamp = m_r.graph[v].stamp;
+    if (!stamp.location.empty()) {
+      return;
+    }
+
+    const clang::StringRef real_path = file->tryGetRealPathName();
+    stamp.location = interned_path(std::filesystem::path(
+        (real_path.empty() ? file->getName() : real_path).str()));
+    stamp.modified = file->getModificationTime();
+    const std::shared_ptr<const RawFile> raw =
+        m_directives ? m_directives->find(file->getUniqueID(), m_fingerprint)
+                     : nullptr;
+    stamp.content_hash =
+        raw ? raw->content_hash : llvm::xxHash64(m_sm->getBufferData(id));
+  }
+
+  // Record in the file containing the current include directive the
+  // specified `file_name` if it was not found, and the paths that were
+  // searched for it but did not exist, so that it will be preprocessed
+  // again if any of these are created.  `file` and `search_path` are as
+  // passed to `InclusionDirective`.
+  void record_lookups(clang::SourceLocation hash_loc,
+                      clang::StringRef file_name, bool is_angled,
+                      const clang::FileEntry *file,
+                      clang::StringRef search_path) {
+    FileState &state = m_stack.back().it->second;
+    file_node &node = m_r.graph[state.v];
+
+    const clang::FileManager &files = m_sm->getFileManager();
+    const auto absolute = [&](const clang::StringRef path) {
+      llvm::SmallString<256> result(path);
+      files.makeAbsolutePath(result);
+      llvm::sys::path::remove_dots(result, true);
+      return result;
+    };
+
+    if (!file) {
+      add_lookup(state.missing_includes, node.missing_includes,
+                 interned_string(file_name.str()));
+    }
+
+    if (llvm::sys::path::is_absolute(file_name)) {
+      if (!file) {
+        add_lookup(state.absent_paths, node.absent_paths,
+                   interned_path(std::filesystem::path(
+                       absolute(file_name).str().str())));
+      }
+      return;
+    }
+
+    // Collect the directories in the order they were searched, stopping at
+    // the one where the file was found
+    std::vector<clang::StringRef> dirs;
+    const clang::FileEntry *includer =
+        m_sm->getFileEntryForID(m_sm->getFileID(hash_loc));
+    if (!is_angled && includer) {
+      dirs.push_back(llvm::sys::path::parent_path(includer->getName()));
+    }
+    const clang::HeaderSearch &search = m_pp->getHeaderSearchInfo();
+    for (auto it = is_angled ? search.angled_dir_begin()
+                             : search.search_dir_begin();
+         it != search.search_dir_end(); ++it) {
+      if (it->isNormalDir()) {
+        dirs.push_back(it->getName());
+      }
+    }
+
+    const llvm::SmallString<256> found = absolute(search_path);
+    std::vector<llvm::SmallString<256>> absent;
+    bool was_found = false;
+    for (const clang::StringRef dir : dirs) {
+      llvm::SmallString<256> directory = absolute(dir);
+      if (file && directory == found) {
+        was_found = true;
+        break;
+      }
+      absent.push_back(std::move(directory));
+    }
+
+    // If we can't tell where the file was found, e.g. from a header map,
+    // then we don't know which directories were searched
+    if (file && !was_found) {
+      return;
+    }
+
+    // Keep the directory and the spelling apart so that each is only
+    // interned once, rather than once for every combination of them
+    const interned_string name = file_name.str();
+    for (llvm::SmallString<256> &directory : absent) {
+      if (!llvm::sys::path::is_separator(directory.back())) {
+        directory += llvm::sys::path::get_separator();
+      }
+      add_lookup(state.absent_paths, node.absent_paths,
+                 interned_path(directory.str().str(), name));
     }
-    m_accounted_for_token_count = token_count;
   }
 
   // This function is taken from MacroPPCallbacks.cpp
@@ -416,17 +1543,129 @@ struct IncludeScanner : public clang::PPCallbacks {
     }
   }
 
+  // Return the value of `m_modifications` when the macro with the specified
+  // `name` was last defined or undefined, or 0 if it never was.
+  std::size_t last_modified(const std::string &name) const {
+    const auto it = m_last_modified.find(name);
+    return it == m_last_modified.end() ? 0u : it->second;
+  }
+
+  // Record that the file being preprocessed tested the macro with the
+  // specified `name`, and the macros used in its definition, which are
+  // tested when it is expanded.
+  void record_test(llvm::StringRef name) {
+    if (!m_options.replace_file_optimization || m_skip_count) {
+      return;
+    }
+
+    InProgress &p = m_stack.back();
+    std::vector<std::string> pending = {name.str()};
+    while (!pending.empty()) {
+      const std::string current = std::move(pending.back());
+      pending.pop_back();
+
+      // If we have already seen a test of this macro, then we only need to
+      // keep this one if it was set earlier
+      const std::size_t modified_at = last_modified(current);
+      const auto [it, inserted] =
+          p.tested.try_emplace(current, TestedMacro{{}, modified_at});
+      if (!inserted && it->second.modified_at <= modified_at) {
+        continue;
+      }
+
+      it->second = {macro_definition(*m_pp, current), modified_at};
+      if (const clang::MacroInfo *mi =
+              m_pp->getMacroInfo(m_pp->getIdentifierInfo(current))) {
+        for (const clang::Token &token : mi->tokens()) {
+          if (const clang::IdentifierInfo *id = token.getIdentifierInfo()) {
+            pending.push_back(id->getName().str());
+          }
+        }
+      }
+    }
+  }
+
+  // Record each identifier in the specified `condition` of an `#if` or
+  // `#elif` directive as tested.  Identifiers that are not macros evaluate
+  // to 0, but they are tested all the same.
+  void record_condition(clang::SourceRange condition) {
+    if (!m_options.replace_file_optimization || m_skip_count ||
+        !condition.getBegin().isFileID() || !condition.getEnd().isFileID()) {
+      return;
+    }
+
+    const char *begin = m_sm->getCharacterData(condition.getBegin());
+    const char *end = m_sm->getCharacterData(condition.getEnd());
+    if (m_sm->getFileID(condition.getBegin()) !=
+            m_sm->getFileID(condition.getEnd()) ||
+        end < begin) {
+      return;
+    }
+
+    // The lexer needs a null-terminated buffer
+    const std::string text(begin, end);
+    clang::Lexer lexer(clang::SourceLocation(), m_pp->getLangOpts(),
+                       text.c_str(), text.c_str(), text.c_str() + text.size());
+    clang::Token token;
+    while (true) {
+      lexer.LexFromRawLexer(token);
+      if (token.is(clang::tok::eof)) {
+        break;
+      }
+
+      if (token.is(clang::tok::raw_identifier)) {
+        record_test(token.getRawIdentifier());
+      }
+    }
+  }
+
+  // Add the macros tested by the specified `child` that were last set
+  // before the specified `parent` was entered to those tested by `parent`.
+  static void propagate_tests(const InProgress &child, InProgress &parent) {
+    for (const auto &[name, tested] : child.tested) {
+      if (tested.modified_at > parent.entered_at) {
+        continue;
+      }
+
+      const auto [it, inserted] = parent.tested.emplace(name, tested);
+      if (!inserted && tested.modified_at < it->second.modified_at) {
+        it->second = tested;
+      }
+    }
+  }
+
 public:
+  /// Return the definition of the macro with the specified `name` in the
+  /// specified `pp`, or an empty string if it is not defined.
+  static std::string macro_definition(clang::Preprocessor &pp,
+                                      llvm::StringRef name) {
+    const clang::IdentifierInfo *id = pp.getIdentifierInfo(name);
+    const clang::MacroInfo *mi = pp.getMacroInfo(id);
+    if (!mi) {
+      return std::string();
+    }
+
+    std::string NameBuffer, ValueBuffer;
+    llvm::raw_string_ostream Name(NameBuffer);
+    llvm::raw_string_ostream Value(ValueBuffer);
+    writeMacroDefinition(*id, *mi, pp, Name, Value);
+    return Name.str() + ' ' + Value.str();
+  }
+
   IncludeScanner(
       const std::function<build_graph::file_type(std::string_view)> &file_type,
       build_graph::result &r, UniqueIdToNode &id_to_node,
-      NeedsReplacing &needs_replacing, std::vector<bool> &replaced,
-      clang::Preprocessor &pp, const std::filesystem::path &working_dir,
-      build_graph::options &options)
+      NeedsReplacing &needs_replacing, clang::Preprocessor &pp,
+      const std::filesystem::path &working_dir, build_graph::options &options,
+      std::vector<IncludeRecord> *includes,
+      const OverwriteFileSystem *replacements,
+      const DirectiveStore *directives)
       : m_r(r), m_sm(&pp.getSourceManager()), m_id_to_node(id_to_node),
-        m_needs_replacing(needs_replacing), m_replaced(replaced),
-        m_file_type(file_type), m_pp(&pp), m_accounted_for_token_count{0u},
-        m_working_dir(working_dir), m_options(options) {}
+        m_needs_replacing(needs_replacing), m_file_type(file_type), m_pp(&pp),
+        m_accounted_for_token_count{0u}, m_working_dir(working_dir),
+        m_options(options), m_includes(includes),
+        m_replacements(replacements), m_directives(directives),
+        m_fingerprint(lexer_fingerprint(pp.getLangOpts())) {}
 
   void FileChanged(clang::SourceLocation Loc, FileChangeReason Reason,
                    clang::SrcMgr::CharacteristicKind FileType,
@@ -445,8 +1684,11 @@ public:
             m_id_to_node.emplace(file->getUniqueID(), empty);
 
         // TODO: Warn that a source is being included
-        // If our stack's empty, then this is our source file
-        assert(inserted);
+        // If our stack's empty, then this is our source file, which gets a
+        // new vertex if it was compiled before with a different command
+        if (!inserted) {
+          it->second = FileState(empty);
+        }
         const std::filesystem::path rel =
             std::filesystem::path(file->getName().str())
                 .lexically_relative(m_working_dir);
@@ -455,16 +1697,14 @@ public:
         }
 
         it->second.v = add_vertex(rel, m_r.graph);
-        if (m_options.replace_file_optimization) {
-          m_replaced.resize(it->second.v + 1);
-        }
 #ifdef _DEBUG
         it->second.debug_name = file->getName();
 #endif
         it->second.angled_rel = rel.parent_path();
+        record_stamp(it->second.v, file, fileID);
 
         m_r.sources.push_back(it->second.v);
-        m_stack.emplace_back(it);
+        m_stack.emplace_back(it).entered_at = m_modifications;
 
         // Check that if we are looking at our source that we haven't got
         // any unaccounted for tokens somehow
@@ -478,19 +1718,38 @@ public:
         // Assign all lexed tokens to the file before we enter this
         // new one
         const std::uint64_t token_count = m_pp->getTokenCount();
-        m_stack.back().c.token_count =
-            token_count - m_accounted_for_token_count;
+        if (!m_directives) {
+          m_stack.back().c.token_count =
+              token_count - m_accounted_for_token_count;
+        }
         m_accounted_for_token_count = token_count;
 
         // We should already have added this in `InclusionDirective` or
         // it is a source file that was already added to the graph
         assert(m_id_to_node.count(file->getUniqueID()) > 0);
 
-        // We can get here if we have a guarded file that included different
-        // files depending on defines.  This is most likely an issue and a poor
-        // design of files. TODO: Warn on this!
+        // Without `replace_file_optimization`, we can get here if we have a
+        // guarded file that included different files depending on defines.
+        // This is most likely an issue and a poor design of files. TODO: Warn
+        // on this!
         assert(m_id_to_node.find(file->getUniqueID())->second.v != empty);
-        m_stack.emplace_back(m_id_to_node.find(file->getUniqueID()));
+        InProgress &p =
+            m_stack.emplace_back(m_id_to_node.find(file->getUniqueID()));
+        p.entered_at = m_modifications;
+        record_stamp(p.it->second.v, file, fileID);
+
+        // A replacement is only used when the macros tested by the original
+        // file have the same definitions, so these are tested as well
+        const ReplacementStore::entry *e =
+            m_replacements ? m_replacements->replacement(file->getUniqueID())
+                           : nullptr;
+        if (e) {
+          p.is_replacement = true;
+          for (const auto &[name, definition] : e->macros) {
+            p.tested.emplace(name,
+                             TestedMacro{definition, last_modified(name)});
+          }
+        }
       }
 
       return;
@@ -512,6 +1771,7 @@ public:
 
       InProgress &p = m_stack.back();
       FileState &state = p.it->second;
+      m_r.replacement_hits += p.is_replacement;
 
       // If we are unguarded then move the total cost into the includer.
       const bool clang_guarded =
@@ -535,6 +1795,7 @@ public:
 
         // If we're not guarded then push the cost to our includer
         const cost x = p.c;
+        propagate_tests(p, m_stack[m_stack.size() - 2]);
         m_stack.pop_back();
         m_stack.back().c += x;
 
@@ -542,19 +1803,27 @@ public:
       } else {
         m_r.unguarded_files.erase(state.v);
         file_node &node = m_r.graph[state.v];
-        if (!state.fully_processed) {
-          // If we are fully guarded, then make sure that subsequent includes
-          // won't do anything.
-          if (m_options.replace_file_optimization && !m_replaced[state.v]) {
-            m_needs_replacing.emplace(
-                std::piecewise_construct,
-                std::forward_as_tuple(file->getUniqueID()),
-                std::forward_as_tuple(llvm::MemoryBuffer::getMemBufferCopy(
-                                          state.replacement_contents, ""),
-                                      file->tryGetRealPathName().str(),
-                                      state.v));
+        // If we are fully guarded, then make sure that subsequent includes
+        // with the same definitions of the macros we tested won't do
+        // anything.  We may have been fully processed already if we were
+        // included with different definitions.
+        if (m_options.replace_file_optimization && !p.is_replacement) {
+          ++m_r.replacement_misses;
+          TestedMacros macros;
+          for (const auto &[name, tested] : p.tested) {
+            if (tested.modified_at <= p.entered_at) {
+              macros.emplace_back(name, tested.definition);
+            }
           }
+          m_needs_replacing.emplace(
+              std::piecewise_construct,
+              std::forward_as_tuple(file->getUniqueID()),
+              std::forward_as_tuple(p.replacement_contents,
+                                    file->tryGetRealPathName().str(),
+                                    std::move(macros)));
+        }
 
+        if (!state.fully_processed) {
           // Mark it at guarded
           node.set_guarded(true);
 
@@ -569,6 +1838,7 @@ public:
         }
 
         assert(guarded && state.fully_processed);
+        propagate_tests(p, m_stack[m_stack.size() - 2]);
         m_stack.pop_back();
       }
 
@@ -598,14 +1868,18 @@ public:
     if (!File) {
       // File does not exist
       m_r.missing_includes.emplace(FileName.str());
-      return;
     }
 
-    if (m_skip_count) {
+    // While skipping, the includer is not at the top of `m_stack`
+    if (m_skip_count || (File && !allowed(File))) {
       return;
     }
 
-    if (!allowed(File)) {
+    if (m_options.record_lookups) {
+      record_lookups(HashLoc, FileName, IsAngled, File, SearchPath);
+    }
+
+    if (!File) {
       return;
     }
 
@@ -613,12 +1887,15 @@ public:
         m_id_to_node.emplace(File->getUniqueID(), empty);
 
     FileState &state = m_stack.back().it->second;
-    if (state.fully_processed && m_r.graph[state.v].is_guarded) {
+    if (state.fully_processed && m_r.graph[state.v].is_guarded &&
+        !m_options.replace_file_optimization) {
       // We can avoid doing any processing here if we have already seen
       // this file and it is unguarded.  For unguarded files (like X macros),
       // they may conditionally include other files depending on what is defined
       // at the point they are defined, and this may change each time it's
-      // included
+      // included.  With `replace_file_optimization`, a guarded file is only
+      // read again when the macros it tests are defined differently, so it
+      // may include different files and we record these below.
       assert(!inserted);
       return;
     }
@@ -643,9 +1920,6 @@ public:
                          .set_external(clang::SrcMgr::isSystem(FileType))
                          .set_precompiled(is_precompiled),
                      m_r.graph);
-      if (m_options.replace_file_optimization) {
-        m_replaced.resize(it->second.v + 1);
-      }
 #ifdef _DEBUG
       it->second.debug_name = RelativePath.str();
 #endif
@@ -675,12 +1949,6 @@ public:
     const char close = IsAngled ? '>' : '"';
     include.insert(include.cend(), &close, &close + 1);
 
-    if (m_options.replace_file_optimization && m_replaced[state.v]) {
-      state.replacement_contents += "#include ";
-      state.replacement_contents += include;
-      state.replacement_contents += '\n';
-    }
-
     const clang::FileID fromFileID = m_sm->getFileID(HashLoc);
     const clang::FileEntry *fromFile = m_sm->getFileEntryForID(fromFileID);
     const bool is_from_predefines = fromFile == nullptr;
@@ -702,7 +1970,13 @@ public:
     // removed
     const bool is_removable = !is_from_predefines && !is_component;
 
-    add_edge(from, to, {include, line_number, is_removable}, m_r.graph);
+    const Graph::edge_descriptor e =
+        add_edge(from, to, {include, line_number, is_removable}, m_r.graph)
+            .first;
+    if (m_includes) {
+      m_includes->push_back(
+          {e, RelativePath.str(), IsAngled, clang::SrcMgr::isSystem(FileType)});
+    }
     m_r.graph[to].internal_incoming += !m_r.graph[from].is_external;
     m_r.graph[to].external_incoming += m_r.graph[from].is_external;
 
@@ -770,8 +2044,10 @@ public:
       return;
     }
 
-    FileState &state = m_stack.back().it->second;
-    if (state.fully_processed || m_replaced[state.v]) {
+    m_last_modified[MacroNameTok.getIdentifierInfo()->getName().str()] =
+        ++m_modifications;
+    InProgress &p = m_stack.back();
+    if (p.is_replacement) {
       return;
     }
 
@@ -792,11 +2068,11 @@ public:
     llvm::raw_string_ostream Value(ValueBuffer);
     writeMacroDefinition(*Id, *MD->getMacroInfo(), *m_pp, Name, Value);
 
-    state.replacement_contents += "#define ";
-    state.replacement_contents += Name.str();
-    state.replacement_contents += ' ';
-    state.replacement_contents += Value.str();
-    state.replacement_contents += '\n';
+    p.replacement_contents += "#define ";
+    p.replacement_contents += Name.str();
+    p.replacement_contents += ' ';
+    p.replacement_contents += Value.str();
+    p.replacement_contents += '\n';
   }
 
   void MacroUndefined(const clang::Token &MacroNameTok,
@@ -809,8 +2085,10 @@ public:
       return;
     }
 
-    FileState &state = m_stack.back().it->second;
-    if (state.fully_processed || m_replaced[state.v]) {
+    m_last_modified[MacroNameTok.getIdentifierInfo()->getName().str()] =
+        ++m_modifications;
+    InProgress &p = m_stack.back();
+    if (p.is_replacement) {
       return;
     }
 
@@ -828,9 +2106,9 @@ public:
       return;
     }
 
-    state.replacement_contents += "#undef ";
-    state.replacement_contents += MacroNameTok.getIdentifierInfo()->getName();
-    state.replacement_contents += '\n';
+    p.replacement_contents += "#undef ";
+    p.replacement_contents += MacroNameTok.getIdentifierInfo()->getName();
+    p.replacement_contents += '\n';
   }
 
   void If(clang::SourceLocation Loc, clang::SourceRange ConditionRange,
@@ -838,6 +2116,17 @@ public:
     if (m_stack.back().seen_first == SeenFirst::None) {
       m_stack.back().seen_first = SeenFirst::If;
     }
+    record_condition(ConditionRange);
+  }
+
+  void Elif(clang::SourceLocation Loc, clang::SourceRange ConditionRange,
+            ConditionValueKind ConditionValue, clang::SourceLocation IfLoc) {
+    record_condition(ConditionRange);
+  }
+
+  void Ifdef(clang::SourceLocation Loc, const clang::Token &MacroNameTok,
+             const clang::MacroDefinition &MD) {
+    record_test(MacroNameTok.getIdentifierInfo()->getName());
   }
 
   void Ifndef(clang::SourceLocation Loc, const clang::Token &MacroNameTok,
@@ -845,6 +2134,12 @@ public:
     if (m_stack.back().seen_first == SeenFirst::None) {
       m_stack.back().seen_first = SeenFirst::Ifndef;
     }
+    record_test(MacroNameTok.getIdentifierInfo()->getName());
+  }
+
+  void Defined(const clang::Token &MacroNameTok,
+               const clang::MacroDefinition &MD, clang::SourceRange Range) {
+    record_test(MacroNameTok.getIdentifierInfo()->getName());
   }
 
   void EndOfMainFile() final {
@@ -861,25 +2156,27 @@ class ExpensiveAction : public clang::PreprocessOnlyAction {
   build_graph::result &m_r;
   UniqueIdToNode &m_id_to_node;
   NeedsReplacing m_needs_replacing;
-  std::vector<bool> &m_replaced; // vertex_descriptor -> isReplaced
   llvm::IntrusiveRefCntPtr<OverwriteFileSystem> m_in_memory_fs;
   llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_fs;
   std::function<build_graph::file_type(std::string_view)> m_file_type;
   std::filesystem::path m_working_dir;
   build_graph::options &m_options;
+  std::vector<IncludeRecord> *m_includes;
+  DirectivesOnlyFileSystem *m_directives;
 
 public:
   ExpensiveAction(
       build_graph::result &r, UniqueIdToNode &id_to_node,
-      std::vector<bool> &replaced,
       llvm::IntrusiveRefCntPtr<OverwriteFileSystem> in_memory_fs,
       llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
       const std::function<build_graph::file_type(std::string_view)> &file_type,
-      const std::filesystem::path &working_dir, build_graph::options &options)
+      const std::filesystem::path &working_dir, build_graph::options &options,
+      std::vector<IncludeRecord> *includes,
+      DirectivesOnlyFileSystem *directives)
       : m_f(), m_ci(nullptr), m_r(r), m_id_to_node(id_to_node),
-        m_needs_replacing(), m_replaced(replaced), m_in_memory_fs(in_memory_fs),
-        m_fs(fs), m_file_type(file_type), m_working_dir(working_dir),
-        m_options(options) {}
+        m_needs_replacing(), m_in_memory_fs(in_memory_fs), m_fs(fs),
+        m_file_type(file_type), m_working_dir(working_dir), m_options(options),
+        m_includes(includes), m_directives(directives) {}
 
   bool BeginInvocation(clang::CompilerInstance &ci) final {
     ci.getDiagnostics().setSuppressAllDiagnostics(true);
@@ -887,6 +2184,11 @@ public:
     ci.getDiagnostics().setIgnoreAllWarnings(true);
     ci.getDiagnostics().setErrorLimit(0u);
     m_ci = &ci;
+
+    // Lex each file as this translation unit would
+    if (m_directives) {
+      m_directives->set_lang_options(ci.getLangOpts());
+    }
     return true;
   }
 
@@ -897,27 +2199,43 @@ public:
   }
 
   void ExecuteAction() final {
+    clang::Preprocessor &pp = m_ci->getPreprocessor();
     getCompilerInstance().getPreprocessor().addPPCallbacks(
         std::make_unique<IncludeScanner>(
-            m_file_type, m_r, m_id_to_node, m_needs_replacing, m_replaced,
-            m_ci->getPreprocessor(), m_working_dir, m_options));
+            m_file_type, m_r, m_id_to_node, m_needs_replacing, pp,
+            m_working_dir, m_options, m_includes, m_in_memory_fs.get(),
+            m_directives ? &m_directives->store() : nullptr));
+
+    // Choose each replacement using the macros defined where it is first
+    // included
+    if (m_in_memory_fs) {
+      m_in_memory_fs->set_environment([&pp](llvm::StringRef name) {
+        return IncludeScanner::macro_definition(pp, name);
+      });
+    }
 
     clang::PreprocessOnlyAction::ExecuteAction();
   }
 
   void EndSourceFileAction() final {
+    if (m_in_memory_fs) {
+      m_in_memory_fs->set_environment(nullptr);
+    }
+
     for (auto &[id, value] : m_needs_replacing) {
-      const llvm::sys::fs::UniqueID new_id =
-          m_in_memory_fs->replace(value.path, id, std::move(value.contents));
-      assert(id != new_id); // Should never happen
-      m_replaced[value.v] = true;
-
-      // Since we're overriding our file, it will get a new `UniqueID` and we
-      // should replace it in the `UniqueID` lookup to the new one
-      const auto prev = m_id_to_node.find(id);
-      const auto [it, inserted] = m_id_to_node.emplace(new_id, prev->second);
-      assert(inserted);
-      m_id_to_node.erase(prev);
+      const std::optional<llvm::sys::fs::UniqueID> new_id =
+          m_in_memory_fs->replace(value.path, id, std::move(value.contents),
+                                  std::move(value.macros));
+      if (!new_id) {
+        continue;
+      }
+      assert(id != *new_id); // Should never happen
+
+      // Since we're overriding our file, it will get a new `UniqueID` that
+      // we add to the `UniqueID` lookup.  We keep the original, which is
+      // still used when the tested macros have different definitions.
+      const FileState state = m_id_to_node.find(id)->second;
+      m_id_to_node.emplace(*new_id, state);
     }
     m_needs_replacing.clear();
   }
@@ -929,24 +2247,32 @@ public:
 class find_graph_factory : public clang::tooling::FrontendActionFactory {
   build_graph::result &m_r;
   UniqueIdToNode &m_id_to_node;
-  std::vector<bool> m_replaced; // vertex_descriptor -> isReplaced
   llvm::IntrusiveRefCntPtr<OverwriteFileSystem> m_in_memory_fs;
   llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> m_fs;
   std::function<build_graph::file_type(std::string_view)> m_file_type;
   std::filesystem::path m_working_dir;
   build_graph::options m_options;
+  std::vector<IncludeRecord> *m_includes;
+  DirectivesOnlyFileSystem *m_directives;
 
 public:
-  /// Create a `print_graph_factory`.
+  /// Create a `print_graph_factory`.  If `includes` is not `nullptr`, then
+  /// append a record of each include directive added to `r`.  If
+  /// `directives` is not `nullptr`, then `fs` is expected to read files
+  /// through `directives`, whose language options are set for each
+  /// translation unit.
   find_graph_factory(
       build_graph::result &r, UniqueIdToNode &id_to_node,
       llvm::IntrusiveRefCntPtr<OverwriteFileSystem> in_memory_fs,
       llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
       const std::function<build_graph::file_type(std::string_view)> &file_type,
-      const std::filesystem::path &working_dir, build_graph::options &&options)
-      : m_r(r), m_id_to_node(id_to_node), m_replaced(),
-        m_in_memory_fs(in_memory_fs), m_fs(fs), m_working_dir(working_dir),
-        m_file_type(file_type), m_options(std::move(options)) {}
+      const std::filesystem::path &working_dir, build_graph::options &&options,
+      std::vector<IncludeRecord> *includes = nullptr,
+      DirectivesOnlyFileSystem *directives = nullptr)
+      : m_r(r), m_id_to_node(id_to_node), m_in_memory_fs(in_memory_fs),
+        m_fs(fs), m_working_dir(working_dir), m_file_type(file_type),
+        m_options(std::move(options)), m_includes(includes),
+        m_directives(directives) {}
 
   /// Invokes the compiler with a FrontendAction created by create().
   bool
@@ -955,7 +2281,7 @@ public:
                 std::shared_ptr<clang::PCHContainerOperations> PCHContainerOps,
                 clang::DiagnosticConsumer *DiagConsumer) final {
     if (m_in_memory_fs) {
-      // For performance, `ClangTool` shares the `clang::FileManager *` across
+      // For performance, `run_tool` shares the `clang::FileManager *` across
       // all translation units.  This FileManager has a cache of file paths
       // against their `File *`, entries which stops us being able to swap out
       // our files in the VFS.
@@ -983,12 +2309,512 @@ public:
 
   /// Returns a new `clang::FrontendAction`.
   std::unique_ptr<clang::FrontendAction> create() final {
-    return std::make_unique<ExpensiveAction>(m_r, m_id_to_node, m_replaced,
-                                             m_in_memory_fs, m_fs, m_file_type,
-                                             m_working_dir, m_options);
+    return std::make_unique<ExpensiveAction>(
+        m_r, m_id_to_node, m_in_memory_fs, m_fs, m_file_type, m_working_dir,
+        m_options, m_includes, m_directives);
+  }
+};
+
+// Return the command line that `clang::tooling::ClangTool` would use for the
+// specified `command`.
+std::vector<std::string>
+effective_command_line(const clang::tooling::CompileCommand &command) {
+  static const clang::tooling::ArgumentsAdjuster s_adjuster =
+      clang::tooling::combineAdjusters(
+          clang::tooling::combineAdjusters(
+              clang::tooling::getClangStripOutputAdjuster(),
+              clang::tooling::getClangSyntaxOnlyAdjuster()),
+          clang::tooling::getClangStripDependencyFileAdjuster());
+  static int s_static_symbol;
+  std::vector<std::string> args =
+      s_adjuster(command.CommandLine, command.Filename);
+  if (std::none_of(args.begin(), args.end(), [](llvm::StringRef arg) {
+        return arg.startswith("-resource-dir");
+      })) {
+    args.push_back("-resource-dir=" +
+                   clang::CompilerInvocation::GetResourcesPath(
+                       "clang_tool", &s_static_symbol));
+  }
+  return args;
+}
+
+// A single translation unit to preprocess.
+struct CompileJob {
+  // The absolute path of the source
+  std::string file;
+
+  // The command, already adjusted with `effective_command_line`
+  clang::tooling::CompileCommand command;
+
+  // The number of identical commands that this job stands for
+  unsigned weight = 1;
+};
+
+// Append to the specified `jobs` one job for each command in the specified
+// `compilation_db` for each of the specified `source_paths`, which are
+// relative to the working directory of the specified `fs`.  If the specified
+// `deduplicate` is `true`, then commands that are identical after adjusting
+// them as `clang::tooling::ClangTool` would are added once and counted in
+// `weight`.  Return whether all sources had at least one command.
+bool make_jobs(const clang::tooling::CompilationDatabase &compilation_db,
+               std::span<const std::filesystem::path> source_paths,
+               llvm::vfs::FileSystem &fs, bool deduplicate,
+               std::vector<CompileJob> &jobs) {
+  std::unordered_map<std::string, std::size_t> seen;
+  bool success = true;
+  for (const std::filesystem::path &source : source_paths) {
+    llvm::Expected<std::string> file =
+        clang::tooling::getAbsolutePath(fs, source.string());
+    if (!file) {
+      llvm::consumeError(file.takeError());
+      success = false;
+      continue;
+    }
+
+    std::vector<clang::tooling::CompileCommand> commands =
+        compilation_db.getCompileCommands(*file);
+    if (commands.empty()) {
+      success = false;
+      continue;
+    }
+
+    for (clang::tooling::CompileCommand &command : commands) {
+      command.CommandLine = effective_command_line(command);
+      if (deduplicate) {
+        std::string key = command.Directory;
+        key += '\0';
+        key += *file;
+        for (const std::string &arg : command.CommandLine) {
+          key += '\0';
+          key += arg;
+        }
+        const auto [it, inserted] = seen.emplace(std::move(key), jobs.size());
+        if (!inserted) {
+          ++jobs[it->second].weight;
+          continue;
+        }
+      }
+      jobs.push_back({*file, std::move(command)});
+    }
+  }
+  return success;
+}
+
+/// This component creates the `clang::CompilerInvocation` for each compile
+/// command.  Running the driver to turn a command line into an invocation
+/// (parsing arguments, detecting the toolchain and its system include
+/// directories, and setting up the target) is a large fixed cost for small
+/// translation units, so commands that differ only in their source file
+/// share the same invocation and only swap in their own main file.
+class InvocationCache {
+  std::mutex m_mutex;
+  std::unordered_map<std::string,
+                     std::shared_ptr<const clang::CompilerInvocation>>
+      m_invocations;
+
+public:
+  InvocationCache() : m_mutex(), m_invocations() {}
+
+  /// Return a new invocation for the specified `job`, using the specified
+  /// `fs` and reporting errors to the specified `diagnostics`.  Return
+  /// `nullptr` if the command is not valid.
+  std::shared_ptr<clang::CompilerInvocation>
+  create(const CompileJob &job,
+         llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
+         clang::DiagnosticConsumer &diagnostics) {
+    const clang::tooling::CompileCommand &command = job.command;
+    const std::vector<std::string> &args = command.CommandLine;
+
+    // Commands are equivalent if they only differ in the source file.  The
+    // extension is kept as it decides the language of the source.
+    std::string key = command.Directory;
+    key += '\0';
+    key += llvm::sys::path::extension(job.file);
+    for (const std::string &arg : args) {
+      key += '\0';
+      if (arg == command.Filename || arg == job.file) {
+        key += '\1';
+      } else {
+        key += arg;
+      }
+    }
+
+    std::shared_ptr<const clang::CompilerInvocation> shared;
+    {
+      const std::lock_guard lock(m_mutex);
+      const auto it = m_invocations.find(key);
+      if (it != m_invocations.end()) {
+        shared = it->second;
+      }
+    }
+
+    if (!shared) {
+      std::vector<const char *> argv(args.size());
+      std::transform(args.begin(), args.end(), argv.begin(),
+                     [](const std::string &arg) { return arg.c_str(); });
+      std::shared_ptr<clang::CompilerInvocation> created =
+          clang::createInvocationFromCommandLine(
+              argv,
+              clang::CompilerInstance::createDiagnostics(
+                  new clang::DiagnosticOptions(), &diagnostics, false),
+              fs);
+      if (!created) {
+        return nullptr;
+      }
+
+      // The driver passes `-disable-free` as it expects the process to exit
+      // after compiling, but we run many translation units so we must free
+      // each one's preprocessor, source manager and file buffers.  This is
+      // what `clang::tooling::ClangTool` does as well.
+      created->getFrontendOpts().DisableFree = false;
+      created->getCodeGenOpts().DisableFree = false;
+
+      const std::lock_guard lock(m_mutex);
+      shared = m_invocations.emplace(std::move(key), std::move(created))
+                   .first->second;
+    }
+
+    auto invocation = std::make_shared<clang::CompilerInvocation>(*shared);
+    std::vector<clang::FrontendInputFile> &inputs =
+        invocation->getFrontendOpts().Inputs;
+    if (inputs.size() != 1u) {
+      return nullptr;
+    }
+    inputs.front() = clang::FrontendInputFile(
+        job.file, inputs.front().getKind(), inputs.front().isSystem());
+    return invocation;
+  }
+};
+
+// Run the specified `factory` over the specified `jobs`, in the same way as
+// `clang::tooling::ClangTool`, with the specified `fs` and the specified
+// `diagnostics`.  Use the specified `invocations` to create each
+// `clang::CompilerInvocation` and set the `weight` of the sources that
+// `factory` adds to the specified `r`.  Return whether all translation units
+// were processed successfully.
+bool run_tool(std::span<const CompileJob> jobs,
+              llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
+              clang::tooling::FrontendActionFactory &factory,
+              clang::DiagnosticConsumer &diagnostics,
+              InvocationCache &invocations, build_graph::result &r) {
+  const auto files = llvm::makeIntrusiveRefCnt<clang::FileManager>(
+      clang::FileSystemOptions(), fs);
+  const auto pch_container_ops =
+      std::make_shared<clang::PCHContainerOperations>();
+  const llvm::ErrorOr<std::string> initial_directory =
+      fs->getCurrentWorkingDirectory();
+  const auto restore_directory = llvm::make_scope_exit([&] {
+    if (initial_directory) {
+      fs->setCurrentWorkingDirectory(*initial_directory);
+    }
+  });
+
+  bool success = true;
+  for (const CompileJob &job : jobs) {
+    if (fs->setCurrentWorkingDirectory(job.command.Directory)) {
+      success = false;
+      continue;
+    }
+
+    const std::size_t first_source = r.sources.size();
+    std::shared_ptr<clang::CompilerInvocation> invocation =
+        invocations.create(job, fs, diagnostics);
+    if (!invocation ||
+        !factory.runInvocation(std::move(invocation), files.get(),
+                               pch_container_ops, &diagnostics)) {
+      success = false;
+    }
+
+    for (std::size_t i = first_source; i < r.sources.size(); ++i) {
+      r.graph[r.sources[i]].weight = job.weight;
+    }
+  }
+  return success;
+}
+
+/// This component merges the graphs of translation units preprocessed in
+/// parallel into a single `build_graph::result`.  Graphs may be added in any
+/// order, but they are merged in the order of their index so that the result
+/// is identical to preprocessing each translation unit in turn.
+class GraphMerger {
+  std::mutex m_mutex;
+  build_graph::result &m_r;
+  UniqueIdToNode m_id_to_node;
+  std::vector<std::optional<TranslationUnitGraph>> m_pending;
+  std::size_t m_next;
+  bool m_failed;
+  std::function<build_graph::file_type(std::string_view)> m_file_type;
+  std::function<void(const std::filesystem::path &)> m_source_started;
+  bool m_replace_file_optimization;
+
+  void merge(const TranslationUnitGraph &tu) {
+    const Graph &g = tu.r.graph;
+    m_failed |= tu.failed;
+
+    for (const Graph::vertex_descriptor local : tu.r.sources) {
+      const std::filesystem::path &rel = g[local].path;
+      if (m_source_started) {
+        m_source_started(rel);
+      }
+
+      // A source compiled again with a different command gets a new vertex
+      auto const [it, inserted] = m_id_to_node.emplace(tu.ids[local], empty);
+      if (!inserted) {
+        it->second = FileState(empty);
+      }
+      it->second.v = add_vertex(rel, m_r.graph);
+      it->second.angled_rel = rel.parent_path();
+      m_r.graph[it->second.v].underlying_cost = g[local].underlying_cost;
+      m_r.graph[it->second.v].stamp = g[local].stamp;
+      m_r.graph[it->second.v].weight = g[local].weight;
+      m_r.sources.push_back(it->second.v);
+    }
+
+    // Replay the include directives in the order they were seen, but as
+    // if we had all the state from previous translation units.  This
+    // mirrors what is done in `IncludeScanner::InclusionDirective`.
+    for (const IncludeRecord &include : tu.includes) {
+      // We can only be missing `from` if it was included by a guarded file
+      // that we have already processed but this time it included different
+      // files.  This is most likely an issue and a poor design of files.
+      const auto from_it = m_id_to_node.find(tu.ids[source(include.e, g)]);
+      if (from_it == m_id_to_node.end() || from_it->second.v == empty) {
+        continue;
+      }
+
+      const FileState &state = from_it->second;
+      const Graph::vertex_descriptor from = state.v;
+      if (state.fully_processed && m_r.graph[from].is_guarded &&
+          !m_replace_file_optimization) {
+        continue;
+      }
+
+      auto const [it, inserted] =
+          m_id_to_node.emplace(tu.ids[target(include.e, g)], empty);
+      if (inserted) {
+        std::filesystem::path relative_path(include.relative_path);
+        const std::filesystem::path p =
+            (include.is_angled ? relative_path
+                               : state.angled_rel / relative_path)
+                .make_preferred()
+                .lexically_normal();
+        const bool is_precompiled =
+            m_r.graph[from].is_precompiled ||
+            m_file_type(p.string()) ==
+                build_graph::file_type::precompiled_header;
+        it->second.v = add_vertex(file_node(p)
+                                      .set_external(include.is_system)
+                                      .set_precompiled(is_precompiled),
+                                  m_r.graph);
+        m_r.graph[it->second.v].stamp = g[target(include.e, g)].stamp;
+        it->second.angled_rel =
+            (include.is_angled ? relative_path
+                               : state.angled_rel / relative_path)
+                .parent_path();
+      }
+
+      const Graph::vertex_descriptor to = it->second.v;
+      if (edge(from, to, m_r.graph).second) {
+        continue;
+      }
+
+      const include_edge &e = g[include.e];
+      const bool is_component = from != to && (m_r.graph[from].path.stem() ==
+                                               m_r.graph[to].path.stem());
+      const bool is_removable = e.lineNumber != 0 && !is_component;
+      add_edge(from, to, {e.code, e.lineNumber, is_removable}, m_r.graph);
+      m_r.graph[to].internal_incoming += !m_r.graph[from].is_external;
+      m_r.graph[to].external_incoming += m_r.graph[from].is_external;
+      if (is_component && !m_r.graph[from].component.has_value()) {
+        m_r.graph[to].component = from;
+        m_r.graph[from].component = to;
+      }
+    }
+
+    // Finally add the lookups of every file and apply the guards and costs
+    // of all files that were exited.  This mirrors what is done in
+    // `IncludeScanner::InclusionDirective` and `IncludeScanner::FileChanged`.
+    for (const Graph::vertex_descriptor local :
+         boost::make_iterator_range(vertices(g))) {
+      const auto it = m_id_to_node.find(tu.ids[local]);
+      if (it == m_id_to_node.end() || it->second.v == empty) {
+        continue;
+      }
+
+      FileState &state = it->second;
+      file_node &node = m_r.graph[state.v];
+      for (const interned_string &m : g[local].missing_includes) {
+        add_lookup(state.missing_includes, node.missing_includes, m);
+      }
+      for (const interned_path &p : g[local].absent_paths) {
+        add_lookup(state.absent_paths, node.absent_paths, p);
+      }
+
+      if (!tu.processed[local]) {
+        continue;
+      }
+
+      if (tu.r.unguarded_files.contains(local)) {
+        m_r.unguarded_files.insert(state.v);
+      } else {
+        m_r.unguarded_files.erase(state.v);
+      }
+
+      if (!state.fully_processed) {
+        state.fully_processed = true;
+        if (g[local].is_guarded) {
+          node.set_guarded(true);
+          node.underlying_cost = g[local].underlying_cost;
+        }
+      }
+    }
+
+    m_r.missing_includes.insert(tu.r.missing_includes.begin(),
+                                tu.r.missing_includes.end());
+    m_r.replacement_hits += tu.r.replacement_hits;
+    m_r.replacement_misses += tu.r.replacement_misses;
+  }
+
+public:
+  GraphMerger(
+      build_graph::result &r, std::size_t count,
+      const std::function<build_graph::file_type(std::string_view)> &file_type,
+      const std::function<void(const std::filesystem::path &)> &source_started,
+      bool replace_file_optimization)
+      : m_mutex(), m_r(r), m_id_to_node(), m_pending(count), m_next(0),
+        m_failed(false), m_file_type(file_type),
+        m_source_started(source_started),
+        m_replace_file_optimization(replace_file_optimization) {}
+
+  /// Add the specified `tu` that was the `index`th translation unit and
+  /// merge all consecutive translation units that are now available.
+  void add(std::size_t index, TranslationUnitGraph &&tu) {
+    std::lock_guard lock(m_mutex);
+    m_pending[index].emplace(std::move(tu));
+    while (m_next < m_pending.size() && m_pending[m_next]) {
+      merge(*m_pending[m_next]);
+      m_pending[m_next].reset();
+      ++m_next;
+    }
   }
+
+  /// Return whether any translation unit failed to be preprocessed.
+  bool failed() const { return m_failed; }
 };
 
+// Return a new `DirectiveStore` if `opts.directives_only` is set, and
+// otherwise `nullptr`.  If `opts.cache_directory` is set, then the store uses
+// a `cost_cache` in that directory.
+std::shared_ptr<DirectiveStore>
+make_directive_store(const build_graph::options &opts) {
+  if (!opts.directives_only) {
+    return nullptr;
+  }
+
+  return std::make_shared<DirectiveStore>(
+      opts.cache_directory.empty()
+          ? nullptr
+          : std::make_shared<const cost_cache>(opts.cache_directory));
+}
+
+// Preprocess the specified `source_paths` using `opts.jobs` threads and
+// merge the results into `r`.  Return whether all translation units were
+// preprocessed successfully.
+bool build_in_parallel(
+    build_graph::result &r,
+    const clang::tooling::CompilationDatabase &compilation_db,
+    const std::filesystem::path &working_dir,
+    std::span<const std::filesystem::path> source_paths,
+    const std::function<build_graph::file_type(std::string_view)> &file_type,
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
+    const build_graph::options &opts) {
+  const llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> cached_fs =
+      llvm::makeIntrusiveRefCnt<StatCacheFileSystem>(fs);
+  std::vector<CompileJob> jobs;
+  const bool found_all = make_jobs(compilation_db, source_paths, *cached_fs,
+                                   opts.deduplicate_sources, jobs);
+
+  GraphMerger merger(r, jobs.size(), file_type, opts.source_started,
+                     opts.replace_file_optimization);
+  const std::shared_ptr<ReplacementStore> store =
+      std::make_shared<ReplacementStore>();
+  const std::shared_ptr<DirectiveStore> directives = make_directive_store(opts);
+  InvocationCache invocations;
+  std::atomic<std::size_t> next = 0;
+  const auto worker = [&] {
+    // Each worker has its own working directory so that `run_tool` can
+    // change it without affecting other workers.
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> worker_fs =
+        llvm::makeIntrusiveRefCnt<WorkingDirectoryFileSystem>(cached_fs);
+    llvm::IntrusiveRefCntPtr<DirectivesOnlyFileSystem> directives_fs;
+    if (directives) {
+      worker_fs = (directives_fs =
+                       llvm::makeIntrusiveRefCnt<DirectivesOnlyFileSystem>(
+                           worker_fs, directives));
+    }
+    clang::IgnoringDiagConsumer ignore;
+    for (std::size_t i = next++; i < jobs.size(); i = next++) {
+      // Replacements are shared between all workers, but a translation unit
+      // only sees those from earlier translation units.  These files will
+      // have been fully processed by the time this translation unit is
+      // merged, so this does not change the result.
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> tu_fs = worker_fs;
+      llvm::IntrusiveRefCntPtr<OverwriteFileSystem> in_memory;
+      if (opts.replace_file_optimization) {
+        tu_fs = (in_memory = llvm::makeIntrusiveRefCnt<OverwriteFileSystem>(
+                     tu_fs, store, i));
+      }
+
+      if (LOG) {
+        tu_fs = llvm::makeIntrusiveRefCnt<LoggingFileSystem>(tu_fs);
+      }
+
+      // `source_started` is called by `merger` so that it is invoked in
+      // order and never concurrently.
+      build_graph::options tu_opts = opts;
+      tu_opts.source_started = nullptr;
+
+      UniqueIdToNode id_to_node;
+      TranslationUnitGraph tu;
+      find_graph_factory f(tu.r, id_to_node, in_memory, tu_fs, file_type,
+                           working_dir, std::move(tu_opts), &tu.includes,
+                           directives_fs.get());
+      tu.failed = !run_tool(std::span(jobs).subspan(i, 1), tu_fs, f, ignore,
+                            invocations, tu.r);
+
+      // Note that `id_to_node` may contain the `UniqueID` of replacement
+      // files, so translate these back to the original file.
+      const ReplacedIds no_replacements;
+      const ReplacedIds &replaced_ids =
+          in_memory ? in_memory->replaced_ids() : no_replacements;
+      const std::size_t count = num_vertices(tu.r.graph);
+      tu.ids.resize(count);
+      tu.processed.resize(count);
+      for (const auto &[id, state] : id_to_node) {
+        if (state.v == empty) {
+          continue;
+        }
+        const auto it = replaced_ids.find(id);
+        tu.ids[state.v] = it == replaced_ids.end() ? id : it->second;
+        tu.processed[state.v] = state.fully_processed;
+      }
+
+      merger.add(i, std::move(tu));
+    }
+  };
+
+  {
+    std::vector<std::jthread> threads;
+    const std::size_t thread_count =
+        std::min<std::size_t>(opts.jobs, jobs.size());
+    for (std::size_t i = 0; i < thread_count; ++i) {
+      threads.emplace_back(worker);
+    }
+  }
+
+  return found_all && !merger.failed();
+}
+
 } // namespace
 
 llvm::Expected<build_graph::result> build_graph::from_compilation_db(
@@ -997,10 +2823,10 @@ llvm::Expected<build_graph::result> build_graph::from_compilation_db(
     std::span<const std::filesystem::path> source_paths,
     std::function<build_graph::file_type(std::string_view)> file_type,
     llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs, options opts) {
-  std::vector<std::string> source_path_strings(source_paths.size());
-  std::transform(source_paths.begin(), source_paths.end(),
-                 source_path_strings.begin(),
-                 [](const std::filesystem::path &p) { return p.string(); });
+  if (opts.index_include_dirs) {
+    fs = llvm::makeIntrusiveRefCnt<HeaderIndexFileSystem>(
+        fs, include_directories(compilation_db, source_paths));
+  }
 
   // Avoid re-preprocessing files that we have seen before and already
   // added to the graph.  By using `OverwriteFileSystem` we can,
@@ -1012,8 +2838,31 @@ llvm::Expected<build_graph::result> build_graph::from_compilation_db(
   //      into our `OverwriteFileSystem`.  Hopefully at this point we can
   //      guarantee that there is no state left over from the previous
   //      source files.
-  //   3. In the future, figure out how we can do this while processing
-  //      sources in parallel.
+  //   3. When processing sources in parallel, each translation unit gets
+  //      its own `OverwriteFileSystem` that shares a `ReplacementStore`
+  //      with all other translation units (see `build_in_parallel`).
+
+  if (opts.jobs > 1) {
+    result r;
+    r.raw_token_costs = opts.directives_only;
+    if (!build_in_parallel(r, compilation_db, working_dir, source_paths,
+                           file_type, fs, opts)) {
+      return llvm::createStringError(
+          std::error_code(1, std::generic_category()), "oops");
+    }
+    return r;
+  }
+
+  // Avoid looking up the same paths again for each translation unit
+  fs = llvm::makeIntrusiveRefCnt<WorkingDirectoryFileSystem>(
+      llvm::makeIntrusiveRefCnt<StatCacheFileSystem>(fs));
+
+  const std::shared_ptr<DirectiveStore> directives = make_directive_store(opts);
+  llvm::IntrusiveRefCntPtr<DirectivesOnlyFileSystem> directives_fs;
+  if (directives) {
+    fs = (directives_fs = llvm::makeIntrusiveRefCnt<DirectivesOnlyFileSystem>(
+              fs, directives));
+  }
 
   llvm::IntrusiveRefCntPtr<OverwriteFileSystem> in_memory;
   if (opts.replace_file_optimization) {
@@ -1024,23 +2873,23 @@ llvm::Expected<build_graph::result> build_graph::from_compilation_db(
     fs = llvm::makeIntrusiveRefCnt<LoggingFileSystem>(fs);
   }
 
-  clang::tooling::ClangTool tool(
-      compilation_db, source_path_strings,
-      std::make_shared<clang::PCHContainerOperations>(), fs);
-
-  // Set our diagnosic consumer here as we get some diagnostics emitted before
-  // `BeginInvocation` is called, e.g.
-  //   > warning: treating 'c' input as 'c++' when in C++ mode, this behavior
-  //   > is deprecated [-Wdeprecated]
-  tool.setDiagnosticConsumer(&s_ignore);
+  std::vector<CompileJob> jobs;
+  const bool found_all = make_jobs(compilation_db, source_paths, *fs,
+                                   opts.deduplicate_sources, jobs);
 
   UniqueIdToNode id_to_node;
   result r;
+  r.raw_token_costs = opts.directives_only;
   find_graph_factory f(r, id_to_node, in_memory, fs, file_type, working_dir,
-                       std::move(opts));
-  const int rc = tool.run(&f);
-  if (rc != 0) {
-    return llvm::createStringError(std::error_code(rc, std::generic_category()),
+                       std::move(opts), nullptr, directives_fs.get());
+
+  // Use our diagnostic consumer for the driver as well, as we get some
+  // diagnostics emitted before `BeginInvocation` is called, e.g.
+  //   > warning: treating 'c' input as 'c++' when in C++ mode, this behavior
+  //   > is deprecated [-Wdeprecated]
+  InvocationCache invocations;
+  if (!run_tool(jobs, fs, f, s_ignore, invocations, r) || !found_all) {
+    return llvm::createStringError(std::error_code(1, std::generic_category()),
                                    "oops");
   }
   return r;
@@ -1073,24 +2922,17 @@ llvm::Expected<build_graph::result> build_graph::from_dir(
   db.m_include_dirs = include_dirs;
   db.m_force_includes = forced_includes;
 
-  std::vector<std::string> directories;
-  directories.push_back(source_dir.string());
-  const llvm::vfs::directory_iterator end;
-  while (!directories.empty()) {
-    const std::string dir_copy = std::move(directories.back());
-    directories.pop_back();
-    std::error_code ec;
-    llvm::vfs::directory_iterator it = fs->dir_begin(dir_copy, ec);
-    while (!ec && it != end) {
-      if (it->type() == llvm::sys::fs::file_type::directory_file) {
-        directories.push_back(it->path().str());
-      } else if (it->type() == llvm::sys::fs::file_type::regular_file &&
-                 file_type(it->path()) == file_type::source) {
-        db.m_sources.emplace_back(it->path().str());
-      }
-      it.increment(ec);
-    }
+  llvm::Expected<std::vector<std::filesystem::path>> sources =
+      crawl::find_files(
+          source_dir, *fs,
+          [&](std::string_view file) {
+            return file_type(file) == file_type::source;
+          },
+          {opts.jobs, opts.exclude});
+  if (!sources) {
+    return sources.takeError();
   }
+  db.m_sources = std::move(*sources);
 
   return from_compilation_db(db, source_dir, db.m_sources, file_type, fs,
                              std::move(opts));
@@ -1112,7 +2954,12 @@ llvm::Expected<build_graph::result> build_graph::from_dir(
 
 std::ostream &operator<<(std::ostream &out, build_graph::options opts) {
   return out << "options(replace_file_optimization=" << std::boolalpha
-             << opts.replace_file_optimization << ")";
+             << opts.replace_file_optimization
+             << ", directives_only=" << opts.directives_only
+             << ", cache_directory=" << opts.cache_directory
+             << ", index_include_dirs=" << opts.index_include_dirs
+             << ", deduplicate_sources=" << opts.deduplicate_sources
+             << ", jobs=" << opts.jobs << ")";
 }
 
 } // namespace IncludeGuardian
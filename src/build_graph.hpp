@@ -13,6 +13,7 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/unordered_set.hpp>
 
+#include <cstdint>
 #include <filesystem>
 #include <functional>
 #include <set>
@@ -37,6 +38,11 @@ struct build_graph {
     std::vector<Graph::vertex_descriptor> sources;
     std::set<std::string> missing_includes;
     std::unordered_set<Graph::vertex_descriptor> unguarded_files;
+    std::uint64_t replacement_hits = 0u;   //< guarded files replaced
+    std::uint64_t replacement_misses = 0u; //< guarded files fully read
+    bool raw_token_costs = false; //< Token counts are those of the
+                                  //< unpreprocessed files, as measured with
+                                  //< `options::directives_only`.
 
     template <typename Archive>
     void serialize(Archive &ar, const unsigned version) {
@@ -49,6 +55,34 @@ struct build_graph {
 
   struct options {
     bool replace_file_optimization = false;
+    bool directives_only = false; //< Read and lex each file once to measure
+                                  //< its cost and afterwards only preprocess
+                                  //< its directives.  Token counts are those
+                                  //< of the unpreprocessed file.
+    std::filesystem::path
+        cache_directory; //< If not empty, the directory of a `cost_cache`
+                         //< used with `directives_only` to avoid lexing
+                         //< files read in previous runs.  This is ignored
+                         //< if `directives_only` is not set.
+    bool index_include_dirs = false; //< List each directory beneath the
+                                     //< include directories once, when it
+                                     //< is first searched, and use this to
+                                     //< find missing files instead of the
+                                     //< file system.  Files must not be
+                                     //< added while preprocessing.
+    bool deduplicate_sources = false; //< Preprocess each distinct compile
+                                      //< command once and record how many
+                                      //< times it appeared as the `weight`
+                                      //< of its source.
+    bool record_lookups = false; //< Record the `missing_includes` and
+                                 //< `absent_paths` of each file, which
+                                 //< `incremental` needs to find the files
+                                 //< to preprocess again.
+    unsigned jobs = 1; //< The number of translation units to preprocess
+                       //< concurrently.  The result is identical no matter
+                       //< what value is used.
+    std::vector<std::string> exclude; //< Glob patterns of files and
+                                      //< directories that `from_dir` ignores
     std::function<void(const std::filesystem::path &)> source_started;
 
     options() = default;
@@ -57,6 +91,41 @@ struct build_graph {
       replace_file_optimization = value;
       return *this;
     }
+
+    options &enable_directives_only(bool value) {
+      directives_only = value;
+      return *this;
+    }
+
+    options &with_cache_directory(std::filesystem::path value) {
+      cache_directory = std::move(value);
+      return *this;
+    }
+
+    options &enable_include_index(bool value) {
+      index_include_dirs = value;
+      return *this;
+    }
+
+    options &enable_deduplicate_sources(bool value) {
+      deduplicate_sources = value;
+      return *this;
+    }
+
+    options &enable_record_lookups(bool value) {
+      record_lookups = value;
+      return *this;
+    }
+
+    options &with_jobs(unsigned value) {
+      jobs = value;
+      return *this;
+    }
+
+    options &with_exclude(std::vector<std::string> value) {
+      exclude = std::move(value);
+      return *this;
+    }
   };
 
   enum class file_type {
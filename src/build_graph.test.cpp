@@ -1,17 +1,26 @@
 #include "build_graph.hpp"
 
+#include "cost_cache.hpp"
 #include "matchers.hpp"
 
+#include <clang/Tooling/CompilationDatabase.h>
+
 #include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/xxhash.h>
 
 #include <boost/predef.h>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <filesystem>
 #include <initializer_list>
+#include <map>
+#include <mutex>
 #include <ostream>
+#include <string>
+#include <vector>
 
 using namespace IncludeGuardian;
 
@@ -198,6 +207,164 @@ TEST_P(BuildGraphTest, FileStats) {
   EXPECT_THAT(results->unguarded_files, IsEmpty());
 }
 
+TEST_P(BuildGraphTest, FileStamps) {
+  auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::string_view main_cpp_code = "#include \"a.hpp\"\n";
+  const std::string_view a_hpp_code = "#pragma once\n";
+  fs->addFile((working_directory / "main.cpp").string(), 1000,
+              llvm::MemoryBuffer::getMemBufferCopy(main_cpp_code));
+  fs->addFile((working_directory / "a.hpp").string(), 2000,
+              llvm::MemoryBuffer::getMemBufferCopy(a_hpp_code));
+
+  llvm::Expected<build_graph::result> results = build_graph::from_dir(
+      working_directory, {}, fs, get_file_type, GetParam());
+  const Graph &graph = results->graph;
+  ASSERT_THAT(num_vertices(graph), Eq(2));
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    const file_node &file = graph[v];
+    EXPECT_THAT(file.stamp.location, Eq(working_directory / file.path));
+    if (file.path == "main.cpp") {
+      EXPECT_THAT(file.stamp.modified, Eq(1000));
+      EXPECT_THAT(file.stamp.content_hash, Eq(llvm::xxHash64(main_cpp_code)));
+    } else {
+      EXPECT_THAT(file.stamp.modified, Eq(2000));
+      EXPECT_THAT(file.stamp.content_hash, Eq(llvm::xxHash64(a_hpp_code)));
+    }
+  }
+}
+
+// Test that only reading the directives of files gives the same graph but
+// with the costs of the unpreprocessed files.
+TEST(BuildGraph, DirectivesOnly) {
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::string_view main_cpp_code = "// Comment\n"
+                                         "#include \"a.hpp\"\n"
+                                         "#include \"x.hpp\"\n"
+                                         "int main() {}\n";
+  const std::string_view a_hpp_code = "#ifndef A\n"
+                                      "#define A\n"
+                                      "int a;\n"
+                                      "#endif\n";
+  const std::string_view x_hpp_code = "int x;\n";
+
+  Graph g;
+  const Graph::vertex_descriptor main_cpp = add_vertex(
+      file_node("main.cpp")
+          .with_cost(12 + 3, (main_cpp_code.size() + x_hpp_code.size()) * B),
+      g);
+  const Graph::vertex_descriptor a_hpp =
+      add_vertex(file_node("a.hpp")
+                     .with_cost(11, a_hpp_code.size() * B)
+                     .set_internal_parents(1),
+                 g);
+  const Graph::vertex_descriptor x_hpp =
+      add_vertex(file_node("x.hpp").set_internal_parents(1), g);
+  add_edge(main_cpp, a_hpp, {"\"a.hpp\"", 2}, g);
+  add_edge(main_cpp, x_hpp, {"\"x.hpp\"", 3}, g);
+
+  for (const build_graph::options &options :
+       {build_graph::options().enable_directives_only(true),
+        build_graph::options().enable_directives_only(true).with_jobs(4),
+        build_graph::options()
+            .enable_directives_only(true)
+            .enable_replace_file_optimization(true)}) {
+    auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    fs->addFile((working_directory / "main.cpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(main_cpp_code));
+    fs->addFile((working_directory / "a.hpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(a_hpp_code));
+    fs->addFile((working_directory / "x.hpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(x_hpp_code));
+
+    llvm::Expected<build_graph::result> results = build_graph::from_dir(
+        working_directory, {}, fs, get_file_type, options);
+    EXPECT_THAT(results->graph, GraphsAreEquivalent(g)) << options;
+    EXPECT_THAT(results->unguarded_files, ElementsAre(x_hpp)) << options;
+    EXPECT_THAT(results->graph[main_cpp].stamp.content_hash,
+                Eq(llvm::xxHash64(main_cpp_code)))
+        << options;
+  }
+}
+
+// Test that when only preprocessing directives, a pragma overriding the
+// token count is only used when it is active and the last one wins, as it
+// does when preprocessing the whole file.
+TEST(BuildGraph, DirectivesOnlyOverrides) {
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::string_view main_cpp_code = "#include \"a.hpp\"\n";
+  const std::string_view a_hpp_code =
+      "#pragma once\n"
+      "// #pragma override_token_count(7)\n"
+      "const char *s = \"#pragma override_token_count(8)\";\n"
+      "#if 0\n"
+      "#pragma override_token_count(9)\n"
+      "#endif\n"
+      "#pragma override_token_count(5)\n"
+      "#pragma override_token_count(6)\n";
+
+  for (const build_graph::options &options :
+       {build_graph::options(),
+        build_graph::options().enable_directives_only(true),
+        build_graph::options().enable_directives_only(true).with_jobs(2)}) {
+    auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    fs->addFile((working_directory / "main.cpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(main_cpp_code));
+    fs->addFile((working_directory / "a.hpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(a_hpp_code));
+
+    llvm::Expected<build_graph::result> results = build_graph::from_dir(
+        working_directory, {}, fs, get_file_type, options);
+    ASSERT_THAT(num_vertices(results->graph), Eq(2)) << options;
+    EXPECT_THAT(results->graph[1].underlying_cost,
+                Eq(cost(6, a_hpp_code.size() * B)))
+        << options;
+  }
+}
+
+// Test that files are added to a `cost_cache` and that later runs use the
+// cost from the cache instead of lexing the file.
+TEST(BuildGraph, CostCache) {
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::filesystem::path cache_directory =
+      std::filesystem::temp_directory_path() / "includeguardian_build_graph";
+  std::filesystem::remove_all(cache_directory);
+  const std::string_view main_cpp_code = "#include \"a.hpp\"\n";
+  const std::string_view a_hpp_code = "#pragma once\n"
+                                      "int a;\n";
+
+  const auto build = [&] {
+    auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    fs->addFile((working_directory / "main.cpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(main_cpp_code));
+    fs->addFile((working_directory / "a.hpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(a_hpp_code));
+    return build_graph::from_dir(working_directory, {}, fs, get_file_type,
+                                 build_graph::options()
+                                     .enable_directives_only(true)
+                                     .with_cache_directory(cache_directory));
+  };
+
+  llvm::Expected<build_graph::result> first = build();
+  ASSERT_THAT(num_vertices(first->graph), Eq(2));
+  EXPECT_THAT(first->graph[1].underlying_cost,
+              Eq(cost{6, a_hpp_code.size() * B}));
+
+  // Change the cost in the entry for `a.hpp`
+  const std::uint64_t a_hpp_hash = llvm::xxHash64(a_hpp_code);
+  const cost_cache cache(cache_directory);
+  std::optional<cost_cache::entry> entry = cache.find(a_hpp_hash);
+  ASSERT_TRUE(entry.has_value());
+  entry->c.token_count = 1000;
+  ASSERT_TRUE(cache.insert(a_hpp_hash, *entry));
+
+  llvm::Expected<build_graph::result> second = build();
+  EXPECT_THAT(second->graph[1].underlying_cost,
+              Eq(cost{1000, a_hpp_code.size() * B}));
+  std::filesystem::remove_all(cache_directory);
+}
+
 TEST_P(BuildGraphTest, MultipleChildren) {
   Graph g;
   const Graph::vertex_descriptor main_cpp =
@@ -410,6 +577,499 @@ TEST_P(BuildGraphTest, ExternalCode) {
   EXPECT_THAT(results->unguarded_files, IsEmpty());
 }
 
+// This component is a `FileSystem` that counts the number of times each
+// path has its status looked up or fails to be opened.
+class CountingFileSystem : public llvm::vfs::ProxyFileSystem {
+  std::mutex m_mutex;
+
+public:
+  std::map<std::string, int> statuses;
+  std::map<std::string, int> failed_opens;
+  std::map<std::string, int> listings;
+
+  explicit CountingFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+      : llvm::vfs::ProxyFileSystem(std::move(underlying)) {}
+
+  llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) final {
+    {
+      std::lock_guard lock(m_mutex);
+      ++statuses[path.str()];
+    }
+    return ProxyFileSystem::status(path);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine &path) final {
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> f =
+        ProxyFileSystem::openFileForRead(path);
+    if (!f) {
+      std::lock_guard lock(m_mutex);
+      ++failed_opens[path.str()];
+    }
+    return f;
+  }
+
+  llvm::vfs::directory_iterator dir_begin(const llvm::Twine &dir,
+                                          std::error_code &ec) final {
+    {
+      std::lock_guard lock(m_mutex);
+      ++listings[dir.str()];
+    }
+    return ProxyFileSystem::dir_begin(dir, ec);
+  }
+};
+
+// Test that each path is only looked up once, even though each source
+// searches the same include directories.
+TEST_P(BuildGraphTest, LookUpPathsOnce) {
+  auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::filesystem::path first = working_directory / "first";
+  const std::filesystem::path second = working_directory / "second";
+  for (const char *source : {"a.cpp", "b.cpp", "c.cpp"}) {
+    fs->addFile((working_directory / "src" / source).string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy("#include <x.hpp>\n"
+                                                     "#include <y.hpp>\n"));
+  }
+  fs->addFile((first / "x.hpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+  fs->addFile((second / "y.hpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+
+  auto counting = llvm::makeIntrusiveRefCnt<CountingFileSystem>(fs);
+  llvm::Expected<build_graph::result> results = build_graph::from_dir(
+      working_directory / "src",
+      {{first, clang::SrcMgr::C_User}, {second, clang::SrcMgr::C_User}},
+      counting, get_file_type, GetParam());
+  ASSERT_THAT(num_vertices(results->graph), Eq(5));
+  EXPECT_THAT(results->missing_includes, IsEmpty());
+
+  // `first/y.hpp` does not exist, but is checked for each source
+  EXPECT_THAT(counting->failed_opens,
+              Contains(Key((first / "y.hpp").string())));
+  for (const auto &[path, count] : counting->statuses) {
+    EXPECT_THAT(count, Eq(1)) << path;
+  }
+  for (const auto &[path, count] : counting->failed_opens) {
+    EXPECT_THAT(count, Eq(1)) << path;
+  }
+}
+
+// Test that with an index of the include directories, missing files within
+// them are never looked up and only the directories that are searched are
+// listed, each of them once.
+TEST(BuildGraph, IncludeIndex) {
+  auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::filesystem::path first = working_directory / "first";
+  const std::filesystem::path second = working_directory / "second";
+  fs->addFile((working_directory / "src" / "a.cpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#include <x.hpp>\n"
+                                                   "#include <sub/y.hpp>\n"
+                                                   "#include <missing.hpp>\n"));
+  fs->addFile((first / "x.hpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+  const std::filesystem::path sub_y_hpp =
+      std::filesystem::path("sub") / "y.hpp";
+  fs->addFile((second / sub_y_hpp).string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+  const std::filesystem::path unused = first / "unused";
+  fs->addFile((unused / "z.hpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+
+  for (const build_graph::options &options :
+       {build_graph::options().enable_include_index(true),
+        build_graph::options().enable_include_index(true).with_jobs(2)}) {
+    auto counting = llvm::makeIntrusiveRefCnt<CountingFileSystem>(fs);
+    llvm::Expected<build_graph::result> results = build_graph::from_dir(
+        working_directory / "src",
+        {{first, clang::SrcMgr::C_User}, {second, clang::SrcMgr::C_System}},
+        counting, get_file_type, options);
+    ASSERT_THAT(num_vertices(results->graph), Eq(3)) << options;
+    EXPECT_THAT(results->graph[1].path, Eq("x.hpp")) << options;
+    EXPECT_THAT(results->graph[2].path, Eq(sub_y_hpp)) << options;
+    EXPECT_THAT(results->graph[2].is_external, Eq(true)) << options;
+    EXPECT_THAT(results->missing_includes, ElementsAre("missing.hpp"))
+        << options;
+    for (const auto &[path, count] : counting->failed_opens) {
+      EXPECT_THAT(path, Not(StartsWith(first.string()))) << options;
+      EXPECT_THAT(path, Not(StartsWith(second.string()))) << options;
+    }
+    EXPECT_THAT(counting->listings, Not(IsEmpty())) << options;
+    for (const auto &[path, count] : counting->listings) {
+      EXPECT_THAT(path, Not(StartsWith(unused.string()))) << options;
+      EXPECT_THAT(count, Eq(1)) << path << options;
+    }
+  }
+}
+
+// Test that we record where each include was looked for but not found, so
+// that the includer is preprocessed again if a file is created there.
+TEST_P(BuildGraphTest, Lookups) {
+  auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::filesystem::path src = working_directory / "src";
+  const std::filesystem::path first = working_directory / "first";
+  const std::filesystem::path second = working_directory / "second";
+  fs->addFile((src / "a.cpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#include \"x.hpp\"\n"
+                                                   "#include <y.hpp>\n"
+                                                   "#include <missing.hpp>\n"));
+  fs->addFile((first / "y.hpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+  fs->addFile((second / "x.hpp").string(), 0,
+              llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+
+  llvm::Expected<build_graph::result> results = build_graph::from_dir(
+      src, {{first, clang::SrcMgr::C_User}, {second, clang::SrcMgr::C_System}},
+      fs, get_file_type,
+      build_graph::options(GetParam()).enable_record_lookups(true));
+  ASSERT_THAT(num_vertices(results->graph), Eq(3));
+  const file_node &a_cpp = results->graph[0];
+  EXPECT_THAT(a_cpp.missing_includes, ElementsAre("missing.hpp"));
+  EXPECT_THAT(a_cpp.absent_paths,
+              UnorderedElementsAre(src / "x.hpp", first / "x.hpp",
+                                   first / "missing.hpp",
+                                   second / "missing.hpp"));
+  EXPECT_THAT(results->graph[1].absent_paths, IsEmpty());
+  EXPECT_THAT(results->missing_includes, ElementsAre("missing.hpp"));
+
+  // Lookups are only recorded when asked for
+  results = build_graph::from_dir(
+      src, {{first, clang::SrcMgr::C_User}, {second, clang::SrcMgr::C_System}},
+      fs, get_file_type, GetParam());
+  ASSERT_THAT(num_vertices(results->graph), Eq(3));
+  EXPECT_THAT(results->graph[0].missing_includes, IsEmpty());
+  EXPECT_THAT(results->graph[0].absent_paths, IsEmpty());
+  EXPECT_THAT(results->missing_includes, ElementsAre("missing.hpp"));
+}
+
+// A compilation database where each source file is compiled with its own
+// extra arguments.
+class ArgumentsCompilationDatabase
+    : public clang::tooling::CompilationDatabase {
+  std::filesystem::path m_working_directory;
+  std::map<std::string, std::vector<std::string>> m_arguments;
+
+public:
+  ArgumentsCompilationDatabase(
+      const std::filesystem::path &working_directory,
+      std::map<std::string, std::vector<std::string>> arguments)
+      : m_working_directory(working_directory),
+        m_arguments(std::move(arguments)) {}
+
+  std::vector<clang::tooling::CompileCommand>
+  getCompileCommands(clang::StringRef FilePath) const final {
+    std::vector<std::string> things = {"/usr/bin/clang++", FilePath.str()};
+    const auto it = m_arguments.find(
+        std::filesystem::path(FilePath.str()).filename().string());
+    if (it != m_arguments.end()) {
+      things.insert(things.end(), it->second.begin(), it->second.end());
+    }
+    return {{m_working_directory.string(), FilePath, std::move(things), "out"}};
+  }
+};
+
+// Test that sources with the same arguments, which share a compiler
+// invocation, are still preprocessed as their own main file and that sources
+// with different arguments do not share an invocation.
+TEST(BuildGraph, SharedInvocations) {
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::string_view source_code = "#ifdef USE_X\n"
+                                       "#include \"x.hpp\"\n"
+                                       "#else\n"
+                                       "#include \"y.hpp\"\n"
+                                       "#endif\n";
+  const ArgumentsCompilationDatabase db(
+      working_directory, {{"a.cpp", {"-DUSE_X"}}, {"c.cpp", {"-DUSE_X"}}});
+  const std::vector<std::filesystem::path> sources = {
+      working_directory / "a.cpp", working_directory / "b.cpp",
+      working_directory / "c.cpp"};
+
+  for (const build_graph::options &options :
+       {build_graph::options(), build_graph::options().with_jobs(2)}) {
+    auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    for (const std::filesystem::path &source : sources) {
+      fs->addFile(source.string(), 0,
+                  llvm::MemoryBuffer::getMemBufferCopy(source_code));
+    }
+    for (const std::string_view header : {"x.hpp", "y.hpp"}) {
+      fs->addFile((working_directory / header).string(), 0,
+                  llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+    }
+
+    llvm::Expected<build_graph::result> results =
+        build_graph::from_compilation_db(db, working_directory, sources,
+                                         get_file_type, fs, options);
+    ASSERT_TRUE(static_cast<bool>(results)) << options;
+    std::map<std::filesystem::path, std::vector<std::string>> includes;
+    for (const Graph::vertex_descriptor source : results->sources) {
+      std::vector<std::string> &codes = includes[results->graph[source].path];
+      for (const Graph::edge_descriptor &edge :
+           boost::make_iterator_range(out_edges(source, results->graph))) {
+        codes.push_back(results->graph[edge].code.str());
+      }
+    }
+    EXPECT_THAT(includes,
+                ElementsAre(Pair(std::filesystem::path("a.cpp"),
+                                 ElementsAre("\"x.hpp\"")),
+                            Pair(std::filesystem::path("b.cpp"),
+                                 ElementsAre("\"y.hpp\"")),
+                            Pair(std::filesystem::path("c.cpp"),
+                                 ElementsAre("\"x.hpp\""))))
+        << options;
+  }
+}
+
+// This component is a `FileSystem` that counts how many of the buffers it
+// has returned are still alive, and the most that were alive at once.
+class LiveBufferFileSystem : public llvm::vfs::ProxyFileSystem {
+  class Buffer : public llvm::MemoryBuffer {
+    std::unique_ptr<llvm::MemoryBuffer> m_underlying;
+    LiveBufferFileSystem &m_fs;
+
+  public:
+    Buffer(std::unique_ptr<llvm::MemoryBuffer> underlying,
+           LiveBufferFileSystem &fs)
+        : m_underlying(std::move(underlying)), m_fs(fs) {
+      init(m_underlying->getBufferStart(), m_underlying->getBufferEnd(),
+           false);
+      std::lock_guard lock(m_fs.m_mutex);
+      m_fs.peak = std::max(m_fs.peak, ++m_fs.live);
+    }
+
+    ~Buffer() {
+      std::lock_guard lock(m_fs.m_mutex);
+      --m_fs.live;
+    }
+
+    BufferKind getBufferKind() const final {
+      return m_underlying->getBufferKind();
+    }
+  };
+
+  class File : public llvm::vfs::File {
+    std::unique_ptr<llvm::vfs::File> m_underlying;
+    LiveBufferFileSystem &m_fs;
+
+  public:
+    File(std::unique_ptr<llvm::vfs::File> underlying, LiveBufferFileSystem &fs)
+        : m_underlying(std::move(underlying)), m_fs(fs) {}
+
+    llvm::ErrorOr<llvm::vfs::Status> status() final {
+      return m_underlying->status();
+    }
+
+    llvm::ErrorOr<std::string> getName() final {
+      return m_underlying->getName();
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>>
+    getBuffer(const llvm::Twine &name, int64_t file_size,
+              bool requires_null_terminator, bool is_volatile) final {
+      llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+          m_underlying->getBuffer(name, file_size, requires_null_terminator,
+                                  is_volatile);
+      if (!buffer) {
+        return buffer;
+      }
+      return std::make_unique<Buffer>(std::move(*buffer), m_fs);
+    }
+
+    std::error_code close() final { return m_underlying->close(); }
+  };
+
+  std::mutex m_mutex;
+
+public:
+  int live = 0;
+  int peak = 0;
+
+  explicit LiveBufferFileSystem(
+      llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> underlying)
+      : llvm::vfs::ProxyFileSystem(std::move(underlying)) {}
+
+  llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>>
+  openFileForRead(const llvm::Twine &path) final {
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> f =
+        ProxyFileSystem::openFileForRead(path);
+    if (!f) {
+      return f;
+    }
+    return std::make_unique<File>(std::move(*f), *this);
+  }
+};
+
+// Test that running many sources through the same shared invocation frees
+// the file buffers of each translation unit once it has finished.
+TEST(BuildGraph, SharedInvocationsFreeTranslationUnits) {
+  const std::filesystem::path working_directory = root / "working_dir";
+  const ArgumentsCompilationDatabase db(working_directory, {});
+  std::vector<std::filesystem::path> sources;
+  for (int i = 0; i != 32; ++i) {
+    sources.push_back(working_directory / ("s" + std::to_string(i) + ".cpp"));
+  }
+
+  for (const build_graph::options &options :
+       {build_graph::options(), build_graph::options().with_jobs(2)}) {
+    auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    for (const std::filesystem::path &source : sources) {
+      fs->addFile(source.string(), 0,
+                  llvm::MemoryBuffer::getMemBufferCopy("#include \"x.hpp\"\n"));
+    }
+    fs->addFile((working_directory / "x.hpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+
+    auto counting = llvm::makeIntrusiveRefCnt<LiveBufferFileSystem>(fs);
+    llvm::Expected<build_graph::result> results =
+        build_graph::from_compilation_db(db, working_directory, sources,
+                                         get_file_type, counting, options);
+    ASSERT_TRUE(static_cast<bool>(results)) << options;
+    EXPECT_THAT(results->sources, SizeIs(sources.size())) << options;
+
+    // Each translation unit reads its source and `x.hpp`, so if they were
+    // leaked we would have a pair of buffers alive for every source
+    EXPECT_THAT(counting->peak, Le(8)) << options;
+  }
+}
+
+// Test that listing the same source again is preprocessed once and recorded
+// in its `weight` when deduplicating, and otherwise adds another source.
+TEST(BuildGraph, DeduplicateSources) {
+  const std::filesystem::path working_directory = root / "working_dir";
+  const ArgumentsCompilationDatabase db(working_directory,
+                                        {{"a.cpp", {"-DUSE_X"}}});
+  const std::vector<std::filesystem::path> sources = {
+      working_directory / "a.cpp", working_directory / "b.cpp",
+      working_directory / "a.cpp", working_directory / "a.cpp"};
+
+  for (const bool deduplicate : {false, true}) {
+    for (const unsigned jobs : {1u, 2u}) {
+      const build_graph::options options =
+          build_graph::options()
+              .enable_deduplicate_sources(deduplicate)
+              .with_jobs(jobs);
+      auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+      for (const std::string_view source : {"a.cpp", "b.cpp"}) {
+        fs->addFile(
+            (working_directory / source).string(), 0,
+            llvm::MemoryBuffer::getMemBufferCopy("#include \"x.hpp\"\n"));
+      }
+      fs->addFile((working_directory / "x.hpp").string(), 0,
+                  llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+
+      llvm::Expected<build_graph::result> results =
+          build_graph::from_compilation_db(db, working_directory, sources,
+                                           get_file_type, fs, options);
+      ASSERT_TRUE(static_cast<bool>(results)) << options;
+      std::vector<std::pair<std::filesystem::path, unsigned>> weights;
+      for (const Graph::vertex_descriptor source : results->sources) {
+        weights.emplace_back(results->graph[source].path,
+                             results->graph[source].weight);
+        EXPECT_THAT(out_degree(source, results->graph), Eq(1u)) << options;
+      }
+
+      if (deduplicate) {
+        EXPECT_THAT(weights, ElementsAre(Pair("a.cpp", 3u), Pair("b.cpp", 1u)))
+            << options;
+      } else {
+        EXPECT_THAT(weights, ElementsAre(Pair("a.cpp", 1u), Pair("b.cpp", 1u),
+                                         Pair("a.cpp", 1u), Pair("a.cpp", 1u)))
+            << options;
+      }
+    }
+  }
+}
+
+// Test that a header that defines different macros depending on the
+// command line is replaced separately for each definition of the macros it
+// tests when using `enable_replace_file_optimization`, and that the files it
+// includes with each definition are all recorded.
+TEST(BuildGraph, ReplacementsDependOnTestedMacros) {
+  const std::filesystem::path working_directory = root / "working_dir";
+  const std::string_view config_hpp_code = "#pragma once\n"
+                                           "#ifdef USE_X\n"
+                                           "#include \"config_x.hpp\"\n"
+                                           "#define CONFIG_X 1\n"
+                                           "#else\n"
+                                           "#include \"config_y.hpp\"\n"
+                                           "#define CONFIG_Y 1\n"
+                                           "#endif\n";
+  const std::string_view source_code = "#include \"config.hpp\"\n"
+                                       "#ifdef CONFIG_X\n"
+                                       "#include \"x.hpp\"\n"
+                                       "#endif\n"
+                                       "#ifdef CONFIG_Y\n"
+                                       "#include \"y.hpp\"\n"
+                                       "#endif\n";
+  const ArgumentsCompilationDatabase db(
+      working_directory, {{"a.cpp", {"-DUSE_X"}}, {"c.cpp", {"-DUSE_X"}}});
+  const std::vector<std::filesystem::path> sources = {
+      working_directory / "a.cpp", working_directory / "b.cpp",
+      working_directory / "c.cpp", working_directory / "d.cpp"};
+
+  for (const unsigned jobs : {1u, 2u}) {
+    const build_graph::options options =
+        build_graph::options()
+            .enable_replace_file_optimization(true)
+            .with_jobs(jobs);
+    auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+    for (const std::filesystem::path &source : sources) {
+      fs->addFile(source.string(), 0,
+                  llvm::MemoryBuffer::getMemBufferCopy(source_code));
+    }
+    fs->addFile((working_directory / "config.hpp").string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(config_hpp_code));
+    for (const std::string_view header :
+         {"x.hpp", "y.hpp", "config_x.hpp", "config_y.hpp"}) {
+      fs->addFile((working_directory / header).string(), 0,
+                  llvm::MemoryBuffer::getMemBufferCopy("#pragma once\n"));
+    }
+
+    llvm::Expected<build_graph::result> results =
+        build_graph::from_compilation_db(db, working_directory, sources,
+                                         get_file_type, fs, options);
+    ASSERT_TRUE(static_cast<bool>(results)) << options;
+    std::map<std::filesystem::path, std::vector<std::string>> includes;
+    for (const Graph::vertex_descriptor source : results->sources) {
+      std::vector<std::string> &codes = includes[results->graph[source].path];
+      for (const Graph::edge_descriptor &edge :
+           boost::make_iterator_range(out_edges(source, results->graph))) {
+        codes.push_back(results->graph[edge].code.str());
+      }
+    }
+    EXPECT_THAT(
+        includes,
+        ElementsAre(
+            Pair(std::filesystem::path("a.cpp"),
+                 ElementsAre("\"config.hpp\"", "\"x.hpp\"")),
+            Pair(std::filesystem::path("b.cpp"),
+                 ElementsAre("\"config.hpp\"", "\"y.hpp\"")),
+            Pair(std::filesystem::path("c.cpp"),
+                 ElementsAre("\"config.hpp\"", "\"x.hpp\"")),
+            Pair(std::filesystem::path("d.cpp"),
+                 ElementsAre("\"config.hpp\"", "\"y.hpp\""))))
+        << options;
+    EXPECT_THAT(num_vertices(results->graph), Eq(9u)) << options;
+
+    // `config.hpp` is read again in `b.cpp` as `USE_X` is not defined
+    std::vector<std::string> config_includes;
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(results->graph))) {
+      if (results->graph[v].path == "config.hpp") {
+        for (const Graph::edge_descriptor &edge :
+             boost::make_iterator_range(out_edges(v, results->graph))) {
+          config_includes.push_back(results->graph[edge].code.str());
+        }
+      }
+    }
+    EXPECT_THAT(config_includes,
+                ElementsAre("\"config_x.hpp\"", "\"config_y.hpp\""))
+        << options;
+  }
+}
+
 TEST_P(BuildGraphTest, UnremovableHeaders) {
   Graph g;
   const std::filesystem::path include = "include";
@@ -1067,9 +1727,70 @@ TEST_P(BuildGraphTest, RecursiveSource) {
   EXPECT_THAT(results->unguarded_files, UnorderedElementsAre(a_cpp));
 }
 
+// Test that preprocessing in parallel gives exactly the same result as
+// preprocessing serially, including the numbering of vertices.
+TEST(BuildGraphParallelTest, SameAsSerial) {
+  Graph g;
+  std::vector<Graph::vertex_descriptor> headers;
+  for (int i = 0; i < 20; ++i) {
+    headers.push_back(add_vertex(file_node("h" + std::to_string(i) + ".hpp")
+                                     .with_cost(i + 1, (10 * i + 1) * B),
+                                 g));
+    for (int j = 0; j < i; j += 3) {
+      const std::string code = "\"h" + std::to_string(j) + ".hpp\"";
+      add_edge(headers.back(), headers[j], {code, 2}, g);
+    }
+  }
+
+  for (int i = 0; i < 16; ++i) {
+    const Graph::vertex_descriptor source =
+        add_vertex(file_node("s" + std::to_string(i) + ".cpp")
+                       .with_cost(100 + i, (1000 + i) * B),
+                   g);
+    for (int j = (7 * i) % 20; j < 20; j += 4) {
+      const std::string code = "\"h" + std::to_string(j) + ".hpp\"";
+      add_edge(source, headers[j], {code, 2}, g);
+    }
+  }
+
+  const std::filesystem::path working_directory = root / "working_dir";
+  llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem> fs =
+      make_file_system(g, working_directory);
+
+  for (const bool replace : {false, true}) {
+    const build_graph::options opts =
+        build_graph::options().enable_replace_file_optimization(replace);
+    llvm::Expected<build_graph::result> serial =
+        build_graph::from_dir(working_directory, {}, fs, get_file_type, opts);
+    ASSERT_TRUE(static_cast<bool>(serial));
+    for (const unsigned jobs : {2u, 3u, 8u}) {
+      llvm::Expected<build_graph::result> parallel = build_graph::from_dir(
+          working_directory, {}, fs, get_file_type,
+          build_graph::options(opts).with_jobs(jobs));
+      ASSERT_TRUE(static_cast<bool>(parallel));
+      EXPECT_THAT(parallel->graph, GraphsAreEquivalent(serial->graph));
+      ASSERT_THAT(num_vertices(parallel->graph),
+                  Eq(num_vertices(serial->graph)));
+      for (const Graph::vertex_descriptor v :
+           boost::make_iterator_range(vertices(serial->graph))) {
+        EXPECT_THAT(parallel->graph[v].path, Eq(serial->graph[v].path));
+      }
+      EXPECT_THAT(parallel->sources, ElementsAreArray(serial->sources));
+      EXPECT_THAT(parallel->unguarded_files,
+                  UnorderedElementsAreArray(serial->unguarded_files));
+      EXPECT_THAT(parallel->missing_includes,
+                  ElementsAreArray(serial->missing_includes));
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(
     SmallFileOptimization, BuildGraphTest,
     Values(build_graph::options(),
-           build_graph::options().enable_replace_file_optimization(true)));
+           build_graph::options().enable_replace_file_optimization(true),
+           build_graph::options().with_jobs(4),
+           build_graph::options()
+               .enable_replace_file_optimization(true)
+               .with_jobs(4)));
 
 } // namespace
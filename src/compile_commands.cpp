@@ -0,0 +1,395 @@
+#include "compile_commands.hpp"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/ConvertUTF.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/StringSaver.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/predef.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <system_error>
+
+namespace IncludeGuardian {
+
+namespace {
+
+// This component scans JSON text without building a document.  Strings
+// are returned as views of their raw contents, still escaped.
+class Scanner {
+  std::string_view m_s;
+  std::size_t &m_pos;
+
+public:
+  Scanner(std::string_view s, std::size_t &pos) : m_s(s), m_pos(pos) {}
+
+  void skip_whitespace() {
+    while (m_pos < m_s.size() &&
+           std::isspace(static_cast<unsigned char>(m_s[m_pos]))) {
+      ++m_pos;
+    }
+  }
+
+  bool consume(char c) {
+    skip_whitespace();
+    if (m_pos < m_s.size() && m_s[m_pos] == c) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  std::optional<std::string_view> string() {
+    if (!consume('"')) {
+      return std::nullopt;
+    }
+    const std::size_t start = m_pos;
+    while (m_pos < m_s.size()) {
+      if (m_s[m_pos] == '\\') {
+        m_pos += 2;
+      } else if (m_s[m_pos] == '"') {
+        return m_s.substr(start, m_pos++ - start);
+      } else {
+        ++m_pos;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Skip over any value, returning `false` if it is not valid.
+  bool skip_value() {
+    skip_whitespace();
+    if (m_pos == m_s.size()) {
+      return false;
+    }
+
+    const char c = m_s[m_pos];
+    if (c == '"') {
+      return string().has_value();
+    }
+
+    if (c == '{' || c == '[') {
+      int depth = 0;
+      while (m_pos < m_s.size()) {
+        const char d = m_s[m_pos];
+        if (d == '"') {
+          if (!string()) {
+            return false;
+          }
+          continue;
+        }
+        ++m_pos;
+        if (d == '{' || d == '[') {
+          ++depth;
+        } else if ((d == '}' || d == ']') && --depth == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    const std::size_t start = m_pos;
+    while (m_pos < m_s.size() &&
+           std::string_view(",}] \t\r\n").find(m_s[m_pos]) ==
+               std::string_view::npos) {
+      ++m_pos;
+    }
+    return m_pos != start;
+  }
+};
+
+// Return the specified `escaped` JSON string contents without escapes,
+// using the specified `storage` only if it contains an escape.
+std::string_view unescape(std::string_view escaped, std::string &storage) {
+  if (escaped.find('\\') == std::string_view::npos) {
+    return escaped;
+  }
+
+  storage.clear();
+  for (std::size_t i = 0; i < escaped.size(); ++i) {
+    if (escaped[i] != '\\' || i + 1 == escaped.size()) {
+      storage += escaped[i];
+      continue;
+    }
+
+    const char c = escaped[++i];
+    switch (c) {
+    case 'b':
+      storage += '\b';
+      break;
+    case 'f':
+      storage += '\f';
+      break;
+    case 'n':
+      storage += '\n';
+      break;
+    case 'r':
+      storage += '\r';
+      break;
+    case 't':
+      storage += '\t';
+      break;
+    case 'u': {
+      const auto hex = [&](std::size_t at) {
+        unsigned value = 0;
+        if (at + 4 <= escaped.size()) {
+          std::from_chars(escaped.data() + at, escaped.data() + at + 4, value,
+                          16);
+        }
+        return value;
+      };
+      unsigned code_point = hex(i + 1);
+      i += 4;
+      if (code_point >= 0xD800 && code_point < 0xE000) {
+        // A high surrogate must be followed by a low surrogate, otherwise
+        // we replace it with U+FFFD like `llvm::json` does
+        const unsigned low =
+            escaped.substr(i + 1, 2) == "\\u" ? hex(i + 3) : 0u;
+        if (code_point < 0xDC00 && low >= 0xDC00 && low < 0xE000) {
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+          i += 6;
+        } else {
+          code_point = 0xFFFD;
+        }
+      }
+      char utf8[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+      char *end = utf8;
+      if (llvm::ConvertCodePointToUTF8(code_point, end)) {
+        storage.append(utf8, end);
+      }
+      break;
+    }
+    default: // '"', '\\' and '/'
+      storage += c;
+      break;
+    }
+  }
+  return storage;
+}
+
+std::string to_string(std::string_view escaped) {
+  std::string storage;
+  const std::string_view s = unescape(escaped, storage);
+  if (s.data() != storage.data()) {
+    storage.assign(s);
+  }
+  return storage;
+}
+
+llvm::Error malformed(std::size_t offset) {
+  return llvm::createStringError(
+      std::errc::invalid_argument,
+      "Invalid compilation database at offset %zu", offset);
+}
+
+} // namespace
+
+compile_commands_reader::compile_commands_reader()
+    : m_region(), m_buffer(), m_offset(0u), m_started(false),
+      m_finished(false), m_filter(), m_include(), m_exclude(),
+      m_arguments(), m_directory_storage(), m_file_storage(), m_path() {}
+
+bool compile_commands_reader::is_accepted(std::string_view directory,
+                                          std::string_view file) {
+  if (m_include.empty() && m_exclude.empty()) {
+    return true;
+  }
+
+  // Join `file` onto `directory` in buffers that are reused between
+  // commands, so that no memory is allocated once they are large enough
+  const std::string_view f = unescape(file, m_file_storage);
+  m_path.clear();
+  if (!llvm::sys::path::is_absolute(f)) {
+    m_path.append(unescape(directory, m_directory_storage));
+    if (!m_path.empty() && !llvm::sys::path::is_separator(m_path.back())) {
+      m_path += '/';
+    }
+  }
+  m_path.append(f);
+#if BOOST_OS_WINDOWS
+  std::replace(m_path.begin(), m_path.end(), '\\', '/');
+#endif
+
+  const auto matches = [&](const llvm::GlobPattern &glob) {
+    return glob.match(f) || glob.match(m_path);
+  };
+  return (m_include.empty() ||
+          std::any_of(m_include.begin(), m_include.end(), matches)) &&
+         std::none_of(m_exclude.begin(), m_exclude.end(), matches);
+}
+
+llvm::Expected<compile_commands_reader>
+compile_commands_reader::open(const std::filesystem::path &path,
+                              const filter &f) {
+  std::error_code ec;
+  const std::uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec) {
+    return llvm::createStringError(ec, "Unable to open '%s'",
+                                   path.string().c_str());
+  }
+  if (size == 0u) {
+    return malformed(0u);
+  }
+
+  std::shared_ptr<const boost::interprocess::mapped_region> region;
+  try {
+    const boost::interprocess::file_mapping mapping(
+        path.string().c_str(), boost::interprocess::read_only);
+    region = std::make_shared<const boost::interprocess::mapped_region>(
+        mapping, boost::interprocess::read_only);
+  } catch (const std::exception &e) {
+    return llvm::createStringError(std::errc::io_error,
+                                   "Unable to open '%s': %s",
+                                   path.string().c_str(), e.what());
+  }
+
+  llvm::Expected<compile_commands_reader> reader = from_buffer(
+      std::string_view(static_cast<const char *>(region->get_address()),
+                       region->get_size()),
+      f);
+  if (reader) {
+    reader->m_region = std::move(region);
+  }
+  return reader;
+}
+
+llvm::Expected<compile_commands_reader>
+compile_commands_reader::from_buffer(std::string_view contents,
+                                     const filter &f) {
+  compile_commands_reader reader;
+  reader.m_buffer = contents;
+  reader.m_filter = std::make_unique<const filter>(f);
+  for (const auto &[patterns, globs] :
+       {std::pair(&reader.m_filter->include, &reader.m_include),
+        std::pair(&reader.m_filter->exclude, &reader.m_exclude)}) {
+    for (const std::string &pattern : *patterns) {
+      llvm::Expected<llvm::GlobPattern> glob =
+          llvm::GlobPattern::create(pattern);
+      if (!glob) {
+        return glob.takeError();
+      }
+      globs->push_back(std::move(*glob));
+    }
+  }
+  return reader;
+}
+
+llvm::Expected<std::optional<compile_commands_reader::command>>
+compile_commands_reader::next() {
+  Scanner scanner(m_buffer, m_offset);
+  while (!m_finished) {
+    if (!m_started) {
+      if (!scanner.consume('[')) {
+        return malformed(m_offset);
+      }
+      m_started = true;
+      if (scanner.consume(']')) {
+        m_finished = true;
+        break;
+      }
+    } else if (scanner.consume(']')) {
+      m_finished = true;
+      break;
+    } else if (!scanner.consume(',')) {
+      return malformed(m_offset);
+    }
+
+    // Find the fields we need, leaving them escaped until we know that
+    // this command is accepted
+    std::string_view directory;
+    std::string_view file;
+    std::string_view output;
+    std::optional<std::string_view> command_line;
+    bool has_arguments = false;
+    m_arguments.clear();
+    if (!scanner.consume('{')) {
+      return malformed(m_offset);
+    }
+    if (!scanner.consume('}')) {
+      do {
+        const std::optional<std::string_view> key = scanner.string();
+        if (!key || !scanner.consume(':')) {
+          return malformed(m_offset);
+        }
+
+        std::optional<std::string_view> value;
+        if (*key == "arguments") {
+          has_arguments = true;
+          if (!scanner.consume('[')) {
+            return malformed(m_offset);
+          }
+          if (!scanner.consume(']')) {
+            do {
+              const std::optional<std::string_view> arg = scanner.string();
+              if (!arg) {
+                return malformed(m_offset);
+              }
+              m_arguments.push_back(*arg);
+            } while (scanner.consume(','));
+            if (!scanner.consume(']')) {
+              return malformed(m_offset);
+            }
+          }
+          continue;
+        } else if (*key == "directory" || *key == "file" ||
+                   *key == "output" || *key == "command") {
+          value = scanner.string();
+          if (!value) {
+            return malformed(m_offset);
+          }
+        } else if (!scanner.skip_value()) {
+          return malformed(m_offset);
+        }
+
+        if (*key == "directory") {
+          directory = *value;
+        } else if (*key == "file") {
+          file = *value;
+        } else if (*key == "output") {
+          output = *value;
+        } else if (*key == "command") {
+          command_line = *value;
+        }
+      } while (scanner.consume(','));
+      if (!scanner.consume('}')) {
+        return malformed(m_offset);
+      }
+    }
+
+    if (!is_accepted(directory, file)) {
+      continue;
+    }
+
+    command c;
+    c.directory = to_string(directory);
+    c.file = to_string(file);
+    c.output = to_string(output);
+    if (has_arguments) {
+      c.arguments.reserve(m_arguments.size());
+      for (const std::string_view arg : m_arguments) {
+        c.arguments.push_back(to_string(arg));
+      }
+    } else if (command_line) {
+      llvm::BumpPtrAllocator allocator;
+      llvm::StringSaver saver(allocator);
+      llvm::SmallVector<const char *, 64> args;
+      const std::string unescaped = to_string(*command_line);
+#if BOOST_OS_WINDOWS
+      llvm::cl::TokenizeWindowsCommandLine(unescaped, saver, args);
+#else
+      llvm::cl::TokenizeGNUCommandLine(unescaped, saver, args);
+#endif
+      c.arguments.assign(args.begin(), args.end());
+    }
+    return c;
+  }
+
+  return std::nullopt;
+}
+
+} // namespace IncludeGuardian
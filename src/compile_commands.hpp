@@ -0,0 +1,88 @@
+#ifndef INCLUDE_GUARD_6F86FD88_5A84_458F_8716_94F74E5BD0AB
+#define INCLUDE_GUARD_6F86FD88_5A84_458F_8716_94F74E5BD0AB
+
+// A `compile_commands.json` for a large project can be hundreds of
+// megabytes.  Instead of parsing the whole file into a JSON document and
+// then copying out every command, `compile_commands_reader` memory maps the
+// file and parses one command at a time.
+//
+// Commands can be filtered with glob patterns that are matched against the
+// source file, both as written and joined onto the command's directory.
+// Commands that are filtered out are skipped without allocating, as only
+// their directory and file are decoded, into buffers that are reused.
+
+#include <llvm/Support/Error.h>
+#include <llvm/Support/GlobPattern.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace boost::interprocess {
+class mapped_region;
+}
+
+namespace IncludeGuardian {
+
+class compile_commands_reader {
+public:
+  struct command {
+    std::string directory;
+    std::string file;
+    std::vector<std::string> arguments; //< Split from "command" if there is
+                                        //< no "arguments"
+    std::string output;
+  };
+
+  struct filter {
+    std::vector<std::string> include; //< If not empty, only commands for
+                                      //< files matching one of these are
+                                      //< read
+    std::vector<std::string> exclude; //< Commands for files matching any of
+                                      //< these are skipped
+  };
+
+private:
+  std::shared_ptr<const boost::interprocess::mapped_region> m_region;
+  std::string_view m_buffer;
+  std::size_t m_offset;
+  bool m_started;
+  bool m_finished;
+  std::unique_ptr<const filter> m_filter; // Owns the strings referenced by
+                                          // `m_include` and `m_exclude`
+  std::vector<llvm::GlobPattern> m_include;
+  std::vector<llvm::GlobPattern> m_exclude;
+  std::vector<std::string_view> m_arguments; // Reused between commands
+  std::string m_directory_storage;           // Reused between commands
+  std::string m_file_storage;                // Reused between commands
+  std::string m_path;                        // Reused between commands
+
+  compile_commands_reader();
+
+  bool is_accepted(std::string_view directory, std::string_view file);
+
+public:
+  /// Return a reader of the compilation database at the specified `path`
+  /// that only returns commands accepted by the specified `f`, or an error
+  /// if `path` cannot be opened or `f` contains an invalid glob.
+  static llvm::Expected<compile_commands_reader> open(
+      const std::filesystem::path &path, const filter &f = filter());
+
+  /// Return a reader of the compilation database with the specified
+  /// `contents`, which must outlive the reader, that only returns commands
+  /// accepted by the specified `f`.
+  static llvm::Expected<compile_commands_reader>
+  from_buffer(std::string_view contents, const filter &f = filter());
+
+  /// Return the next accepted command, an empty optional if there are no
+  /// more commands, or an error if the file is not valid.
+  llvm::Expected<std::optional<command>> next();
+};
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,168 @@
+#include "compile_commands.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+const std::string_view database = R"([
+  {
+    "directory": "/home/project",
+    "file": "src/a.cpp",
+    "arguments": ["clang++", "-DNAME=\"a\"", "-c", "src/a.cpp"],
+    "output": "a.o"
+  },
+  {
+    "file": "/home/project/test/b.cpp",
+    "command": "clang++ -I \"include dir\" -c test/b.cpp",
+    "unknown": {"nested": [1, 2, {"x": "]}"}]},
+    "directory": "/home/project"
+  },
+  {"directory": "/home/project", "file": "src/café.cpp",
+   "arguments": []}
+])";
+
+// Return the files of all commands read from the specified `reader`.
+std::vector<std::string> files(compile_commands_reader &reader) {
+  std::vector<std::string> result;
+  while (true) {
+    llvm::Expected<std::optional<compile_commands_reader::command>> c =
+        reader.next();
+    if (!c) {
+      ADD_FAILURE() << llvm::toString(c.takeError());
+      break;
+    }
+    if (!*c) {
+      break;
+    }
+    result.push_back((*c)->file);
+  }
+  return result;
+}
+
+TEST(CompileCommandsReader, Read) {
+  llvm::Expected<compile_commands_reader> reader =
+      compile_commands_reader::from_buffer(database);
+  ASSERT_TRUE(static_cast<bool>(reader));
+
+  llvm::Expected<std::optional<compile_commands_reader::command>> a =
+      reader->next();
+  ASSERT_TRUE(a && *a);
+  EXPECT_EQ((*a)->directory, "/home/project");
+  EXPECT_EQ((*a)->file, "src/a.cpp");
+  EXPECT_THAT((*a)->arguments,
+              ElementsAre("clang++", "-DNAME=\"a\"", "-c", "src/a.cpp"));
+  EXPECT_EQ((*a)->output, "a.o");
+
+  llvm::Expected<std::optional<compile_commands_reader::command>> b =
+      reader->next();
+  ASSERT_TRUE(b && *b);
+  EXPECT_EQ((*b)->directory, "/home/project");
+  EXPECT_EQ((*b)->file, "/home/project/test/b.cpp");
+  EXPECT_THAT((*b)->arguments,
+              ElementsAre("clang++", "-I", "include dir", "-c", "test/b.cpp"));
+
+  llvm::Expected<std::optional<compile_commands_reader::command>> c =
+      reader->next();
+  ASSERT_TRUE(c && *c);
+  EXPECT_EQ((*c)->file, "src/caf\xC3\xA9.cpp");
+  EXPECT_THAT((*c)->arguments, SizeIs(0));
+
+  for (int i = 0; i != 2; ++i) {
+    llvm::Expected<std::optional<compile_commands_reader::command>> end =
+        reader->next();
+    ASSERT_TRUE(static_cast<bool>(end));
+    EXPECT_FALSE(end->has_value());
+  }
+}
+
+TEST(CompileCommandsReader, Filter) {
+  llvm::Expected<compile_commands_reader> only_src =
+      compile_commands_reader::from_buffer(database, {{"src/*"}, {}});
+  ASSERT_TRUE(static_cast<bool>(only_src));
+  EXPECT_THAT(files(*only_src),
+              ElementsAre("src/a.cpp", "src/caf\xC3\xA9.cpp"));
+
+  // Patterns are also matched against the file joined to the directory
+  llvm::Expected<compile_commands_reader> not_a =
+      compile_commands_reader::from_buffer(database,
+                                           {{}, {"/home/project/src/a.*"}});
+  ASSERT_TRUE(static_cast<bool>(not_a));
+  EXPECT_THAT(files(*not_a), ElementsAre("/home/project/test/b.cpp",
+                                         "src/caf\xC3\xA9.cpp"));
+
+  llvm::Expected<compile_commands_reader> invalid =
+      compile_commands_reader::from_buffer(database, {{"[a"}, {}});
+  EXPECT_FALSE(static_cast<bool>(invalid));
+  llvm::consumeError(invalid.takeError());
+}
+
+TEST(CompileCommandsReader, Surrogates) {
+  llvm::Expected<compile_commands_reader> reader =
+      compile_commands_reader::from_buffer(R"([
+    {"directory": "/", "file": "\ud83d\ude00.cpp"},
+    {"directory": "/", "file": "\ud83d.cpp"},
+    {"directory": "/", "file": "\ud83d\u0041.cpp"},
+    {"directory": "/", "file": "\ude00.cpp"}
+  ])");
+  ASSERT_TRUE(static_cast<bool>(reader));
+
+  // Unpaired surrogates are replaced with U+FFFD
+  EXPECT_THAT(files(*reader),
+              ElementsAre("\xF0\x9F\x98\x80.cpp", "\xEF\xBF\xBD.cpp",
+                          "\xEF\xBF\xBD"
+                          "A.cpp",
+                          "\xEF\xBF\xBD.cpp"));
+}
+
+TEST(CompileCommandsReader, Invalid) {
+  for (const std::string_view contents :
+       {"", "{}", "[{\"file\": \"a.cpp\"", "[{\"file\": 1}]",
+        "[{\"file\": \"a.cpp\"} {\"file\": \"b.cpp\"}]"}) {
+    llvm::Expected<compile_commands_reader> reader =
+        compile_commands_reader::from_buffer(contents);
+    ASSERT_TRUE(static_cast<bool>(reader));
+    bool failed = false;
+    while (true) {
+      llvm::Expected<std::optional<compile_commands_reader::command>> c =
+          reader->next();
+      if (!c) {
+        llvm::consumeError(c.takeError());
+        failed = true;
+        break;
+      }
+      if (!*c) {
+        break;
+      }
+    }
+    EXPECT_TRUE(failed) << contents;
+  }
+}
+
+TEST(CompileCommandsReader, Open) {
+  const std::filesystem::path path =
+      std::filesystem::temp_directory_path() /
+      "includeguardian_compile_commands.json";
+  std::ofstream(path, std::ios::binary) << database;
+  llvm::Expected<compile_commands_reader> reader =
+      compile_commands_reader::open(path);
+  ASSERT_TRUE(static_cast<bool>(reader));
+  EXPECT_THAT(files(*reader), SizeIs(3));
+  std::filesystem::remove(path);
+
+  llvm::Expected<compile_commands_reader> missing =
+      compile_commands_reader::open(path);
+  EXPECT_FALSE(static_cast<bool>(missing));
+  llvm::consumeError(missing.takeError());
+}
+
+} // namespace
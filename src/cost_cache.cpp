@@ -0,0 +1,228 @@
+#include "cost_cache.hpp"
+
+#include <llvm/Support/Process.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace IncludeGuardian {
+
+namespace {
+
+constexpr char magic[8] = {'I', 'G', 'C', 'O', 'S', 'T', '\0', '\0'};
+
+constexpr std::uint32_t version = 3;
+
+// Written as a native integer so that we can detect files written on a
+// machine with a different byte order
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+template <typename T> void write(std::ostream &out, T value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void write(std::ostream &out, std::string_view s) {
+  write(out, std::uint64_t(s.size()));
+  out.write(s.data(), s.size());
+}
+
+// This component reads the values written by `write` from a buffer and
+// remembers whether it ran out of bytes.
+class Reader {
+  std::string_view m_buffer;
+  bool m_failed = false;
+
+public:
+  explicit Reader(std::string_view buffer) : m_buffer(buffer) {}
+
+  template <typename T> T read() {
+    T value{};
+    if (m_buffer.size() < sizeof(T)) {
+      m_failed = true;
+      m_buffer = {};
+      return value;
+    }
+    std::memcpy(&value, m_buffer.data(), sizeof(T));
+    m_buffer.remove_prefix(sizeof(T));
+    return value;
+  }
+
+  std::string_view read_string() {
+    const std::uint64_t size = read<std::uint64_t>();
+    if (m_buffer.size() < size) {
+      m_failed = true;
+      m_buffer = {};
+      return {};
+    }
+    const std::string_view s = m_buffer.substr(0, size);
+    m_buffer.remove_prefix(size);
+    return s;
+  }
+
+  bool failed() const { return m_failed; }
+};
+
+// Return the specified `directives` without any spaces at the end of each
+// line, which make up the majority of it.
+std::string trim_lines(std::string_view directives) {
+  std::string trimmed;
+  std::size_t spaces = 0;
+  for (const char c : directives) {
+    if (c == ' ') {
+      ++spaces;
+      continue;
+    }
+    if (c != '\n' && c != '\r') {
+      trimmed.append(spaces, ' ');
+    }
+    spaces = 0;
+    trimmed += c;
+  }
+  return trimmed;
+}
+
+} // namespace
+
+std::filesystem::path cost_cache::path(std::uint64_t key) const {
+  std::ostringstream name;
+  name << std::hex << std::setfill('0') << std::setw(16) << key;
+  return m_directory / name.str();
+}
+
+cost_cache::cost_cache(std::filesystem::path directory)
+    : m_directory(std::move(directory)) {
+  std::error_code ec;
+  std::filesystem::create_directories(m_directory, ec);
+}
+
+std::optional<cost_cache::entry> cost_cache::find(std::uint64_t key) const {
+  const std::filesystem::path p = path(key);
+  std::ifstream in(p, std::ios::binary);
+  if (!in) {
+    return std::nullopt;
+  }
+
+  const std::string buffer((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  if (buffer.size() < sizeof(magic) ||
+      std::memcmp(buffer.data(), magic, sizeof(magic)) != 0) {
+    return std::nullopt;
+  }
+
+  Reader reader(std::string_view(buffer).substr(sizeof(magic)));
+  if (reader.read<std::uint32_t>() != version ||
+      reader.read<std::uint32_t>() != byte_order_mark) {
+    return std::nullopt;
+  }
+
+  entry e;
+  e.c.token_count = reader.read<std::int64_t>();
+  e.c.file_size =
+      boost::units::quantity<boost::units::information::info>::from_value(
+          reader.read<double>());
+  const std::uint64_t directives_size = reader.read<std::uint64_t>();
+  e.directives = reader.read_string();
+  if (reader.failed() || e.directives.size() > directives_size) {
+    return std::nullopt;
+  }
+
+  // Pad the end so that the size matches the original file
+  e.directives.resize(directives_size, ' ');
+
+  // Entries are pruned by when they were last written, so touch this one
+  // to show that it is still used
+  std::error_code ec;
+  std::filesystem::last_write_time(
+      p, std::filesystem::file_time_type::clock::now(), ec);
+  return e;
+}
+
+bool cost_cache::insert(std::uint64_t key, const entry &e) const {
+  std::ostringstream out;
+  out.write(magic, sizeof(magic));
+  write(out, version);
+  write(out, byte_order_mark);
+  write(out, std::int64_t(e.c.token_count));
+  write(out, e.c.file_size.value());
+  write(out, std::uint64_t(e.directives.size()));
+  write(out, std::string_view(trim_lines(e.directives)));
+
+  // Write to a file unique to this process and call before renaming it, so
+  // that readers never see a partially written entry.
+  static std::atomic<std::uint64_t> counter = 0;
+  const std::filesystem::path destination = path(key);
+  std::filesystem::path temporary = destination;
+  temporary += "." + std::to_string(llvm::sys::Process::getProcessId()) + "." +
+               std::to_string(counter++) + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    const std::string contents = std::move(out).str();
+    file.write(contents.data(), contents.size());
+    if (!file) {
+      std::error_code ec;
+      std::filesystem::remove(temporary, ec);
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temporary, destination, ec);
+  if (ec) {
+    std::filesystem::remove(temporary, ec);
+    return false;
+  }
+  return true;
+}
+
+std::size_t cost_cache::prune(const std::uintmax_t max_bytes) const {
+  struct file {
+    std::filesystem::file_time_type last_used;
+    std::uintmax_t size;
+    std::filesystem::path path;
+  };
+
+  // Temporary files are skipped as they are about to be renamed
+  std::vector<file> files;
+  std::uintmax_t total = 0;
+  std::error_code ec;
+  for (const std::filesystem::directory_entry &entry :
+       std::filesystem::directory_iterator(m_directory, ec)) {
+    if (!entry.is_regular_file(ec) || entry.path().extension() == ".tmp") {
+      continue;
+    }
+    const std::uintmax_t size = entry.file_size(ec);
+    const std::filesystem::file_time_type last_used =
+        entry.last_write_time(ec);
+    if (!ec) {
+      files.push_back({last_used, size, entry.path()});
+      total += size;
+    }
+  }
+
+  std::sort(files.begin(), files.end(), [](const file &l, const file &r) {
+    return l.last_used < r.last_used;
+  });
+  std::size_t removed = 0;
+  for (auto it = files.begin(); it != files.end() && total > max_bytes;
+       ++it) {
+    if (std::filesystem::remove(it->path, ec)) {
+      total -= it->size;
+      ++removed;
+    }
+  }
+  return removed;
+}
+
+const std::filesystem::path &cost_cache::directory() const {
+  return m_directory;
+}
+
+} // namespace IncludeGuardian
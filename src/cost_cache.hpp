@@ -0,0 +1,67 @@
+#ifndef INCLUDE_GUARD_01B90963_10B7_4C35_9A82_17B44E4A4A11
+#define INCLUDE_GUARD_01B90963_10B7_4C35_9A82_17B44E4A4A11
+
+// Most headers, such as those of the standard library or third-party
+// libraries, do not change between runs, yet each run would otherwise lex
+// them again.  A `cost_cache` is a directory containing one file for each
+// header that has been read, named after a key that combines a hash of its
+// contents with the language options it was lexed with.  Files are lexed
+// without being preprocessed, so an entry only depends on its key and can be
+// shared between all translation units and builds.
+//
+// Entries are written to a temporary file and renamed into place, so a
+// cache directory can be shared between threads and processes.  Entries
+// that are missing, truncated or from a different version are treated as
+// misses.  The directory grows with each distinct file that is read, so
+// `prune` should be called to remove the least recently used entries.
+
+#include "cost.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace IncludeGuardian {
+
+class cost_cache {
+public:
+  struct entry {
+    cost c; //< The cost of lexing the file
+    std::string directives; //< The contents with everything other than the
+                            //< preprocessor directives removed (see
+                            //< `build_graph::options::directives_only`)
+  };
+
+private:
+  std::filesystem::path m_directory;
+
+  std::filesystem::path path(std::uint64_t key) const;
+
+public:
+  /// Create a `cost_cache` storing entries in the specified `directory`,
+  /// which is created if it does not exist.
+  explicit cost_cache(std::filesystem::path directory);
+
+  /// Return the entry with the specified `key`, or an empty optional if
+  /// there is none.  The entry is marked as recently used.
+  std::optional<entry> find(std::uint64_t key) const;
+
+  /// Store the specified `e` with the specified `key`, replacing any
+  /// existing entry.  Return `true` on success, and `false` if it could not
+  /// be written.
+  bool insert(std::uint64_t key, const entry &e) const;
+
+  /// Remove the least recently used entries until the total size of all
+  /// entries is at most the specified `max_bytes`.  Return the number of
+  /// entries removed.
+  std::size_t prune(std::uintmax_t max_bytes) const;
+
+  /// Return the directory containing the entries.
+  const std::filesystem::path &directory() const;
+};
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,115 @@
+#include "cost_cache.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+const auto B = boost::units::information::byte;
+
+// This component is a directory in the temporary directory that is removed
+// when destroyed.
+class TemporaryDirectory {
+  std::filesystem::path m_path;
+
+public:
+  explicit TemporaryDirectory(const std::string &name)
+      : m_path(std::filesystem::temp_directory_path() / name) {
+    std::error_code ec;
+    std::filesystem::remove_all(m_path, ec);
+  }
+  ~TemporaryDirectory() {
+    std::error_code ec;
+    std::filesystem::remove_all(m_path, ec);
+  }
+
+  const std::filesystem::path &path() const { return m_path; }
+};
+
+cost_cache::entry make_entry() {
+  cost_cache::entry e;
+  e.c = cost{42, 100 * B};
+  e.directives = "#pragma once  \n;   \r\n#include \"a.hpp\"\n   ";
+  return e;
+}
+
+TEST(CostCache, RoundTrip) {
+  const TemporaryDirectory dir("includeguardian_cost_cache_round_trip");
+  const cost_cache cache(dir.path() / "nested");
+  EXPECT_TRUE(std::filesystem::is_directory(dir.path() / "nested"));
+  EXPECT_FALSE(cache.find(1234u).has_value());
+
+  const cost_cache::entry expected = make_entry();
+  ASSERT_TRUE(cache.insert(1234u, expected));
+
+  const std::optional<cost_cache::entry> actual = cache.find(1234u);
+  ASSERT_TRUE(actual.has_value());
+  EXPECT_EQ(actual->c, expected.c);
+
+  // Trailing spaces on each line are not stored, but the line numbers and
+  // total size are the same
+  std::string directives = "#pragma once\n;\r\n#include \"a.hpp\"\n";
+  directives.resize(expected.directives.size(), ' ');
+  EXPECT_EQ(actual->directives, directives);
+
+  // Entries are separate for each key
+  EXPECT_FALSE(cache.find(1235u).has_value());
+  EXPECT_TRUE(cost_cache(dir.path() / "nested").find(1234u).has_value());
+}
+
+TEST(CostCache, InvalidEntry) {
+  const TemporaryDirectory dir("includeguardian_cost_cache_invalid");
+  const cost_cache cache(dir.path());
+  ASSERT_TRUE(cache.insert(1u, make_entry()));
+  ASSERT_EQ(std::distance(std::filesystem::directory_iterator(dir.path()),
+                          std::filesystem::directory_iterator()),
+            1);
+  const std::filesystem::path entry =
+      std::filesystem::directory_iterator(dir.path())->path();
+
+  // Truncate the entry
+  const std::uintmax_t size = std::filesystem::file_size(entry);
+  std::filesystem::resize_file(entry, size - 10u);
+  EXPECT_FALSE(cache.find(1u).has_value());
+
+  std::ofstream(entry, std::ios::binary | std::ios::trunc) << "garbage";
+  EXPECT_FALSE(cache.find(1u).has_value());
+}
+
+TEST(CostCache, Prune) {
+  const TemporaryDirectory dir("includeguardian_cost_cache_prune");
+  const cost_cache cache(dir.path());
+  for (std::uint64_t hash = 1u; hash <= 3u; ++hash) {
+    ASSERT_TRUE(cache.insert(hash, make_entry()));
+  }
+  const std::uintmax_t size =
+      std::filesystem::file_size(*std::filesystem::directory_iterator(
+          dir.path()));
+
+  // Make the entries look like they were used at different times, with
+  // the second one used most recently when found
+  const auto now = std::filesystem::file_time_type::clock::now();
+  for (const std::filesystem::directory_entry &entry :
+       std::filesystem::directory_iterator(dir.path())) {
+    std::filesystem::last_write_time(entry.path(), now - std::chrono::hours(1));
+  }
+  ASSERT_TRUE(cache.find(2u).has_value());
+
+  EXPECT_EQ(cache.prune(3u * size), 0u);
+  EXPECT_EQ(cache.prune(size), 2u);
+  EXPECT_FALSE(cache.find(1u).has_value());
+  EXPECT_TRUE(cache.find(2u).has_value());
+  EXPECT_FALSE(cache.find(3u).has_value());
+  EXPECT_EQ(cache.prune(0u), 1u);
+  EXPECT_FALSE(cache.find(2u).has_value());
+}
+
+} // namespace
@@ -0,0 +1,112 @@
+#include "crawl.hpp"
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/GlobPattern.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace IncludeGuardian {
+
+llvm::Expected<std::vector<std::filesystem::path>> crawl::find_files(
+    const std::filesystem::path &root, llvm::vfs::FileSystem &fs,
+    const std::function<bool(std::string_view)> &accept, const options &opts,
+    const std::function<void(const std::filesystem::path &)> &found) {
+  std::vector<llvm::GlobPattern> excludes;
+  for (const std::string &pattern : opts.exclude) {
+    llvm::Expected<llvm::GlobPattern> glob = llvm::GlobPattern::create(pattern);
+    if (!glob) {
+      return glob.takeError();
+    }
+    excludes.push_back(std::move(*glob));
+  }
+
+  const std::string root_string = root.string();
+  const auto is_excluded = [&](llvm::StringRef path) {
+    if (excludes.empty()) {
+      return false;
+    }
+
+    llvm::StringRef relative = path;
+    relative.consume_front(root_string);
+    const std::string generic =
+        std::filesystem::path(relative.ltrim("/\\").str()).generic_string();
+    const llvm::StringRef name = llvm::sys::path::filename(path);
+    return std::any_of(excludes.begin(), excludes.end(),
+                       [&](const llvm::GlobPattern &glob) {
+                         return glob.match(name) || glob.match(generic);
+                       });
+  };
+
+  // Directories are listed without holding `mutex`, and a thread only
+  // finishes once there are no directories waiting and none being listed,
+  // as these may contain more directories.
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::string> pending = {root_string};
+  unsigned listing = 0u;
+  std::vector<std::filesystem::path> files;
+  const auto worker = [&] {
+    std::unique_lock lock(mutex);
+    while (true) {
+      cv.wait(lock, [&] { return !pending.empty() || listing == 0u; });
+      if (pending.empty()) {
+        return;
+      }
+
+      const std::string directory = std::move(pending.back());
+      pending.pop_back();
+      ++listing;
+      lock.unlock();
+
+      std::vector<std::string> directories;
+      std::vector<std::filesystem::path> new_files;
+      std::error_code ec;
+      const llvm::vfs::directory_iterator end;
+      for (llvm::vfs::directory_iterator it = fs.dir_begin(directory, ec);
+           !ec && it != end; it.increment(ec)) {
+        if (is_excluded(it->path())) {
+          continue;
+        }
+
+        if (it->type() == llvm::sys::fs::file_type::directory_file) {
+          directories.push_back(it->path().str());
+        } else if (it->type() == llvm::sys::fs::file_type::regular_file &&
+                   accept(it->path())) {
+          new_files.emplace_back(it->path().str());
+        }
+      }
+
+      lock.lock();
+      --listing;
+      pending.insert(pending.end(),
+                     std::make_move_iterator(directories.begin()),
+                     std::make_move_iterator(directories.end()));
+      for (std::filesystem::path &file : new_files) {
+        if (found) {
+          found(file);
+        }
+        files.push_back(std::move(file));
+      }
+      cv.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1u; i < opts.jobs; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &t : threads) {
+    t.join();
+  }
+
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+} // namespace IncludeGuardian
@@ -0,0 +1,50 @@
+#ifndef INCLUDE_GUARD_53DCF52E_AB2C_45A6_A57D_FC409927E654
+#define INCLUDE_GUARD_53DCF52E_AB2C_45A6_A57D_FC409927E654
+
+// Finding every source file in a large checkout can take a long time when
+// each directory is listed one after another, especially on a network file
+// system.  `crawl` lists directories on several threads, which take the
+// next directory from a shared stack of those still to be listed.
+//
+// Files and directories can be excluded with glob patterns (e.g. ".git" or
+// "build*"), which are matched against both the name of each entry and its
+// path relative to the root using forward slashes.  Excluded directories
+// are not descended into.
+
+#include <llvm/Support/Error.h>
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace llvm::vfs {
+class FileSystem;
+}
+
+namespace IncludeGuardian {
+
+struct crawl {
+  struct options {
+    unsigned jobs = 1u; //< The number of directories to list concurrently
+    std::vector<std::string> exclude; //< Glob patterns of files and
+                                      //< directories to skip
+  };
+
+  /// Return, in sorted order, all regular files under the specified `root`
+  /// in the specified `fs` for which the specified `accept` returns `true`.
+  /// If the specified `found` is set, call it with each of these files as
+  /// soon as it is found; it is never called concurrently.  Return an error
+  /// if any pattern in `opts.exclude` is not a valid glob.
+  static llvm::Expected<std::vector<std::filesystem::path>>
+  find_files(const std::filesystem::path &root, llvm::vfs::FileSystem &fs,
+             const std::function<bool(std::string_view)> &accept,
+             const options &opts,
+             const std::function<void(const std::filesystem::path &)> &found =
+                 nullptr);
+};
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,86 @@
+#include "crawl.hpp"
+
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+const std::filesystem::path root = "/home/project";
+
+bool is_source(std::string_view file) { return file.ends_with(".cpp"); }
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::InMemoryFileSystem>
+make_file_system(const std::vector<std::filesystem::path> &files) {
+  auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  for (const std::filesystem::path &file : files) {
+    fs->addFile((root / file).string(), 0,
+                llvm::MemoryBuffer::getMemBufferCopy(""));
+  }
+  return fs;
+}
+
+TEST(Crawl, FindFiles) {
+  std::vector<std::filesystem::path> expected;
+  std::vector<std::filesystem::path> files = {"a.hpp", "c/d.hpp"};
+  for (int i = 0; i != 20; ++i) {
+    const std::filesystem::path dir = "dir" + std::to_string(i);
+    files.push_back(dir / "a.cpp");
+    files.push_back(dir / "a.hpp");
+    files.push_back(dir / "sub" / "b.cpp");
+    expected.push_back(root / dir / "a.cpp");
+    expected.push_back(root / dir / "sub" / "b.cpp");
+  }
+  files.push_back("main.cpp");
+  expected.push_back(root / "main.cpp");
+  std::sort(expected.begin(), expected.end());
+
+  const auto fs = make_file_system(files);
+  for (const unsigned jobs : {1u, 2u, 8u}) {
+    std::vector<std::filesystem::path> found;
+    llvm::Expected<std::vector<std::filesystem::path>> actual =
+        crawl::find_files(root, *fs, is_source, {jobs, {}},
+                          [&](const std::filesystem::path &file) {
+                            found.push_back(file);
+                          });
+    ASSERT_TRUE(static_cast<bool>(actual)) << jobs;
+    EXPECT_THAT(*actual, ElementsAreArray(expected)) << jobs;
+    EXPECT_THAT(found, UnorderedElementsAreArray(expected)) << jobs;
+  }
+}
+
+TEST(Crawl, Exclude) {
+  const auto fs = make_file_system({"main.cpp", ".git/hooks/x.cpp",
+                                    "build-debug/gen.cpp", "src/a.cpp",
+                                    "src/generated/b.cpp", "src/b.cpp",
+                                    "other/generated/c.cpp"});
+  const crawl::options opts = {4u, {".git", "build*", "src/generated"}};
+  llvm::Expected<std::vector<std::filesystem::path>> actual =
+      crawl::find_files(root, *fs, is_source, opts);
+  ASSERT_TRUE(static_cast<bool>(actual));
+  EXPECT_THAT(*actual, ElementsAre(root / "main.cpp",
+                                   root / "other" / "generated" / "c.cpp",
+                                   root / "src" / "a.cpp",
+                                   root / "src" / "b.cpp"));
+}
+
+TEST(Crawl, InvalidGlob) {
+  const auto fs = make_file_system({"main.cpp"});
+  llvm::Expected<std::vector<std::filesystem::path>> actual =
+      crawl::find_files(root, *fs, is_source, {1u, {"[a"}});
+  EXPECT_FALSE(static_cast<bool>(actual));
+  llvm::consumeError(actual.takeError());
+}
+
+} // namespace
@@ -0,0 +1,19 @@
+#include "dominator_tree.hpp"
+
+namespace IncludeGuardian {
+
+dominator_tree::dominator_tree() : m_post(), m_order(), m_idom(), m_stack() {}
+
+std::size_t dominator_tree::intersect(std::size_t lhs, std::size_t rhs) const {
+  while (lhs != rhs) {
+    while (m_post[lhs] < m_post[rhs]) {
+      lhs = m_idom[lhs];
+    }
+    while (m_post[rhs] < m_post[lhs]) {
+      rhs = m_idom[rhs];
+    }
+  }
+  return lhs;
+}
+
+} // namespace IncludeGuardian
@@ -0,0 +1,187 @@
+#ifndef INCLUDE_GUARD_A75957D3_8821_4C1C_A3DA_29B2AD3B86C4
+#define INCLUDE_GUARD_A75957D3_8821_4C1C_A3DA_29B2AD3B86C4
+
+// The files that would no longer be reachable from a source if part of the
+// include graph were removed are exactly the files dominated by that part in
+// the include graph rooted at the source.  `find_dominating_headers` and
+// `find_expensive_includes` both build a dominator tree for each source and
+// sum up the cost of each subtree, which gives the savings of removing every
+// part at once.
+//
+// The dominator tree is built using the iterative algorithm from "A Simple,
+// Fast Dominance Algorithm" by Cooper, Harvey and Kennedy.
+
+#include "cost.hpp"
+#include "graph.hpp"
+#include "graph_snapshot.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <functional>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace IncludeGuardian {
+
+class dominator_tree {
+public:
+  /// The value returned for a missing child or immediate dominator.
+  static constexpr std::size_t none = -1;
+
+private:
+  std::vector<std::size_t> m_post;  // vertex -> post-order number
+  std::vector<std::size_t> m_order; // post-order number -> vertex
+  std::vector<std::size_t> m_idom;  // vertex -> immediate dominator
+  std::vector<std::pair<std::size_t, std::size_t>> m_stack;
+
+  std::size_t intersect(std::size_t lhs, std::size_t rhs) const;
+
+public:
+  dominator_tree();
+
+  /// Build the dominator tree of all vertices reachable from the specified
+  /// `root` in a graph with the specified `vertex_count` vertices, where
+  /// `child(v, i)` returns the `i`th child of `v` or `none` if `v` has at
+  /// most `i` children, and `for_each_parent(v, visit)` calls `visit(p)`
+  /// for each parent `p` of `v`.  Any memory used by a previous tree is
+  /// reused.
+  template <typename CHILD, typename FOR_EACH_PARENT>
+  void build(std::size_t vertex_count, std::size_t root, CHILD child,
+             FOR_EACH_PARENT for_each_parent);
+
+  /// Return the vertices reachable from the root in post-order, which
+  /// always ends with the root and where every vertex comes before its
+  /// immediate dominator.
+  std::span<const std::size_t> post_order() const { return m_order; }
+
+  /// Return the immediate dominator of `v`, which is the root for the root
+  /// and `none` for vertices that are not reachable.
+  std::size_t immediate_dominator(std::size_t v) const { return m_idom[v]; }
+};
+
+/// Return the element-wise sum of the `size` savings added for each of the
+/// specified `sources` by `helper.add_savings(source, savings)`.  Sources
+/// are split into one chunk per thread and each chunk creates a single
+/// `helper` with `make_helper()`, so that it can reuse the memory for its
+/// dominator tree and savings.
+template <typename MAKE_HELPER>
+std::vector<cost>
+sum_savings_over_sources(std::span<const Graph::vertex_descriptor> sources,
+                         std::size_t size, MAKE_HELPER make_helper);
+
+/// Return the same as `sum_savings_over_sources`, but summed over each
+/// configuration of the specified `graph` separately, where each chunk
+/// creates its `helper` with `make_helper(configuration, mask)` using the
+/// arguments passed by `for_each_configuration`.
+template <typename MAKE_HELPER>
+std::vector<cost> sum_savings_over_configurations(
+    const graph_snapshot &graph,
+    std::span<const Graph::vertex_descriptor> sources, std::size_t size,
+    MAKE_HELPER make_helper);
+
+template <typename CHILD, typename FOR_EACH_PARENT>
+void dominator_tree::build(const std::size_t vertex_count,
+                           const std::size_t root, CHILD child,
+                           FOR_EACH_PARENT for_each_parent) {
+  // Number all vertices reachable from `root` in post-order, using `m_post`
+  // to mark vertices that are on the stack as it is always overwritten
+  // before it is read
+  m_post.assign(vertex_count, none);
+  m_order.clear();
+  m_post[root] = 0;
+  m_stack.emplace_back(root, 0u);
+  while (!m_stack.empty()) {
+    auto &[v, next] = m_stack.back();
+    const std::size_t c = child(v, next);
+    if (c == none) {
+      m_post[v] = m_order.size();
+      m_order.push_back(v);
+      m_stack.pop_back();
+      continue;
+    }
+
+    ++next;
+    if (m_post[c] == none) {
+      m_post[c] = 0;
+      m_stack.emplace_back(c, 0u);
+    }
+  }
+
+  m_idom.assign(vertex_count, none);
+  m_idom[root] = root;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    // Go through in reverse post-order, skipping `root` at the end
+    for (auto it = m_order.rbegin() + 1; it != m_order.rend(); ++it) {
+      const std::size_t v = *it;
+      std::size_t new_idom = none;
+      for_each_parent(v, [&](const std::size_t p) {
+        if (m_idom[p] != none) {
+          new_idom = new_idom == none ? p : intersect(p, new_idom);
+        }
+      });
+
+      if (m_idom[v] != new_idom) {
+        m_idom[v] = new_idom;
+        changed = true;
+      }
+    }
+  }
+}
+
+template <typename MAKE_HELPER>
+std::vector<cost>
+sum_savings_over_sources(std::span<const Graph::vertex_descriptor> sources,
+                         const std::size_t size, MAKE_HELPER make_helper) {
+  const std::size_t chunk_count = std::min<std::size_t>(
+      sources.size(), std::max(1u, std::thread::hardware_concurrency()));
+  std::vector<std::vector<cost>> chunk_savings(chunk_count,
+                                               std::vector<cost>(size));
+  std::vector<std::size_t> chunks(chunk_count);
+  std::iota(chunks.begin(), chunks.end(), std::size_t(0));
+  std::for_each(std::execution::par, chunks.begin(), chunks.end(),
+                [&](const std::size_t chunk) {
+                  auto helper = make_helper();
+                  for (std::size_t i = chunk; i < sources.size();
+                       i += chunk_count) {
+                    helper.add_savings(sources[i], chunk_savings[chunk]);
+                  }
+                });
+
+  std::vector<cost> savings(size);
+  for (const std::vector<cost> &chunk : chunk_savings) {
+    std::transform(savings.begin(), savings.end(), chunk.begin(),
+                   savings.begin(), std::plus<>());
+  }
+  return savings;
+}
+
+template <typename MAKE_HELPER>
+std::vector<cost> sum_savings_over_configurations(
+    const graph_snapshot &graph,
+    std::span<const Graph::vertex_descriptor> sources, const std::size_t size,
+    MAKE_HELPER make_helper) {
+  std::vector<cost> savings(size);
+  for_each_configuration(graph, [&](const graph_snapshot &configuration,
+                                    const std::uint32_t mask) {
+    const std::vector<cost> configuration_savings =
+        sum_savings_over_sources(sources, size, [&] {
+          return make_helper(configuration, mask);
+        });
+    std::transform(savings.begin(), savings.end(),
+                   configuration_savings.begin(), savings.begin(),
+                   std::plus<>());
+  });
+  return savings;
+}
+
+} // namespace IncludeGuardian
+
+#endif
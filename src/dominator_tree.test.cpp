@@ -0,0 +1,74 @@
+#include "dominator_tree.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+const auto B = boost::units::information::byte;
+
+// Return the dominator tree rooted at the specified `root` of the graph with
+// the specified `children` of each vertex.
+dominator_tree
+make_tree(const std::vector<std::vector<std::size_t>> &children,
+          std::size_t root) {
+  std::vector<std::vector<std::size_t>> parents(children.size());
+  for (std::size_t v = 0; v != children.size(); ++v) {
+    for (const std::size_t child : children[v]) {
+      parents[child].push_back(v);
+    }
+  }
+
+  dominator_tree tree;
+  tree.build(
+      children.size(), root,
+      [&](const std::size_t v, const std::size_t i) {
+        return i < children[v].size() ? children[v][i] : dominator_tree::none;
+      },
+      [&](const std::size_t v, auto visit) {
+        for (const std::size_t p : parents[v]) {
+          visit(p);
+        }
+      });
+  return tree;
+}
+
+// 0 includes 1 and 2, which both include 3, which is in a cycle with 4.  5
+// also includes 4 but is not reachable from 0.
+TEST(DominatorTree, Diamond) {
+  const dominator_tree tree =
+      make_tree({{1, 2}, {3}, {3}, {4}, {3}, {4}}, 0);
+  const std::vector<std::size_t> order(tree.post_order().begin(),
+                                       tree.post_order().end());
+  EXPECT_THAT(order, UnorderedElementsAre(0u, 1u, 2u, 3u, 4u));
+  EXPECT_THAT(order.back(), Eq(0u));
+  EXPECT_THAT(tree.immediate_dominator(0), Eq(0u));
+  EXPECT_THAT(tree.immediate_dominator(1), Eq(0u));
+  EXPECT_THAT(tree.immediate_dominator(2), Eq(0u));
+  EXPECT_THAT(tree.immediate_dominator(3), Eq(0u));
+  EXPECT_THAT(tree.immediate_dominator(4), Eq(3u));
+  EXPECT_THAT(tree.immediate_dominator(5), Eq(dominator_tree::none));
+}
+
+TEST(DominatorTree, SumSavingsOverSources) {
+  struct helper {
+    void add_savings(Graph::vertex_descriptor source,
+                     std::vector<cost> &savings) {
+      savings[source % savings.size()] += cost{1, 1 * B};
+    }
+  };
+
+  const std::vector<Graph::vertex_descriptor> sources = {0, 1, 2, 3, 4};
+  EXPECT_THAT(sum_savings_over_sources(sources, 2, [] { return helper(); }),
+              ElementsAre(cost{3, 3 * B}, cost{2, 2 * B}));
+  EXPECT_THAT(sum_savings_over_sources({}, 2, [] { return helper(); }),
+              ElementsAre(cost{}, cost{}));
+}
+
+} // namespace
@@ -0,0 +1,142 @@
+#include "find_dominating_headers.hpp"
+
+#include "dominator_tree.hpp"
+
+#include <boost/units/io.hpp>
+
+#include <ostream>
+#include <span>
+
+namespace IncludeGuardian {
+
+namespace {
+
+// This component calculates, for a single source, the cost of all files that
+// would no longer be reachable if each file were removed, which are the files
+// that it dominates.
+class DominatorHelper {
+  const graph_snapshot &m_graph;
+  dominator_tree m_tree;
+  std::vector<cost> m_subtree; // vertex -> cost of dominated vertices
+
+public:
+  explicit DominatorHelper(const graph_snapshot &graph)
+      : m_graph(graph), m_tree(), m_subtree() {}
+
+  // Add to `savings` the cost of all files that would no longer be
+  // reachable from `source` if each file were removed.
+  void add_savings(graph_snapshot::vertex_descriptor source,
+                   std::vector<cost> &savings) {
+    // Skip sources that are not compiled in this configuration
+    const int weight = static_cast<int>(m_graph.weight(source));
+    if (weight == 0) {
+      return;
+    }
+
+    m_tree.build(
+        m_graph.vertex_count(), source,
+        [&](const std::size_t v, const std::size_t i) {
+          const std::span<const graph_snapshot::vertex_descriptor> children =
+              m_graph.children(v);
+          return i < children.size() ? children[i] : dominator_tree::none;
+        },
+        [&](const std::size_t v, auto visit) {
+          for (const graph_snapshot::vertex_descriptor p :
+               m_graph.parents(v)) {
+            visit(p);
+          }
+        });
+
+    // Dominators always come later in post-order, so we can sum up the
+    // cost of each subtree in a single pass.
+    m_subtree.assign(m_graph.vertex_count(), cost{});
+    for (const std::size_t v : m_tree.post_order()) {
+      m_subtree[v] += m_graph.true_cost(v);
+      if (v != source) {
+        m_subtree[m_tree.immediate_dominator(v)] += m_subtree[v];
+      }
+    }
+
+    for (const std::size_t v : m_tree.post_order()) {
+      savings[v] += m_subtree[v] * weight;
+    }
+  }
+};
+
+} // namespace
+
+bool operator==(const find_dominating_headers::result &lhs,
+                const find_dominating_headers::result &rhs) {
+  return lhs.v == rhs.v && lhs.saving == rhs.saving;
+}
+
+bool operator!=(const find_dominating_headers::result &lhs,
+                const find_dominating_headers::result &rhs) {
+  return !(lhs == rhs);
+}
+
+std::ostream &operator<<(std::ostream &out,
+                         const find_dominating_headers::result &v) {
+  return out << '[' << v.v << " saving=" << v.saving << ']';
+}
+
+std::vector<find_dominating_headers::result>
+find_dominating_headers::from_graph(
+    const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
+    const std::int64_t minimum_token_count_cut_off) {
+  return from_graph(graph_snapshot(graph), sources,
+                    minimum_token_count_cut_off);
+}
+
+std::vector<find_dominating_headers::result>
+find_dominating_headers::from_graph(
+    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
+    const std::int64_t minimum_token_count_cut_off) {
+  return from_graph(graph, std::span(sources.begin(), sources.end()),
+                    minimum_token_count_cut_off);
+}
+
+std::vector<find_dominating_headers::result>
+find_dominating_headers::from_graph(
+    const graph_snapshot &graph,
+    std::span<const Graph::vertex_descriptor> sources,
+    const std::int64_t minimum_token_count_cut_off) {
+  std::vector<result> results;
+  if (sources.empty()) {
+    return results;
+  }
+
+  const std::size_t V = graph.vertex_count();
+  const std::vector<cost> savings = sum_savings_over_configurations(
+      graph, sources, V,
+      [](const graph_snapshot &configuration, std::uint32_t) {
+        return DominatorHelper(configuration);
+      });
+
+  std::vector<bool> is_source(V, false);
+  for (const Graph::vertex_descriptor source : sources) {
+    is_source[source] = true;
+  }
+
+  for (Graph::vertex_descriptor v = 0; v != V; ++v) {
+    // Sources can't be removed without removing the whole translation unit
+    if (is_source[v]) {
+      continue;
+    }
+
+    const cost saved = savings[v];
+
+    // Skip headers where there is nothing to save, which includes all
+    // headers that are not reachable from any source
+    if (saved == cost{}) {
+      continue;
+    }
+
+    if (saved.token_count >= minimum_token_count_cut_off) {
+      results.push_back({v, saved});
+    }
+  }
+  return results;
+}
+
+} // namespace IncludeGuardian
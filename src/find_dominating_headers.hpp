@@ -0,0 +1,78 @@
+#ifndef INCLUDE_GUARD_C7768DD6_359C_4877_A698_A77F02F5BAD1
+#define INCLUDE_GUARD_C7768DD6_359C_4877_A698_A77F02F5BAD1
+
+// We want to determine, for every header `H`, how much would be saved
+// if `H` were empty.  Not only would we no longer pay for `H` itself,
+// but we would no longer pay for any file that is only included through
+// `H`.
+//
+// For example, given the set of files below:
+//
+//   +-----------------------------------+
+//   | foo.cpp     main.cpp      bar.cpp |
+//   |      \     /        \    /        |
+//   |       \   /          \  /         |
+//   |      foo.hpp       bar.hpp        |
+//   |         \            /  \         |
+//   |          \          /    \        |
+//   |           common.hpp    large.hpp |
+//   |               |                   |
+//   |               |                   |
+//   |            zorb.hpp               |
+//   +-----------------------------------+
+//
+// Emptying `bar.hpp` would save `bar.hpp` and `large.hpp` from both
+// `main.cpp` and `bar.cpp`, but not `common.hpp` as that is still
+// included through `foo.hpp` in `main.cpp`.
+//
+// The files that would disappear from a source are exactly those
+// dominated by `H` in the include graph rooted at that source, so
+// we build a dominator tree for each source and sum up the costs of
+// each subtree, which gives the result for all headers at once.
+
+#include "graph.hpp"
+#include "graph_snapshot.hpp"
+
+#include <initializer_list>
+#include <iosfwd>
+#include <span>
+#include <vector>
+
+namespace IncludeGuardian {
+
+struct find_dominating_headers {
+  struct result {
+    Graph::vertex_descriptor v; //< The header file
+    cost saving; //< The saving if the header and all files only reachable
+                 // through it were removed
+  };
+
+  /// Return the list of header files reachable from the specified `sources`
+  /// in the specified `graph` along with the total cost saved across all
+  /// sources if the header, and all files that are only included through
+  /// it, were empty.  Only return headers whose saving has a token count
+  /// of at least `minimum_token_count_cut_off`.
+  static std::vector<result>
+  from_graph(const Graph &graph,
+             std::span<const Graph::vertex_descriptor> sources,
+             std::int64_t minimum_token_count_cut_off = 0);
+  static std::vector<result>
+  from_graph(const Graph &graph,
+             std::initializer_list<Graph::vertex_descriptor> sources,
+             std::int64_t minimum_token_count_cut_off = 0);
+  static std::vector<result>
+  from_graph(const graph_snapshot &graph,
+             std::span<const Graph::vertex_descriptor> sources,
+             std::int64_t minimum_token_count_cut_off = 0);
+};
+
+bool operator==(const find_dominating_headers::result &lhs,
+                const find_dominating_headers::result &rhs);
+bool operator!=(const find_dominating_headers::result &lhs,
+                const find_dominating_headers::result &rhs);
+std::ostream &operator<<(std::ostream &out,
+                         const find_dominating_headers::result &v);
+
+} // namespace IncludeGuardian
+
+#endif
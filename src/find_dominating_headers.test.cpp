@@ -0,0 +1,114 @@
+#include "find_dominating_headers.hpp"
+
+#include "analysis_test_fixtures.hpp"
+#include "get_total_cost.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+using result = find_dominating_headers::result;
+
+// Check that every result from `find_dominating_headers` matches the
+// difference in `get_total_cost` after removing all edges to and from the
+// header.
+void expect_matches_total_cost(
+    const Graph &graph, std::span<const Graph::vertex_descriptor> sources) {
+  const cost total = get_total_cost::from_graph(graph, sources).true_cost;
+  for (const result &r :
+       find_dominating_headers::from_graph(graph, sources, INT64_MIN)) {
+    Graph copy = graph;
+    clear_vertex(r.v, copy);
+    EXPECT_EQ(r.saving,
+              total - get_total_cost::from_graph(copy, sources).true_cost)
+        << graph[r.v].path;
+  }
+}
+
+TEST_F(DiamondGraph, FindDominatingHeaders) {
+  EXPECT_THAT(find_dominating_headers::from_graph(graph, sources()),
+              UnorderedElementsAreArray({
+                  result{b, B},
+                  result{c, C},
+                  result{d, D},
+              }));
+  expect_matches_total_cost(graph, sources());
+}
+
+TEST_F(MultiLevel, FindDominatingHeaders) {
+  EXPECT_THAT(find_dominating_headers::from_graph(graph, sources()),
+              UnorderedElementsAreArray({
+                  result{c, C},
+                  result{d, 2 * D + F},
+                  result{e, E + G},
+                  result{f, 2 * F + H},
+                  result{g, G},
+                  result{h, 2 * H},
+              }));
+  expect_matches_total_cost(graph, sources());
+}
+
+TEST_F(LongChain, FindDominatingHeaders) {
+  EXPECT_THAT(find_dominating_headers::from_graph(graph, sources()),
+              UnorderedElementsAreArray({
+                  result{b, B},
+                  result{c, C},
+                  result{d, D + E + F + G + H + I + J},
+                  result{e, E},
+                  result{f, F},
+                  result{g, G + H},
+                  result{h, H},
+                  result{i, I},
+                  result{j, J},
+              }));
+  expect_matches_total_cost(graph, sources());
+}
+
+TEST_F(ComplexCascadingInclude, FindDominatingHeaders) {
+  EXPECT_THAT(find_dominating_headers::from_graph(graph, sources()),
+              UnorderedElementsAreArray({
+                  result{a_h, 2 * A_H + 2 * B_H + 2 * C_H + 2 * D_H + F_H},
+                  result{b_h, 3 * B_H + 3 * C_H + 3 * D_H + 2 * F_H},
+                  result{c_h, 4 * C_H + 4 * D_H},
+                  result{d_h, 5 * D_H},
+                  result{e_h, 2 * E_H + F_H},
+                  result{f_h, 4 * F_H},
+                  result{s_h, S_H},
+              }));
+  expect_matches_total_cost(graph, sources());
+}
+
+TEST_F(ComplexCascadingInclude, FindDominatingHeadersCutOff) {
+  EXPECT_THAT(find_dominating_headers::from_graph(graph, sources(),
+                                                  (4 * F_H).token_count),
+              UnorderedElementsAreArray({
+                  result{f_h, 4 * F_H},
+              }));
+}
+
+// Test a larger graph with cycles against `get_total_cost`
+TEST(FindDominatingHeaders, Cycles) {
+  constexpr int SIZE = 60;
+  Graph graph;
+  for (int i = 0; i != SIZE; ++i) {
+    const cost size{i + 1, (i + 1.0) * boost::units::information::byte};
+    add_vertex(file_node(std::to_string(i)).with_cost(size), graph);
+  }
+  for (int i = 0; i != SIZE; ++i) {
+    add_edge(i, (i * 7 + 3) % SIZE, {"x"}, graph);
+    if (i % 5 == 0) {
+      add_edge(i, (i * 13 + 11) % SIZE, {"y"}, graph);
+    }
+  }
+
+  const Graph::vertex_descriptor sources[] = {0, 5, 17, 42};
+  expect_matches_total_cost(graph, sources);
+}
+
+} // namespace
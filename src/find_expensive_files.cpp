@@ -27,30 +27,46 @@ std::ostream &operator<<(std::ostream &out, const file_and_cost &v) {
 std::vector<file_and_cost> find_expensive_files::from_graph(
     const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
     const int minimum_token_count_cut_off) {
+  return from_graph(graph, graph_snapshot(graph), sources,
+                    minimum_token_count_cut_off);
+}
+
+std::vector<file_and_cost> find_expensive_files::from_graph(
+    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off) {
+  return from_graph(graph, std::span(sources.begin(), sources.end()),
+                    minimum_token_count_cut_off);
+}
+
+std::vector<file_and_cost> find_expensive_files::from_graph(
+    const Graph &graph, const graph_snapshot &snapshot,
+    std::span<const Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off) {
   std::mutex m;
   std::vector<file_and_cost> results;
   if (sources.empty()) {
     return results;
   }
 
-  reachability_graph reach(graph);
+  source_reachability_graph reach(graph, sources);
 
   const auto [begin, end] = vertices(graph);
   std::for_each(
       std::execution::par, begin, end,
       [&](const Graph::vertex_descriptor file) {
         // Ignore all files we have no control over
-        if (graph[file].is_external) {
+        if (snapshot.is_external(file)) {
           return;
         }
 
         const double reachable_count = std::accumulate(
             sources.begin(), sources.end(), 0.0,
             [&](const double count, const Graph::vertex_descriptor source) {
-              return count + reach.is_reachable(source, file);
+              return count + reach.is_reachable(source, file) *
+                                 snapshot.weight(source);
             });
 
-        if (reachable_count * graph[file].true_cost().token_count >=
+        if (reachable_count * snapshot.true_cost(file).token_count >=
             minimum_token_count_cut_off) {
           // There are ways to avoid this mutex, but if the
           // `minimum_size_cut_off` is large enough, it's relatively rare to
@@ -62,11 +78,4 @@ std::vector<file_and_cost> find_expensive_files::from_graph(
   return results;
 }
 
-std::vector<file_and_cost> find_expensive_files::from_graph(
-    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
-    const int minimum_token_count_cut_off) {
-  return from_graph(graph, std::span(sources.begin(), sources.end()),
-                    minimum_token_count_cut_off);
-}
-
 } // namespace IncludeGuardian
@@ -2,6 +2,7 @@
 #define INCLUDE_GUARD_AA4F6A18_E09D_419B_B133_5E8DDD0D995A
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <initializer_list>
 #include <iosfwd>
@@ -36,6 +37,13 @@ struct find_expensive_files {
   from_graph(const Graph &graph,
              std::initializer_list<Graph::vertex_descriptor> sources,
              int minimum_token_count_cut_off = 0);
+
+  /// Return the same as above, using the specified `snapshot`, which must
+  /// have been taken of `graph`, instead of taking a new one.
+  static std::vector<file_and_cost>
+  from_graph(const Graph &graph, const graph_snapshot &snapshot,
+             std::span<const Graph::vertex_descriptor> sources,
+             int minimum_token_count_cut_off = 0);
 };
 
 } // namespace IncludeGuardian
@@ -2,11 +2,11 @@
 
 #include "dfs.hpp"
 #include "get_total_cost.hpp"
-#include "reachability_graph.hpp"
 
 #include <boost/units/io.hpp>
 
 #include <execution>
+#include <functional>
 #include <iomanip>
 #include <list>
 #include <numeric>
@@ -34,7 +34,9 @@ from_graph_ref(const G &graph,
             total.precompiled += graph[v]->underlying_cost;
           }
         }
-        return total;
+        const int weight = static_cast<int>(graph[source]->weight);
+        return get_total_cost::result{total.true_cost * weight,
+                                      total.precompiled * weight};
       });
   return std::reduce(source_cost.begin(), source_cost.end());
 }
@@ -43,7 +45,7 @@ from_graph_ref(const G &graph,
 // `source` if no files ever included `file` + an optional extra cost that
 // would occur if we needed to add a new source file.
 std::optional<cost> total_file_size_of_unreachable(
-    const Graph &graph, cost cost_before,
+    const Graph &graph, const graph_snapshot &snapshot, cost cost_before,
     std::span<const Graph::vertex_descriptor> sources,
     Graph::vertex_descriptor file,
     const std::int64_t minimum_token_count_cut_off) {
@@ -55,11 +57,16 @@ std::optional<cost> total_file_size_of_unreachable(
   }
 
   const cost best_case_saving =
-      get_total_cost::from_graph(graph, {file}).true_cost;
+      get_total_cost::from_graph(snapshot, {file}).true_cost;
 
   // If **every** source saved the full amount and this
   // doesn't hit the target we can exit early
-  if (static_cast<std::int64_t>(best_case_saving.token_count * sources.size()) <
+  const std::int64_t total_weight = std::transform_reduce(
+      sources.begin(), sources.end(), std::int64_t(0), std::plus<>(),
+      [&](const Graph::vertex_descriptor source) {
+        return std::int64_t(graph[source].weight);
+      });
+  if (best_case_saving.token_count * total_weight <
       minimum_token_count_cut_off) {
     return std::nullopt;
   }
@@ -153,19 +160,36 @@ std::vector<find_expensive_headers::result> find_expensive_headers::from_graph(
     const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
     const std::int64_t minimum_token_count_cut_off,
     const unsigned maximum_dependencies) {
+  return from_graph(graph, graph_snapshot(graph), sources,
+                    minimum_token_count_cut_off, maximum_dependencies);
+}
+
+std::vector<find_expensive_headers::result> find_expensive_headers::from_graph(
+    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
+    const std::int64_t minimum_token_count_cut_off,
+    const unsigned maximum_dependencies) {
+  return from_graph(graph, std::span(sources.begin(), sources.end()),
+                    minimum_token_count_cut_off, maximum_dependencies);
+}
+
+std::vector<find_expensive_headers::result> find_expensive_headers::from_graph(
+    const Graph &graph, const graph_snapshot &snapshot,
+    std::span<const Graph::vertex_descriptor> sources,
+    const std::int64_t minimum_token_count_cut_off,
+    const unsigned maximum_dependencies) {
   std::mutex m;
   std::vector<find_expensive_headers::result> results;
   if (sources.empty()) {
     return results;
   }
 
-  reachability_graph reach(graph);
   std::vector<bool> is_source(num_vertices(graph));
   for (const Graph::vertex_descriptor source : sources) {
     is_source[source] = true;
   }
 
-  const cost cost_before = get_total_cost::from_graph(graph, sources).true_cost;
+  const cost cost_before =
+      get_total_cost::from_graph(snapshot, sources).true_cost;
   const auto [begin, end] = vertices(graph);
   std::for_each(
       std::execution::par, begin, end,
@@ -177,7 +201,8 @@ std::vector<find_expensive_headers::result> find_expensive_headers::from_graph(
         }
 
         const std::optional<cost> saving = total_file_size_of_unreachable(
-            graph, cost_before, sources, file, minimum_token_count_cut_off);
+            graph, snapshot, cost_before, sources, file,
+            minimum_token_count_cut_off);
 
         if (saving.has_value() &&
             saving->token_count >= minimum_token_count_cut_off) {
@@ -192,14 +217,6 @@ std::vector<find_expensive_headers::result> find_expensive_headers::from_graph(
   return results;
 }
 
-std::vector<find_expensive_headers::result> find_expensive_headers::from_graph(
-    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
-    const std::int64_t minimum_token_count_cut_off,
-    const unsigned maximum_dependencies) {
-  return from_graph(graph, std::span(sources.begin(), sources.end()),
-                    minimum_token_count_cut_off, maximum_dependencies);
-}
-
 bool operator==(const find_expensive_headers::result &lhs,
                 const find_expensive_headers::result &rhs) {
   return lhs.v == rhs.v && lhs.saving == rhs.saving &&
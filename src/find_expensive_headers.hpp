@@ -44,6 +44,7 @@
 // compared to the size of `common.cpp`.
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <initializer_list>
 #include <iosfwd>
@@ -74,6 +75,14 @@ struct find_expensive_headers {
              std::initializer_list<Graph::vertex_descriptor> sources,
              std::int64_t minimum_token_count_cut_off = 0,
              unsigned maximum_dependencies = UINT_MAX);
+
+  /// Return the same as above, using the specified `snapshot`, which must
+  /// have been taken of `graph`, instead of taking a new one.
+  static std::vector<result>
+  from_graph(const Graph &graph, const graph_snapshot &snapshot,
+             std::span<const Graph::vertex_descriptor> sources,
+             std::int64_t minimum_token_count_cut_off = 0,
+             unsigned maximum_dependencies = UINT_MAX);
 };
 
 bool operator==(const find_expensive_headers::result &lhs,
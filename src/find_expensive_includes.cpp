@@ -1,4 +1,6 @@
 #include "find_expensive_includes.hpp"
+
+#include "dominator_tree.hpp"
 #include "reachability_graph.hpp"
 
 #ifndef NDEBUG
@@ -12,7 +14,9 @@
 #include <execution>
 #include <iomanip>
 #include <mutex>
+#include <numeric>
 #include <ostream>
+#include <utility>
 
 // Future improvements:
 //  * We could avoid calling `fill_n` in `total_file_size_of_unreachable` for
@@ -24,6 +28,15 @@ namespace IncludeGuardian {
 
 namespace {
 
+// Return whether the specified `include` was seen in every configuration in
+// which the file containing it was seen.  Includes that depend on the
+// configuration may be needed in the configurations where they are used.
+bool in_all_configurations(const Graph &graph,
+                           const Graph::edge_descriptor &include) {
+  return (graph[source(include, graph)].configurations &
+          ~graph[include].configurations) == 0u;
+}
+
 class DFSHelper {
   enum class search_state : std::uint8_t {
     not_seen,      // not found yet
@@ -32,14 +45,21 @@ class DFSHelper {
   };
 
   const Graph &m_graph;
-  const reachability_graph<file_node, include_edge> &m_reach;
+  const graph_snapshot &m_snapshot;
+  const source_reachability_graph<file_node, include_edge> &m_reach;
+  std::uint32_t m_mask;
   std::unique_ptr<search_state[]> m_state;
   std::vector<Graph::vertex_descriptor> m_stack;
 
 public:
-  explicit DFSHelper(const Graph &graph,
-                     const reachability_graph<file_node, include_edge> &reach)
-      : m_graph(graph), m_reach(reach),
+  // Create a `DFSHelper` that only follows includes in `graph` whose
+  // configurations intersect `mask`, where `snapshot` is the snapshot of
+  // those configurations.
+  explicit DFSHelper(
+      const Graph &graph, const graph_snapshot &snapshot,
+      const source_reachability_graph<file_node, include_edge> &reach,
+      std::uint32_t mask)
+      : m_graph(graph), m_snapshot(snapshot), m_reach(reach), m_mask(mask),
         m_state(std::make_unique_for_overwrite<search_state[]>(
             num_vertices(m_graph))),
         m_stack() {
@@ -54,7 +74,8 @@ public:
     // If we can reach the file who has the `removed_edge` then we won't
     // gain anything
     const Graph::vertex_descriptor includer = source(removed_edge, m_graph);
-    if (!m_reach.is_reachable(from, includer)) {
+    if ((m_graph[removed_edge].configurations & m_mask) == 0u ||
+        !m_reach.is_reachable(from, includer)) {
       return cost{};
     }
 
@@ -93,8 +114,9 @@ public:
       for (const Graph::edge_descriptor &e :
            boost::make_iterator_range(out_edges(v, m_graph))) {
 
-        // Don't traverse our `removed_edge`
-        if (e == removed_edge) {
+        // Don't traverse our `removed_edge` or includes that are in other
+        // configurations
+        if (e == removed_edge || (m_graph[e].configurations & m_mask) == 0u) {
           continue;
         }
 
@@ -110,8 +132,11 @@ public:
       }
     }
 
-    // Check that we actually reached our includer
-    assert(m_state[includer] == search_state::seen_initial);
+    // `m_reach` includes paths in all configurations, so we may not reach
+    // our includer in these configurations
+    if (m_state[includer] != search_state::seen_initial) {
+      return {};
+    }
 
     cost savings;
 
@@ -128,7 +153,7 @@ public:
       case search_state::not_seen:
         // If we didn't see this file when we skipped `removed_edge` then we
         // will get that saving
-        savings += m_graph[v].true_cost();
+        savings += m_snapshot.true_cost(v);
         [[fallthrough]];
       case search_state::seen_initial:
         // If we already saw this file, we don't get a saving but need to
@@ -136,14 +161,177 @@ public:
         m_state[v] = search_state::seen_followup;
       }
 
-      const auto [begin, end] = adjacent_vertices(v, m_graph);
-      m_stack.insert(m_stack.end(), begin, end);
+      const auto children = m_snapshot.children(v);
+      m_stack.insert(m_stack.end(), children.begin(), children.end());
     }
 
     return savings;
   }
 };
 
+// This component stores the include edges of a graph in compressed sparse row
+// form so that each edge can be referred to by an index.  The edges of each
+// vertex are stored contiguously in both directions.
+struct EdgeIndex {
+  std::vector<Graph::edge_descriptor> edges; // index -> edge
+  std::vector<Graph::vertex_descriptor> sources; // index -> source
+  std::vector<Graph::vertex_descriptor> targets; // index -> target
+  std::vector<std::uint32_t> configurations;     // index -> configurations
+  std::vector<std::size_t> out_offsets; // vertex -> first index in `edges`
+  std::vector<std::size_t> in_offsets;  // vertex -> first index in `in`
+  std::vector<std::size_t> in;          // indices ordered by target
+
+  explicit EdgeIndex(const Graph &graph)
+      : edges(), sources(), targets(), configurations(), out_offsets(),
+        in_offsets(), in() {
+    const std::size_t V = num_vertices(graph);
+    out_offsets.reserve(V + 1);
+    in_offsets.assign(V + 1, 0u);
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(graph))) {
+      out_offsets.push_back(edges.size());
+      for (const Graph::edge_descriptor &e :
+           boost::make_iterator_range(out_edges(v, graph))) {
+        edges.push_back(e);
+        sources.push_back(v);
+        targets.push_back(target(e, graph));
+        configurations.push_back(graph[e].configurations);
+        ++in_offsets[target(e, graph) + 1];
+      }
+    }
+    out_offsets.push_back(edges.size());
+
+    std::partial_sum(in_offsets.begin(), in_offsets.end(), in_offsets.begin());
+    in.resize(edges.size());
+    std::vector<std::size_t> next(in_offsets.begin(), in_offsets.end() - 1);
+    for (std::size_t i = 0; i != edges.size(); ++i) {
+      in[next[targets[i]]++] = i;
+    }
+  }
+};
+
+// This component calculates the savings from removing each include edge for
+// a single source.  We split each edge with a virtual vertex, then the files
+// that can only be reached through that edge are exactly the files dominated
+// by the virtual vertex.
+//
+// Vertices `[0, V)` are the files in the graph and `[V, V + E)` are the
+// virtual vertices for each edge.  The virtual vertices of edges that are
+// not in the current configuration have no children, so they never
+// dominate anything.
+class DominatorHelper {
+  const graph_snapshot &m_graph;
+  const EdgeIndex &m_index;
+  std::uint32_t m_mask;
+  std::size_t m_vertex_count;
+  dominator_tree m_tree;
+  std::vector<cost> m_subtree; // vertex -> cost of dominated vertices
+
+  bool is_followed(std::size_t e) const {
+    return (m_index.configurations[e] & m_mask) != 0u;
+  }
+
+public:
+  // Create a `DominatorHelper` that only follows includes whose
+  // configurations intersect `mask`, where `graph` is the snapshot of those
+  // configurations.
+  DominatorHelper(const graph_snapshot &graph, const EdgeIndex &index,
+                  std::uint32_t mask)
+      : m_graph(graph), m_index(index), m_mask(mask),
+        m_vertex_count(graph.vertex_count()), m_tree(), m_subtree() {}
+
+  // Add to `savings` the cost of all files that would no longer be
+  // reachable from `source` if each include edge were removed.
+  void add_savings(Graph::vertex_descriptor source,
+                   std::vector<cost> &savings) {
+    // Skip sources that are not compiled in this configuration
+    const int weight = static_cast<int>(m_graph.weight(source));
+    if (weight == 0) {
+      return;
+    }
+
+    const std::size_t V = m_vertex_count;
+    const std::size_t vertex_count = V + m_index.edges.size();
+    m_tree.build(
+        vertex_count, source,
+        [&](const std::size_t v, const std::size_t i) {
+          if (v < V) {
+            const std::size_t e = m_index.out_offsets[v] + i;
+            return e < m_index.out_offsets[v + 1] ? V + e
+                                                  : dominator_tree::none;
+          }
+          return i == 0 && is_followed(v - V) ? m_index.targets[v - V]
+                                              : dominator_tree::none;
+        },
+        [&](const std::size_t v, auto visit) {
+          if (v < V) {
+            for (std::size_t i = m_index.in_offsets[v];
+                 i != m_index.in_offsets[v + 1]; ++i) {
+              if (is_followed(m_index.in[i])) {
+                visit(V + m_index.in[i]);
+              }
+            }
+          } else {
+            // Virtual vertices only have the includer as a predecessor
+            visit(m_index.sources[v - V]);
+          }
+        });
+
+    // Dominators always come later in post-order, so we can sum up the
+    // cost of each subtree in a single pass.
+    m_subtree.assign(vertex_count, cost{});
+    for (const std::size_t v : m_tree.post_order()) {
+      if (v < V) {
+        m_subtree[v] += m_graph.true_cost(v);
+      }
+      if (v != source) {
+        m_subtree[m_tree.immediate_dominator(v)] += m_subtree[v];
+      }
+    }
+
+    for (const std::size_t v : m_tree.post_order()) {
+      if (v >= V) {
+        savings[v - V] += m_subtree[v] * weight;
+      }
+    }
+  }
+};
+
+std::vector<include_directive_and_cost>
+from_graph_dominator_tree(const Graph &graph, const graph_snapshot &snapshot,
+                          std::span<const Graph::vertex_descriptor> sources,
+                          const int minimum_token_count_cut_off) {
+  const EdgeIndex index(graph);
+
+  const std::vector<cost> savings = sum_savings_over_configurations(
+      snapshot, sources, index.edges.size(),
+      [&](const graph_snapshot &configuration, const std::uint32_t mask) {
+        return DominatorHelper(configuration, index, mask);
+      });
+
+  std::vector<include_directive_and_cost> results;
+  for (std::size_t i = 0; i != index.edges.size(); ++i) {
+    const Graph::edge_descriptor &include = index.edges[i];
+
+    // Skip files that come from external libraries
+    if (snapshot.is_external(index.sources[i])) {
+      continue;
+    }
+
+    if (!graph[include].is_removable ||
+        !in_all_configurations(graph, include)) {
+      continue;
+    }
+
+    const cost saved = savings[i];
+    if (saved.token_count >= minimum_token_count_cut_off) {
+      results.push_back({std::filesystem::path(graph[index.sources[i]].path),
+                         saved, &graph[include]});
+    }
+  }
+  return results;
+}
+
 } // namespace
 
 bool operator==(const include_directive_and_cost &lhs,
@@ -165,16 +353,44 @@ std::ostream &operator<<(std::ostream &out,
 
 std::vector<include_directive_and_cost> find_expensive_includes::from_graph(
     const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
-    const int minimum_token_count_cut_off) {
+    const int minimum_token_count_cut_off, const engine algorithm) {
+  return from_graph(graph, graph_snapshot(graph), sources,
+                    minimum_token_count_cut_off, algorithm);
+}
+
+std::vector<include_directive_and_cost> find_expensive_includes::from_graph(
+    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off, const engine algorithm) {
+  return from_graph(graph, std::span(sources.begin(), sources.end()),
+                    minimum_token_count_cut_off, algorithm);
+}
+
+std::vector<include_directive_and_cost> find_expensive_includes::from_graph(
+    const Graph &graph, const graph_snapshot &snapshot,
+    std::span<const Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off, const engine algorithm) {
   std::mutex m;
   std::vector<include_directive_and_cost> results;
   if (sources.empty()) {
     return results;
   }
 
-  reachability_graph reach(graph);
+  if (algorithm == engine::dominator_tree) {
+    return from_graph_dominator_tree(graph, snapshot, sources,
+                                     minimum_token_count_cut_off);
+  }
+
+  source_reachability_graph reach(graph, sources);
   const auto [begin, end] = edges(graph);
 
+  // Take the snapshot of each configuration up front, along with the mask
+  // of includes to follow in it
+  std::vector<std::pair<graph_snapshot, std::uint32_t>> configurations;
+  for_each_configuration(snapshot, [&](const graph_snapshot &configuration,
+                                       const std::uint32_t mask) {
+    configurations.emplace_back(configuration, mask);
+  });
+
   // edge iterators fail the `forward iterator` concept check when using
   // parallel `for_each` so we must first take a copy.
   std::vector<Graph::edge_descriptor> edges(begin, end);
@@ -182,21 +398,26 @@ std::vector<include_directive_and_cost> find_expensive_includes::from_graph(
       std::execution::par, edges.begin(), edges.end(),
       [&](const Graph::edge_descriptor &include) {
         // Skip files that come from external libraries
-        if (graph[source(include, graph)].is_external) {
+        if (snapshot.is_external(source(include, graph))) {
           return;
         }
 
-        if (!graph[include].is_removable) {
+        if (!graph[include].is_removable ||
+            !in_all_configurations(graph, include)) {
           return;
         }
 
-        DFSHelper helper(graph, reach);
-        const cost saved = std::accumulate(
-            sources.begin(), sources.end(), cost{},
-            [&](cost acc, Graph::vertex_descriptor source) {
-              return acc +
-                     helper.total_file_size_of_unreachable(source, include);
-            });
+        cost saved;
+        for (const auto &[configuration, mask] : configurations) {
+          DFSHelper helper(graph, configuration, reach, mask);
+          saved = std::accumulate(
+              sources.begin(), sources.end(), saved,
+              [&](cost acc, Graph::vertex_descriptor source) {
+                return acc +
+                       helper.total_file_size_of_unreachable(source, include) *
+                           static_cast<int>(configuration.weight(source));
+              });
+        }
 
         if (saved.token_count >= minimum_token_count_cut_off) {
           // There are ways to avoid this mutex, but if the
@@ -211,11 +432,4 @@ std::vector<include_directive_and_cost> find_expensive_includes::from_graph(
   return results;
 }
 
-std::vector<include_directive_and_cost> find_expensive_includes::from_graph(
-    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
-    const int minimum_token_count_cut_off) {
-  return from_graph(graph, std::span(sources.begin(), sources.end()),
-                    minimum_token_count_cut_off);
-}
-
 } // namespace IncludeGuardian
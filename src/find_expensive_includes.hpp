@@ -2,6 +2,7 @@
 #define INCLUDE_GUARD_0DC4C9E1_CE28_4D0C_9771_86480E7D991D
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <filesystem>
 #include <initializer_list>
@@ -28,14 +29,33 @@ std::ostream &operator<<(std::ostream &out,
 /// This component will output the include directives along with the total file
 /// size that would be saved if it was deleted.
 struct find_expensive_includes {
+  /// The algorithm used to calculate the savings.  `dominator_tree` builds a
+  /// dominator tree for each source and is much faster.  `reference` runs a
+  /// separate search for each include directive and source and is kept for
+  /// testing.
+  enum class engine {
+    dominator_tree,
+    reference,
+  };
+
   static std::vector<include_directive_and_cost>
   from_graph(const Graph &graph,
              std::span<const Graph::vertex_descriptor> sources,
-             int minimum_token_count_cut_off = 0);
+             int minimum_token_count_cut_off = 0,
+             engine algorithm = engine::dominator_tree);
   static std::vector<include_directive_and_cost>
   from_graph(const Graph &graph,
              std::initializer_list<Graph::vertex_descriptor> sources,
-             int minimum_token_count_cut_off = 0);
+             int minimum_token_count_cut_off = 0,
+             engine algorithm = engine::dominator_tree);
+
+  /// Return the same as above, using the specified `snapshot`, which must
+  /// have been taken of `graph`, instead of taking a new one.
+  static std::vector<include_directive_and_cost>
+  from_graph(const Graph &graph, const graph_snapshot &snapshot,
+             std::span<const Graph::vertex_descriptor> sources,
+             int minimum_token_count_cut_off = 0,
+             engine algorithm = engine::dominator_tree);
 };
 
 } // namespace IncludeGuardian
@@ -5,6 +5,9 @@
 #include <gmock/gmock-matchers.h>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 using namespace IncludeGuardian;
 using namespace testing;
 
@@ -42,6 +45,59 @@ TEST_F(LongChain, FindExpensiveIncludes) {
               }));
 }
 
+TEST_F(MultiLevel, FindExpensiveIncludesReference) {
+  EXPECT_THAT(
+      find_expensive_includes::from_graph(
+          graph, sources(), 0, find_expensive_includes::engine::reference),
+      UnorderedElementsAreArray(
+          find_expensive_includes::from_graph(graph, sources(), 0)));
+}
+
+TEST_F(LongChain, FindExpensiveIncludesReference) {
+  EXPECT_THAT(
+      find_expensive_includes::from_graph(
+          graph, sources(), 0, find_expensive_includes::engine::reference),
+      UnorderedElementsAreArray(
+          find_expensive_includes::from_graph(graph, sources(), 0)));
+}
+
+TEST_F(ComplexCascadingInclude, FindExpensiveIncludesReference) {
+  EXPECT_THAT(
+      find_expensive_includes::from_graph(
+          graph, sources(), 0, find_expensive_includes::engine::reference),
+      UnorderedElementsAreArray(
+          find_expensive_includes::from_graph(graph, sources(), 0)));
+}
+
+// Test that the dominator tree engine handles cycles and self-includes in
+// the same way as the reference engine.
+TEST(FindExpensiveIncludes, Cycles) {
+  constexpr int SIZE = 60;
+  Graph graph;
+  std::vector<Graph::vertex_descriptor> sources;
+  for (int i = 0; i != SIZE; ++i) {
+    add_vertex(file_node(std::to_string(i))
+                   .with_cost(i + 1, (i + 1) * boost::units::information::byte),
+               graph);
+    if (i % 10 == 0) {
+      sources.push_back(i);
+    }
+  }
+  for (int i = 0; i != SIZE; ++i) {
+    add_edge(i, (i * 7 + 3) % SIZE, {"x"}, graph);
+    if (i % 4 == 0) {
+      add_edge(i, (i * 13 + 11) % SIZE, {"y"}, graph);
+    }
+  }
+  add_edge(0, 0, {"self"}, graph);
+
+  EXPECT_THAT(
+      find_expensive_includes::from_graph(
+          graph, sources, 0, find_expensive_includes::engine::reference),
+      UnorderedElementsAreArray(
+          find_expensive_includes::from_graph(graph, sources, 0)));
+}
+
 TEST_F(NoSources, FindExpensiveIncludes) {
   EXPECT_THAT(find_expensive_includes::from_graph(graph, sources(), 1u),
               SizeIs(0));
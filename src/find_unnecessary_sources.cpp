@@ -25,7 +25,24 @@ std::vector<find_unnecessary_sources::result>
 find_unnecessary_sources::from_graph(
     const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
     const int minimum_token_count_cut_off) {
-  reachability_graph reach(graph);
+  return from_graph(graph, graph_snapshot(graph), sources,
+                    minimum_token_count_cut_off);
+}
+
+std::vector<find_unnecessary_sources::result>
+find_unnecessary_sources::from_graph(
+    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off) {
+  return from_graph(graph, std::span(sources.begin(), sources.end()),
+                    minimum_token_count_cut_off);
+}
+
+std::vector<find_unnecessary_sources::result>
+find_unnecessary_sources::from_graph(
+    const Graph &graph, const graph_snapshot &snapshot,
+    std::span<const Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off) {
+  source_reachability_graph reach(graph, sources);
   std::mutex m;
   std::vector<result> results;
 
@@ -35,7 +52,9 @@ find_unnecessary_sources::from_graph(
       [&](Graph::vertex_descriptor source) {
         // If we don't have an associate header then we probably can't do
         // anything.  TODO: report as an error.
-        if (!graph[source].component.has_value()) {
+        const graph_snapshot::vertex_descriptor header =
+            snapshot.properties().component(source);
+        if (header == node_properties::no_component) {
           return;
         }
 
@@ -43,7 +62,7 @@ find_unnecessary_sources::from_graph(
         // most likely if the library has sources, it is already
         // compiled into a library and there is no additional cost when
         // we compile our code
-        if (graph[source].is_external) {
+        if (snapshot.is_external(source)) {
           return;
         }
 
@@ -67,21 +86,24 @@ find_unnecessary_sources::from_graph(
           }
 
           reachable[v] = static_cast<reachability>(reachable[v] | SOURCE);
-          saving += graph[v].true_cost();
-          reachable_from_source_only += graph[v].true_cost();
+          saving += snapshot.true_cost(v);
+          reachable_from_source_only += snapshot.true_cost(v);
           ++num_reachable_from_source_only;
 
-          const auto [begin, end] = adjacent_vertices(v, graph);
-          stack.insert(stack.end(), begin, end);
+          const auto children = snapshot.children(v);
+          stack.insert(stack.end(), children.begin(), children.end());
         }
 
+        // Removing `source` saves its cost for every time it was compiled
+        saving = saving * static_cast<int>(snapshot.weight(source));
+
         // If we won't save enough in the first place, exit early
         if (saving.token_count < minimum_token_count_cut_off) {
           return;
         }
 
         // Mark all files reachable from the header file
-        stack.push_back(*graph[source].component);
+        stack.push_back(header);
         while (!stack.empty()) {
           const Graph::vertex_descriptor v = stack.back();
           stack.pop_back();
@@ -91,17 +113,16 @@ find_unnecessary_sources::from_graph(
 
           reachable[v] = static_cast<reachability>(reachable[v] | HEADER);
           --num_reachable_from_source_only;
-          reachable_from_source_only -= graph[v].true_cost();
+          reachable_from_source_only -= snapshot.true_cost(v);
 
-          const auto [begin, end] = adjacent_vertices(v, graph);
-          stack.insert(stack.end(), begin, end);
+          const auto children = snapshot.children(v);
+          stack.insert(stack.end(), children.begin(), children.end());
         }
 
         // Go through all sources, for each source, do a DFS and find
         // all files that it reaches that are
         // sum up the size of all files in the set `S`.
         std::vector<cost> added_cost(size);
-        const Graph::vertex_descriptor header = *graph[source].component;
         std::transform(
             std::execution::par, sources.begin(), sources.end(),
             added_cost.begin(), [&](Graph::vertex_descriptor start_source) {
@@ -138,14 +159,14 @@ find_unnecessary_sources::from_graph(
                 // files some other way, then we need to subtract its cost.
                 if (reachable[v] == SOURCE) {
                   --count;
-                  total -= graph[v].true_cost();
+                  total -= snapshot.true_cost(v);
                 }
 
-                const auto [begin, end] = adjacent_vertices(v, graph);
-                stack.insert(stack.end(), begin, end);
+                const auto children = snapshot.children(v);
+                stack.insert(stack.end(), children.begin(), children.end());
               }
 
-              return total;
+              return total * static_cast<int>(snapshot.weight(start_source));
             });
 
         const cost extra =
@@ -163,14 +184,6 @@ find_unnecessary_sources::from_graph(
   return results;
 }
 
-std::vector<find_unnecessary_sources::result>
-find_unnecessary_sources::from_graph(
-    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
-    const int minimum_token_count_cut_off) {
-  return from_graph(graph, std::span(sources.begin(), sources.end()),
-                    minimum_token_count_cut_off);
-}
-
 bool operator==(const find_unnecessary_sources::result &lhs,
                 const find_unnecessary_sources::result &rhs) {
   return lhs.source == rhs.source && lhs.extra_cost == rhs.extra_cost &&
@@ -34,6 +34,7 @@
 // file `foo.cpp` that included `foo.hpp` and `bar.hpp`.
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <initializer_list>
 #include <iosfwd>
@@ -65,6 +66,13 @@ struct find_unnecessary_sources {
   from_graph(const Graph &graph,
              std::initializer_list<Graph::vertex_descriptor> sources,
              int minimum_token_count_cut_off = 0);
+
+  /// Return the same as above, using the specified `snapshot`, which must
+  /// have been taken of `graph`, instead of taking a new one.
+  static std::vector<result>
+  from_graph(const Graph &graph, const graph_snapshot &snapshot,
+             std::span<const Graph::vertex_descriptor> sources,
+             int minimum_token_count_cut_off = 0);
 };
 
 bool operator==(const find_unnecessary_sources::result &lhs,
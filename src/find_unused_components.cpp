@@ -4,9 +4,7 @@
 
 #include <boost/units/io.hpp>
 
-#include <execution>
 #include <iomanip>
-#include <numeric>
 #include <ostream>
 
 namespace IncludeGuardian {
@@ -26,30 +24,36 @@ std::ostream &operator<<(std::ostream &out, const component_and_cost &v) {
 std::vector<component_and_cost> find_unused_components::from_graph(
     const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
     unsigned included_by_at_most, int minimum_token_count_cut_off) {
-  std::mutex m;
+  return from_graph(graph, graph_snapshot(graph), sources, included_by_at_most,
+                    minimum_token_count_cut_off);
+}
+
+std::vector<component_and_cost> find_unused_components::from_graph(
+    const Graph &graph, const graph_snapshot &snapshot,
+    std::span<const Graph::vertex_descriptor> sources,
+    unsigned included_by_at_most, int minimum_token_count_cut_off) {
+  // Find all candidate components first so that we can calculate their
+  // costs together
+  std::vector<Graph::vertex_descriptor> candidates;
+  for (const Graph::vertex_descriptor v : sources) {
+    const boost::optional<Graph::vertex_descriptor> &header =
+        graph[v].component;
+
+    // Don't forget to add 1 to account for that component's
+    // source include
+    if (header && in_degree(*header, graph) <= included_by_at_most + 1) {
+      candidates.push_back(v);
+    }
+  }
+
+  const std::vector<get_total_cost::result> costs =
+      get_total_cost::for_each_source(snapshot, candidates);
   std::vector<component_and_cost> results;
-  std::for_each(
-      std::execution::par, sources.begin(), sources.end(),
-      [&](const Graph::vertex_descriptor v) {
-        const boost::optional<Graph::vertex_descriptor> &header =
-            graph[v].component;
-        if (!header) {
-          return;
-        }
-
-        // Don't forget to add 1 to account for that component's
-        // source include
-        if (in_degree(*header, graph) <= included_by_at_most + 1 &&
-            get_total_cost::from_graph(graph, {v}).true_cost.token_count >=
-                minimum_token_count_cut_off) {
-          std::lock_guard g(m);
-          // There are ways to avoid this mutex, but if the
-          // `minimum_size_cut_off` is large enough, it's relatively
-          // rare to enter this if statement
-          results.push_back({
-              &graph[v], get_total_cost::from_graph(graph, {v}).true_cost});
-        }
-      });
+  for (std::size_t i = 0; i != candidates.size(); ++i) {
+    if (costs[i].true_cost.token_count >= minimum_token_count_cut_off) {
+      results.push_back({&graph[candidates[i]], costs[i].true_cost});
+    }
+  }
   return results;
 }
 
@@ -27,6 +27,7 @@
 // recommend a header+source pair to avoid this issue.
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <initializer_list>
 #include <iosfwd>
@@ -57,6 +58,14 @@ struct find_unused_components {
              std::initializer_list<Graph::vertex_descriptor> sources,
              unsigned included_by_at_most = 0u,
              int minimum_token_count_cut_off = 0);
+
+  /// Return the same as above, using the specified `snapshot`, which must
+  /// have been taken of `graph`, instead of taking a new one.
+  static std::vector<component_and_cost>
+  from_graph(const Graph &graph, const graph_snapshot &snapshot,
+             std::span<const Graph::vertex_descriptor> sources,
+             unsigned included_by_at_most = 0u,
+             int minimum_token_count_cut_off = 0);
 };
 
 } // namespace IncludeGuardian
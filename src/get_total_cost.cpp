@@ -1,11 +1,14 @@
 #include "get_total_cost.hpp"
 
-#include "dfs.hpp"
+#include "multi_source_bfs.hpp"
 
 #include <boost/units/io.hpp>
 
 #include <algorithm>
-#include <execution>
+#include <bit>
+#include <functional>
+#include <iterator>
+#include <numeric>
 #include <ostream>
 
 namespace IncludeGuardian {
@@ -13,22 +16,7 @@ namespace IncludeGuardian {
 get_total_cost::result
 get_total_cost::from_graph(const Graph &graph,
                            std::span<const Graph::vertex_descriptor> sources) {
-
-  std::vector<result> source_cost(num_vertices(graph));
-  std::transform(std::execution::par, sources.begin(), sources.end(),
-                 source_cost.data(),
-                 [&](const Graph::vertex_descriptor source) {
-                   dfs_adaptor dfs(graph);
-                   result total;
-                   for (const Graph::vertex_descriptor v : dfs.from(source)) {
-                     total.true_cost += graph[v].true_cost();
-                     if (graph[v].is_precompiled) {
-                       total.precompiled += graph[v].underlying_cost;
-                     }
-                   }
-                   return total;
-                 });
-  return std::reduce(source_cost.begin(), source_cost.end());
+  return from_graph(graph_snapshot(graph), sources);
 }
 
 get_total_cost::result get_total_cost::from_graph(
@@ -37,6 +25,92 @@ get_total_cost::result get_total_cost::from_graph(
   return from_graph(graph, std::span(sources.begin(), sources.end()));
 }
 
+get_total_cost::result
+get_total_cost::from_graph(const graph_snapshot &graph,
+                           std::span<const Graph::vertex_descriptor> sources) {
+  // A source may include different files in each configuration, so cost
+  // each configuration separately, skipping sources not compiled in it
+  if (graph.configuration_count() > 1u) {
+    result total;
+    for_each_configuration(graph, [&](const graph_snapshot &configuration,
+                                      std::uint32_t) {
+      std::vector<Graph::vertex_descriptor> compiled;
+      std::copy_if(sources.begin(), sources.end(),
+                   std::back_inserter(compiled),
+                   [&](const Graph::vertex_descriptor source) {
+                     return configuration.weight(source) != 0u;
+                   });
+      total = total + from_graph(configuration, compiled);
+    });
+    return total;
+  }
+
+  // Each vertex is visited once per batch with the set of sources that
+  // reach it, so we only need to multiply its cost by the total weight of
+  // those sources
+  const std::vector<unsigned> weights = graph.weights(sources);
+  std::vector<result> batch_cost((sources.size() +
+                                  multi_source_bfs::batch_size - 1) /
+                                 multi_source_bfs::batch_size);
+  multi_source_bfs::for_each(
+      graph, sources,
+      [&](const std::size_t batch, const graph_snapshot::vertex_descriptor v,
+          const multi_source_bfs::mask m) {
+        const int count = static_cast<int>(
+            multi_source_bfs::weighted_count(batch, m, weights));
+        batch_cost[batch].true_cost += graph.true_cost(v) * count;
+        batch_cost[batch].precompiled += graph.precompiled_cost(v) * count;
+      });
+  return std::reduce(batch_cost.begin(), batch_cost.end());
+}
+
+get_total_cost::result get_total_cost::from_graph(
+    const graph_snapshot &graph,
+    std::initializer_list<Graph::vertex_descriptor> sources) {
+  return from_graph(graph, std::span(sources.begin(), sources.end()));
+}
+
+std::vector<get_total_cost::result> get_total_cost::for_each_source(
+    const Graph &graph, std::span<const Graph::vertex_descriptor> sources) {
+  return for_each_source(graph_snapshot(graph), sources);
+}
+
+std::vector<get_total_cost::result> get_total_cost::for_each_source(
+    const graph_snapshot &graph,
+    std::span<const Graph::vertex_descriptor> sources) {
+  if (graph.configuration_count() > 1u) {
+    std::vector<result> source_cost(sources.size());
+    for_each_configuration(graph, [&](const graph_snapshot &configuration,
+                                      std::uint32_t) {
+      const std::vector<result> c = for_each_source(configuration, sources);
+      std::transform(source_cost.begin(), source_cost.end(), c.begin(),
+                     source_cost.begin(), std::plus<>());
+    });
+    return source_cost;
+  }
+
+  std::vector<result> source_cost(sources.size());
+  multi_source_bfs::for_each(
+      graph, sources,
+      [&](const std::size_t batch, const graph_snapshot::vertex_descriptor v,
+          multi_source_bfs::mask m) {
+        const result r = {graph.true_cost(v), graph.precompiled_cost(v)};
+        const std::size_t offset = batch * multi_source_bfs::batch_size;
+        for (; m != 0u; m &= m - 1) {
+          result &total = source_cost[offset + std::countr_zero(m)];
+          total = total + r;
+        }
+      });
+  for (std::size_t i = 0; i != sources.size(); ++i) {
+    const int weight = static_cast<int>(graph.weight(sources[i]));
+    if (weight != 1) {
+      source_cost[i] = {source_cost[i].true_cost * weight,
+                        source_cost[i].precompiled * weight};
+    }
+  }
+  return source_cost;
+}
+
 get_total_cost::result operator+(get_total_cost::result lhs,
                                  get_total_cost::result rhs) {
   return {lhs.true_cost + rhs.true_cost, lhs.precompiled + rhs.precompiled};
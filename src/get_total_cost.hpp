@@ -2,14 +2,20 @@
 #define INCLUDE_GUARD_AF3B784D_80D5_41F4_9502_F3652DD261AE
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <initializer_list>
 #include <span>
+#include <vector>
 
 namespace IncludeGuardian {
 
 /// This component will output the total number of bytes and preprocessing
 /// tokens if all the `source` were expanded after the preprocessing step.
+/// Each source is counted `weight` times.  If the graph was merged from
+/// several configurations, each configuration is costed separately with the
+/// includes and source weights of that configuration, though each file keeps
+/// the cost it had in the first configuration (see `multi_config`).
 struct get_total_cost {
   struct result {
     cost true_cost;   //< The cost (excluding precompiled) of the graph
@@ -23,6 +29,21 @@ struct get_total_cost {
   static result
   from_graph(const Graph &graph,
              std::initializer_list<Graph::vertex_descriptor> sources);
+  static result from_graph(const graph_snapshot &graph,
+                           std::span<const Graph::vertex_descriptor> sources);
+  static result
+  from_graph(const graph_snapshot &graph,
+             std::initializer_list<Graph::vertex_descriptor> sources);
+
+  /// Return the cost of each of the specified `sources` individually,
+  /// multiplied by its `weight`, where the `i`th element corresponds to
+  /// `sources[i]`.
+  static std::vector<result>
+  for_each_source(const Graph &graph,
+                  std::span<const Graph::vertex_descriptor> sources);
+  static std::vector<result>
+  for_each_source(const graph_snapshot &graph,
+                  std::span<const Graph::vertex_descriptor> sources);
 };
 
 get_total_cost::result operator+(get_total_cost::result lhs,
@@ -2,9 +2,14 @@
 
 #include "analysis_test_fixtures.hpp"
 
+#include <gmock/gmock-matchers.h>
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 using namespace IncludeGuardian;
+using namespace testing;
 
 namespace {
 
@@ -18,6 +23,17 @@ TEST_F(MultiLevel, GetTotalCost) {
             (A + C + D + F + H) + (B + D + E + F + G + H));
 }
 
+TEST_F(MultiLevel, GetTotalCostWeighted) {
+  graph[a].weight = 3u;
+  EXPECT_EQ(get_total_cost::from_graph(graph, sources()).true_cost,
+            3 * (A + C + D + F + H) + (B + D + E + F + G + H));
+  EXPECT_THAT(get_total_cost::for_each_source(graph, sources()),
+              ElementsAre(Field(&get_total_cost::result::true_cost,
+                                3 * (A + C + D + F + H)),
+                          Field(&get_total_cost::result::true_cost,
+                                B + D + E + F + G + H)));
+}
+
 TEST_F(LongChain, GetTotalCostTest) {
   EXPECT_EQ(get_total_cost::from_graph(graph, sources()).true_cost,
             A + B + C + D + E + F + G + H + I + J);
@@ -40,4 +56,46 @@ TEST_F(ComplexCascadingInclude, GetTotalCostTest) {
                 D_C + (2 * E_H) + (4 * F_H) + S_H + MAIN_C);
 }
 
+TEST_F(ComplexCascadingInclude, GetTotalCostForEachSource) {
+  EXPECT_THAT(get_total_cost::for_each_source(graph, sources()),
+              ElementsAre(Field(&get_total_cost::result::true_cost,
+                                MAIN_C + A_H + B_H + C_H + D_H + E_H + F_H),
+                          Field(&get_total_cost::result::true_cost,
+                                A_C + A_H + B_H + C_H + D_H + F_H),
+                          Field(&get_total_cost::result::true_cost,
+                                B_C + B_H + C_H + D_H + F_H + S_H),
+                          Field(&get_total_cost::result::true_cost,
+                                C_C + C_H + D_H),
+                          Field(&get_total_cost::result::true_cost,
+                                D_C + D_H + E_H + F_H)));
+}
+
+// Test a line where every file is a source so that the sources span
+// multiple batches, e.g.
+//
+//   0 -> 1 -> 2 -> ... -> 149
+TEST(GetTotalCost, ManySources) {
+  constexpr int SIZE = 150;
+  const cost one(1, 1.0 * boost::units::information::byte);
+  Graph graph;
+  std::vector<Graph::vertex_descriptor> sources;
+  for (int i = 0; i != SIZE; ++i) {
+    sources.push_back(
+        add_vertex(file_node(std::to_string(i)).with_cost(one), graph));
+    if (i > 0) {
+      add_edge(sources[i - 1], sources[i], {std::to_string(i)}, graph);
+    }
+  }
+
+  EXPECT_EQ(get_total_cost::from_graph(graph, sources).true_cost,
+            one * (SIZE * (SIZE + 1) / 2));
+
+  const std::vector<get_total_cost::result> costs =
+      get_total_cost::for_each_source(graph, sources);
+  ASSERT_EQ(costs.size(), SIZE);
+  for (int i = 0; i != SIZE; ++i) {
+    EXPECT_EQ(costs[i].true_cost, one * (SIZE - i)) << i;
+  }
+}
+
 } // namespace
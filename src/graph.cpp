@@ -1,8 +1,11 @@
 #include "graph.hpp"
 
+#include <boost/range/iterator_range.hpp>
 #include <boost/units/io.hpp>
 
 #include <ostream>
+#include <string>
+#include <unordered_set>
 
 namespace IncludeGuardian {
 
@@ -83,27 +86,110 @@ file_node &&file_node::set_guarded(bool v) && {
   return std::move(*this);
 }
 
+file_node &file_node::with_weight(unsigned v) & {
+  this->weight = v;
+  return *this;
+}
+
+file_node &&file_node::with_weight(unsigned v) && {
+  this->weight = v;
+  return std::move(*this);
+}
+
+file_node &file_node::with_configurations(std::uint32_t v) & {
+  this->configurations = v;
+  return *this;
+}
+
+file_node &&file_node::with_configurations(std::uint32_t v) && {
+  this->configurations = v;
+  return std::move(*this);
+}
+
 cost file_node::true_cost() const {
   return is_precompiled ? cost{} : underlying_cost;
 }
 
+unsigned file_node::configuration_weight(const unsigned configuration) const {
+  if (!configuration_weights.empty()) {
+    return configuration < configuration_weights.size()
+               ? configuration_weights[configuration]
+               : 0u;
+  }
+  return (configurations >> configuration) & 1u ? weight : 0u;
+}
+
 std::ostream &operator<<(std::ostream &stream, const file_node &value) {
   return stream << value.path << ' ' << value.underlying_cost
                 << " [incoming (int)=" << value.internal_incoming << ']'
                 << " [incoming (ext)=" << value.external_incoming << ']'
                 << (value.is_external ? " [external]" : "")
                 << (value.component ? " [linked]" : "")
-                << (value.is_precompiled ? " [precompiled]" : "");
+                << (value.is_precompiled ? " [precompiled]" : "")
+                << (value.weight != 1u
+                        ? " [weight=" + std::to_string(value.weight) + ']'
+                        : "")
+                << (value.configurations != 1u
+                        ? " [configurations=" +
+                              std::to_string(value.configurations) + ']'
+                        : "");
+}
+
+const interned_path &file_identity(const file_node &node) {
+  return node.stamp.location.empty() ? node.path : node.stamp.location;
+}
+
+namespace {
+
+template <typename T>
+void merge(std::vector<T> &to, const std::vector<T> &from) {
+  if (from.empty()) {
+    return;
+  }
+
+  std::unordered_set<T> seen(to.begin(), to.end());
+  for (const T &s : from) {
+    if (seen.insert(s).second) {
+      to.push_back(s);
+    }
+  }
+}
+
+} // namespace
+
+void merge_lookups(file_node &to, const file_node &from) {
+  merge(to.missing_includes, from.missing_includes);
+  merge(to.absent_paths, from.absent_paths);
+}
+
+void recalculate_incoming(Graph &graph) {
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    graph[v].internal_incoming = 0u;
+    graph[v].external_incoming = 0u;
+  }
+  for (const Graph::edge_descriptor &e :
+       boost::make_iterator_range(edges(graph))) {
+    file_node &to = graph[target(e, graph)];
+    const bool is_external = graph[source(e, graph)].is_external;
+    to.internal_incoming += !is_external;
+    to.external_incoming += is_external;
+  }
 }
 
 std::ostream &operator<<(std::ostream &stream, const include_edge &value) {
   return stream << value.code << "#" << value.lineNumber
-                << (value.is_removable ? "" : " not removable");
+                << (value.is_removable ? "" : " not removable")
+                << (value.configurations != 1u
+                        ? " [configurations=" +
+                              std::to_string(value.configurations) + ']'
+                        : "");
 }
 
 bool operator==(const include_edge &lhs, const include_edge &rhs) {
   return lhs.code == rhs.code && lhs.lineNumber == rhs.lineNumber &&
-         lhs.is_removable == rhs.is_removable;
+         lhs.is_removable == rhs.is_removable &&
+         lhs.configurations == rhs.configurations;
 }
 
 bool operator!=(const include_edge &lhs, const include_edge &rhs) {
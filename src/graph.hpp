@@ -2,18 +2,22 @@
 #define INCLUDE_GUARD_9228E240_D576_4608_9B9A_9D747F5AEF27
 
 #include "cost.hpp"
+#include "string_pool.hpp"
 
 #include <boost/graph/adjacency_list.hpp>
 
 #include <boost/serialization/optional.hpp>
 #include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
 
 #include <boost/units/quantity.hpp>
 #include <boost/units/systems/information/byte.hpp>
 
+#include <cstdint>
 #include <filesystem>
 #include <iosfwd>
 #include <string>
+#include <vector>
 
 namespace boost {
 namespace serialization {
@@ -47,12 +51,27 @@ using Graph =
     boost::adjacency_list<boost::vecS, boost::vecS, boost::bidirectionalS,
                           file_node, include_edge>;
 
+class file_stamp {
+public:
+  interned_path location;     //< The path this file was read from
+  std::int64_t modified = 0;  //< The modification time in seconds since the
+                              //< epoch when this file was read
+  std::uint64_t content_hash = 0; //< The `llvm::xxHash64` of the contents
+
+  template <typename Archive>
+  void serialize(Archive &ar, const unsigned version) {
+    ar &location;
+    ar &modified;
+    ar &content_hash;
+  }
+};
+
 class file_node {
 public:
-  std::filesystem::path path; //< Note that this will most likely be
-                              //< a relative path (e.g. boost/foo.hpp) and
-                              //< it will be unknown and generally unnecessary
-                              //< as to what path it is relative to.
+  interned_path path; //< Note that this will most likely be
+                      //< a relative path (e.g. boost/foo.hpp) and
+                      //< it will be unknown and generally unnecessary
+                      //< as to what path it is relative to.
   bool is_external = false; //< Whether this file comes from an external library
   cost underlying_cost;
   boost::optional<Graph::vertex_descriptor>
@@ -66,6 +85,27 @@ public:
   unsigned external_incoming =
       0; //< The number of times this file is included from external files
   bool is_guarded = false;
+  file_stamp stamp; //< Where and when this file was read.  This is empty
+                    //< for files that were not read from a file system.
+  unsigned weight = 1; //< For sources, the number of identical translation
+                       //< units that this stands for.  Analyses count the
+                       //< cost of a source this many times.
+  std::uint32_t configurations = 1u; //< A bitmask where bit `i` is set if
+                                     //< this file was seen when building
+                                     //< the `i`th configuration
+  std::vector<unsigned> configuration_weights; //< For sources in a merged
+                                               //< graph, the `weight` in
+                                               //< each configuration, which
+                                               //< sum to `weight`
+  std::vector<interned_string> missing_includes; //< The files included by
+                                                 //< this file that could not
+                                                 //< be found
+  std::vector<interned_path> absent_paths; //< The paths that were searched
+                                           //< for the includes of this file,
+                                           //< in any translation unit, but
+                                           //< did not exist, as the absolute
+                                           //< directory searched and the
+                                           //< spelling of the include
 
   file_node();
   file_node(const std::filesystem::path &path);
@@ -88,9 +128,19 @@ public:
   file_node &&set_precompiled(bool is_precompiled) &&;
   file_node &set_guarded(bool is_guarded) &;
   file_node &&set_guarded(bool is_guarded) &&;
+  file_node &with_weight(unsigned weight) &;
+  file_node &&with_weight(unsigned weight) &&;
+  file_node &with_configurations(std::uint32_t configurations) &;
+  file_node &&with_configurations(std::uint32_t configurations) &&;
 
   cost true_cost() const;
 
+  /// Return the `weight` of this file in the specified `configuration`,
+  /// which is taken from `configuration_weights` if it is not empty, or
+  /// otherwise is `weight` if this file was seen in `configuration` and 0
+  /// if it was not.
+  unsigned configuration_weight(unsigned configuration) const;
+
   template <typename Archive>
   void serialize(Archive &ar, const unsigned version) {
     ar &path;
@@ -101,16 +151,38 @@ public:
     ar &internal_incoming;
     ar &external_incoming;
     ar &is_guarded;
+    ar &stamp;
+    ar &weight;
+    ar &configurations;
+    ar &configuration_weights;
+    ar &missing_includes;
+    ar &absent_paths;
   }
 };
 
 std::ostream &operator<<(std::ostream &stream, const file_node &value);
 
+/// Return the path that identifies the file of the specified `node` across
+/// different graphs, which is the location in its `stamp`, or its `path` if
+/// it has no stamp.
+const interned_path &file_identity(const file_node &node);
+
+/// Add the `missing_includes` and `absent_paths` of the specified `from`
+/// to those of the specified `to`, skipping any that it already has.
+void merge_lookups(file_node &to, const file_node &from);
+
+/// Set the `internal_incoming` and `external_incoming` of every file in the
+/// specified `graph` from its include edges.
+void recalculate_incoming(Graph &graph);
+
 class include_edge {
 public:
-  std::string code;
+  interned_string code;
   unsigned lineNumber;
   bool is_removable = true;
+  std::uint32_t configurations = 1u; //< A bitmask where bit `i` is set if
+                                     //< this include was seen when building
+                                     //< the `i`th configuration
 };
 
 std::ostream &operator<<(std::ostream &stream, const include_edge &value);
@@ -128,6 +200,7 @@ void serialize(Archive &ar, IncludeGuardian::include_edge &e,
   ar &e.code;
   ar &e.lineNumber;
   ar &e.is_removable;
+  ar &e.configurations;
 }
 
 } // namespace serialization
@@ -0,0 +1,425 @@
+#include "graph_file.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace IncludeGuardian {
+
+namespace {
+
+constexpr char magic[8] = {'I', 'G', 'G', 'R', 'A', 'P', 'H', '\0'};
+
+// Written as a native integer so that we can detect files written on a
+// machine with a different byte order
+constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+constexpr std::uint32_t no_component =
+    std::numeric_limits<std::uint32_t>::max();
+
+enum flag : std::uint8_t {
+  external = 1 << 0,
+  precompiled = 1 << 1,
+  guarded = 1 << 2,
+};
+
+enum result_flag : std::uint64_t {
+  raw_token_costs = 1 << 0,
+};
+
+struct header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t vertex_count;
+  std::uint64_t edge_count;
+  std::uint64_t source_count;
+  std::uint64_t unguarded_count;
+  std::uint64_t missing_count;
+  std::uint64_t string_count;
+  std::uint64_t string_bytes;
+  std::uint64_t result_flags;
+};
+static_assert(sizeof(header) % 8 == 0);
+
+void pad(std::ostream &out, const std::size_t bytes) {
+  const char zeros[8] = {};
+  out.write(zeros, (8 - bytes % 8) % 8);
+}
+
+template <typename T>
+void write_array(std::ostream &out, const std::vector<T> &values) {
+  const std::size_t bytes = values.size() * sizeof(T);
+  out.write(reinterpret_cast<const char *>(values.data()), bytes);
+  pad(out, bytes);
+}
+
+// This component assigns each distinct string an index in the order it is
+// first seen.
+class StringTable {
+  std::unordered_map<string_pool::id, std::uint32_t> m_indices;
+  std::vector<interned_string> m_strings;
+
+public:
+  std::uint32_t index(const interned_string &s) {
+    const auto [it, inserted] =
+        m_indices.emplace(s.id(), std::uint32_t(m_strings.size()));
+    if (inserted) {
+      m_strings.push_back(s);
+    }
+    return it->second;
+  }
+
+  std::size_t size() const { return m_strings.size(); }
+
+  std::size_t byte_count() const {
+    std::size_t total = 0;
+    for (const interned_string &s : m_strings) {
+      total += s.str().size();
+    }
+    return total;
+  }
+
+  void write(std::ostream &out) const {
+    std::vector<std::uint64_t> offsets;
+    offsets.reserve(m_strings.size() + 1);
+    offsets.push_back(0u);
+    for (const interned_string &s : m_strings) {
+      offsets.push_back(offsets.back() + s.str().size());
+    }
+    write_array(out, offsets);
+    for (const interned_string &s : m_strings) {
+      out.write(s.str().data(), s.str().size());
+    }
+    pad(out, offsets.back());
+  }
+};
+
+// This component reads aligned arrays from a block of memory, throwing if
+// we would read past the end.
+class Reader {
+  const char *m_it;
+  const char *m_end;
+
+public:
+  Reader(const void *data, std::size_t size)
+      : m_it(static_cast<const char *>(data)), m_end(m_it + size) {}
+
+  template <typename T> std::span<const T> array(const std::uint64_t count) {
+    if (count > static_cast<std::size_t>(m_end - m_it) / sizeof(T)) {
+      throw std::runtime_error("Graph file is truncated");
+    }
+    const T *const data = reinterpret_cast<const T *>(m_it);
+    const std::size_t bytes = count * sizeof(T);
+    m_it += std::min<std::size_t>(bytes + (8 - bytes % 8) % 8, m_end - m_it);
+    return {data, count};
+  }
+};
+
+void check(const bool condition, const char *message) {
+  if (!condition) {
+    throw std::runtime_error(message);
+  }
+}
+
+} // namespace
+
+void graph_file::save(const build_graph::result &r, std::ostream &out) {
+  const Graph &graph = r.graph;
+  const std::size_t V = num_vertices(graph);
+  StringTable strings;
+
+  std::vector<std::uint32_t> directories;
+  std::vector<std::uint32_t> names;
+  std::vector<std::int64_t> token_counts;
+  std::vector<double> file_sizes;
+  std::vector<std::uint8_t> flags;
+  std::vector<std::uint32_t> components;
+  std::vector<std::uint32_t> internal_incoming;
+  std::vector<std::uint32_t> external_incoming;
+  std::vector<std::uint32_t> location_directories;
+  std::vector<std::uint32_t> location_names;
+  std::vector<std::int64_t> modified;
+  std::vector<std::uint64_t> content_hashes;
+  std::vector<std::uint32_t> weights;
+  std::vector<std::uint32_t> vertex_configurations;
+  std::vector<std::uint64_t> configuration_weight_offsets;
+  std::vector<std::uint32_t> configuration_weights;
+  std::vector<std::uint64_t> missing_include_offsets;
+  std::vector<std::uint32_t> missing_includes;
+  std::vector<std::uint64_t> absent_path_offsets;
+  std::vector<std::uint32_t> absent_directories;
+  std::vector<std::uint32_t> absent_names;
+  std::vector<std::uint64_t> out_offsets;
+  std::vector<std::uint32_t> targets;
+  std::vector<std::uint32_t> codes;
+  std::vector<std::uint32_t> line_numbers;
+  std::vector<std::uint8_t> removable;
+  std::vector<std::uint32_t> edge_configurations;
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    const file_node &node = graph[v];
+    directories.push_back(strings.index(node.path.directory()));
+    names.push_back(strings.index(node.path.name()));
+    token_counts.push_back(node.underlying_cost.token_count);
+    file_sizes.push_back(node.underlying_cost.file_size.value());
+    flags.push_back((node.is_external ? external : 0) |
+                    (node.is_precompiled ? precompiled : 0) |
+                    (node.is_guarded ? guarded : 0));
+    components.push_back(node.component ? std::uint32_t(*node.component)
+                                        : no_component);
+    internal_incoming.push_back(node.internal_incoming);
+    external_incoming.push_back(node.external_incoming);
+    location_directories.push_back(
+        strings.index(node.stamp.location.directory()));
+    location_names.push_back(strings.index(node.stamp.location.name()));
+    modified.push_back(node.stamp.modified);
+    content_hashes.push_back(node.stamp.content_hash);
+    weights.push_back(node.weight);
+    vertex_configurations.push_back(node.configurations);
+    configuration_weight_offsets.push_back(configuration_weights.size());
+    configuration_weights.insert(configuration_weights.end(),
+                                 node.configuration_weights.begin(),
+                                 node.configuration_weights.end());
+    missing_include_offsets.push_back(missing_includes.size());
+    for (const interned_string &m : node.missing_includes) {
+      missing_includes.push_back(strings.index(m));
+    }
+    absent_path_offsets.push_back(absent_directories.size());
+    for (const interned_path &p : node.absent_paths) {
+      absent_directories.push_back(strings.index(p.directory()));
+      absent_names.push_back(strings.index(p.name()));
+    }
+
+    out_offsets.push_back(targets.size());
+    for (const Graph::edge_descriptor &e :
+         boost::make_iterator_range(out_edges(v, graph))) {
+      const include_edge &include = graph[e];
+      targets.push_back(std::uint32_t(target(e, graph)));
+      codes.push_back(strings.index(include.code));
+      line_numbers.push_back(include.lineNumber);
+      removable.push_back(include.is_removable);
+      edge_configurations.push_back(include.configurations);
+    }
+  }
+  configuration_weight_offsets.push_back(configuration_weights.size());
+  missing_include_offsets.push_back(missing_includes.size());
+  absent_path_offsets.push_back(absent_directories.size());
+  out_offsets.push_back(targets.size());
+
+  const std::vector<std::uint32_t> sources(r.sources.begin(),
+                                           r.sources.end());
+
+  // Sort the unguarded files so that the output is deterministic
+  std::vector<std::uint32_t> unguarded(r.unguarded_files.begin(),
+                                       r.unguarded_files.end());
+  std::sort(unguarded.begin(), unguarded.end());
+
+  std::vector<std::uint32_t> missing;
+  for (const std::string &m : r.missing_includes) {
+    missing.push_back(strings.index(interned_string(m)));
+  }
+
+  header h = {};
+  std::copy(std::begin(magic), std::end(magic), h.magic);
+  h.version = version;
+  h.byte_order = byte_order_mark;
+  h.vertex_count = V;
+  h.edge_count = targets.size();
+  h.source_count = sources.size();
+  h.unguarded_count = unguarded.size();
+  h.missing_count = missing.size();
+  h.string_count = strings.size();
+  h.string_bytes = strings.byte_count();
+  h.result_flags = r.raw_token_costs ? raw_token_costs : 0u;
+  out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+
+  strings.write(out);
+  write_array(out, directories);
+  write_array(out, names);
+  write_array(out, token_counts);
+  write_array(out, file_sizes);
+  write_array(out, flags);
+  write_array(out, components);
+  write_array(out, internal_incoming);
+  write_array(out, external_incoming);
+  write_array(out, location_directories);
+  write_array(out, location_names);
+  write_array(out, modified);
+  write_array(out, content_hashes);
+  write_array(out, weights);
+  write_array(out, vertex_configurations);
+  write_array(out, configuration_weight_offsets);
+  write_array(out, configuration_weights);
+  write_array(out, missing_include_offsets);
+  write_array(out, missing_includes);
+  write_array(out, absent_path_offsets);
+  write_array(out, absent_directories);
+  write_array(out, absent_names);
+  write_array(out, out_offsets);
+  write_array(out, targets);
+  write_array(out, codes);
+  write_array(out, line_numbers);
+  write_array(out, removable);
+  write_array(out, edge_configurations);
+  write_array(out, sources);
+  write_array(out, unguarded);
+  write_array(out, missing);
+}
+
+build_graph::result graph_file::load(const std::filesystem::path &path) {
+  namespace bip = boost::interprocess;
+  const bip::file_mapping file(path.string().c_str(), bip::read_only);
+  const bip::mapped_region region(file, bip::read_only);
+  Reader reader(region.get_address(), region.get_size());
+
+  const header &h = reader.array<header>(1)[0];
+  check(std::equal(std::begin(magic), std::end(magic), h.magic),
+        "Not a graph file");
+  check(h.byte_order == byte_order_mark,
+        "Graph file was written with a different byte order");
+  check(h.version == version, "Unsupported graph file version");
+
+  const std::size_t V = h.vertex_count;
+  const std::size_t E = h.edge_count;
+  const std::span offsets = reader.array<std::uint64_t>(h.string_count + 1);
+  const std::span chars = reader.array<char>(h.string_bytes);
+  check(offsets.front() == 0u && offsets.back() == chars.size() &&
+            std::is_sorted(offsets.begin(), offsets.end()),
+        "Corrupt string table");
+  std::vector<interned_string> strings;
+  strings.reserve(h.string_count);
+  for (std::size_t i = 0; i != h.string_count; ++i) {
+    strings.emplace_back(std::string_view(chars.data() + offsets[i],
+                                          offsets[i + 1] - offsets[i]));
+  }
+  const auto string_at = [&](const std::uint32_t i) {
+    check(i < strings.size(), "Corrupt string index");
+    return strings[i];
+  };
+
+  const std::span directories = reader.array<std::uint32_t>(V);
+  const std::span names = reader.array<std::uint32_t>(V);
+  const std::span token_counts = reader.array<std::int64_t>(V);
+  const std::span file_sizes = reader.array<double>(V);
+  const std::span flags = reader.array<std::uint8_t>(V);
+  const std::span components = reader.array<std::uint32_t>(V);
+  const std::span internal_incoming = reader.array<std::uint32_t>(V);
+  const std::span external_incoming = reader.array<std::uint32_t>(V);
+  const std::span location_directories = reader.array<std::uint32_t>(V);
+  const std::span location_names = reader.array<std::uint32_t>(V);
+  const std::span modified = reader.array<std::int64_t>(V);
+  const std::span content_hashes = reader.array<std::uint64_t>(V);
+  const std::span weights = reader.array<std::uint32_t>(V);
+  const std::span vertex_configurations = reader.array<std::uint32_t>(V);
+  const std::span configuration_weight_offsets =
+      reader.array<std::uint64_t>(V + 1);
+  check(configuration_weight_offsets.front() == 0u &&
+            std::is_sorted(configuration_weight_offsets.begin(),
+                           configuration_weight_offsets.end()),
+        "Corrupt configuration weight offsets");
+  const std::span configuration_weights =
+      reader.array<std::uint32_t>(configuration_weight_offsets.back());
+  const std::span missing_include_offsets = reader.array<std::uint64_t>(V + 1);
+  check(missing_include_offsets.front() == 0u &&
+            std::is_sorted(missing_include_offsets.begin(),
+                           missing_include_offsets.end()),
+        "Corrupt missing include offsets");
+  const std::span missing_includes =
+      reader.array<std::uint32_t>(missing_include_offsets.back());
+  const std::span absent_path_offsets = reader.array<std::uint64_t>(V + 1);
+  check(absent_path_offsets.front() == 0u &&
+            std::is_sorted(absent_path_offsets.begin(),
+                           absent_path_offsets.end()),
+        "Corrupt absent path offsets");
+  const std::span absent_directories =
+      reader.array<std::uint32_t>(absent_path_offsets.back());
+  const std::span absent_names =
+      reader.array<std::uint32_t>(absent_path_offsets.back());
+  const std::span out_offsets = reader.array<std::uint64_t>(V + 1);
+  const std::span targets = reader.array<std::uint32_t>(E);
+  const std::span codes = reader.array<std::uint32_t>(E);
+  const std::span line_numbers = reader.array<std::uint32_t>(E);
+  const std::span removable = reader.array<std::uint8_t>(E);
+  const std::span edge_configurations = reader.array<std::uint32_t>(E);
+  const std::span sources = reader.array<std::uint32_t>(h.source_count);
+  const std::span unguarded = reader.array<std::uint32_t>(h.unguarded_count);
+  const std::span missing = reader.array<std::uint32_t>(h.missing_count);
+  check(out_offsets.front() == 0u && out_offsets.back() == E &&
+            std::is_sorted(out_offsets.begin(), out_offsets.end()),
+        "Corrupt edge offsets");
+  const auto vertex_at = [&](const std::uint32_t v) {
+    check(v < V, "Corrupt vertex index");
+    return Graph::vertex_descriptor(v);
+  };
+
+  build_graph::result r;
+  r.graph = Graph(V);
+  r.raw_token_costs = h.result_flags & raw_token_costs;
+  for (Graph::vertex_descriptor v = 0; v != V; ++v) {
+    file_node &node = r.graph[v];
+    node.path = interned_path(string_at(directories[v]), string_at(names[v]));
+    node.underlying_cost = cost{
+        token_counts[v],
+        boost::units::quantity<boost::units::information::info>::from_value(
+            file_sizes[v])};
+    node.is_external = flags[v] & external;
+    node.is_precompiled = flags[v] & precompiled;
+    node.is_guarded = flags[v] & guarded;
+    if (components[v] != no_component) {
+      node.component = vertex_at(components[v]);
+    }
+    node.internal_incoming = internal_incoming[v];
+    node.external_incoming = external_incoming[v];
+    node.stamp.location = interned_path(string_at(location_directories[v]),
+                                        string_at(location_names[v]));
+    node.stamp.modified = modified[v];
+    node.stamp.content_hash = content_hashes[v];
+    node.weight = weights[v];
+    node.configurations = vertex_configurations[v];
+    node.configuration_weights.assign(
+        configuration_weights.begin() + configuration_weight_offsets[v],
+        configuration_weights.begin() + configuration_weight_offsets[v + 1]);
+    for (std::size_t i = missing_include_offsets[v];
+         i != missing_include_offsets[v + 1]; ++i) {
+      node.missing_includes.push_back(string_at(missing_includes[i]));
+    }
+    for (std::size_t i = absent_path_offsets[v];
+         i != absent_path_offsets[v + 1]; ++i) {
+      node.absent_paths.emplace_back(string_at(absent_directories[i]),
+                                     string_at(absent_names[i]));
+    }
+  }
+
+  for (Graph::vertex_descriptor v = 0; v != V; ++v) {
+    for (std::size_t i = out_offsets[v]; i != out_offsets[v + 1]; ++i) {
+      add_edge(v, vertex_at(targets[i]),
+               include_edge{string_at(codes[i]), line_numbers[i],
+                            removable[i] != 0, edge_configurations[i]},
+               r.graph);
+    }
+  }
+
+  r.sources.reserve(sources.size());
+  for (const std::uint32_t v : sources) {
+    r.sources.push_back(vertex_at(v));
+  }
+  for (const std::uint32_t v : unguarded) {
+    r.unguarded_files.insert(vertex_at(v));
+  }
+  for (const std::uint32_t i : missing) {
+    r.missing_includes.insert(string_at(i).str());
+  }
+  return r;
+}
+
+} // namespace IncludeGuardian
@@ -0,0 +1,45 @@
+#ifndef INCLUDE_GUARD_E78DD4B5_7259_4FDD_811E_43714E0D56CF
+#define INCLUDE_GUARD_E78DD4B5_7259_4FDD_811E_43714E0D56CF
+
+// `graph_file` reads and writes a `build_graph::result` in a versioned
+// binary format that is designed to be memory mapped.  The file is a fixed
+// size header followed by a series of arrays, each aligned to 8 bytes:
+//
+//   * the string table, as offsets followed by the characters
+//   * a column for each `file_node` property, including its `file_stamp`,
+//     with paths and include directives stored as indices into the string
+//     table, and the `configuration_weights`, `missing_includes` and
+//     `absent_paths` (as a directory and a name) in compressed sparse row
+//     form
+//   * the include edges in compressed sparse row form
+//   * the sources, unguarded files and missing includes
+//
+// Loading a file maps it into memory and builds the graph directly from
+// these arrays without any parsing.
+
+#include "build_graph.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+
+namespace IncludeGuardian {
+
+struct graph_file {
+  /// The version written by `save`.  `load` will only accept files with
+  /// this version.
+  static constexpr std::uint32_t version = 8;
+
+  /// Write the specified `r` to the specified `out`, which should be opened
+  /// in binary mode.
+  static void save(const build_graph::result &r, std::ostream &out);
+
+  /// Return the result stored in the file at the specified `path`.  Throw
+  /// `std::runtime_error` if the file is not a valid graph file of the
+  /// current `version`.
+  static build_graph::result load(const std::filesystem::path &path);
+};
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,135 @@
+#include "graph_file.hpp"
+
+#include "analysis_test_fixtures.hpp"
+#include "matchers.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+// This component writes to a file in the temporary directory and removes it
+// when destroyed.
+class TemporaryFile {
+  std::filesystem::path m_path;
+
+public:
+  explicit TemporaryFile(const std::string &name)
+      : m_path(std::filesystem::temp_directory_path() / name) {}
+  ~TemporaryFile() {
+    std::error_code ec;
+    std::filesystem::remove(m_path, ec);
+  }
+  const std::filesystem::path &path() const { return m_path; }
+};
+
+build_graph::result round_trip(const build_graph::result &r,
+                               const std::string &name) {
+  const TemporaryFile file(name);
+  {
+    std::ofstream out(file.path(), std::ios::binary);
+    graph_file::save(r, out);
+  }
+  return graph_file::load(file.path());
+}
+
+TEST_F(DiamondGraph, GraphFile) {
+  graph[b].is_external = true;
+  graph[c].is_precompiled = true;
+  graph[c].is_guarded = false;
+  graph[d].component = c;
+  graph[d].internal_incoming = 1;
+  graph[d].external_incoming = 2;
+  graph[c_to_d].is_removable = false;
+  graph[d].stamp.location = interned_path(std::filesystem::path("/inc/d.hpp"));
+  graph[d].stamp.modified = 1234567890;
+  graph[d].stamp.content_hash = 0xFEDCBA9876543210u;
+  graph[a].weight = 3u;
+  graph[a].configuration_weights = {1u, 0u, 2u};
+  graph[b].configurations = 0b101u;
+  graph[c].missing_includes = {"missing.hpp"};
+  graph[c].absent_paths = {{"/inc/", "c/d.hpp"}, {"/inc/", "missing.hpp"}};
+  graph[c_to_d].configurations = 0b110u;
+
+  build_graph::result expected;
+  expected.graph = graph;
+  expected.sources = {a};
+  expected.missing_includes = {"missing.hpp", "other/missing.hpp"};
+  expected.unguarded_files = {c, d};
+  expected.raw_token_costs = true;
+
+  const build_graph::result actual =
+      round_trip(expected, "includeguardian_diamond.igg");
+  EXPECT_THAT(actual.graph, GraphsAreEquivalent(expected.graph));
+  EXPECT_THAT(actual.sources, ElementsAre(a));
+  EXPECT_THAT(actual.missing_includes,
+              ElementsAre("missing.hpp", "other/missing.hpp"));
+  EXPECT_THAT(actual.unguarded_files, UnorderedElementsAre(c, d));
+  EXPECT_TRUE(actual.raw_token_costs);
+  EXPECT_TRUE(actual.graph[d].component == c);
+  EXPECT_FALSE(actual.graph[a].component);
+  EXPECT_EQ(actual.graph[d].internal_incoming, 1u);
+  EXPECT_EQ(actual.graph[d].external_incoming, 2u);
+  EXPECT_EQ(actual.graph[d].stamp.location, "/inc/d.hpp");
+  EXPECT_EQ(actual.graph[d].stamp.modified, 1234567890);
+  EXPECT_EQ(actual.graph[d].stamp.content_hash, 0xFEDCBA9876543210u);
+  EXPECT_TRUE(actual.graph[a].stamp.location.empty());
+  EXPECT_EQ(actual.graph[a].weight, 3u);
+  EXPECT_THAT(actual.graph[a].configuration_weights, ElementsAre(1u, 0u, 2u));
+  EXPECT_THAT(actual.graph[b].configuration_weights, SizeIs(0));
+  EXPECT_EQ(actual.graph[b].configurations, 0b101u);
+  EXPECT_EQ(actual.graph[a].configurations, 1u);
+  EXPECT_THAT(actual.graph[c].missing_includes, ElementsAre("missing.hpp"));
+  EXPECT_THAT(actual.graph[c].absent_paths,
+              ElementsAre(interned_path("/inc/", "c/d.hpp"),
+                          interned_path("/inc/", "missing.hpp")));
+  EXPECT_THAT(actual.graph[d].absent_paths, SizeIs(0));
+}
+
+TEST_F(ComplexCascadingInclude, GraphFile) {
+  build_graph::result expected;
+  expected.graph = graph;
+  const build_graph::result actual =
+      round_trip(expected, "includeguardian_complex.igg");
+  EXPECT_THAT(actual.graph, GraphsAreEquivalent(expected.graph));
+  EXPECT_THAT(actual.sources, SizeIs(0));
+  EXPECT_THAT(actual.missing_includes, SizeIs(0));
+  EXPECT_THAT(actual.unguarded_files, SizeIs(0));
+  EXPECT_FALSE(actual.raw_token_costs);
+}
+
+TEST(GraphFile, InvalidFile) {
+  const TemporaryFile file("includeguardian_invalid.igg");
+  {
+    std::ofstream out(file.path(), std::ios::binary);
+    out << "22 serialization::archive 19 0 0 4 4 0 0 0";
+  }
+  EXPECT_THROW(graph_file::load(file.path()), std::runtime_error);
+}
+
+TEST_F(LongChain, GraphFileTruncated) {
+  build_graph::result r;
+  r.graph = graph;
+  const TemporaryFile file("includeguardian_truncated.igg");
+  std::string contents;
+  {
+    std::ostringstream out;
+    graph_file::save(r, out);
+    contents = out.str();
+  }
+  {
+    std::ofstream out(file.path(), std::ios::binary);
+    out.write(contents.data(), contents.size() / 2);
+  }
+  EXPECT_THROW(graph_file::load(file.path()), std::runtime_error);
+}
+
+} // namespace
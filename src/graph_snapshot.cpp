@@ -0,0 +1,150 @@
+#include "graph_snapshot.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <limits>
+#include <numeric>
+
+namespace IncludeGuardian {
+
+graph_snapshot::graph_snapshot(const node_properties &properties)
+    : m_out_offsets(), m_out(), m_in_offsets(), m_in(),
+      m_properties(properties), m_configuration_count(1u),
+      m_out_configurations(), m_configuration_weights() {}
+
+graph_snapshot::graph_snapshot(const Graph &graph)
+    : m_out_offsets(), m_out(), m_in_offsets(), m_in(), m_properties(graph),
+      m_configuration_count(), m_out_configurations(),
+      m_configuration_weights() {
+  const std::size_t V = num_vertices(graph);
+  assert(V < std::numeric_limits<vertex_descriptor>::max());
+
+  std::uint32_t configurations = 0u;
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    configurations |= graph[v].configurations;
+  }
+  m_configuration_count =
+      std::max(1u, static_cast<unsigned>(std::bit_width(configurations)));
+  const bool is_merged = m_configuration_count > 1u;
+
+  m_out_offsets.reserve(V + 1);
+  m_out.reserve(num_edges(graph));
+  if (is_merged) {
+    m_out_configurations.reserve(num_edges(graph));
+    m_configuration_weights.reserve(V * m_configuration_count);
+  }
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    m_out_offsets.push_back(m_out.size());
+    for (const Graph::edge_descriptor &e :
+         boost::make_iterator_range(out_edges(v, graph))) {
+      m_out.push_back(static_cast<vertex_descriptor>(target(e, graph)));
+      if (is_merged) {
+        m_out_configurations.push_back(graph[e].configurations);
+      }
+    }
+    if (is_merged) {
+      for (unsigned i = 0; i != m_configuration_count; ++i) {
+        m_configuration_weights.push_back(graph[v].configuration_weight(i));
+      }
+    }
+  }
+  m_out_offsets.push_back(m_out.size());
+  build_parents();
+}
+
+void graph_snapshot::build_parents() {
+  const std::size_t V = vertex_count();
+  m_in_offsets.assign(V + 1, 0u);
+  for (const vertex_descriptor child : m_out) {
+    ++m_in_offsets[child + 1];
+  }
+
+  // Fill in the parents using a counting sort on the children
+  std::partial_sum(m_in_offsets.begin(), m_in_offsets.end(),
+                   m_in_offsets.begin());
+  m_in.resize(m_out.size());
+  std::vector<std::size_t> next(m_in_offsets.begin(), m_in_offsets.end() - 1);
+  for (vertex_descriptor v = 0; v != V; ++v) {
+    for (const vertex_descriptor child : children(v)) {
+      m_in[next[child]++] = v;
+    }
+  }
+}
+
+graph_snapshot
+graph_snapshot::configuration(const unsigned configuration) const {
+  assert(configuration < m_configuration_count);
+  if (m_configuration_count == 1u) {
+    return *this;
+  }
+
+  graph_snapshot result(m_properties);
+  const std::size_t V = vertex_count();
+  const std::uint32_t bit = std::uint32_t(1) << configuration;
+  result.m_out_offsets.reserve(V + 1);
+  for (vertex_descriptor v = 0; v != V; ++v) {
+    result.m_out_offsets.push_back(result.m_out.size());
+    for (std::size_t i = m_out_offsets[v]; i != m_out_offsets[v + 1]; ++i) {
+      if (m_out_configurations[i] & bit) {
+        result.m_out.push_back(m_out[i]);
+      }
+    }
+    result.m_properties.set_weight(
+        v, m_configuration_weights[v * m_configuration_count + configuration]);
+  }
+  result.m_out_offsets.push_back(result.m_out.size());
+  result.build_parents();
+  return result;
+}
+
+std::vector<unsigned> graph_snapshot::weights(
+    std::span<const Graph::vertex_descriptor> sources) const {
+  std::vector<unsigned> result;
+  if (std::any_of(sources.begin(), sources.end(),
+                  [&](const Graph::vertex_descriptor v) {
+                    return weight(v) != 1u;
+                  })) {
+    result.reserve(sources.size());
+    for (const Graph::vertex_descriptor v : sources) {
+      result.push_back(weight(v));
+    }
+  }
+  return result;
+}
+
+std::size_t num_vertices(const graph_snapshot &graph) {
+  return graph.vertex_count();
+}
+
+std::pair<graph_snapshot::adjacency_iterator,
+          graph_snapshot::adjacency_iterator>
+adjacent_vertices(graph_snapshot::vertex_descriptor v,
+                  const graph_snapshot &graph) {
+  const std::span<const graph_snapshot::vertex_descriptor> c =
+      graph.children(v);
+  return {c.data(), c.data() + c.size()};
+}
+
+std::pair<graph_snapshot::adjacency_iterator,
+          graph_snapshot::adjacency_iterator>
+inv_adjacent_vertices(graph_snapshot::vertex_descriptor v,
+                      const graph_snapshot &graph) {
+  const std::span<const graph_snapshot::vertex_descriptor> p =
+      graph.parents(v);
+  return {p.data(), p.data() + p.size()};
+}
+
+std::size_t out_degree(graph_snapshot::vertex_descriptor v,
+                       const graph_snapshot &graph) {
+  return graph.children(v).size();
+}
+
+std::size_t in_degree(graph_snapshot::vertex_descriptor v,
+                      const graph_snapshot &graph) {
+  return graph.parents(v).size();
+}
+
+} // namespace IncludeGuardian
@@ -0,0 +1,151 @@
+#ifndef INCLUDE_GUARD_2C13635D_C7B4_4D3D_9DD2_D1231DEC75D7
+#define INCLUDE_GUARD_2C13635D_C7B4_4D3D_9DD2_D1231DEC75D7
+
+// `graph_snapshot` is an immutable copy of a `Graph` for use during analysis.
+// `Graph` stores a separate heap allocation for the edges of each vertex and
+// mixes properties that we rarely look at (e.g. `path`) with those that are
+// used in the inner loop of most traversals (e.g. `true_cost()`).  Here we
+// store the edges in compressed sparse row form with 32-bit vertex ids, and
+// keep the hot properties in a columnar `node_properties`.
+//
+// Vertex ids are identical to those in the original `Graph`.
+//
+// For a graph merged from several configurations by `multi_config::merge`,
+// we also keep the configurations of each include and the weight of each
+// source in each configuration, so that analyses can cost each
+// configuration separately with `configuration`.
+
+#include "graph.hpp"
+#include "node_properties.hpp"
+
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace IncludeGuardian {
+
+class graph_snapshot {
+public:
+  using vertex_descriptor = std::uint32_t;
+  using adjacency_iterator = const vertex_descriptor *;
+
+private:
+  std::vector<std::size_t> m_out_offsets; //< vertex -> first index in `m_out`
+  std::vector<vertex_descriptor> m_out;   //< children ordered by parent
+  std::vector<std::size_t> m_in_offsets;  //< vertex -> first index in `m_in`
+  std::vector<vertex_descriptor> m_in;    //< parents ordered by child
+  node_properties m_properties;
+  unsigned m_configuration_count; //< 1 unless the graph was merged
+  std::vector<std::uint32_t> m_out_configurations; //< configurations of each
+                                                   //< include in `m_out`
+  std::vector<std::uint32_t> m_configuration_weights; //< vertex * count + i ->
+                                                      //< weight in the `i`th
+                                                      //< configuration
+
+  explicit graph_snapshot(const node_properties &properties);
+
+  // Fill in `m_in` and `m_in_offsets` from `m_out` and `m_out_offsets`.
+  void build_parents();
+
+public:
+
+  /// Create a snapshot of the specified `graph`, which must have fewer than
+  /// 2^32 vertices.
+  explicit graph_snapshot(const Graph &graph);
+
+  /// Return the number of configurations of the original graph, which is
+  /// the position of the highest bit set in the `configurations` of any
+  /// file, or 1 if there are none.
+  unsigned configuration_count() const { return m_configuration_count; }
+
+  /// Return a snapshot of the part of the original graph seen in the
+  /// specified `configuration`, with the same vertices, but only the
+  /// includes seen in `configuration` and where each `weight` is the
+  /// `configuration_weight` of that file.  The cost of each file is
+  /// unchanged, as the merged graph only has one cost per file.  The behavior
+  /// is undefined unless `configuration < configuration_count()`.
+  graph_snapshot configuration(unsigned configuration) const;
+
+  /// Return the number of vertices.
+  std::size_t vertex_count() const { return m_properties.size(); }
+
+  /// Return the vertices directly included by `v`.
+  std::span<const vertex_descriptor> children(vertex_descriptor v) const {
+    return {m_out.data() + m_out_offsets[v],
+            m_out.data() + m_out_offsets[v + 1]};
+  }
+
+  /// Return the vertices that directly include `v`.
+  std::span<const vertex_descriptor> parents(vertex_descriptor v) const {
+    return {m_in.data() + m_in_offsets[v], m_in.data() + m_in_offsets[v + 1]};
+  }
+
+  /// Return the properties of all vertices.
+  const node_properties &properties() const { return m_properties; }
+
+  /// Return the `true_cost()` of `v` in the original graph.
+  cost true_cost(vertex_descriptor v) const {
+    return m_properties.true_cost(v);
+  }
+
+  /// Return the `underlying_cost` of `v` if it is precompiled, otherwise 0.
+  cost precompiled_cost(vertex_descriptor v) const {
+    return m_properties.precompiled_cost(v);
+  }
+
+  bool is_external(vertex_descriptor v) const {
+    return m_properties.is_external(v);
+  }
+  bool is_precompiled(vertex_descriptor v) const {
+    return m_properties.is_precompiled(v);
+  }
+  bool is_guarded(vertex_descriptor v) const {
+    return m_properties.is_guarded(v);
+  }
+
+  /// Return the `weight` of `v` in the original graph.
+  unsigned weight(vertex_descriptor v) const { return m_properties.weight(v); }
+
+  /// Return the `weight` of each of the specified `sources`, or an empty
+  /// vector if all of them have a weight of 1.
+  std::vector<unsigned>
+  weights(std::span<const Graph::vertex_descriptor> sources) const;
+};
+
+/// Call `f(configuration, mask)` for each configuration of the specified
+/// `graph`, where `configuration` is the snapshot returned by
+/// `graph.configuration(i)` and `mask` has only bit `i` set.  If there is
+/// only one configuration, then call `f(graph, mask)` once with all bits of
+/// `mask` set instead.
+template <typename F> void for_each_configuration(const graph_snapshot &graph,
+                                                  F f) {
+  if (graph.configuration_count() == 1u) {
+    f(graph, ~std::uint32_t(0));
+    return;
+  }
+
+  for (unsigned i = 0; i != graph.configuration_count(); ++i) {
+    f(graph.configuration(i), std::uint32_t(1) << i);
+  }
+}
+
+// Overloads that allow `graph_snapshot` to be used in generic graph algorithms
+// written for `Graph`, such as `multi_source_bfs`.
+std::size_t num_vertices(const graph_snapshot &graph);
+std::pair<graph_snapshot::adjacency_iterator,
+          graph_snapshot::adjacency_iterator>
+adjacent_vertices(graph_snapshot::vertex_descriptor v,
+                  const graph_snapshot &graph);
+std::pair<graph_snapshot::adjacency_iterator,
+          graph_snapshot::adjacency_iterator>
+inv_adjacent_vertices(graph_snapshot::vertex_descriptor v,
+                      const graph_snapshot &graph);
+std::size_t out_degree(graph_snapshot::vertex_descriptor v,
+                       const graph_snapshot &graph);
+std::size_t in_degree(graph_snapshot::vertex_descriptor v,
+                      const graph_snapshot &graph);
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,76 @@
+#include "graph_snapshot.hpp"
+
+#include "analysis_test_fixtures.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <span>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+std::vector<graph_snapshot::vertex_descriptor>
+to_vector(std::span<const graph_snapshot::vertex_descriptor> vs) {
+  return {vs.begin(), vs.end()};
+}
+
+TEST_F(MultiLevel, GraphSnapshot) {
+  const graph_snapshot snapshot(graph);
+  ASSERT_EQ(snapshot.vertex_count(), num_vertices(graph));
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    const auto [out_begin, out_end] = adjacent_vertices(v, graph);
+    EXPECT_THAT(to_vector(snapshot.children(v)),
+                ElementsAreArray(out_begin, out_end))
+        << v;
+    const auto [in_begin, in_end] = inv_adjacent_vertices(v, graph);
+    EXPECT_THAT(to_vector(snapshot.parents(v)),
+                UnorderedElementsAreArray(in_begin, in_end))
+        << v;
+    EXPECT_EQ(snapshot.true_cost(v), graph[v].true_cost()) << v;
+    EXPECT_EQ(snapshot.precompiled_cost(v), cost{}) << v;
+    EXPECT_FALSE(snapshot.is_external(v)) << v;
+  }
+}
+
+TEST(GraphSnapshot, Flags) {
+  const cost size(10, 100.0 * boost::units::information::byte);
+  Graph graph;
+  const Graph::vertex_descriptor a =
+      add_vertex(file_node("a").with_cost(size), graph);
+  const Graph::vertex_descriptor b = add_vertex(
+      file_node("b").with_cost(size).set_external(true).set_guarded(true),
+      graph);
+  const Graph::vertex_descriptor c =
+      add_vertex(file_node("c").with_cost(size).set_precompiled(true), graph);
+  add_edge(a, b, {"b"}, graph);
+  add_edge(a, c, {"c"}, graph);
+
+  const graph_snapshot snapshot(graph);
+  EXPECT_FALSE(snapshot.is_external(a));
+  EXPECT_FALSE(snapshot.is_precompiled(a));
+  EXPECT_FALSE(snapshot.is_guarded(a));
+  EXPECT_TRUE(snapshot.is_external(b));
+  EXPECT_FALSE(snapshot.is_precompiled(b));
+  EXPECT_TRUE(snapshot.is_guarded(b));
+  EXPECT_FALSE(snapshot.is_external(c));
+  EXPECT_TRUE(snapshot.is_precompiled(c));
+  EXPECT_FALSE(snapshot.is_guarded(c));
+
+  EXPECT_EQ(snapshot.true_cost(a), size);
+  EXPECT_EQ(snapshot.true_cost(c), graph[c].true_cost());
+  EXPECT_EQ(snapshot.precompiled_cost(a), cost{});
+  EXPECT_EQ(snapshot.precompiled_cost(c), size);
+
+  EXPECT_THAT(to_vector(snapshot.children(a)), ElementsAre(b, c));
+  EXPECT_THAT(to_vector(snapshot.parents(b)), ElementsAre(a));
+  EXPECT_THAT(to_vector(snapshot.parents(c)), ElementsAre(a));
+  EXPECT_EQ(out_degree(a, snapshot), 2u);
+  EXPECT_EQ(in_degree(a, snapshot), 0u);
+}
+
+} // namespace
@@ -1,7 +1,11 @@
 #include "includeguardian.hpp"
 
 #include "build_graph.hpp"
+#include "compile_commands.hpp"
+#include "cost_cache.hpp"
+#include "crawl.hpp"
 #include "dot_graph.hpp"
+#include "find_dominating_headers.hpp"
 #include "find_expensive_files.hpp"
 #include "find_expensive_headers.hpp"
 #include "find_expensive_includes.hpp"
@@ -9,15 +13,19 @@
 #include "find_unused_components.hpp"
 #include "get_total_cost.hpp"
 #include "graph.hpp"
+#include "graph_file.hpp"
+#include "graph_snapshot.hpp"
+#include "incremental.hpp"
 #include "list_included_files.hpp"
+#include "multi_config.hpp"
+#include "node_properties.hpp"
 #include "recommend_precompiled.hpp"
+#include "schedule.hpp"
+#include "shard.hpp"
 #include "topological_order.hpp"
 
 #include <termcolor/termcolor.hpp>
 
-#include <boost/archive/text_iarchive.hpp>
-#include <boost/archive/text_oarchive.hpp>
-#include <boost/graph/adj_list_serialize.hpp>
 #include <boost/units/io.hpp>
 
 #include <llvm/Support/CommandLine.h>
@@ -26,13 +34,18 @@
 #include <clang/Tooling/ArgumentsAdjusters.h>
 #include <clang/Tooling/CommonOptionsParser.h>
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
+#include <optional>
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace IncludeGuardian {
 
@@ -146,6 +159,10 @@ void yaml_value(std::ostream &o,
     << i.value() << comment_color << " # " << format_file_size(i) << "\n";
 }
 
+void yaml_value(std::ostream &o, const interned_path &p) {
+  yaml_value(o, std::string_view(p.string()));
+}
+
 void yaml_value(std::ostream &o, const file_node &v) {
   std::ostringstream ss;
   if (v.is_external) {
@@ -293,19 +310,8 @@ build_graph::file_type map_ext(std::string_view file) {
       ->second;
 }
 
-get_total_cost::result get_naive_cost(const Graph &g) {
-  const auto [begin, end] = vertices(g);
-  return std::accumulate(
-      begin, end, get_total_cost::result{},
-      [&](get_total_cost::result acc, const Graph::vertex_descriptor v) {
-        get_total_cost::result r;
-        if (g[v].is_precompiled) {
-          r.precompiled += g[v].underlying_cost;
-        } else {
-          r.true_cost += g[v].underlying_cost;
-        }
-        return acc + r;
-      });
+get_total_cost::result get_naive_cost(const node_properties &properties) {
+  return {properties.total_true_cost(), properties.total_precompiled_cost()};
 }
 
 std::vector<std::string>
@@ -364,28 +370,8 @@ public:
   std::vector<std::filesystem::path> m_sources;
 
   ReplacementCompilationDatabase(const std::filesystem::path &working_directory,
-                                 const std::filesystem::path &source_directory,
-                                 llvm::vfs::FileSystem &fs)
-      : m_working_directory(working_directory), m_sources() {
-    std::vector<std::string> directories;
-    directories.push_back(source_directory.string());
-    const llvm::vfs::directory_iterator end;
-    while (!directories.empty()) {
-      const std::string dir_copy = std::move(directories.back());
-      directories.pop_back();
-      std::error_code ec;
-      llvm::vfs::directory_iterator it = fs.dir_begin(dir_copy, ec);
-      while (!ec && it != end) {
-        if (it->type() == llvm::sys::fs::file_type::directory_file) {
-          directories.push_back(it->path().str());
-        } else if (it->type() == llvm::sys::fs::file_type::regular_file &&
-                   map_ext(it->path()) == build_graph::file_type::source) {
-          m_sources.emplace_back(it->path().str());
-        }
-        it.increment(ec);
-      }
-    }
-  }
+                                 std::vector<std::filesystem::path> sources)
+      : m_working_directory(working_directory), m_sources(std::move(sources)) {}
 
   /// Returns all compile commands in which the specified file was
   /// compiled.
@@ -420,6 +406,56 @@ public:
   }
 };
 
+class StreamingCompilationDatabase
+    : public clang::tooling::CompilationDatabase {
+  std::unordered_map<std::string, std::vector<clang::tooling::CompileCommand>>
+      m_commands;
+  std::vector<std::string> m_files; //< In order of first appearance
+
+public:
+  /// Read all commands from the specified `reader`, returning an error if
+  /// it is not a valid compilation database.
+  static llvm::Expected<std::unique_ptr<StreamingCompilationDatabase>>
+  read(compile_commands_reader &reader) {
+    auto db = std::make_unique<StreamingCompilationDatabase>();
+    while (true) {
+      llvm::Expected<std::optional<compile_commands_reader::command>> c =
+          reader.next();
+      if (!c) {
+        return c.takeError();
+      }
+      if (!*c) {
+        return db;
+      }
+
+      compile_commands_reader::command &command = **c;
+      std::string file = (std::filesystem::path(command.directory) /
+                          std::filesystem::path(command.file))
+                             .lexically_normal()
+                             .string();
+      std::vector<clang::tooling::CompileCommand> &commands =
+          db->m_commands[file];
+      if (commands.empty()) {
+        db->m_files.push_back(file);
+      }
+      commands.emplace_back(std::move(command.directory), std::move(file),
+                            std::move(command.arguments),
+                            std::move(command.output));
+    }
+  }
+
+  std::vector<clang::tooling::CompileCommand>
+  getCompileCommands(clang::StringRef FilePath) const final {
+    const auto it = m_commands.find(
+        std::filesystem::path(FilePath.str()).lexically_normal().string());
+    return it == m_commands.end()
+               ? std::vector<clang::tooling::CompileCommand>()
+               : it->second;
+  }
+
+  std::vector<std::string> getAllFiles() const final { return m_files; }
+};
+
 } // namespace
 
 int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
@@ -429,6 +465,43 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
                                        llvm::cl::Optional,
                                        llvm::cl::cat(build_category));
 
+  llvm::cl::opt<std::string> incremental_path(
+      "incremental",
+      llvm::cl::desc("Load a graph saved with --save and only preprocess the "
+                     "sources that include a file that has since changed"),
+      llvm::cl::value_desc("saved-graph"), llvm::cl::Optional,
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<std::string> shard_spec(
+      "shard",
+      llvm::cl::desc("Only preprocess the i-th of N equal slices of the "
+                     "sources, counting from 0.  Use with --save and combine "
+                     "the saved graphs with --merge"),
+      llvm::cl::value_desc("i/N"), llvm::cl::Optional,
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<bool> merge_shards(
+      "merge",
+      llvm::cl::desc("Instead of preprocessing, merge the graphs saved with "
+                     "--shard that are passed as positional arguments, in "
+                     "order of their shard"),
+      llvm::cl::init(false), llvm::cl::cat(build_category));
+
+  llvm::cl::opt<bool> merge_configs(
+      "merge-configs",
+      llvm::cl::desc("Instead of preprocessing, merge the graphs saved with "
+                     "--save for different build configurations that are "
+                     "passed as positional arguments and only report "
+                     "findings that hold in all of them"),
+      llvm::cl::init(false), llvm::cl::cat(build_category));
+
+  llvm::cl::list<unsigned> select_configs(
+      "select-configs",
+      llvm::cl::desc("The configurations to analyze with --merge-configs, "
+                     "counting from 0.  Defaults to all configurations"),
+      llvm::cl::value_desc("index"), llvm::cl::CommaSeparated,
+      llvm::cl::cat(build_category));
+
   llvm::cl::opt<std::string> build_path("p", llvm::cl::desc("Build path"),
                                         llvm::cl::Optional,
                                         llvm::cl::cat(build_category));
@@ -448,6 +521,25 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       llvm::cl::value_desc("directory"), llvm::cl::Optional,
       llvm::cl::cat(build_category));
 
+  llvm::cl::list<std::string> exclude(
+      "exclude",
+      llvm::cl::desc("Glob patterns of files and directories to ignore when "
+                     "using --dir, e.g. '.git' or 'build*'"),
+      llvm::cl::ZeroOrMore, llvm::cl::cat(build_category));
+
+  llvm::cl::list<std::string> include_sources(
+      "include-sources",
+      llvm::cl::desc("Glob patterns of the sources to read from "
+                     "compile_commands.json, e.g. 'src/*'.  If none are "
+                     "given, all sources are read"),
+      llvm::cl::ZeroOrMore, llvm::cl::cat(build_category));
+
+  llvm::cl::list<std::string> exclude_sources(
+      "exclude-sources",
+      llvm::cl::desc("Glob patterns of the sources to skip when reading "
+                     "compile_commands.json, e.g. '*/third_party/*'"),
+      llvm::cl::ZeroOrMore, llvm::cl::cat(build_category));
+
   llvm::cl::list<std::string> include_dirs(
       "I", llvm::cl::desc("Additional include directories"),
       llvm::cl::ZeroOrMore, llvm::cl::cat(build_category));
@@ -482,6 +574,66 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       llvm::cl::value_desc("enabled"), llvm::cl::init(true), llvm::cl::Hidden,
       llvm::cl::cat(build_category));
 
+  llvm::cl::opt<bool> directives_only(
+      "directives-only",
+      llvm::cl::desc("Whether to lex each file once to measure its cost and "
+                     "afterwards only preprocess its directives.  This is "
+                     "faster, but token counts will include inactive "
+                     "preprocessor blocks and will not expand macros"),
+      llvm::cl::value_desc("enabled"), llvm::cl::init(false),
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<std::string> cache_dir(
+      "cache-dir",
+      llvm::cl::desc("A directory in which to cache the cost of each file "
+                     "between runs.  This requires --directives-only"),
+      llvm::cl::value_desc("directory"), llvm::cl::Optional,
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<unsigned> cache_size(
+      "cache-size",
+      llvm::cl::desc("The maximum size of --cache-dir, after which the least "
+                     "recently used entries are removed"),
+      llvm::cl::value_desc("megabytes"), llvm::cl::init(1024),
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<bool> index_include_dirs(
+      "index-include-dirs",
+      llvm::cl::desc("Whether to list each include directory once when it "
+                     "is first searched instead of searching for each "
+                     "include separately"),
+      llvm::cl::value_desc("enabled"), llvm::cl::init(false),
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<bool> deduplicate_sources(
+      "deduplicate-sources",
+      llvm::cl::desc("Whether to preprocess identical compile commands once "
+                     "and count their cost once for each time they appear"),
+      llvm::cl::value_desc("enabled"), llvm::cl::init(false),
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<unsigned> jobs(
+      "jobs",
+      llvm::cl::desc("The number of source files to preprocess in parallel"),
+      llvm::cl::value_desc("count"), llvm::cl::init(1),
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<bool> schedule_sources(
+      "schedule",
+      llvm::cl::desc("Whether to preprocess the sources sharing the most "
+                     "includes at their start first, so that these headers "
+                     "are replaced by --smaller-file-opt as soon as possible"),
+      llvm::cl::value_desc("enabled"), llvm::cl::init(false),
+      llvm::cl::cat(build_category));
+
+  llvm::cl::opt<std::string> schedule_from(
+      "schedule-from",
+      llvm::cl::desc("A graph saved by a previous run with --save used to "
+                     "preprocess the sources sharing the most expensive "
+                     "headers first.  This takes priority over --schedule"),
+      llvm::cl::value_desc("path"), llvm::cl::Optional,
+      llvm::cl::cat(build_category));
+
   llvm::cl::opt<bool> show_sources(
       "show-sources", llvm::cl::desc("Whether to output all source files"),
       llvm::cl::value_desc("enabled"), llvm::cl::init(true),
@@ -535,6 +687,47 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
 
   const double percent_cut_off = cutoff.getValue() / 100.0;
 
+  std::optional<shard> slice;
+  if (!shard_spec.empty()) {
+    slice = shard::parse(shard_spec.getValue());
+    if (!slice) {
+      err << "'shard' must be of the form i/N where 0 <= i < N\n";
+      return 1;
+    }
+  }
+
+  if (merge_shards.getValue() && merge_configs.getValue()) {
+    err << "'merge' and 'merge-configs' cannot be used together\n";
+    return 1;
+  }
+
+  if (merge_configs.getValue() &&
+      source_paths.size() > multi_config::max_count) {
+    err << "'merge-configs' supports at most " << multi_config::max_count
+        << " configurations\n";
+    return 1;
+  }
+
+  if (!cache_dir.empty() && !directives_only.getValue()) {
+    err << "'cache-dir' can only be used with 'directives-only'\n";
+    return 1;
+  }
+
+  if (!select_configs.empty() && !merge_configs.getValue()) {
+    err << "'select-configs' can only be used with 'merge-configs'\n";
+    return 1;
+  }
+
+  std::uint32_t config_mask = 0u;
+  for (const unsigned config : select_configs) {
+    if (config >= source_paths.size() || config >= multi_config::max_count) {
+      err << "'select-configs' must only contain indices of the graphs "
+             "passed to 'merge-configs'\n";
+      return 1;
+    }
+    config_mask |= 1u << config;
+  }
+
   if (pch_ratio.getValue() <= 0.0) {
     err << "'pch-ratio' must be positive\n";
     return 1;
@@ -567,7 +760,13 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
   }
 
   build_graph::options options;
-  options.enable_replace_file_optimization(smaller_file_opt);
+  options.enable_replace_file_optimization(smaller_file_opt)
+      .enable_directives_only(directives_only)
+      .with_cache_directory(cache_dir.getValue())
+      .enable_include_index(index_include_dirs)
+      .enable_deduplicate_sources(deduplicate_sources)
+      .enable_record_lookups(!save_path.empty() || !incremental_path.empty())
+      .with_jobs(std::max(1u, jobs.getValue()));
   std::optional<ArrayPrinter> sources_printer;
   if (show_sources.getValue()) {
     sources_printer.emplace(stats.arr("sources"));
@@ -579,11 +778,49 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
   }
 
   auto result = [&]() -> llvm::Expected<build_graph::result> {
-    if (!load_path.empty()) {
+    if (merge_shards.getValue() || merge_configs.getValue()) {
+      std::vector<build_graph::result> graphs;
+      for (const std::string &path : source_paths) {
+        try {
+          graphs.push_back(graph_file::load(path));
+        } catch (const std::exception &e) {
+          return llvm::createStringError(std::errc::invalid_argument,
+                                         "Unable to load '%s': %s",
+                                         path.c_str(), e.what());
+        }
+      }
+      build_graph::result r;
+      if (merge_shards.getValue()) {
+        r = shard::merge(graphs);
+      } else {
+        r = multi_config::merge(graphs);
+        if (config_mask != 0u) {
+          r = multi_config::select(r, config_mask);
+        }
+      }
+      if (options.source_started) {
+        for (const Graph::vertex_descriptor source : r.sources) {
+          options.source_started(r.graph[source].path);
+        }
+      }
+      sources_printer.reset();
+      stats.property("processing time", timer.restart());
+      if (merge_configs.getValue()) {
+        stats.comment("Each file keeps the cost it had in the first");
+        stats.comment("configuration that saw it, even if its macros expand");
+        stats.comment("differently in the others.");
+        stats.property("file costs", std::string_view("first configuration"));
+      }
+      return r;
+    } else if (!load_path.empty()) {
       build_graph::result r;
-      std::ifstream ifs(load_path.getValue()); // save to file
-      boost::archive::text_iarchive ia(ifs);
-      ia >> r;
+      try {
+        r = graph_file::load(load_path.getValue());
+      } catch (const std::exception &e) {
+        return llvm::createStringError(std::errc::invalid_argument,
+                                       "Unable to load '%s': %s",
+                                       load_path.getValue().c_str(), e.what());
+      }
       if (options.source_started) {
         std::for_each(r.sources.begin(), r.sources.end(),
                       [&](const Graph::vertex_descriptor source) {
@@ -598,14 +835,50 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
           llvm::vfs::getRealFileSystem();
 
       std::unique_ptr<clang::tooling::CompilationDatabase> db;
-      if (!build_path.empty()) {
+      const std::filesystem::path compile_commands =
+          std::filesystem::path(build_path.getValue()) /
+          "compile_commands.json";
+      if (!build_path.empty() && std::filesystem::exists(compile_commands)) {
+        llvm::Expected<compile_commands_reader> reader =
+            compile_commands_reader::open(
+                compile_commands,
+                {std::vector<std::string>(include_sources.begin(),
+                                          include_sources.end()),
+                 std::vector<std::string>(exclude_sources.begin(),
+                                          exclude_sources.end())});
+        if (!reader) {
+          return reader.takeError();
+        }
+        auto streaming = StreamingCompilationDatabase::read(*reader);
+        if (!streaming) {
+          return streaming.takeError();
+        }
+
+        // Wrap the commands the same way that clang does when it loads a
+        // `compile_commands.json` itself
+        db = clang::tooling::inferTargetAndDriverMode(
+            clang::tooling::inferMissingCompileCommands(
+                clang::tooling::expandResponseFiles(std::move(*streaming),
+                                                    fs)));
+      } else if (!build_path.empty()) {
         db = clang::tooling::CompilationDatabase::autoDetectFromDirectory(
             build_path, ErrorMessage);
       } else if (fake_compilation_db != "") {
+        const std::filesystem::path source_dir =
+            std::filesystem::current_path() / fake_compilation_db.getValue();
+        llvm::Expected<std::vector<std::filesystem::path>> sources =
+            crawl::find_files(
+                source_dir, *fs,
+                [](std::string_view file) {
+                  return map_ext(file) == build_graph::file_type::source;
+                },
+                {std::max(1u, jobs.getValue()),
+                 std::vector<std::string>(exclude.begin(), exclude.end())});
+        if (!sources) {
+          return sources.takeError();
+        }
         db = std::make_unique<ReplacementCompilationDatabase>(
-            std::filesystem::current_path(),
-            std::filesystem::current_path() / fake_compilation_db.getValue(),
-            *fs);
+            std::filesystem::current_path(), std::move(*sources));
       } else if (!source_paths.empty()) {
         db = clang::tooling::CompilationDatabase::autoDetectFromSource(
             source_paths.front(), ErrorMessage);
@@ -663,6 +936,70 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       std::transform(
           raw_sources.begin(), raw_sources.end(), source_files.begin(),
           [](const std::string &s) { return std::filesystem::path(s); });
+      if (slice) {
+        const std::span selected = slice->select(source_files);
+        source_files = std::vector(selected.begin(), selected.end());
+      }
+
+      std::vector<std::size_t> order;
+      if (!schedule_from.empty()) {
+        build_graph::result previous;
+        try {
+          previous = graph_file::load(schedule_from.getValue());
+        } catch (const std::exception &e) {
+          return llvm::createStringError(
+              std::errc::invalid_argument, "Unable to load '%s': %s",
+              schedule_from.getValue().c_str(), e.what());
+        }
+        order = schedule::from_graph(previous, source_files,
+                                     std::filesystem::current_path());
+      } else if (schedule_sources.getValue()) {
+        std::vector<std::vector<std::string>> includes(source_files.size());
+        for (std::size_t i = 0; i != source_files.size(); ++i) {
+          if (const auto buffer =
+                  fs->getBufferForFile(source_files[i].string())) {
+            includes[i] = schedule::include_prefix((*buffer)->getBuffer());
+          }
+        }
+        order = schedule::from_includes(includes);
+      }
+      if (!order.empty()) {
+        std::vector<std::filesystem::path> scheduled;
+        scheduled.reserve(order.size());
+        for (const std::size_t i : order) {
+          scheduled.push_back(std::move(source_files[i]));
+        }
+        source_files = std::move(scheduled);
+      }
+
+      if (!incremental_path.empty()) {
+        build_graph::result previous;
+        try {
+          previous = graph_file::load(incremental_path.getValue());
+        } catch (const std::exception &e) {
+          return llvm::createStringError(
+              std::errc::invalid_argument, "Unable to load '%s': %s",
+              incremental_path.getValue().c_str(), e.what());
+        }
+
+        const std::vector<Graph::vertex_descriptor> changed =
+            incremental::find_changed_files(previous.graph, *fs);
+        const incremental::plan plan =
+            incremental::make_plan(previous, changed, source_files,
+                                   std::filesystem::current_path());
+        auto fresh = build_graph::from_compilation_db(
+            *db, std::filesystem::current_path(), plan.sources, map_ext, fs,
+            options);
+
+        sources_printer.reset();
+        if (!fresh) {
+          return fresh.takeError();
+        }
+        stats.property("changed files", changed.size());
+        stats.property("preprocessed sources", plan.sources.size());
+        stats.property("processing time", timer.restart());
+        return incremental::splice(previous, plan.stale_sources, *fresh);
+      }
 
       auto result =
           build_graph::from_compilation_db(*db, std::filesystem::current_path(),
@@ -680,18 +1017,51 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
     return 1;
   }
 
+  if (!cache_dir.empty()) {
+    stats.property("pruned cache entries",
+                   cost_cache(cache_dir.getValue())
+                       .prune(std::uintmax_t(cache_size.getValue()) << 20));
+  }
+
   const auto &graph = result->graph;
   const auto &sources = result->sources;
   const auto &missing = result->missing_includes;
   const auto &unguarded = result->unguarded_files;
 
+  if (result->raw_token_costs) {
+    stats.comment("Token counts are those of the unpreprocessed files, which");
+    stats.comment("include inactive blocks and do not expand macros.");
+    stats.property("token counts", std::string_view("raw (directives only)"));
+  }
   stats.property("source count", sources.size());
+  if (deduplicate_sources.getValue()) {
+    stats.property(
+        "translation unit count",
+        std::accumulate(sources.begin(), sources.end(), std::uint64_t(0),
+                        [&](std::uint64_t acc, Graph::vertex_descriptor v) {
+                          return acc + graph[v].weight;
+                        }));
+  }
+  if (smaller_file_opt.getValue() &&
+      result->replacement_hits + result->replacement_misses > 0u) {
+    ObjPrinter o = stats.obj("replacements");
+    o.property("hits", result->replacement_hits);
+    o.property("misses", result->replacement_misses);
+    const std::uint64_t total =
+        result->replacement_hits + result->replacement_misses;
+    o.property("hit rate",
+               percent((100.0 * result->replacement_hits) / total));
+  }
   stats.property("file count", num_vertices(graph));
   stats.property("include directives", num_edges(graph));
 
-  const get_total_cost::result naive_cost = get_naive_cost(graph);
+  // Most analyses only need the structure of the graph and the cost of
+  // each file, so take a compact copy of that now that `graph` is complete
+  const graph_snapshot snapshot(graph);
+  const get_total_cost::result naive_cost =
+      get_naive_cost(snapshot.properties());
   const get_total_cost::result project_cost =
-      get_total_cost::from_graph(graph, sources);
+      get_total_cost::from_graph(snapshot, sources);
 
   const cost &postprocessed = project_cost.true_cost;
   const cost &actual = project_cost.total();
@@ -733,9 +1103,8 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
     ObjPrinter output = stats.obj("output");
     output.property("file", save_path.getValue());
     output.key("save time");
-    std::ofstream ofs(save_path.getValue()); // save to file
-    boost::archive::text_oarchive oa(ofs);
-    oa << *result;
+    std::ofstream ofs(save_path.getValue(), std::ios::binary);
+    graph_file::save(*result, ofs);
     output.value(timer.restart());
   }
 
@@ -784,7 +1153,8 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       // it's trivial.
       const int minimum_size = 10;
       std::vector<component_and_cost> results =
-          find_unused_components::from_graph(graph, sources, 0u, minimum_size);
+          find_unused_components::from_graph(graph, snapshot, sources, 0u,
+                                             minimum_size);
       std::sort(results.begin(), results.end(),
                 [](const component_and_cost &l, const component_and_cost &r) {
                   return l.saving.token_count > r.saving.token_count;
@@ -805,7 +1175,7 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       ObjPrinter include_directives = an.obj("include directives");
       std::vector<include_directive_and_cost> results =
           find_expensive_includes::from_graph(
-              graph, sources,
+              graph, snapshot, sources,
               project_cost.true_cost.token_count * percent_cut_off);
       std::sort(results.begin(), results.end(),
                 [](const include_directive_and_cost &l,
@@ -817,7 +1187,7 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       ArrayPrinter results_out = include_directives.arr("results");
       for (const include_directive_and_cost &i : results) {
         ObjPrinter result_out = results_out.obj();
-        result_out.property("directive", "#include " + i.include->code);
+        result_out.property("directive", "#include " + i.include->code.str());
         result_out.property("file", i.file.filename());
         result_out.property("line", i.include->lineNumber);
         result_out.property("saving",
@@ -826,6 +1196,33 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       }
     }
 
+    {
+      out << '\n';
+      an.comment("This is a list of header files along with the saving if");
+      an.comment("the header, and all files only included through it, were "
+                 "empty.");
+      ObjPrinter dominating_headers = an.obj("dominating headers");
+      std::vector<find_dominating_headers::result> results =
+          find_dominating_headers::from_graph(
+              snapshot, sources,
+              project_cost.true_cost.token_count * percent_cut_off);
+      std::sort(results.begin(), results.end(),
+                [](const find_dominating_headers::result &l,
+                   const find_dominating_headers::result &r) {
+                  return l.saving.token_count > r.saving.token_count;
+                });
+      dominating_headers.property("time", timer.restart());
+
+      ArrayPrinter results_out = dominating_headers.arr("results");
+      for (const find_dominating_headers::result &i : results) {
+        ObjPrinter result_out = results_out.obj();
+        result_out.property("file", graph[i.v]);
+        result_out.property("saving",
+                            percent((100.0 * i.saving.token_count) /
+                                    project_cost.true_cost.token_count));
+      }
+    }
+
     {
       out << '\n';
       an.comment(
@@ -835,7 +1232,7 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       ObjPrinter make_private = an.obj("make private");
       std::vector<find_expensive_headers::result> results =
           find_expensive_headers::from_graph(
-              graph, sources,
+              graph, snapshot, sources,
               project_cost.true_cost.token_count * percent_cut_off);
       std::sort(results.begin(), results.end(),
                 [](const find_expensive_headers::result &l,
@@ -862,10 +1259,10 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       an.comment("to be added to the precompiled header:");
       ObjPrinter pch_additions = an.obj("pch additions");
       std::vector<recommend_precompiled::result> results =
-          recommend_precompiled::from_graph(graph, sources,
-                                            project_cost.true_cost.token_count *
-                                                percent_cut_off,
-                                            pch_ratio.getValue());
+          recommend_precompiled::from_graph(
+              graph, snapshot, sources,
+              project_cost.true_cost.token_count * percent_cut_off,
+              pch_ratio.getValue());
       std::sort(results.begin(), results.end(),
                 [](const recommend_precompiled::result &l,
                    const recommend_precompiled::result &r) {
@@ -893,7 +1290,7 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
       // Assume that each "expensive" file could be reduced this much
       const double assumed_reduction = 0.50;
       std::vector<file_and_cost> results = find_expensive_files::from_graph(
-          graph, sources,
+          graph, snapshot, sources,
           project_cost.true_cost.token_count * percent_cut_off /
               assumed_reduction);
       large_files.property("assumed reduction",
@@ -930,7 +1327,7 @@ int run(int argc, const char **argv, std::ostream &out, std::ostream &err) {
 
       std::vector<find_unnecessary_sources::result> results =
           find_unnecessary_sources::from_graph(
-              graph, sources,
+              graph, snapshot, sources,
               project_cost.true_cost.token_count * percent_cut_off);
       std::sort(results.begin(), results.end(),
                 [](const find_unnecessary_sources::result &l,
@@ -0,0 +1,310 @@
+#include "incremental.hpp"
+
+#include <llvm/Support/Chrono.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/xxhash.h>
+
+#include <boost/range/iterator_range.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace IncludeGuardian {
+
+namespace {
+
+const Graph::vertex_descriptor empty =
+    boost::graph_traits<Graph>::null_vertex();
+
+// Return whether each vertex in `graph` is reachable from `roots`.
+std::vector<bool> reachable(const Graph &graph,
+                            std::span<const Graph::vertex_descriptor> roots) {
+  std::vector<bool> seen(num_vertices(graph));
+  std::vector<Graph::vertex_descriptor> stack(roots.begin(), roots.end());
+  while (!stack.empty()) {
+    const Graph::vertex_descriptor v = stack.back();
+    stack.pop_back();
+    if (seen[v]) {
+      continue;
+    }
+    seen[v] = true;
+    for (const Graph::vertex_descriptor child :
+         boost::make_iterator_range(adjacent_vertices(v, graph))) {
+      if (!seen[child]) {
+        stack.push_back(child);
+      }
+    }
+  }
+  return seen;
+}
+
+} // namespace
+
+std::vector<Graph::vertex_descriptor>
+incremental::find_changed_files(Graph &graph, llvm::vfs::FileSystem &fs) {
+  // This is done serially as `fs` may not be safe to use from more than one
+  // thread, e.g. if it caches the results of `status`.
+  std::vector<Graph::vertex_descriptor> results;
+
+  // The same paths are often searched from many files
+  std::unordered_map<interned_path, bool> exists;
+  const auto now_exists = [&](const interned_path &path) {
+    const auto [it, inserted] = exists.emplace(path, false);
+    if (inserted) {
+      it->second = fs.exists(path.string());
+    }
+    return it->second;
+  };
+
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    // If a file was created where we looked for one of its includes, then
+    // that include may now find a different file
+    if (std::any_of(graph[v].absent_paths.begin(),
+                    graph[v].absent_paths.end(), now_exists)) {
+      results.push_back(v);
+      continue;
+    }
+
+    file_stamp &stamp = graph[v].stamp;
+    if (stamp.location.empty()) {
+      continue;
+    }
+
+    const std::string path = stamp.location.string();
+    const llvm::ErrorOr<llvm::vfs::Status> status = fs.status(path);
+    if (!status) {
+      results.push_back(v);
+      continue;
+    }
+
+    const std::int64_t modified =
+        llvm::sys::toTimeT(status->getLastModificationTime());
+    if (modified == stamp.modified) {
+      continue;
+    }
+
+    // Touching a file without changing it should not cause all of its
+    // includers to be preprocessed again.
+    const auto buffer = fs.getBufferForFile(path);
+    if (!buffer ||
+        llvm::xxHash64((*buffer)->getBuffer()) != stamp.content_hash) {
+      results.push_back(v);
+      continue;
+    }
+    stamp.modified = modified;
+  }
+  return results;
+}
+
+std::vector<Graph::vertex_descriptor> incremental::affected_sources(
+    const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
+    std::span<const Graph::vertex_descriptor> changed) {
+  // Walk backwards through the includes of all changed files
+  std::vector<bool> seen(num_vertices(graph));
+  std::vector<Graph::vertex_descriptor> stack(changed.begin(), changed.end());
+  while (!stack.empty()) {
+    const Graph::vertex_descriptor v = stack.back();
+    stack.pop_back();
+    if (seen[v]) {
+      continue;
+    }
+    seen[v] = true;
+    for (const Graph::vertex_descriptor parent :
+         boost::make_iterator_range(inv_adjacent_vertices(v, graph))) {
+      if (!seen[parent]) {
+        stack.push_back(parent);
+      }
+    }
+  }
+
+  std::vector<Graph::vertex_descriptor> results;
+  std::copy_if(sources.begin(), sources.end(), std::back_inserter(results),
+               [&](const Graph::vertex_descriptor v) { return seen[v]; });
+  return results;
+}
+
+std::vector<Graph::vertex_descriptor> incremental::affected_sources(
+    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
+    std::initializer_list<Graph::vertex_descriptor> changed) {
+  return affected_sources(graph, std::span(sources.begin(), sources.end()),
+                          std::span(changed.begin(), changed.end()));
+}
+
+incremental::plan
+incremental::make_plan(const build_graph::result &previous,
+                       std::span<const Graph::vertex_descriptor> changed,
+                       std::span<const std::filesystem::path> source_paths,
+                       const std::filesystem::path &working_dir) {
+  const auto normalize = [&](const std::filesystem::path &p) {
+    return (working_dir / p).lexically_normal().string();
+  };
+
+  std::unordered_set<Graph::vertex_descriptor> affected;
+  for (const Graph::vertex_descriptor v :
+       affected_sources(previous.graph, previous.sources, changed)) {
+    affected.insert(v);
+  }
+
+  std::unordered_set<std::string> current;
+  for (const std::filesystem::path &p : source_paths) {
+    current.insert(normalize(p));
+  }
+
+  plan p;
+  std::unordered_map<std::string, Graph::vertex_descriptor> existing;
+  for (const Graph::vertex_descriptor v : previous.sources) {
+    const std::string path = normalize(previous.graph[v].path);
+    existing.emplace(path, v);
+    if (affected.contains(v) || !current.contains(path)) {
+      p.stale_sources.push_back(v);
+    }
+  }
+
+  for (const std::filesystem::path &source : source_paths) {
+    const auto it = existing.find(normalize(source));
+    if (it == existing.end() || affected.contains(it->second)) {
+      p.sources.push_back(source);
+    }
+  }
+  return p;
+}
+
+build_graph::result
+incremental::splice(const build_graph::result &previous,
+                    std::span<const Graph::vertex_descriptor> stale_sources,
+                    const build_graph::result &fresh) {
+  const Graph &old_graph = previous.graph;
+  const Graph &new_graph = fresh.graph;
+  const std::size_t old_count = num_vertices(old_graph);
+  const std::size_t new_count = num_vertices(new_graph);
+
+  // Everything reachable from a source that we keep is unchanged
+  const std::unordered_set<Graph::vertex_descriptor> stale(
+      stale_sources.begin(), stale_sources.end());
+  std::vector<Graph::vertex_descriptor> kept_sources;
+  std::copy_if(previous.sources.begin(), previous.sources.end(),
+               std::back_inserter(kept_sources),
+               [&](const Graph::vertex_descriptor v) {
+                 return !stale.contains(v);
+               });
+  const std::vector<bool> unaffected = reachable(old_graph, kept_sources);
+
+  // Match up the files in both graphs
+  std::unordered_map<interned_path, Graph::vertex_descriptor> old_by_key;
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(old_graph))) {
+    old_by_key.emplace(file_identity(old_graph[v]), v);
+  }
+  std::vector<Graph::vertex_descriptor> old_to_new(old_count, empty);
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(new_graph))) {
+    const auto it = old_by_key.find(file_identity(new_graph[v]));
+    if (it != old_by_key.end()) {
+      old_to_new[it->second] = v;
+    }
+  }
+
+  // Keep the previous order of all files that survive and then append any
+  // new files.
+  build_graph::result r;
+  r.raw_token_costs = previous.raw_token_costs || fresh.raw_token_costs;
+  std::vector<Graph::vertex_descriptor> old_index(old_count, empty);
+  std::vector<Graph::vertex_descriptor> new_index(new_count, empty);
+  std::vector<bool> is_unaffected;
+  for (Graph::vertex_descriptor v = 0; v != old_count; ++v) {
+    if (unaffected[v] || old_to_new[v] != empty) {
+      old_index[v] = add_vertex(r.graph);
+      is_unaffected.push_back(unaffected[v]);
+      if (old_to_new[v] != empty) {
+        new_index[old_to_new[v]] = old_index[v];
+      }
+    }
+  }
+  for (Graph::vertex_descriptor v = 0; v != new_count; ++v) {
+    if (new_index[v] == empty) {
+      new_index[v] = add_vertex(r.graph);
+      is_unaffected.push_back(false);
+    }
+  }
+
+  const auto copy_node = [&](const file_node &from,
+                             std::span<const Graph::vertex_descriptor> index,
+                             const Graph::vertex_descriptor to) {
+    file_node &node = r.graph[to];
+    node = from;
+    node.component.reset();
+    if (from.component && index[*from.component] != empty) {
+      node.component = index[*from.component];
+    }
+  };
+
+  for (Graph::vertex_descriptor v = 0; v != old_count; ++v) {
+    if (unaffected[v]) {
+      copy_node(old_graph[v], old_index, old_index[v]);
+
+      // Translation units that were preprocessed again may have searched
+      // for its includes in other places
+      if (old_to_new[v] != empty) {
+        merge_lookups(r.graph[old_index[v]], new_graph[old_to_new[v]]);
+      }
+      for (const Graph::edge_descriptor &e :
+           boost::make_iterator_range(out_edges(v, old_graph))) {
+        add_edge(old_index[v], old_index[target(e, old_graph)], old_graph[e],
+                 r.graph);
+      }
+    }
+  }
+  for (Graph::vertex_descriptor v = 0; v != new_count; ++v) {
+    if (!is_unaffected[new_index[v]]) {
+      copy_node(new_graph[v], new_index, new_index[v]);
+      for (const Graph::edge_descriptor &e :
+           boost::make_iterator_range(out_edges(v, new_graph))) {
+        add_edge(new_index[v], new_index[target(e, new_graph)], new_graph[e],
+                 r.graph);
+      }
+    }
+  }
+
+  // The number of times each file is included may have changed
+  recalculate_incoming(r.graph);
+
+  std::vector<bool> is_source(num_vertices(r.graph));
+  const auto add_source = [&](const Graph::vertex_descriptor v) {
+    if (!is_source[v]) {
+      is_source[v] = true;
+      r.sources.push_back(v);
+    }
+  };
+  for (const Graph::vertex_descriptor v : kept_sources) {
+    add_source(old_index[v]);
+  }
+  for (const Graph::vertex_descriptor v : fresh.sources) {
+    add_source(new_index[v]);
+  }
+
+  for (const Graph::vertex_descriptor v : previous.unguarded_files) {
+    if (unaffected[v]) {
+      r.unguarded_files.insert(old_index[v]);
+    }
+  }
+  for (const Graph::vertex_descriptor v : fresh.unguarded_files) {
+    if (!is_unaffected[new_index[v]]) {
+      r.unguarded_files.insert(new_index[v]);
+    }
+  }
+
+  // Only keep the missing includes of files that are still in the graph
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(r.graph))) {
+    for (const interned_string &m : r.graph[v].missing_includes) {
+      r.missing_includes.insert(m.str());
+    }
+  }
+  return r;
+}
+
+} // namespace IncludeGuardian
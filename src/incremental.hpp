@@ -0,0 +1,88 @@
+#ifndef INCLUDE_GUARD_BDE9DE02_0396_4409_BE5C_E0487B5C8893
+#define INCLUDE_GUARD_BDE9DE02_0396_4409_BE5C_E0487B5C8893
+
+// When a graph has previously been saved, we can avoid preprocessing every
+// translation unit again by only preprocessing those that include a file
+// that has changed.
+//
+// Each `file_node` records a `file_stamp` when it is first read, which is
+// compared against the file system to find which files have changed.  A
+// file has also changed if any of its `absent_paths` now exist, as one of
+// its includes may now find a new file.  Any source that can reach a
+// changed file is affected and is preprocessed again.  The graphs of these
+// sources are then spliced back into the previous result.
+//
+// Files that are reachable from unaffected sources cannot have changed, nor
+// can anything they include, so these files are kept exactly as they were.
+// Only files that are reachable solely from affected sources are replaced.
+
+#include "build_graph.hpp"
+
+#include <filesystem>
+#include <initializer_list>
+#include <span>
+#include <vector>
+
+namespace llvm::vfs {
+class FileSystem;
+}
+
+namespace IncludeGuardian {
+
+struct incremental {
+  struct plan {
+    std::vector<Graph::vertex_descriptor>
+        stale_sources; //< Sources in the previous result that must be
+                       //< removed before splicing
+    std::vector<std::filesystem::path>
+        sources; //< Sources that need to be preprocessed
+  };
+
+  /// Return the vertices in the specified `graph` whose file has changed
+  /// in the specified `fs` since their `file_stamp` was recorded.  Files
+  /// with a different modification time but identical contents are not
+  /// returned and have their `file_stamp` updated.  Files without a
+  /// `file_stamp` are assumed to be unchanged.  Vertices with any of their
+  /// `absent_paths` now existing in `fs` are also returned.
+  static std::vector<Graph::vertex_descriptor>
+  find_changed_files(Graph &graph, llvm::vfs::FileSystem &fs);
+
+  /// Return those of the specified `sources` that include, directly or
+  /// indirectly, any of the specified `changed` files in `graph`.
+  static std::vector<Graph::vertex_descriptor>
+  affected_sources(const Graph &graph,
+                   std::span<const Graph::vertex_descriptor> sources,
+                   std::span<const Graph::vertex_descriptor> changed);
+  static std::vector<Graph::vertex_descriptor>
+  affected_sources(const Graph &graph,
+                   std::initializer_list<Graph::vertex_descriptor> sources,
+                   std::initializer_list<Graph::vertex_descriptor> changed);
+
+  /// Return which sources of the specified `previous` result need to be
+  /// removed and which of the specified `source_paths` need to be
+  /// preprocessed, given the specified `changed` files.  Sources are
+  /// matched by their path relative to the specified `working_dir`, so
+  /// this must be the same directory that was used to build `previous`.
+  static plan
+  make_plan(const build_graph::result &previous,
+            std::span<const Graph::vertex_descriptor> changed,
+            std::span<const std::filesystem::path> source_paths,
+            const std::filesystem::path &working_dir);
+
+  /// Return the specified `previous` result with the specified
+  /// `stale_sources`, and any files only reachable from them, removed and
+  /// with the specified `fresh` result merged in.  Files are matched by the
+  /// location in their `file_stamp`, or by their path if they have none.
+  /// Files reachable from the remaining sources of `previous` keep their
+  /// properties and includes, though the number of incoming includes is
+  /// recalculated and any lookups from `fresh` are added.  The missing
+  /// includes of the result are those of the files that remain.
+  static build_graph::result
+  splice(const build_graph::result &previous,
+         std::span<const Graph::vertex_descriptor> stale_sources,
+         const build_graph::result &fresh);
+};
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,168 @@
+#include "incremental.hpp"
+
+#include "analysis_test_fixtures.hpp"
+
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+TEST_F(MultiLevel, AffectedSources) {
+  EXPECT_THAT(incremental::affected_sources(graph, {a, b}, {g}),
+              ElementsAre(b));
+  EXPECT_THAT(incremental::affected_sources(graph, {a, b}, {c}),
+              ElementsAre(a));
+  EXPECT_THAT(incremental::affected_sources(graph, {a, b}, {h}),
+              ElementsAre(a, b));
+  EXPECT_THAT(incremental::affected_sources(graph, {a, b}, {}), SizeIs(0));
+}
+
+TEST(Incremental, FindChangedFiles) {
+  auto fs = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+  fs->addFile("/src/same.hpp", 100,
+              llvm::MemoryBuffer::getMemBuffer("same"));
+  fs->addFile("/src/touched.hpp", 200,
+              llvm::MemoryBuffer::getMemBuffer("touched"));
+  fs->addFile("/src/modified.hpp", 200,
+              llvm::MemoryBuffer::getMemBuffer("new contents"));
+  fs->addFile("/inc/created.hpp", 200,
+              llvm::MemoryBuffer::getMemBuffer("created"));
+
+  Graph graph;
+  add_vertex(stamped("same.hpp", "/src/same.hpp", 100, "same"), graph);
+  const Graph::vertex_descriptor touched =
+      add_vertex(stamped("touched.hpp", "/src/touched.hpp", 100, "touched"),
+                 graph);
+  const Graph::vertex_descriptor modified =
+      add_vertex(stamped("modified.hpp", "/src/modified.hpp", 100,
+                         "old contents"),
+                 graph);
+  const Graph::vertex_descriptor deleted =
+      add_vertex(stamped("deleted.hpp", "/src/deleted.hpp", 100, "deleted"),
+                 graph);
+  add_vertex(file_node("unstamped.hpp"), graph);
+  file_node still_missing =
+      stamped("still_missing.hpp", "/src/still_missing.hpp", 100, "");
+  still_missing.absent_paths = {{"/inc/", "missing.hpp"}};
+  fs->addFile("/src/still_missing.hpp", 100,
+              llvm::MemoryBuffer::getMemBuffer(""));
+  add_vertex(still_missing, graph);
+  file_node shadowed("shadowed.hpp");
+  shadowed.absent_paths = {{"/inc/", "missing.hpp"}, {"/inc/", "created.hpp"}};
+  const Graph::vertex_descriptor created = add_vertex(shadowed, graph);
+
+  EXPECT_THAT(incremental::find_changed_files(graph, *fs),
+              ElementsAre(modified, deleted, created));
+  EXPECT_EQ(graph[touched].stamp.modified, 200);
+}
+
+TEST(Incremental, MakePlan) {
+  build_graph::result previous;
+  const Graph::vertex_descriptor a =
+      add_vertex(file_node("src/a.cpp"), previous.graph);
+  const Graph::vertex_descriptor b =
+      add_vertex(file_node("src/b.cpp"), previous.graph);
+  const Graph::vertex_descriptor c =
+      add_vertex(file_node("src/c.cpp"), previous.graph);
+  const Graph::vertex_descriptor x =
+      add_vertex(file_node("x.hpp"), previous.graph);
+  add_edge(a, x, {"\"x.hpp\""}, previous.graph);
+  previous.sources = {a, b, c};
+
+  const std::filesystem::path working_dir = "/work";
+  const std::vector<std::filesystem::path> source_paths = {
+      "/work/src/a.cpp", "src/b.cpp", "/work/src/d.cpp"};
+  const incremental::plan p = incremental::make_plan(
+      previous, std::vector{x}, source_paths, working_dir);
+  EXPECT_THAT(p.stale_sources, ElementsAre(a, c));
+  EXPECT_THAT(p.sources, ElementsAre(std::filesystem::path("/work/src/a.cpp"),
+                                     std::filesystem::path("/work/src/d.cpp")));
+}
+
+//  previous            fresh
+//
+//  a.cpp  b.cpp        a.cpp
+//    |      |            |
+//  x.hpp  y.hpp        w.hpp
+//     \   /              |
+//     z.hpp            z.hpp
+TEST(Incremental, Splice) {
+  const auto B = boost::units::information::byte;
+  build_graph::result previous;
+  {
+    Graph &graph = previous.graph;
+    const auto a = add_vertex(file_node("a.cpp").with_cost(1, 1 * B), graph);
+    const auto b = add_vertex(file_node("b.cpp").with_cost(2, 2 * B), graph);
+    const auto x = add_vertex(file_node("x.hpp").with_cost(3, 3 * B), graph);
+    const auto y = add_vertex(file_node("y.hpp").with_cost(4, 4 * B), graph);
+    const auto z = add_vertex(file_node("z.hpp").with_cost(5, 5 * B), graph);
+    add_edge(a, x, {"\"x.hpp\""}, graph);
+    add_edge(b, y, {"\"y.hpp\""}, graph);
+    add_edge(x, z, {"\"z.hpp\""}, graph);
+    add_edge(y, z, {"\"z.hpp\""}, graph);
+    graph[z].internal_incoming = 2;
+    graph[x].missing_includes = {"removed"};
+    graph[y].missing_includes = {"old"};
+    graph[z].absent_paths = {{"/inc/z/", "q.hpp"}};
+    previous.sources = {a, b};
+    previous.unguarded_files = {x, z};
+    previous.missing_includes = {"old", "removed"};
+  }
+
+  build_graph::result fresh;
+  {
+    Graph &graph = fresh.graph;
+    const auto a = add_vertex(file_node("a.cpp").with_cost(6, 6 * B), graph);
+    const auto w = add_vertex(file_node("w.hpp").with_cost(7, 7 * B), graph);
+    const auto z = add_vertex(file_node("z.hpp").with_cost(8, 8 * B), graph);
+    add_edge(a, w, {"\"w.hpp\""}, graph);
+    add_edge(w, z, {"\"z.hpp\""}, graph);
+    graph[w].missing_includes = {"new"};
+    graph[z].absent_paths = {{"/inc/z/", "q.hpp"}, {"/other/", "q.hpp"}};
+    fresh.sources = {a};
+    fresh.unguarded_files = {w, z};
+    fresh.missing_includes = {"new"};
+  }
+
+  const build_graph::result r =
+      incremental::splice(previous, std::vector{Graph::vertex_descriptor(0)},
+                          fresh);
+  const Graph &graph = r.graph;
+  ASSERT_THAT(paths(graph),
+              ElementsAre("a.cpp", "b.cpp", "y.hpp", "z.hpp", "w.hpp"));
+  const Graph::vertex_descriptor a = 0, b = 1, y = 2, z = 3, w = 4;
+
+  // Files that are still reachable from `b.cpp` are unchanged
+  EXPECT_EQ(graph[z].underlying_cost, cost(5, 5 * B));
+  EXPECT_EQ(graph[y].underlying_cost, cost(4, 4 * B));
+  EXPECT_EQ(graph[a].underlying_cost, cost(6, 6 * B));
+  EXPECT_EQ(graph[w].underlying_cost, cost(7, 7 * B));
+
+  EXPECT_THAT(children(graph, a), ElementsAre("w.hpp"));
+  EXPECT_THAT(children(graph, b), ElementsAre("y.hpp"));
+  EXPECT_THAT(children(graph, w), ElementsAre("z.hpp"));
+  EXPECT_THAT(children(graph, y), ElementsAre("z.hpp"));
+  EXPECT_EQ(graph[z].internal_incoming, 2u);
+  EXPECT_EQ(graph[w].internal_incoming, 1u);
+
+  EXPECT_THAT(r.sources, ElementsAre(b, a));
+  EXPECT_THAT(r.unguarded_files, UnorderedElementsAre(z, w));
+  EXPECT_THAT(graph[z].absent_paths,
+              ElementsAre(interned_path("/inc/z/", "q.hpp"),
+                          interned_path("/other/", "q.hpp")));
+
+  // Missing includes are dropped along with the files that included them
+  EXPECT_THAT(r.missing_includes, ElementsAre("new", "old"));
+}
+
+} // namespace
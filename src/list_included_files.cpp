@@ -1,38 +1,36 @@
 #include "list_included_files.hpp"
 
-#include <algorithm>
+#include "multi_source_bfs.hpp"
+
 #include <atomic>
-#include <execution>
 #include <ostream>
 
 namespace IncludeGuardian {
 
 std::vector<list_included_files::result> list_included_files::from_graph(
     const Graph &graph, std::span<const Graph::vertex_descriptor> sources) {
+  return from_graph(graph_snapshot(graph), sources);
+}
 
-  std::vector<std::atomic<unsigned>> count(num_vertices(graph));
-  std::for_each(std::execution::par, sources.begin(), sources.end(),
-                [&](const Graph::vertex_descriptor source) {
-                  std::vector<bool> seen(num_vertices(graph));
-                  std::vector<Graph::vertex_descriptor> stack;
-                  stack.push_back(source);
-
-                  cost total;
-                  while (!stack.empty()) {
-                    const Graph::vertex_descriptor v = stack.back();
-                    stack.pop_back();
-                    if (seen[v]) {
-                      continue;
-                    }
-
-                    seen[v] = true;
-                    count[v].fetch_add(1);
+std::vector<list_included_files::result> list_included_files::from_graph(
+    const Graph &graph,
+    std::initializer_list<Graph::vertex_descriptor> sources) {
+  return list_included_files::from_graph(
+      graph, std::span(sources.begin(), sources.end()));
+}
 
-                    const auto [begin, end] = adjacent_vertices(v, graph);
-                    stack.insert(stack.end(), begin, end);
-                  }
-                  return total;
-                });
+std::vector<list_included_files::result> list_included_files::from_graph(
+    const graph_snapshot &graph,
+    std::span<const Graph::vertex_descriptor> sources) {
+  const std::vector<unsigned> weights = graph.weights(sources);
+  std::vector<std::atomic<unsigned>> count(num_vertices(graph));
+  multi_source_bfs::for_each(
+      graph, sources,
+      [&](const std::size_t batch, const graph_snapshot::vertex_descriptor v,
+          const multi_source_bfs::mask m) {
+        count[v].fetch_add(static_cast<unsigned>(
+            multi_source_bfs::weighted_count(batch, m, weights)));
+      });
 
   std::vector<result> r;
   r.reserve(num_vertices(graph));
@@ -42,13 +40,6 @@ std::vector<list_included_files::result> list_included_files::from_graph(
   return r;
 }
 
-std::vector<list_included_files::result> list_included_files::from_graph(
-    const Graph &graph,
-    std::initializer_list<Graph::vertex_descriptor> sources) {
-  return list_included_files::from_graph(
-      graph, std::span(sources.begin(), sources.end()));
-}
-
 bool operator==(const list_included_files::result &lhs,
                 const list_included_files::result &rhs) {
   return lhs.v == rhs.v && lhs.source_that_can_reach_it_count ==
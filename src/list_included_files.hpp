@@ -2,6 +2,7 @@
 #define INCLUDE_GUARD_E685EBC9_8546_4A67_8A47_188BC65EB5E6
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <initializer_list>
 #include <span>
@@ -10,7 +11,7 @@ namespace IncludeGuardian {
 
 /// This component will list out all individual files along side the
 /// number of source files in which they are directly or indirectly
-/// included.
+/// included, counting each source `weight` times.
 struct list_included_files {
   struct result {
     Graph::vertex_descriptor v;
@@ -23,6 +24,9 @@ struct list_included_files {
   static std::vector<result>
   from_graph(const Graph &graph,
              std::initializer_list<Graph::vertex_descriptor> sources);
+  static std::vector<result>
+  from_graph(const graph_snapshot &graph,
+             std::span<const Graph::vertex_descriptor> sources);
 };
 
 bool operator==(const list_included_files::result &lhs,
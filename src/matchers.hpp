@@ -13,7 +13,9 @@ inline bool vertices_equal(const file_node &lhs, const Graph &lgraph,
       lhs.underlying_cost != rhs.underlying_cost ||
       lhs.internal_incoming != rhs.internal_incoming ||
       lhs.external_incoming != rhs.external_incoming ||
-      lhs.is_precompiled != rhs.is_precompiled) {
+      lhs.is_precompiled != rhs.is_precompiled || lhs.weight != rhs.weight ||
+      lhs.configurations != rhs.configurations ||
+      lhs.configuration_weights != rhs.configuration_weights) {
     return false;
   }
 
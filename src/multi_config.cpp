@@ -0,0 +1,188 @@
+#include "multi_config.hpp"
+
+#include <boost/range/iterator_range.hpp>
+
+#include <cassert>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace IncludeGuardian {
+
+namespace {
+
+const Graph::vertex_descriptor empty =
+    boost::graph_traits<Graph>::null_vertex();
+
+} // namespace
+
+build_graph::result
+multi_config::merge(std::span<const build_graph::result> configs) {
+  assert(configs.size() <= max_count);
+  build_graph::result r;
+  std::unordered_map<interned_path, Graph::vertex_descriptor> files;
+  std::vector<bool> is_source;
+
+  // `edge_to[t]` is the edge in `r.graph` from the file whose includes we
+  // are currently merging to `t`, which avoids searching the out edges of
+  // that file for every include
+  std::vector<std::optional<Graph::edge_descriptor>> edge_to;
+  for (std::size_t i = 0; i != configs.size(); ++i) {
+    const build_graph::result &config = configs[i];
+    const Graph &g = config.graph;
+    const std::uint32_t bit = 1u << i;
+
+    std::vector<Graph::vertex_descriptor> index(num_vertices(g));
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(g))) {
+      const auto [it, inserted] = files.emplace(file_identity(g[v]), empty);
+      if (inserted) {
+        it->second = add_vertex(g[v], r.graph);
+        r.graph[it->second].component.reset();
+        r.graph[it->second].configurations = 0u;
+      } else {
+        // A file is only guarded if it was guarded in every configuration
+        file_node &node = r.graph[it->second];
+        node.is_guarded = node.is_guarded && g[v].is_guarded;
+        merge_lookups(node, g[v]);
+      }
+      r.graph[it->second].configurations |= bit;
+      index[v] = it->second;
+    }
+
+    edge_to.resize(num_vertices(r.graph));
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(g))) {
+      const Graph::vertex_descriptor from = index[v];
+      for (const Graph::edge_descriptor &e :
+           boost::make_iterator_range(out_edges(from, r.graph))) {
+        edge_to[target(e, r.graph)] = e;
+      }
+
+      for (const Graph::edge_descriptor &e :
+           boost::make_iterator_range(out_edges(v, g))) {
+        const Graph::vertex_descriptor to = index[target(e, g)];
+        if (edge_to[to]) {
+          r.graph[*edge_to[to]].configurations |= bit;
+        } else {
+          include_edge include = g[e];
+          include.configurations = bit;
+          edge_to[to] = add_edge(from, to, include, r.graph).first;
+        }
+      }
+
+      for (const Graph::edge_descriptor &e :
+           boost::make_iterator_range(out_edges(from, r.graph))) {
+        edge_to[target(e, r.graph)].reset();
+      }
+    }
+
+    // The first link between a header and source wins
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(g))) {
+      if (g[v].component && !r.graph[index[v]].component) {
+        r.graph[index[v]].component = index[*g[v].component];
+      }
+    }
+
+    for (const Graph::vertex_descriptor v : config.unguarded_files) {
+      r.unguarded_files.insert(index[v]);
+    }
+
+    // Each configuration compiles its sources again, so we keep the weight
+    // from each configuration to cost them separately
+    is_source.resize(num_vertices(r.graph));
+    for (const Graph::vertex_descriptor v : config.sources) {
+      file_node &node = r.graph[index[v]];
+      if (is_source[index[v]]) {
+        node.weight += g[v].weight;
+      } else {
+        is_source[index[v]] = true;
+        node.weight = g[v].weight;
+        node.configuration_weights.clear();
+        r.sources.push_back(index[v]);
+      }
+      node.configuration_weights.resize(configs.size(), 0u);
+      node.configuration_weights[i] += g[v].weight;
+    }
+
+    r.missing_includes.insert(config.missing_includes.begin(),
+                              config.missing_includes.end());
+    r.raw_token_costs |= config.raw_token_costs;
+  }
+
+  // Files included from more than one configuration would be counted
+  // again for each configuration if we copied their incoming counts
+  recalculate_incoming(r.graph);
+  return r;
+}
+
+build_graph::result multi_config::select(const build_graph::result &r,
+                                         const std::uint32_t mask) {
+  const Graph &g = r.graph;
+  build_graph::result s;
+  std::vector<Graph::vertex_descriptor> index(num_vertices(g), empty);
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(g))) {
+    if (g[v].configurations & mask) {
+      index[v] = add_vertex(g[v], s.graph);
+      s.graph[index[v]].configurations &= mask;
+      s.graph[index[v]].component.reset();
+    }
+  }
+
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(g))) {
+    if (index[v] == empty) {
+      continue;
+    }
+
+    if (g[v].component && index[*g[v].component] != empty) {
+      s.graph[index[v]].component = index[*g[v].component];
+    }
+
+    for (const Graph::edge_descriptor &e :
+         boost::make_iterator_range(out_edges(v, g))) {
+      const Graph::vertex_descriptor to = index[target(e, g)];
+      if ((g[e].configurations & mask) && to != empty) {
+        include_edge include = g[e];
+        include.configurations &= mask;
+        add_edge(index[v], to, include, s.graph);
+      }
+    }
+  }
+
+  for (const Graph::vertex_descriptor v : r.sources) {
+    if (index[v] == empty) {
+      continue;
+    }
+
+    // Only keep the weight of the selected configurations, and drop sources
+    // that were only compiled in the others
+    file_node &node = s.graph[index[v]];
+    if (!node.configuration_weights.empty()) {
+      node.weight = 0u;
+      for (std::size_t i = 0; i != node.configuration_weights.size(); ++i) {
+        if (((mask >> i) & 1u) == 0u) {
+          node.configuration_weights[i] = 0u;
+        }
+        node.weight += node.configuration_weights[i];
+      }
+    }
+    if (node.weight != 0u) {
+      s.sources.push_back(index[v]);
+    }
+  }
+
+  for (const Graph::vertex_descriptor v : r.unguarded_files) {
+    if (index[v] != empty) {
+      s.unguarded_files.insert(index[v]);
+    }
+  }
+
+  s.missing_includes = r.missing_includes;
+  recalculate_incoming(s.graph);
+  return s;
+}
+
+} // namespace IncludeGuardian
@@ -0,0 +1,63 @@
+#ifndef INCLUDE_GUARD_3F7A9C2E_6B1D_4E85_A0C4_8D2F61B7E935
+#define INCLUDE_GUARD_3F7A9C2E_6B1D_4E85_A0C4_8D2F61B7E935
+
+// A project is often built in several configurations, e.g. for different
+// platforms, and a header that is unused in one configuration may be vital
+// in another.  We can build a graph for each configuration separately and
+// merge them into a single graph of all configurations.
+//
+// Each file and include directive in the merged graph has a `configurations`
+// bitmask recording which configurations it was seen in.  Files are
+// identified by `file_identity` like `shard`, but unlike shards, each
+// configuration preprocesses every file again, so a file collects the
+// includes from all configurations and its cost comes from the first
+// configuration that saw it.  A source that was compiled in several
+// configurations is a single source whose `weight` is the sum of its
+// weights in each configuration, which are kept in `configuration_weights`.
+//
+// A source may include different files in each configuration, so the cost
+// of a merged graph is not the cost of all its includes multiplied by the
+// `weight`.  `get_total_cost`, `find_expensive_includes` and
+// `find_dominating_headers` cost each configuration separately using
+// `graph_snapshot::configuration`, only following the include directives
+// seen in that configuration and using the source weights of that
+// configuration.  Each file still has the cost from the first configuration
+// that saw it, so these costs are only exact when a file is the same size in
+// every configuration.  The remaining analyses treat each source as
+// including the union of its includes, so their savings are an upper bound.
+//
+// Analyses run on the merged graph are conservative: `find_unused_components`
+// only reports components whose header is unused in every configuration and
+// `find_expensive_includes` only reports include directives that were seen in
+// every configuration of the file containing them.
+
+#include "build_graph.hpp"
+
+#include <cstdint>
+#include <span>
+
+namespace IncludeGuardian {
+
+struct multi_config {
+  /// The maximum number of configurations that can be merged.
+  static constexpr unsigned max_count = 32u;
+
+  /// Return the union of the specified `configs`, where `configs[i]` was
+  /// built with the `i`th configuration, and set bit `i` of `configurations`
+  /// for every file and include directive that is in `configs[i]`.  The
+  /// behavior is undefined unless `configs` has at most `max_count`
+  /// elements.  This takes time linear in the total size of `configs`.
+  static build_graph::result
+  merge(std::span<const build_graph::result> configs);
+
+  /// Return the part of the specified merged `r` that was seen in any of the
+  /// configurations in the specified `mask`.  The `weight` of each source is
+  /// the sum of its weights in the selected configurations, and sources that
+  /// were not compiled in any of them are removed.
+  static build_graph::result select(const build_graph::result &r,
+                                    std::uint32_t mask);
+};
+
+} // namespace IncludeGuardian
+
+#endif
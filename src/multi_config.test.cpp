@@ -0,0 +1,236 @@
+#include "multi_config.hpp"
+
+#include "analysis_test_fixtures.hpp"
+#include "find_dominating_headers.hpp"
+#include "find_expensive_includes.hpp"
+#include "find_unused_components.hpp"
+#include "get_total_cost.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <boost/range/iterator_range.hpp>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+const auto B = boost::units::information::byte;
+
+// Return the path of the includer and the target of each include in the
+// specified `graph` along with its `configurations`.
+std::vector<std::pair<std::string, std::uint32_t>>
+includes(const Graph &graph) {
+  std::vector<std::pair<std::string, std::uint32_t>> results;
+  for (const Graph::edge_descriptor &e :
+       boost::make_iterator_range(edges(graph))) {
+    results.emplace_back(graph[source(e, graph)].path.string() + " -> " +
+                             graph[target(e, graph)].path.string(),
+                         graph[e].configurations);
+  }
+  return results;
+}
+
+//  configuration 0         configuration 1
+//
+//   a.cpp   foo.cpp         a.cpp -----+    foo.cpp
+//     |        |           /   \       |       |
+//   x.hpp   foo.hpp     x.hpp  w.hpp   +--- foo.hpp
+class MultiConfig : public Test {
+protected:
+  build_graph::result configs[2];
+
+  MultiConfig() {
+    for (build_graph::result &config : configs) {
+      Graph &g = config.graph;
+      const auto a = add_vertex(file_node("a.cpp").with_cost(1, 1 * B), g);
+      const auto x = add_vertex(file_node("x.hpp").with_cost(2, 2 * B), g);
+      const auto foo_cpp =
+          add_vertex(file_node("foo.cpp").with_cost(4, 4 * B), g);
+      const auto foo_hpp =
+          add_vertex(file_node("foo.hpp").with_cost(8, 8 * B), g);
+      add_edge(a, x, {"\"x.hpp\"", 1}, g);
+      add_edge(foo_cpp, foo_hpp, {"\"foo.hpp\"", 1}, g);
+      g[foo_cpp].component = foo_hpp;
+      g[foo_hpp].component = foo_cpp;
+      config.sources = {a, foo_cpp};
+    }
+
+    Graph &g = configs[1].graph;
+    const auto w = add_vertex(file_node("w.hpp").with_cost(16, 16 * B), g);
+    add_edge(0, w, {"\"w.hpp\"", 2}, g);
+    add_edge(0, 3, {"\"foo.hpp\"", 3}, g);
+    configs[1].unguarded_files = {w};
+    configs[1].missing_includes = {"missing.hpp"};
+  }
+};
+
+TEST_F(MultiConfig, Merge) {
+  const build_graph::result r = multi_config::merge(configs);
+  const Graph &g = r.graph;
+  ASSERT_THAT(paths(g),
+              ElementsAre("a.cpp", "x.hpp", "foo.cpp", "foo.hpp", "w.hpp"));
+  const Graph::vertex_descriptor a = 0, x = 1, foo_cpp = 2, foo_hpp = 3,
+                                 w = 4;
+
+  EXPECT_THAT(g[a].configurations, Eq(0b11u));
+  EXPECT_THAT(g[x].configurations, Eq(0b11u));
+  EXPECT_THAT(g[w].configurations, Eq(0b10u));
+  EXPECT_THAT(includes(g),
+              UnorderedElementsAre(Pair("a.cpp -> x.hpp", 0b11u),
+                                   Pair("a.cpp -> w.hpp", 0b10u),
+                                   Pair("a.cpp -> foo.hpp", 0b10u),
+                                   Pair("foo.cpp -> foo.hpp", 0b11u)));
+
+  EXPECT_THAT(r.sources, ElementsAre(a, foo_cpp));
+  EXPECT_THAT(g[a].weight, Eq(2u));
+  EXPECT_THAT(g[a].configuration_weights, ElementsAre(1u, 1u));
+  EXPECT_THAT(g[foo_cpp].weight, Eq(2u));
+  EXPECT_THAT(g[foo_cpp].configuration_weights, ElementsAre(1u, 1u));
+  EXPECT_THAT(g[x].configuration_weights, SizeIs(0));
+  EXPECT_THAT(g[foo_hpp].internal_incoming, Eq(2u));
+  EXPECT_TRUE(g[foo_cpp].component == foo_hpp);
+  EXPECT_THAT(r.unguarded_files, UnorderedElementsAre(w));
+  EXPECT_THAT(r.missing_includes, ElementsAre("missing.hpp"));
+}
+
+TEST_F(MultiConfig, Select) {
+  const build_graph::result merged = multi_config::merge(configs);
+  const build_graph::result r = multi_config::select(merged, 0b01u);
+  const Graph &g = r.graph;
+  ASSERT_THAT(paths(g), ElementsAre("a.cpp", "x.hpp", "foo.cpp", "foo.hpp"));
+  EXPECT_THAT(includes(g),
+              UnorderedElementsAre(Pair("a.cpp -> x.hpp", 0b01u),
+                                   Pair("foo.cpp -> foo.hpp", 0b01u)));
+  EXPECT_THAT(r.sources, ElementsAre(0u, 2u));
+  EXPECT_THAT(g[0].weight, Eq(1u));
+  EXPECT_THAT(g[0].configuration_weights, ElementsAre(1u, 0u));
+  EXPECT_THAT(g[3].internal_incoming, Eq(1u));
+  EXPECT_TRUE(g[2].component == Graph::vertex_descriptor(3));
+  EXPECT_THAT(r.unguarded_files, SizeIs(0));
+}
+
+TEST_F(MultiConfig, FindUnusedComponents) {
+  // `foo.hpp` is only included by `a.cpp` in configuration 1
+  const build_graph::result merged = multi_config::merge(configs);
+  EXPECT_THAT(find_unused_components::from_graph(merged.graph, merged.sources),
+              SizeIs(0));
+
+  const build_graph::result first = multi_config::select(merged, 0b01u);
+  const std::vector<component_and_cost> unused =
+      find_unused_components::from_graph(first.graph, first.sources);
+  ASSERT_THAT(unused, SizeIs(1));
+  EXPECT_THAT(unused[0].source->path, Eq("foo.cpp"));
+}
+
+TEST_F(MultiConfig, FindExpensiveIncludes) {
+  // Includes that are only in configuration 1 are not reported, as `a.cpp`
+  // was seen in both configurations
+  const build_graph::result merged = multi_config::merge(configs);
+  for (const find_expensive_includes::engine algorithm :
+       {find_expensive_includes::engine::dominator_tree,
+        find_expensive_includes::engine::reference}) {
+    std::vector<std::pair<std::string, std::string>> reported;
+    for (const include_directive_and_cost &include :
+         find_expensive_includes::from_graph(merged.graph, merged.sources, 0,
+                                             algorithm)) {
+      reported.emplace_back(include.file.string(), include.include->code.str());
+    }
+    EXPECT_THAT(reported,
+                UnorderedElementsAre(Pair("a.cpp", "\"x.hpp\""),
+                                     Pair("foo.cpp", "\"foo.hpp\"")));
+  }
+}
+
+//  configuration 0 (x3)   configuration 1 (x1)
+//
+//        s.cpp                  s.cpp
+//          |                      |
+//        c.hpp                  c.hpp
+//          |                      |
+//        a.hpp                  b.hpp
+class MultiConfigCost : public Test {
+protected:
+  build_graph::result configs[2];
+  build_graph::result merged;
+
+  MultiConfigCost() {
+    const char *const headers[] = {"a.hpp", "b.hpp"};
+    const std::int64_t header_costs[] = {10, 20};
+    const unsigned weights[] = {3u, 1u};
+    for (std::size_t i = 0; i != 2; ++i) {
+      Graph &g = configs[i].graph;
+      const auto s = add_vertex(
+          file_node("s.cpp").with_cost(1, 1 * B).with_weight(weights[i]), g);
+      const auto c = add_vertex(file_node("c.hpp").with_cost(100, 100 * B), g);
+      const auto h = add_vertex(file_node(headers[i])
+                                    .with_cost(header_costs[i],
+                                               header_costs[i] * B),
+                                g);
+      add_edge(s, c, {"\"c.hpp\"", 1}, g);
+      add_edge(c, h, {"\"" + std::string(headers[i]) + "\"", 1}, g);
+      configs[i].sources = {s};
+    }
+    merged = multi_config::merge(configs);
+  }
+};
+
+TEST_F(MultiConfigCost, Weights) {
+  const Graph &g = merged.graph;
+  ASSERT_THAT(paths(g), ElementsAre("s.cpp", "c.hpp", "a.hpp", "b.hpp"));
+  EXPECT_THAT(g[0].weight, Eq(4u));
+  EXPECT_THAT(g[0].configuration_weights, ElementsAre(3u, 1u));
+
+  const build_graph::result second = multi_config::select(merged, 0b10u);
+  EXPECT_THAT(second.sources, ElementsAre(0u));
+  EXPECT_THAT(second.graph[0].weight, Eq(1u));
+  EXPECT_THAT(second.graph[0].configuration_weights, ElementsAre(0u, 1u));
+}
+
+TEST_F(MultiConfigCost, GetTotalCost) {
+  // Each configuration only includes its own header, so we should not
+  // count `a.hpp` and `b.hpp` for every source in both configurations
+  const cost expected = {3 * 111 + 121, (3 * 111 + 121) * B};
+  EXPECT_THAT(
+      get_total_cost::from_graph(merged.graph, merged.sources).true_cost,
+      Eq(expected));
+
+  const std::vector<get_total_cost::result> each =
+      get_total_cost::for_each_source(merged.graph, merged.sources);
+  ASSERT_THAT(each, SizeIs(1));
+  EXPECT_THAT(each[0].true_cost, Eq(expected));
+}
+
+TEST_F(MultiConfigCost, FindDominatingHeaders) {
+  const Graph::vertex_descriptor c = 1, a = 2, b = 3;
+  EXPECT_THAT(
+      find_dominating_headers::from_graph(merged.graph, merged.sources),
+      UnorderedElementsAre(
+          find_dominating_headers::result{c, {3 * 110 + 120,
+                                              (3 * 110 + 120) * B}},
+          find_dominating_headers::result{a, {3 * 10, 3 * 10 * B}},
+          find_dominating_headers::result{b, {20, 20 * B}}));
+}
+
+TEST_F(MultiConfigCost, FindExpensiveIncludes) {
+  // Only `#include "c.hpp"` is in every configuration of `s.cpp`
+  for (const find_expensive_includes::engine algorithm :
+       {find_expensive_includes::engine::dominator_tree,
+        find_expensive_includes::engine::reference}) {
+    const std::vector<include_directive_and_cost> results =
+        find_expensive_includes::from_graph(merged.graph, merged.sources, 0,
+                                            algorithm);
+    ASSERT_THAT(results, SizeIs(1));
+    EXPECT_THAT(results[0].include->code.str(), Eq("\"c.hpp\""));
+    EXPECT_THAT(results[0].saving,
+                Eq(cost{3 * 110 + 120, (3 * 110 + 120) * B}));
+  }
+}
+
+} // namespace
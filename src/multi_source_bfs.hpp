@@ -0,0 +1,135 @@
+#ifndef INCLUDE_GUARD_47C350A1_1451_456E_A7B8_6E319D4467F4
+#define INCLUDE_GUARD_47C350A1_1451_456E_A7B8_6E319D4467F4
+
+// `multi_source_bfs` traverses a graph from many sources at once in the
+// style of "The More the Merrier: Efficient Multi-Source Graph Traversal"
+// by Then et al.  Sources are split into batches of 64 and each vertex
+// stores a bitmask of which sources in the batch have reached it, so a
+// single sweep over the graph does the work of 64 separate traversals.
+// Batches are traversed in parallel.
+
+#include <boost/range/iterator_range.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace IncludeGuardian {
+
+struct multi_source_bfs {
+  using mask = std::uint64_t;
+
+  /// The number of sources traversed together in each batch.
+  static constexpr std::size_t batch_size = 64;
+
+  /// Return the sum of `weights[batch * batch_size + i]` for each bit `i`
+  /// set in the specified `m`, or the number of bits set if the specified
+  /// `weights` is empty.
+  static std::uint64_t weighted_count(const std::size_t batch, mask m,
+                                      std::span<const unsigned> weights) {
+    if (weights.empty()) {
+      return std::popcount(m);
+    }
+
+    const unsigned *const w = weights.data() + batch * batch_size;
+    std::uint64_t count = 0u;
+    for (; m != 0u; m &= m - 1) {
+      count += w[std::countr_zero(m)];
+    }
+    return count;
+  }
+
+  /// Call `visit(batch, v, m)` for every vertex `v` reachable from the
+  /// specified `sources` in the specified `graph`.  Bit `i` of `m` is set if
+  /// `v` can be reached by `sources[batch * batch_size + i]`.  A vertex may
+  /// be visited more than once for the same batch, but each bit is only set
+  /// once for each vertex so the results of `visit` can be summed.  Calls
+  /// for the same `batch` are made sequentially, but calls for different
+  /// batches may be made concurrently.
+  template <typename GRAPH, typename VERTEX, typename VISIT>
+  static void for_each(const GRAPH &graph, std::span<const VERTEX> sources,
+                       VISIT visit) {
+    std::vector<std::size_t> batches((sources.size() + batch_size - 1) /
+                                     batch_size);
+    std::iota(batches.begin(), batches.end(), std::size_t(0));
+    std::for_each(
+        std::execution::par, batches.begin(), batches.end(),
+        [&](const std::size_t batch) {
+          const std::size_t first = batch * batch_size;
+          const std::size_t last =
+              std::min(first + batch_size, sources.size());
+          traverse(graph, sources.subspan(first, last - first),
+                   [&](const typename GRAPH::vertex_descriptor v,
+                       const mask m) { visit(batch, v, m); });
+        });
+  }
+
+  /// Call `visit(v, m)` for every vertex `v` reachable from the specified
+  /// `sources`, of which there must be at most `batch_size`, in the
+  /// specified `graph`.  Bit `i` of `m` is set if `v` can be reached by
+  /// `sources[i]` and each bit is only set once for each vertex.
+  template <typename GRAPH, typename VERTEX, typename VISIT>
+  static void traverse(const GRAPH &graph, std::span<const VERTEX> sources,
+                       VISIT visit) {
+    assert(sources.size() <= batch_size);
+    using vertex_descriptor = typename GRAPH::vertex_descriptor;
+    const std::size_t V = num_vertices(graph);
+    std::vector<mask> seen(V, 0u);    // all sources that reached a vertex
+    std::vector<mask> current(V, 0u); // sources that reached it last level
+    std::vector<mask> arrived(V, 0u); // sources that reached it this level
+    std::vector<vertex_descriptor> frontier;
+    std::vector<vertex_descriptor> next_frontier;
+
+    for (std::size_t i = 0; i != sources.size(); ++i) {
+      const auto source = static_cast<vertex_descriptor>(sources[i]);
+      if (current[source] == 0u) {
+        frontier.push_back(source);
+      }
+      current[source] |= mask(1) << i;
+      seen[source] |= mask(1) << i;
+    }
+
+    while (!frontier.empty()) {
+      for (const vertex_descriptor v : frontier) {
+        visit(v, current[v]);
+      }
+
+      // Push the sources in each frontier vertex along all of its out edges,
+      // only keeping the bits that haven't reached the target before.
+      next_frontier.clear();
+      for (const vertex_descriptor v : frontier) {
+        const mask m = current[v];
+        for (const vertex_descriptor w :
+             boost::make_iterator_range(adjacent_vertices(v, graph))) {
+          const mask unseen = m & ~seen[w];
+          if (unseen != 0u) {
+            if (arrived[w] == 0u) {
+              next_frontier.push_back(w);
+            }
+            arrived[w] |= unseen;
+            seen[w] |= unseen;
+          }
+        }
+      }
+
+      for (const vertex_descriptor v : frontier) {
+        current[v] = 0u;
+      }
+      for (const vertex_descriptor w : next_frontier) {
+        current[w] = arrived[w];
+        arrived[w] = 0u;
+      }
+      std::swap(frontier, next_frontier);
+    }
+  }
+};
+
+} // namespace IncludeGuardian
+
+#endif
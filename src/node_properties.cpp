@@ -0,0 +1,69 @@
+#include "node_properties.hpp"
+
+#include <cassert>
+#include <execution>
+#include <functional>
+#include <numeric>
+
+namespace IncludeGuardian {
+
+namespace {
+
+// Return the sum of the `token_count` and `file_size` columns for all
+// vertices where `flags & precompiled` is equal to `mask`.
+cost sum_where(const std::vector<std::int64_t> &token_count,
+               const std::vector<double> &file_size,
+               const std::vector<std::uint8_t> &flags,
+               const std::uint8_t mask) {
+  const std::int64_t tokens = std::transform_reduce(
+      std::execution::unseq, token_count.begin(), token_count.end(),
+      flags.begin(), std::int64_t(0), std::plus<>(),
+      [=](const std::int64_t t, const std::uint8_t f) {
+        return (f & node_properties::precompiled) == mask ? t : 0;
+      });
+  const double bytes = std::transform_reduce(
+      std::execution::unseq, file_size.begin(), file_size.end(),
+      flags.begin(), 0.0, std::plus<>(),
+      [=](const double s, const std::uint8_t f) {
+        return (f & node_properties::precompiled) == mask ? s : 0.0;
+      });
+  return {tokens,
+          boost::units::quantity<boost::units::information::info>::from_value(
+              bytes)};
+}
+
+} // namespace
+
+node_properties::node_properties(const Graph &graph)
+    : m_token_count(), m_file_size(), m_flags(), m_component(), m_weight() {
+  const std::size_t V = num_vertices(graph);
+  assert(V < no_component);
+  m_token_count.reserve(V);
+  m_file_size.reserve(V);
+  m_flags.reserve(V);
+  m_component.reserve(V);
+  m_weight.reserve(V);
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    const file_node &node = graph[v];
+    m_token_count.push_back(node.underlying_cost.token_count);
+    m_file_size.push_back(node.underlying_cost.file_size.value());
+    m_flags.push_back((node.is_external ? external : 0) |
+                      (node.is_precompiled ? precompiled : 0) |
+                      (node.is_guarded ? guarded : 0));
+    m_component.push_back(node.component.has_value()
+                              ? static_cast<vertex_descriptor>(*node.component)
+                              : no_component);
+    m_weight.push_back(node.weight);
+  }
+}
+
+cost node_properties::total_true_cost() const {
+  return sum_where(m_token_count, m_file_size, m_flags, 0);
+}
+
+cost node_properties::total_precompiled_cost() const {
+  return sum_where(m_token_count, m_file_size, m_flags, precompiled);
+}
+
+} // namespace IncludeGuardian
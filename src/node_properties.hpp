@@ -0,0 +1,95 @@
+#ifndef INCLUDE_GUARD_C51440C7_5851_4CA5_9E42_70E617CC4EE4
+#define INCLUDE_GUARD_C51440C7_5851_4CA5_9E42_70E617CC4EE4
+
+// `node_properties` stores the properties of every `file_node` in a `Graph`
+// that are used during analysis as separate columns indexed by vertex.
+// Splitting out the token count, file size, flags and component means that
+// a loop over one property only touches the memory for that property, and
+// summing costs over all vertices can be vectorized by the compiler.
+//
+// Cold properties, such as `path`, are not stored and should be looked up in
+// the original `Graph`.
+
+#include "graph.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace IncludeGuardian {
+
+class node_properties {
+public:
+  using vertex_descriptor = std::uint32_t;
+
+  /// The value of `component` for files without a component.
+  static constexpr vertex_descriptor no_component =
+      std::numeric_limits<vertex_descriptor>::max();
+
+  enum flag : std::uint8_t {
+    external = 1 << 0,
+    precompiled = 1 << 1,
+    guarded = 1 << 2,
+  };
+
+private:
+  std::vector<std::int64_t> m_token_count; //< vertex -> underlying tokens
+  std::vector<double> m_file_size;         //< vertex -> underlying file size
+  std::vector<std::uint8_t> m_flags;       //< vertex -> `flag` bitmask
+  std::vector<vertex_descriptor> m_component; //< vertex -> component
+  std::vector<std::uint32_t> m_weight;        //< vertex -> weight
+
+public:
+  /// Copy the properties of all vertices in the specified `graph`, which
+  /// must have fewer than 2^32 - 1 vertices.
+  explicit node_properties(const Graph &graph);
+
+  /// Return the number of vertices.
+  std::size_t size() const { return m_flags.size(); }
+
+  /// Return the `underlying_cost` of `v`.
+  cost underlying_cost(vertex_descriptor v) const {
+    return {m_token_count[v],
+            boost::units::quantity<boost::units::information::info>::
+                from_value(m_file_size[v])};
+  }
+
+  /// Return the `true_cost()` of `v`.
+  cost true_cost(vertex_descriptor v) const {
+    return is_precompiled(v) ? cost{} : underlying_cost(v);
+  }
+
+  /// Return the `underlying_cost` of `v` if it is precompiled, otherwise 0.
+  cost precompiled_cost(vertex_descriptor v) const {
+    return is_precompiled(v) ? underlying_cost(v) : cost{};
+  }
+
+  bool is_external(vertex_descriptor v) const { return m_flags[v] & external; }
+  bool is_precompiled(vertex_descriptor v) const {
+    return m_flags[v] & precompiled;
+  }
+  bool is_guarded(vertex_descriptor v) const { return m_flags[v] & guarded; }
+
+  /// Return the corresponding source or header of `v`, or `no_component`.
+  vertex_descriptor component(vertex_descriptor v) const {
+    return m_component[v];
+  }
+
+  /// Return the `weight` of `v`.
+  unsigned weight(vertex_descriptor v) const { return m_weight[v]; }
+
+  /// Set the `weight` of `v` to the specified `weight`.
+  void set_weight(vertex_descriptor v, unsigned weight) {
+    m_weight[v] = weight;
+  }
+
+  /// Return the sum of `true_cost()` over all vertices.
+  cost total_true_cost() const;
+
+  /// Return the sum of `precompiled_cost()` over all vertices.
+  cost total_precompiled_cost() const;
+};
+
+} // namespace IncludeGuardian
+
+#endif
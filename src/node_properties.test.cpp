@@ -0,0 +1,56 @@
+#include "node_properties.hpp"
+
+#include "analysis_test_fixtures.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace IncludeGuardian;
+
+namespace {
+
+TEST_F(ComplexCascadingInclude, NodeProperties) {
+  const node_properties properties(graph);
+  ASSERT_EQ(properties.size(), num_vertices(graph));
+
+  cost expected_true_cost;
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    EXPECT_EQ(properties.underlying_cost(v), graph[v].underlying_cost) << v;
+    EXPECT_EQ(properties.true_cost(v), graph[v].true_cost()) << v;
+    EXPECT_EQ(properties.is_external(v), graph[v].is_external) << v;
+    EXPECT_EQ(properties.is_precompiled(v), graph[v].is_precompiled) << v;
+    EXPECT_EQ(properties.is_guarded(v), graph[v].is_guarded) << v;
+    if (graph[v].component) {
+      EXPECT_EQ(properties.component(v), *graph[v].component) << v;
+    } else {
+      EXPECT_EQ(properties.component(v), node_properties::no_component) << v;
+    }
+    expected_true_cost += graph[v].true_cost();
+  }
+
+  EXPECT_EQ(properties.total_true_cost(), expected_true_cost);
+  EXPECT_EQ(properties.total_precompiled_cost(), cost{});
+}
+
+TEST(NodeProperties, Precompiled) {
+  const cost a_size(1, 10.0 * boost::units::information::byte);
+  const cost b_size(20, 200.0 * boost::units::information::byte);
+  const cost c_size(300, 3000.0 * boost::units::information::byte);
+  Graph graph;
+  const Graph::vertex_descriptor a =
+      add_vertex(file_node("a").with_cost(a_size), graph);
+  const Graph::vertex_descriptor b = add_vertex(
+      file_node("b").with_cost(b_size).set_precompiled(true), graph);
+  const Graph::vertex_descriptor c = add_vertex(
+      file_node("c").with_cost(c_size).set_external(true), graph);
+
+  const node_properties properties(graph);
+  EXPECT_EQ(properties.true_cost(a), a_size);
+  EXPECT_EQ(properties.true_cost(b), cost{});
+  EXPECT_EQ(properties.precompiled_cost(b), b_size);
+  EXPECT_EQ(properties.true_cost(c), c_size);
+  EXPECT_EQ(properties.total_true_cost(), a_size + c_size);
+  EXPECT_EQ(properties.total_precompiled_cost(), b_size);
+}
+
+} // namespace
@@ -2,9 +2,16 @@
 #define INCLUDE_GUARD_E31B79D8_2464_4823_BDE1_37F760251C13
 
 #include <boost/graph/adjacency_list.hpp>
+#include <boost/graph/strong_components.hpp>
 
-#include <deque>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <execution>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <span>
 #include <utility>
 #include <vector>
 
@@ -17,29 +24,12 @@ public:
                             NODE, EDGE>::vertex_descriptor;
 
 private:
-  std::size_t m_size;
-  std::vector<char> m_paths;
-
-  // For each unique path leading from `v` invoke `vis(vertex_descriptor)` for
-  // each vertex in these paths.  Note that `vis` may visit the same vertext
-  // multiple times if it is reachable from `v` through different paths.
-  template <class IncidenceGraph, class Visitor>
-  static void traverse_all_paths(
-      const IncidenceGraph &g,
-      const typename boost::graph_traits<IncidenceGraph>::vertex_descriptor v,
-      Visitor vis) {
-    std::deque<typename boost::graph_traits<IncidenceGraph>::vertex_descriptor>
-        vs;
-    vs.push_back(v);
-    while (!vs.empty()) {
-      const auto v = vs.front();
-      vs.pop_front();
-      if (vis(v)) {
-        const auto [begin, end] = adjacent_vertices(v, g);
-        vs.insert(vs.end(), begin, end);
-      }
-    }
-  }
+  using word = std::uint64_t;
+  static constexpr std::size_t word_bits = 64;
+
+  std::vector<std::size_t> m_component; // vertex -> component
+  std::size_t m_stride;                 // number of `word` in each row
+  std::vector<word> m_rows; // component -> bitset of reachable components
 
 public:
   // Create a `reachability_matrix`.
@@ -57,24 +47,346 @@ template <typename NODE, typename EDGE>
 reachability_graph<NODE, EDGE>::reachability_graph(
     const boost::adjacency_list<boost::vecS, boost::vecS, boost::bidirectionalS,
                                 NODE, EDGE> &dag)
-    : m_size(num_vertices(dag)), m_paths(m_size * m_size) {
-  const auto [begin, end] = vertices(dag);
-  std::for_each(std::execution::par, begin, end, [&](const handle v) {
-    // THINKING: It would be very good if we can reuse information
-    // from previous vertex searches
-    const std::size_t offset = v * m_size;
-    traverse_all_paths(dag, v, [=](handle u) {
-      const bool carry_on = !m_paths[offset + u];
-      m_paths[offset + u] = true;
-      return carry_on;
-    });
-  });
+    : m_component(num_vertices(dag)), m_stride(0u), m_rows() {
+  // Every vertex in a strongly connected component can reach every other
+  // vertex in that component, so we only need to store one row per
+  // component.  Tarjan's algorithm numbers the components in reverse
+  // topological order, which means that we can build each row by OR-ing
+  // together the already complete rows of the components it includes.
+  const std::size_t component_count = boost::strong_components(
+      dag, boost::make_iterator_property_map(m_component.begin(),
+                                             get(boost::vertex_index, dag)));
+  m_stride = (component_count + word_bits - 1) / word_bits;
+  m_rows.resize(component_count * m_stride);
+
+  std::vector<std::vector<handle>> members(component_count);
+  for (const handle v : boost::make_iterator_range(vertices(dag))) {
+    members[m_component[v]].push_back(v);
+  }
+
+  for (std::size_t c = 0; c != component_count; ++c) {
+    word *const row = m_rows.data() + c * m_stride;
+    row[c / word_bits] |= word(1) << (c % word_bits);
+    for (const handle v : members[c]) {
+      for (const handle u :
+           boost::make_iterator_range(adjacent_vertices(v, dag))) {
+        const std::size_t child = m_component[u];
+
+        // If we can already reach `child` then we have OR-ed in a row that
+        // is a superset of its row.
+        if (row[child / word_bits] & (word(1) << (child % word_bits))) {
+          continue;
+        }
+
+        const word *const child_row = m_rows.data() + child * m_stride;
+        for (std::size_t i = 0; i != m_stride; ++i) {
+          row[i] |= child_row[i];
+        }
+      }
+    }
+  }
 }
 
 template <typename NODE, typename EDGE>
 bool reachability_graph<NODE, EDGE>::is_reachable(handle from,
                                                   handle to) const {
-  return m_paths[from * m_size + to];
+  const std::size_t to_component = m_component[to];
+  return m_rows[m_component[from] * m_stride + to_component / word_bits] &
+         (word(1) << (to_component % word_bits));
+}
+
+/// This component answers the same queries as `reachability_graph` but uses
+/// an index that takes O(V * k) memory instead of O(V^2), which makes it
+/// suitable for very large graphs.  Following GRAIL, each strongly connected
+/// component is given `k` interval labels from randomized post-order
+/// traversals of the condensation of the graph.  If `from` can reach `to` then
+/// every label of `to` lies within the corresponding label of `from`, so most
+/// negative queries are answered immediately.  The remaining queries fall
+/// back to a depth-first search that is pruned using the same labels.
+template <typename NODE, typename EDGE> class indexed_reachability_graph {
+public:
+  using handle =
+      typename boost::adjacency_list<boost::vecS, boost::vecS,
+                                     boost::bidirectionalS, NODE,
+                                     EDGE>::vertex_descriptor;
+
+private:
+  static constexpr std::size_t label_count = 5;
+
+  struct label {
+    std::uint32_t low;  //< The lowest `post` of all reachable components
+    std::uint32_t post; //< The rank of this component in post-order
+  };
+
+  std::vector<std::size_t> m_component; // vertex -> component
+  std::vector<std::size_t> m_offsets;   // component -> start in `m_children`
+  std::vector<std::size_t> m_children;  // distinct child components
+  std::vector<std::uint32_t> m_level;   // component -> longest path to a leaf
+  std::vector<label> m_labels;          // component -> `label_count` labels
+
+  // Return `false` if there is definitely no path from the component `from`
+  // to a different component `to`, otherwise return `true`.
+  bool may_reach(std::size_t from, std::size_t to) const {
+    if (m_level[from] <= m_level[to]) {
+      return false;
+    }
+
+    const label *const f = m_labels.data() + from * label_count;
+    const label *const t = m_labels.data() + to * label_count;
+    for (std::size_t i = 0; i != label_count; ++i) {
+      if (t[i].low < f[i].low || t[i].post > f[i].post) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+public:
+  // Create an `indexed_reachability_graph`.
+  explicit indexed_reachability_graph(
+      const boost::adjacency_list<boost::vecS, boost::vecS,
+                                  boost::bidirectionalS, NODE, EDGE> &dag);
+
+  indexed_reachability_graph(const indexed_reachability_graph &) = delete;
+
+  // Return whether there is a path `from` to `to`.
+  bool is_reachable(handle from, handle to) const;
+};
+
+template <typename NODE, typename EDGE>
+indexed_reachability_graph<NODE, EDGE>::indexed_reachability_graph(
+    const boost::adjacency_list<boost::vecS, boost::vecS, boost::bidirectionalS,
+                                NODE, EDGE> &dag)
+    : m_component(num_vertices(dag)), m_offsets(), m_children(), m_level(),
+      m_labels() {
+  const std::size_t component_count = boost::strong_components(
+      dag, boost::make_iterator_property_map(m_component.begin(),
+                                             get(boost::vertex_index, dag)));
+
+  // Build the condensation in compressed sparse row form
+  std::vector<std::pair<std::size_t, std::size_t>> edges;
+  for (const handle v : boost::make_iterator_range(vertices(dag))) {
+    for (const handle u :
+         boost::make_iterator_range(adjacent_vertices(v, dag))) {
+      if (m_component[v] != m_component[u]) {
+        edges.emplace_back(m_component[v], m_component[u]);
+      }
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+  m_offsets.assign(component_count + 1, 0u);
+  m_children.reserve(edges.size());
+  for (const auto &[from, to] : edges) {
+    ++m_offsets[from + 1];
+    m_children.push_back(to);
+  }
+  std::partial_sum(m_offsets.begin(), m_offsets.end(), m_offsets.begin());
+
+  // Tarjan's algorithm numbers components in reverse topological order so
+  // all children have a lower number than their parents.
+  m_level.assign(component_count, 0u);
+  for (std::size_t c = 0; c != component_count; ++c) {
+    for (std::size_t i = m_offsets[c]; i != m_offsets[c + 1]; ++i) {
+      m_level[c] = std::max(m_level[c], m_level[m_children[i]] + 1);
+    }
+  }
+
+  // Use a fixed seed so that our results are reproducible
+  m_labels.resize(component_count * label_count);
+  std::mt19937 rng(0);
+  std::vector<std::size_t> roots(component_count);
+  std::iota(roots.begin(), roots.end(), std::size_t(0));
+  std::vector<bool> visited;
+  struct frame {
+    std::size_t c;
+    std::size_t start; //< A random offset to visit the children from
+    std::size_t next;  //< The number of children visited
+  };
+  std::vector<frame> stack;
+  for (std::size_t l = 0; l != label_count; ++l) {
+    std::shuffle(roots.begin(), roots.end(), rng);
+    visited.assign(component_count, false);
+    std::uint32_t rank = 0;
+    for (const std::size_t root : roots) {
+      if (visited[root]) {
+        continue;
+      }
+
+      visited[root] = true;
+      stack.push_back({root, rng(), 0u});
+      while (!stack.empty()) {
+        frame &top = stack.back();
+        const std::size_t begin = m_offsets[top.c];
+        const std::size_t degree = m_offsets[top.c + 1] - begin;
+        if (top.next != degree) {
+          const std::size_t child =
+              m_children[begin + (top.start + top.next++) % degree];
+          if (!visited[child]) {
+            visited[child] = true;
+            stack.push_back({child, rng(), 0u});
+          }
+          continue;
+        }
+
+        label &x = m_labels[top.c * label_count + l];
+        x.post = rank++;
+        x.low = x.post;
+        for (std::size_t i = begin; i != begin + degree; ++i) {
+          x.low =
+              std::min(x.low, m_labels[m_children[i] * label_count + l].low);
+        }
+        stack.pop_back();
+      }
+    }
+  }
+}
+
+template <typename NODE, typename EDGE>
+bool indexed_reachability_graph<NODE, EDGE>::is_reachable(handle from,
+                                                          handle to) const {
+  const std::size_t source = m_component[from];
+  const std::size_t target = m_component[to];
+  if (source == target) {
+    return true;
+  }
+
+  if (!may_reach(source, target)) {
+    return false;
+  }
+
+  // Queries that get past `may_reach` are common enough in the analyses that
+  // we reuse the search memory of each thread.  A component has been seen by
+  // this query if its mark equals the current epoch, so nothing needs to be
+  // cleared between queries.
+  thread_local struct {
+    std::vector<std::uint32_t> marks;
+    std::uint32_t epoch = 0;
+    std::vector<std::size_t> stack;
+  } scratch;
+  if (scratch.marks.size() < m_level.size()) {
+    scratch.marks.resize(m_level.size(), 0u);
+  }
+  if (++scratch.epoch == 0) {
+    std::fill(scratch.marks.begin(), scratch.marks.end(), 0u);
+    scratch.epoch = 1;
+  }
+
+  std::vector<std::size_t> &stack = scratch.stack;
+  stack.clear();
+  stack.push_back(source);
+  while (!stack.empty()) {
+    const std::size_t c = stack.back();
+    stack.pop_back();
+    for (std::size_t i = m_offsets[c]; i != m_offsets[c + 1]; ++i) {
+      const std::size_t child = m_children[i];
+      if (child == target) {
+        return true;
+      }
+
+      if (scratch.marks[child] != scratch.epoch &&
+          may_reach(child, target)) {
+        scratch.marks[child] = scratch.epoch;
+        stack.push_back(child);
+      }
+    }
+  }
+  return false;
+}
+
+/// This component answers the same queries as `reachability_graph`, but
+/// only for paths starting at one of the sources specified at construction.
+/// This stores one bit for each source and vertex, so memory grows with the
+/// number of translation units instead of the square of the number of files.
+/// If this would take more than `max_dense_bytes`, then an
+/// `indexed_reachability_graph` is used instead.
+template <typename NODE, typename EDGE> class source_reachability_graph {
+public:
+  using handle =
+      typename boost::adjacency_list<boost::vecS, boost::vecS,
+                                     boost::bidirectionalS, NODE,
+                                     EDGE>::vertex_descriptor;
+
+private:
+  using word = std::uint64_t;
+  static constexpr std::size_t word_bits = 64;
+  static constexpr std::size_t not_a_source = -1;
+
+  std::vector<std::size_t> m_row; // vertex -> row, or `not_a_source`
+  std::size_t m_stride;           // number of `word` in each row
+  std::vector<word> m_rows;       // row -> bitset of reachable vertices
+  std::unique_ptr<const indexed_reachability_graph<NODE, EDGE>> m_index;
+
+public:
+  static constexpr std::size_t default_max_dense_bytes = std::size_t(1) << 30;
+
+  // Create a `source_reachability_graph` for paths starting from `sources`.
+  source_reachability_graph(
+      const boost::adjacency_list<boost::vecS, boost::vecS,
+                                  boost::bidirectionalS, NODE, EDGE> &dag,
+      std::span<const handle> sources,
+      std::size_t max_dense_bytes = default_max_dense_bytes);
+
+  source_reachability_graph(const source_reachability_graph &) = delete;
+
+  // Return whether there is a path `from` to `to`.  The behavior is undefined
+  // unless `from` was one of the sources supplied at construction.
+  bool is_reachable(handle from, handle to) const;
+};
+
+template <typename NODE, typename EDGE>
+source_reachability_graph<NODE, EDGE>::source_reachability_graph(
+    const boost::adjacency_list<boost::vecS, boost::vecS, boost::bidirectionalS,
+                                NODE, EDGE> &dag,
+    std::span<const handle> sources, std::size_t max_dense_bytes)
+    : m_row(num_vertices(dag), not_a_source),
+      m_stride((num_vertices(dag) + word_bits - 1) / word_bits), m_rows(),
+      m_index() {
+  std::vector<handle> unique_sources;
+  for (const handle source : sources) {
+    if (m_row[source] == not_a_source) {
+      m_row[source] = unique_sources.size();
+      unique_sources.push_back(source);
+    }
+  }
+
+  if (unique_sources.size() * m_stride * sizeof(word) > max_dense_bytes) {
+    m_index = std::make_unique<indexed_reachability_graph<NODE, EDGE>>(dag);
+    return;
+  }
+
+  m_rows.resize(unique_sources.size() * m_stride);
+  std::for_each(
+      std::execution::par, unique_sources.begin(), unique_sources.end(),
+      [&](const handle source) {
+        word *const row = m_rows.data() + m_row[source] * m_stride;
+        std::vector<handle> stack;
+        stack.push_back(source);
+        while (!stack.empty()) {
+          const handle v = stack.back();
+          stack.pop_back();
+          word &w = row[v / word_bits];
+          const word bit = word(1) << (v % word_bits);
+          if (w & bit) {
+            continue;
+          }
+
+          w |= bit;
+          const auto [begin, end] = adjacent_vertices(v, dag);
+          stack.insert(stack.end(), begin, end);
+        }
+      });
+}
+
+template <typename NODE, typename EDGE>
+bool source_reachability_graph<NODE, EDGE>::is_reachable(handle from,
+                                                         handle to) const {
+  assert(m_row[from] != not_a_source);
+  if (m_index) {
+    return m_index->is_reachable(from, to);
+  }
+  return m_rows[m_row[from] * m_stride + to / word_bits] &
+         (word(1) << (to % word_bits));
 }
 
 } // namespace IncludeGuardian
@@ -4,6 +4,9 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 using namespace IncludeGuardian;
 
 namespace {
@@ -95,4 +98,135 @@ TEST_F(LongChain, ReachabilityGraph) {
   }
 }
 
+// Test that all files in a cycle are reachable from each other, e.g.
+//
+//      a
+//      |
+//      b <-.
+//      |   |
+//      c --'
+//      |
+//      d
+TEST(ReachabilityGraph, Cycle) {
+  Graph graph;
+  const Graph::vertex_descriptor a = add_vertex(file_node("a"), graph);
+  const Graph::vertex_descriptor b = add_vertex(file_node("b"), graph);
+  const Graph::vertex_descriptor c = add_vertex(file_node("c"), graph);
+  const Graph::vertex_descriptor d = add_vertex(file_node("d"), graph);
+  add_edge(a, b, {"b"}, graph);
+  add_edge(b, c, {"c"}, graph);
+  add_edge(c, b, {"b"}, graph);
+  add_edge(c, d, {"d"}, graph);
+
+  reachability_graph dag(graph);
+  EXPECT_EQ(dag.is_reachable(a, a), true);
+  EXPECT_EQ(dag.is_reachable(a, b), true);
+  EXPECT_EQ(dag.is_reachable(a, c), true);
+  EXPECT_EQ(dag.is_reachable(a, d), true);
+
+  EXPECT_EQ(dag.is_reachable(b, a), false);
+  EXPECT_EQ(dag.is_reachable(b, b), true);
+  EXPECT_EQ(dag.is_reachable(b, c), true);
+  EXPECT_EQ(dag.is_reachable(b, d), true);
+
+  EXPECT_EQ(dag.is_reachable(c, a), false);
+  EXPECT_EQ(dag.is_reachable(c, b), true);
+  EXPECT_EQ(dag.is_reachable(c, c), true);
+  EXPECT_EQ(dag.is_reachable(c, d), true);
+
+  EXPECT_EQ(dag.is_reachable(d, a), false);
+  EXPECT_EQ(dag.is_reachable(d, b), false);
+  EXPECT_EQ(dag.is_reachable(d, c), false);
+  EXPECT_EQ(dag.is_reachable(d, d), true);
+}
+
+// Test a graph with more than 64 strongly connected components so that
+// each row spans multiple words.
+TEST(ReachabilityGraph, LongLine) {
+  constexpr int SIZE = 150;
+  Graph graph;
+  std::vector<Graph::vertex_descriptor> vs;
+  for (int i = 0; i != SIZE; ++i) {
+    vs.push_back(add_vertex(file_node(std::to_string(i)), graph));
+    if (i > 0) {
+      add_edge(vs[i - 1], vs[i], {std::to_string(i)}, graph);
+    }
+  }
+
+  reachability_graph dag(graph);
+  for (int from = 0; from != SIZE; ++from) {
+    for (int to = 0; to != SIZE; ++to) {
+      EXPECT_EQ(dag.is_reachable(vs[from], vs[to]), from <= to)
+          << from << "->" << to;
+    }
+  }
+}
+
+TEST_F(MultiLevel, SourceReachabilityGraph) {
+  constexpr int SIZE = 8;
+  ASSERT_EQ(num_vertices(graph), SIZE);
+
+  const Graph::vertex_descriptor vs[SIZE] = {a, b, c, d, e, f, g, h};
+
+  const Graph::vertex_descriptor sources[] = {a, b, e};
+  const reachability_graph all(graph);
+  const source_reachability_graph dag(graph, sources);
+  for (const Graph::vertex_descriptor from : sources) {
+    for (const Graph::vertex_descriptor to : vs) {
+      EXPECT_EQ(dag.is_reachable(from, to), all.is_reachable(from, to))
+          << from << "->" << to;
+    }
+  }
+}
+
+TEST_F(LongChain, IndexedReachabilityGraph) {
+  const reachability_graph expected(graph);
+  const indexed_reachability_graph dag(graph);
+  for (const Graph::vertex_descriptor from :
+       boost::make_iterator_range(vertices(graph))) {
+    for (const Graph::vertex_descriptor to :
+         boost::make_iterator_range(vertices(graph))) {
+      EXPECT_EQ(dag.is_reachable(from, to), expected.is_reachable(from, to))
+          << from << "->" << to;
+    }
+  }
+}
+
+// Test a larger graph with cycles against `reachability_graph`
+TEST(IndexedReachabilityGraph, Cycles) {
+  constexpr int SIZE = 200;
+  Graph graph;
+  for (int i = 0; i != SIZE; ++i) {
+    add_vertex(file_node(std::to_string(i)), graph);
+  }
+  for (int i = 0; i != SIZE; ++i) {
+    add_edge(i, (i * 7 + 3) % SIZE, {"x"}, graph);
+    if (i % 5 == 0) {
+      add_edge(i, (i * 13 + 11) % SIZE, {"y"}, graph);
+    }
+  }
+
+  const reachability_graph expected(graph);
+  const indexed_reachability_graph dag(graph);
+  const std::vector<Graph::vertex_descriptor> sources = {0, 5, 17, 120};
+  const source_reachability_graph indexed_sources(graph, sources, 0u);
+  for (const Graph::vertex_descriptor from :
+       boost::make_iterator_range(vertices(graph))) {
+    for (const Graph::vertex_descriptor to :
+         boost::make_iterator_range(vertices(graph))) {
+      ASSERT_EQ(dag.is_reachable(from, to), expected.is_reachable(from, to))
+          << from << "->" << to;
+    }
+  }
+
+  for (const Graph::vertex_descriptor from : sources) {
+    for (const Graph::vertex_descriptor to :
+         boost::make_iterator_range(vertices(graph))) {
+      ASSERT_EQ(indexed_sources.is_reachable(from, to),
+                expected.is_reachable(from, to))
+          << from << "->" << to;
+    }
+  }
+}
+
 } // namespace
@@ -1,10 +1,9 @@
 #include "recommend_precompiled.hpp"
 
-#include "reachability_graph.hpp"
-
 #include <boost/units/io.hpp>
 
 #include <execution>
+#include <functional>
 #include <iomanip>
 #include <numeric>
 #include <ostream>
@@ -23,6 +22,21 @@ enum search_state : std::uint8_t {
 std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
     const Graph &graph, std::span<const Graph::vertex_descriptor> sources,
     const int minimum_token_count_cut_off, const double minimum_saving_ratio) {
+  return from_graph(graph, graph_snapshot(graph), sources,
+                    minimum_token_count_cut_off, minimum_saving_ratio);
+}
+
+std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
+    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off, const double minimum_saving_ratio) {
+  return from_graph(graph, std::span(sources.begin(), sources.end()),
+                    minimum_token_count_cut_off, minimum_saving_ratio);
+}
+
+std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
+    const Graph &graph, const graph_snapshot &snapshot,
+    std::span<const Graph::vertex_descriptor> sources,
+    const int minimum_token_count_cut_off, const double minimum_saving_ratio) {
   assert(minimum_saving_ratio > 0.0);
   std::mutex m;
   std::vector<recommend_precompiled::result> results;
@@ -30,7 +44,12 @@ std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
     return results;
   }
 
-  const reachability_graph reach(graph);
+  const std::int64_t total_weight = std::transform_reduce(
+      sources.begin(), sources.end(), std::int64_t(0), std::plus<>(),
+      [&](const Graph::vertex_descriptor source) {
+        return std::int64_t(snapshot.weight(source));
+      });
+
   const auto [begin, end] = vertices(graph);
   std::for_each(begin, end, [&](const Graph::vertex_descriptor file) {
     const file_node &f = graph[file];
@@ -62,27 +81,28 @@ std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
     int newly_precompiled_count = 0;
 
     std::vector<std::uint8_t> state(num_vertices(graph), not_seen);
-    std::vector<Graph::vertex_descriptor> stack;
+    std::vector<graph_snapshot::vertex_descriptor> stack;
     stack.push_back(file);
     while (!stack.empty()) {
-      const Graph::vertex_descriptor v = stack.back();
+      const graph_snapshot::vertex_descriptor v = stack.back();
       stack.pop_back();
       if (state[v] == seen) {
         continue;
       }
 
       // If we're already precompiled then all our descendents are
-      if (graph[v].is_precompiled) {
+      if (snapshot.is_precompiled(v)) {
         continue;
       }
 
       newly_precompiled[v] = true;
       ++newly_precompiled_count;
 
-      r.extra_precompiled_size += graph[v].underlying_cost;
+      // As `v` is not precompiled its `true_cost` is its underlying cost
+      r.extra_precompiled_size += snapshot.true_cost(v);
       state[v] = seen;
-      const auto [begin, end] = adjacent_vertices(v, graph);
-      stack.insert(stack.end(), begin, end);
+      const auto children = snapshot.children(v);
+      stack.insert(stack.end(), children.begin(), children.end());
     }
 
     // Not only do we need to beat the `minimum_token_count_cut_off`, but
@@ -94,21 +114,24 @@ std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
 
     // Go through all sources that included `file` and find what dependencies
     // of `file` are reachable through other means.
+    std::int64_t remaining_weight = total_weight;
     for (std::size_t i = 0; i < sources.size(); ++i) {
       // If the file is so small that we couldn't possibly exceeed
       // our threshold with the remaining files, then give up
-      const int remaining_sources = sources.size() - i;
-      if (r.extra_precompiled_size.token_count * remaining_sources +
+      if (r.extra_precompiled_size.token_count * remaining_weight +
               r.saving.token_count <
           cutoff_token_count) {
         return;
       }
 
+      const int weight = static_cast<int>(snapshot.weight(sources[i]));
+      remaining_weight -= weight;
+
       // DFS from our source and sum up all files we traverse that
       // are newly precompiled and sum up their size
       stack.push_back(sources[i]);
       while (!stack.empty()) {
-        const Graph::vertex_descriptor v = stack.back();
+        const graph_snapshot::vertex_descriptor v = stack.back();
         stack.pop_back();
         if (state[v] == seen) {
           continue;
@@ -117,12 +140,12 @@ std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
         // If we found a file that is now added to the precompiled list
         // sum up its cost
         if (newly_precompiled[v]) {
-          r.saving += graph[v].underlying_cost;
+          r.saving += snapshot.true_cost(v) * weight;
         }
 
         state[v] = seen;
-        const auto [begin, end] = adjacent_vertices(v, graph);
-        stack.insert(stack.end(), begin, end);
+        const auto children = snapshot.children(v);
+        stack.insert(stack.end(), children.begin(), children.end());
       }
 
       // Reset the state before we can use it again
@@ -143,13 +166,6 @@ std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
   return results;
 }
 
-std::vector<recommend_precompiled::result> recommend_precompiled::from_graph(
-    const Graph &graph, std::initializer_list<Graph::vertex_descriptor> sources,
-    const int minimum_token_count_cut_off, const double minimum_saving_ratio) {
-  return from_graph(graph, std::span(sources.begin(), sources.end()),
-                    minimum_token_count_cut_off, minimum_saving_ratio);
-}
-
 bool operator==(const recommend_precompiled::result &lhs,
                 const recommend_precompiled::result &rhs) {
   return lhs.v == rhs.v && lhs.saving == rhs.saving &&
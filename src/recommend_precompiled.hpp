@@ -35,6 +35,7 @@
 // 2 sources instead of `common.hpp`s 3.
 
 #include "graph.hpp"
+#include "graph_snapshot.hpp"
 
 #include <initializer_list>
 #include <iosfwd>
@@ -63,6 +64,14 @@ struct recommend_precompiled {
              std::initializer_list<Graph::vertex_descriptor> sources,
              int minimum_token_count_cut_off = 0,
              double minimum_saving_ratio = 1.5);
+
+  /// Return the same as above, using the specified `snapshot`, which must
+  /// have been taken of `graph`, instead of taking a new one.
+  static std::vector<result>
+  from_graph(const Graph &graph, const graph_snapshot &snapshot,
+             std::span<const Graph::vertex_descriptor> sources,
+             int minimum_token_count_cut_off = 0,
+             double minimum_saving_ratio = 1.5);
 };
 
 bool operator==(const recommend_precompiled::result &lhs,
@@ -0,0 +1,233 @@
+#include "schedule.hpp"
+
+#include <boost/range/iterator_range.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+namespace IncludeGuardian {
+
+namespace {
+
+// Return the order in which to pick each of the specified `covers`, where
+// `covers[i]` holds the distinct items covered by the `i`th candidate, so
+// that each candidate picked covers the greatest total of the specified
+// `values` of items not covered by earlier candidates.  Ties are broken by
+// picking the earlier candidate, and candidates that cover nothing new keep
+// their relative order at the end.
+std::vector<std::size_t>
+greedy_order(std::span<const std::vector<std::size_t>> covers,
+             std::span<const std::uint64_t> values) {
+  std::vector<bool> covered(values.size());
+  const auto gain = [&](std::size_t i) {
+    std::uint64_t total = 0u;
+    for (const std::size_t item : covers[i]) {
+      total += covered[item] ? 0u : values[item];
+    }
+    return total;
+  };
+
+  using Candidate = std::pair<std::uint64_t, std::size_t>; // gain, index
+  const auto worse = [](const Candidate &lhs, const Candidate &rhs) {
+    return lhs.first != rhs.first ? lhs.first < rhs.first
+                                  : lhs.second > rhs.second;
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(worse)>
+      queue(worse);
+  for (std::size_t i = 0; i != covers.size(); ++i) {
+    if (const std::uint64_t g = gain(i); g > 0u) {
+      queue.emplace(g, i);
+    }
+  }
+
+  std::vector<bool> picked(covers.size());
+  std::vector<std::size_t> order;
+  order.reserve(covers.size());
+  while (!queue.empty()) {
+    const auto [previous_gain, i] = queue.top();
+    queue.pop();
+    const Candidate current(gain(i), i);
+    if (current.first == 0u) {
+      continue;
+    }
+
+    // Gains only decrease, so if we are still at least as good as the next
+    // best candidate's stale gain, then we are the best candidate
+    if (current.first < previous_gain && !queue.empty() &&
+        worse(current, queue.top())) {
+      queue.push(current);
+      continue;
+    }
+
+    order.push_back(i);
+    picked[i] = true;
+    for (const std::size_t item : covers[i]) {
+      covered[item] = true;
+    }
+  }
+
+  for (std::size_t i = 0; i != covers.size(); ++i) {
+    if (!picked[i]) {
+      order.push_back(i);
+    }
+  }
+  return order;
+}
+
+} // namespace
+
+std::vector<std::size_t>
+schedule::from_graph(const build_graph::result &previous,
+                     std::span<const std::filesystem::path> source_paths,
+                     const std::filesystem::path &working_dir) {
+  const auto normalize = [&](const std::filesystem::path &p) {
+    return (working_dir / p).lexically_normal().string();
+  };
+
+  const Graph &graph = previous.graph;
+  std::unordered_map<std::string, Graph::vertex_descriptor> existing;
+  for (const Graph::vertex_descriptor v : previous.sources) {
+    existing.emplace(normalize(graph[v].path), v);
+  }
+
+  // Find the guarded headers reachable from each source, marking each
+  // vertex with the index of the last source that reached it
+  const std::size_t unseen = source_paths.size();
+  std::vector<std::size_t> seen_by(num_vertices(graph), unseen);
+  std::vector<std::uint64_t> reached_by(num_vertices(graph));
+  std::vector<std::vector<std::size_t>> covers(source_paths.size());
+  std::vector<Graph::vertex_descriptor> stack;
+  for (std::size_t i = 0; i != source_paths.size(); ++i) {
+    const auto it = existing.find(normalize(source_paths[i]));
+    if (it == existing.end()) {
+      continue;
+    }
+
+    stack.assign(1, it->second);
+    seen_by[it->second] = i;
+    while (!stack.empty()) {
+      const Graph::vertex_descriptor v = stack.back();
+      stack.pop_back();
+      if (v != it->second && graph[v].is_guarded) {
+        covers[i].push_back(v);
+        ++reached_by[v];
+      }
+
+      for (const Graph::vertex_descriptor child :
+           boost::make_iterator_range(adjacent_vertices(v, graph))) {
+        if (seen_by[child] != i) {
+          seen_by[child] = i;
+          stack.push_back(child);
+        }
+      }
+    }
+  }
+
+  // A header is replaced for every source after the first that includes it
+  std::vector<std::uint64_t> values(num_vertices(graph));
+  for (const Graph::vertex_descriptor v :
+       boost::make_iterator_range(vertices(graph))) {
+    if (reached_by[v] > 1u) {
+      values[v] = (reached_by[v] - 1u) * graph[v].underlying_cost.token_count;
+    }
+  }
+  return greedy_order(covers, values);
+}
+
+std::vector<std::string> schedule::include_prefix(std::string_view contents) {
+  std::vector<std::string> results;
+  std::size_t i = 0u;
+  while (i < contents.size()) {
+    // Read the next line with all comments removed, where a line continues
+    // until the end of any comment started on it
+    std::string line;
+    bool in_comment = false;
+    while (i < contents.size() && (in_comment || contents[i] != '\n')) {
+      if (in_comment) {
+        if (contents.compare(i, 2, "*/") == 0) {
+          in_comment = false;
+          line += ' ';
+          i += 2;
+        } else {
+          ++i;
+        }
+      } else if (contents.compare(i, 2, "/*") == 0) {
+        in_comment = true;
+        i += 2;
+      } else if (contents.compare(i, 2, "//") == 0) {
+        i = std::min(contents.find('\n', i), contents.size());
+      } else {
+        line += contents[i++];
+      }
+    }
+    ++i;
+
+    std::string_view text = line;
+    const std::size_t first = text.find_first_not_of(" \t\r\f\v");
+    if (first == std::string_view::npos) {
+      continue;
+    }
+
+    text.remove_prefix(first);
+    if (text.front() != '#') {
+      break;
+    }
+
+    // Skip directives other than includes, such as include guards
+    text.remove_prefix(1);
+    text.remove_prefix(std::min(text.find_first_not_of(" \t"), text.size()));
+    if (!text.starts_with("include")) {
+      continue;
+    }
+
+    const std::size_t open = text.find_first_of("\"<");
+    if (open == std::string_view::npos) {
+      continue;
+    }
+
+    const char delimiter = text[open] == '"' ? '"' : '>';
+    const std::size_t close = text.find(delimiter, open + 1);
+    if (close != std::string_view::npos) {
+      results.emplace_back(text.substr(open + 1, close - open - 1));
+    }
+  }
+  return results;
+}
+
+std::vector<std::size_t>
+schedule::from_includes(std::span<const std::vector<std::string>> includes) {
+  std::unordered_map<std::string_view, std::size_t> ids;
+  std::vector<std::uint64_t> values;
+  std::vector<std::vector<std::size_t>> covers(includes.size());
+  for (std::size_t i = 0; i != includes.size(); ++i) {
+    for (const std::string &include : includes[i]) {
+      const auto [it, inserted] = ids.emplace(include, values.size());
+      if (inserted) {
+        values.push_back(0u);
+      }
+
+      // Only count each include once per source
+      if (std::find(covers[i].begin(), covers[i].end(), it->second) ==
+          covers[i].end()) {
+        covers[i].push_back(it->second);
+        ++values[it->second];
+      }
+    }
+  }
+
+  // An include is worth something for each source after the first
+  for (std::uint64_t &value : values) {
+    value -= 1u;
+  }
+  return greedy_order(covers, values);
+}
+
+std::vector<std::size_t> schedule::from_includes(
+    std::initializer_list<std::vector<std::string>> includes) {
+  return from_includes(std::span(includes.begin(), includes.end()));
+}
+
+} // namespace IncludeGuardian
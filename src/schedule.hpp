@@ -0,0 +1,61 @@
+#ifndef INCLUDE_GUARD_57392809_D6E5_4E7B_82E2_323B678BC199
+#define INCLUDE_GUARD_57392809_D6E5_4E7B_82E2_323B678BC199
+
+// With `replace_file_optimization`, a guarded header is only replaced by a
+// smaller file of its macro definitions once a translation unit has fully
+// processed it, and when preprocessing in parallel a translation unit only
+// sees the replacements published before it started.  Preprocessing the
+// sources that share the most expensive headers first means that these
+// headers are replaced as early as possible and that later translation
+// units read as little as possible.
+//
+// Sources are ordered greedily: we repeatedly pick the source whose headers,
+// not yet included by an earlier source, are worth the most.  A header is
+// worth something for each other source that includes it.  As the worth of
+// a source can only go down as more sources are picked, each source is only
+// re-evaluated when it is a candidate to be picked next.
+//
+// The headers of each source come either from a graph saved by a previous
+// run, where a header is worth its token count, or from the `#include`
+// directives at the start of each source, which are cheap to find and where
+// each header is worth the same.
+
+#include "build_graph.hpp"
+
+#include <filesystem>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace IncludeGuardian {
+
+struct schedule {
+  /// Return a permutation of the indices of the specified `source_paths`
+  /// in the order they should be preprocessed, using the guarded headers
+  /// that each source included in the specified `previous` result.  Sources
+  /// are matched by their path relative to the specified `working_dir`, and
+  /// sources that are not in `previous` are last in their original order.
+  static std::vector<std::size_t>
+  from_graph(const build_graph::result &previous,
+             std::span<const std::filesystem::path> source_paths,
+             const std::filesystem::path &working_dir);
+
+  /// Return the text between the quotes or angle brackets of each
+  /// `#include` directive at the start of the specified `contents`, before
+  /// anything other than comments and preprocessor directives.
+  static std::vector<std::string> include_prefix(std::string_view contents);
+
+  /// Return a permutation of the indices of the specified `includes` in the
+  /// order their sources should be preprocessed, where `includes[i]` are
+  /// the includes found by `include_prefix` for the `i`th source.
+  static std::vector<std::size_t>
+  from_includes(std::span<const std::vector<std::string>> includes);
+  static std::vector<std::size_t>
+  from_includes(std::initializer_list<std::vector<std::string>> includes);
+};
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,91 @@
+#include "schedule.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+const auto B = boost::units::information::byte;
+
+TEST(Schedule, IncludePrefix) {
+  EXPECT_THAT(schedule::include_prefix(""), SizeIs(0));
+  EXPECT_THAT(schedule::include_prefix("// Copyright\n"
+                                       "/* A multi-line\n"
+                                       "   comment */\n"
+                                       "#ifndef A_HPP\n"
+                                       "#define A_HPP\n"
+                                       "#pragma once\n"
+                                       "\n"
+                                       "#include \"a.hpp\" // The interface\n"
+                                       "  #  include <vector>\r\n"
+                                       "#include_next <cstdio>\n"
+                                       "#include MACRO_HEADER\n"
+                                       "#ifdef X /* start\n"
+                                       "   end */ #include \"commented.hpp\"\n"
+                                       "#include <x.hpp>\n"
+                                       "#endif\n"
+                                       "int x;\n"
+                                       "#include \"late.hpp\"\n"),
+              ElementsAre("a.hpp", "vector", "cstdio", "x.hpp"));
+}
+
+TEST(Schedule, FromIncludes) {
+  // The third source shares the most includes with the others, after
+  // which no other source shares anything new
+  EXPECT_THAT(schedule::from_includes({{"a.hpp"},
+                                       {"x.hpp", "y.hpp"},
+                                       {"x.hpp", "y.hpp", "a.hpp"},
+                                       {"z.hpp", "z.hpp"}}),
+              ElementsAre(2u, 0u, 1u, 3u));
+  EXPECT_THAT(schedule::from_includes({{"a.hpp"}, {"b.hpp"}}),
+              ElementsAre(0u, 1u));
+  EXPECT_THAT(schedule::from_includes({}), SizeIs(0));
+}
+
+//  a.cpp  b.cpp  c.cpp    d.cpp
+//     \   /        |        |
+//   small.hpp   mid.hpp     |
+//                  |        |
+//               big.hpp ----+
+TEST(Schedule, FromGraph) {
+  build_graph::result previous;
+  Graph &g = previous.graph;
+  const auto a = add_vertex(file_node("a.cpp").with_cost(1, 1 * B), g);
+  const auto b = add_vertex(file_node("b.cpp").with_cost(1, 1 * B), g);
+  const auto c = add_vertex(file_node("src/c.cpp").with_cost(1, 1 * B), g);
+  const auto d = add_vertex(file_node("d.cpp").with_cost(1, 1 * B), g);
+  const auto small =
+      add_vertex(file_node("small.hpp").with_cost(1, 1 * B).set_guarded(true),
+                 g);
+  const auto mid =
+      add_vertex(file_node("mid.hpp").with_cost(10, 1 * B).set_guarded(true),
+                 g);
+  const auto big =
+      add_vertex(file_node("big.hpp").with_cost(100, 1 * B).set_guarded(true),
+                 g);
+  add_edge(a, small, {"\"small.hpp\"", 1}, g);
+  add_edge(b, small, {"\"small.hpp\"", 1}, g);
+  add_edge(c, mid, {"\"mid.hpp\"", 1}, g);
+  add_edge(mid, big, {"\"big.hpp\"", 1}, g);
+  add_edge(d, big, {"\"big.hpp\"", 1}, g);
+  previous.sources = {a, b, c, d};
+
+  // `big.hpp` is shared by `c.cpp` and `d.cpp`, so one of these goes first
+  // and then `small.hpp` is shared by `a.cpp` and `b.cpp`.  `new.cpp` was
+  // not seen before, so goes last.
+  const std::filesystem::path working_dir = "/home/project";
+  const std::vector<std::filesystem::path> sources = {
+      working_dir / "a.cpp", "b.cpp", working_dir / "src" / "c.cpp",
+      working_dir / "new.cpp", working_dir / "d.cpp"};
+  EXPECT_THAT(schedule::from_graph(previous, sources, working_dir),
+              ElementsAre(2u, 0u, 1u, 3u, 4u));
+}
+
+} // namespace
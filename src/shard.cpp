@@ -0,0 +1,156 @@
+#include "shard.hpp"
+
+#include <boost/range/iterator_range.hpp>
+
+#include <charconv>
+#include <unordered_map>
+#include <vector>
+
+namespace IncludeGuardian {
+
+namespace {
+
+const Graph::vertex_descriptor empty =
+    boost::graph_traits<Graph>::null_vertex();
+
+} // namespace
+
+std::optional<shard> shard::parse(std::string_view spec) {
+  const std::size_t slash = spec.find('/');
+  if (slash == std::string_view::npos) {
+    return std::nullopt;
+  }
+
+  shard s;
+  const char *const index_end = spec.data() + slash;
+  const char *const count_end = spec.data() + spec.size();
+  const auto [i, i_ec] = std::from_chars(spec.data(), index_end, s.index);
+  const auto [n, n_ec] = std::from_chars(index_end + 1, count_end, s.count);
+  if (i_ec != std::errc() || i != index_end || n_ec != std::errc() ||
+      n != count_end || s.count == 0u || s.index >= s.count) {
+    return std::nullopt;
+  }
+  return s;
+}
+
+std::span<const std::filesystem::path>
+shard::select(std::span<const std::filesystem::path> sources) const {
+  const std::size_t begin = sources.size() * index / count;
+  const std::size_t end = sources.size() * (index + 1) / count;
+  return sources.subspan(begin, end - begin);
+}
+
+build_graph::result
+shard::merge(std::span<const build_graph::result> shards) {
+  build_graph::result r;
+  std::unordered_map<interned_path, Graph::vertex_descriptor> files;
+  for (const build_graph::result &partial : shards) {
+    const Graph &g = partial.graph;
+
+    // A guarded file that an earlier shard has already processed would not
+    // be processed again, so its includes in this shard, and any files only
+    // reachable through them, are left out.  This includes files that this
+    // shard saw with different macros defined.
+    const auto is_skipped = [&](const Graph::vertex_descriptor v) {
+      const auto it = files.find(file_identity(g[v]));
+      return it != files.end() && r.graph[it->second].is_guarded;
+    };
+    std::vector<bool> reached(num_vertices(g));
+    std::vector<bool> skipped(num_vertices(g));
+    std::vector<Graph::vertex_descriptor> stack(partial.sources.begin(),
+                                                partial.sources.end());
+    while (!stack.empty()) {
+      const Graph::vertex_descriptor v = stack.back();
+      stack.pop_back();
+      if (reached[v]) {
+        continue;
+      }
+
+      reached[v] = true;
+      skipped[v] = is_skipped(v);
+      if (!skipped[v]) {
+        for (const Graph::vertex_descriptor to :
+             boost::make_iterator_range(adjacent_vertices(v, g))) {
+          stack.push_back(to);
+        }
+      }
+    }
+
+    // Add all reached files that we haven't seen before, in the order they
+    // were seen in this shard.
+    std::vector<Graph::vertex_descriptor> index(num_vertices(g), empty);
+    std::vector<bool> existed(num_vertices(g));
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(g))) {
+      if (!reached[v]) {
+        continue;
+      }
+
+      const auto [it, inserted] = files.emplace(file_identity(g[v]), empty);
+      if (inserted) {
+        it->second = add_vertex(g[v], r.graph);
+        r.graph[it->second].component.reset();
+      } else {
+        merge_lookups(r.graph[it->second], g[v]);
+      }
+      index[v] = it->second;
+      existed[v] = !inserted;
+    }
+
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(g))) {
+      if (!reached[v] || skipped[v]) {
+        continue;
+      }
+
+      file_node &node = r.graph[index[v]];
+      if (existed[v] && g[v].is_guarded) {
+        node.set_guarded(true);
+        node.underlying_cost = g[v].underlying_cost;
+      }
+
+      for (const Graph::edge_descriptor &e :
+           boost::make_iterator_range(out_edges(v, g))) {
+        const Graph::vertex_descriptor to = index[target(e, g)];
+        if (!edge(index[v], to, r.graph).second) {
+          add_edge(index[v], to, g[e], r.graph);
+        }
+      }
+    }
+
+    // The first link between a header and source wins
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(g))) {
+      if (reached[v] && g[v].component && !r.graph[index[v]].component &&
+          index[*g[v].component] != empty) {
+        r.graph[index[v]].component = index[*g[v].component];
+      }
+    }
+
+    // Whether a file is guarded is decided by the last time it was exited
+    for (const Graph::vertex_descriptor v :
+         boost::make_iterator_range(vertices(g))) {
+      if (!reached[v]) {
+        continue;
+      } else if (partial.unguarded_files.contains(v)) {
+        r.unguarded_files.insert(index[v]);
+      } else if (g[v].is_guarded) {
+        r.unguarded_files.erase(index[v]);
+      }
+    }
+
+    for (const Graph::vertex_descriptor v : partial.sources) {
+      r.sources.push_back(index[v]);
+    }
+    r.missing_includes.insert(partial.missing_includes.begin(),
+                              partial.missing_includes.end());
+    r.raw_token_costs |= partial.raw_token_costs;
+  }
+
+  // Files included from more than one shard would be counted twice if we
+  // summed the incoming counts of each shard
+  recalculate_incoming(r.graph);
+  return r;
+}
+
+} // namespace IncludeGuardian
@@ -0,0 +1,47 @@
+#ifndef INCLUDE_GUARD_B87CB48C_4421_46E3_8443_9B4F75CF9F0A
+#define INCLUDE_GUARD_B87CB48C_4421_46E3_8443_9B4F75CF9F0A
+
+// For very large projects we can split the sources of a compilation
+// database into `count` contiguous slices and preprocess each one in a
+// separate process, or on a separate machine.  The partial results are
+// then merged together.
+//
+// Merging the shards in order gives the same graph as preprocessing all
+// sources in one process: files are created in the order they are first
+// seen, a guarded file takes its cost and includes from the first shard
+// that processed it, and unguarded files collect the includes from all
+// shards.  Files that a later shard only reached through the includes of
+// such a guarded file are left out, as they would never have been seen.
+// Files are identified by `file_identity`, as the path of a file depends on
+// the file that first included it and this can differ between shards.
+
+#include "build_graph.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace IncludeGuardian {
+
+struct shard {
+  unsigned index = 0u; //< Which slice to process, in the range [0, `count`)
+  unsigned count = 1u; //< The total number of slices
+
+  /// Return the shard described by the specified `spec` in the form "i/N",
+  /// or an empty optional if `spec` is not valid.
+  static std::optional<shard> parse(std::string_view spec);
+
+  /// Return the slice of the specified `sources` processed by this shard.
+  std::span<const std::filesystem::path>
+  select(std::span<const std::filesystem::path> sources) const;
+
+  /// Return the result of merging the specified `shards`, which should be
+  /// in order of their `index`.
+  static build_graph::result
+  merge(std::span<const build_graph::result> shards);
+};
+
+} // namespace IncludeGuardian
+
+#endif
@@ -0,0 +1,165 @@
+#include "shard.hpp"
+
+#include "analysis_test_fixtures.hpp"
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using namespace IncludeGuardian;
+using namespace testing;
+
+namespace {
+
+const auto B = boost::units::information::byte;
+
+TEST(Shard, Parse) {
+  EXPECT_THAT(shard::parse("0/4").value().index, Eq(0u));
+  EXPECT_THAT(shard::parse("0/4").value().count, Eq(4u));
+  EXPECT_THAT(shard::parse("3/4").value().index, Eq(3u));
+  EXPECT_FALSE(shard::parse("4/4"));
+  EXPECT_FALSE(shard::parse("0/0"));
+  EXPECT_FALSE(shard::parse("1"));
+  EXPECT_FALSE(shard::parse("a/b"));
+  EXPECT_FALSE(shard::parse("1/2x"));
+  EXPECT_FALSE(shard::parse(""));
+}
+
+TEST(Shard, Select) {
+  std::vector<std::filesystem::path> sources;
+  for (int i = 0; i != 10; ++i) {
+    sources.push_back(std::to_string(i) + ".cpp");
+  }
+
+  std::vector<std::filesystem::path> all;
+  for (unsigned i = 0; i != 3; ++i) {
+    const std::span slice = shard{i, 3}.select(sources);
+    EXPECT_THAT(slice.size(), AnyOf(Eq(3u), Eq(4u)));
+    all.insert(all.end(), slice.begin(), slice.end());
+  }
+  EXPECT_THAT(all, ElementsAreArray(sources));
+}
+
+//  shard 0        shard 1
+//
+//   a.cpp       b.cpp -- b.hpp
+//     |         /  \
+//   x.hpp  ../x.hpp u.hpp
+//     |       |      |
+//   u.hpp   u.hpp  w.hpp
+TEST(Shard, Merge) {
+  build_graph::result shards[2];
+  {
+    Graph &g = shards[0].graph;
+    const auto a = add_vertex(stamped("a.cpp", "/src/a.cpp"), g);
+    const auto x = add_vertex(
+        stamped("x.hpp", "/src/x.hpp").with_cost(3, 3 * B).set_guarded(true),
+        g);
+    const auto u = add_vertex(stamped("u.hpp", "/src/u.hpp"), g);
+    add_edge(a, x, {"\"x.hpp\"", 1}, g);
+    add_edge(x, u, {"\"u.hpp\"", 1}, g);
+    shards[0].sources = {a};
+    shards[0].unguarded_files = {u};
+    shards[0].missing_includes = {"missing0"};
+  }
+  {
+    Graph &g = shards[1].graph;
+    const auto b = add_vertex(stamped("b.cpp", "/src/b.cpp"), g);
+    const auto b_hpp = add_vertex(stamped("b.hpp", "/src/b.hpp"), g);
+    const auto x = add_vertex(
+        stamped("../x.hpp", "/src/x.hpp").with_cost(9, 9 * B).set_guarded(true),
+        g);
+    const auto u = add_vertex(stamped("u.hpp", "/src/u.hpp"), g);
+    const auto w = add_vertex(stamped("w.hpp", "/src/w.hpp"), g);
+    add_edge(b, b_hpp, {"\"b.hpp\"", 1}, g);
+    add_edge(b, x, {"\"../x.hpp\"", 2}, g);
+    add_edge(b, u, {"\"u.hpp\"", 3}, g);
+    add_edge(x, u, {"\"u.hpp\"", 1}, g);
+    add_edge(u, w, {"\"w.hpp\"", 1}, g);
+    g[b].component = b_hpp;
+    g[b_hpp].component = b;
+    shards[1].sources = {b};
+    shards[1].unguarded_files = {u};
+    shards[1].missing_includes = {"missing1"};
+    shards[1].raw_token_costs = true;
+  }
+
+  const build_graph::result r = shard::merge(shards);
+  const Graph &g = r.graph;
+  ASSERT_THAT(paths(g), ElementsAre("a.cpp", "x.hpp", "u.hpp", "b.cpp",
+                                    "b.hpp", "w.hpp"));
+  const Graph::vertex_descriptor a = 0, x = 1, u = 2, b = 3, b_hpp = 4, w = 5;
+
+  // `x.hpp` is guarded and takes everything from the first shard
+  EXPECT_THAT(g[x].underlying_cost, Eq(cost(3, 3 * B)));
+  EXPECT_THAT(children(g, x), ElementsAre("u.hpp"));
+
+  // `u.hpp` is unguarded and collects includes from both shards
+  EXPECT_THAT(children(g, u), ElementsAre("w.hpp"));
+  EXPECT_THAT(children(g, b), ElementsAre("b.hpp", "x.hpp", "u.hpp"));
+  EXPECT_THAT(children(g, a), ElementsAre("x.hpp"));
+
+  EXPECT_THAT(g[x].internal_incoming, Eq(2u));
+  EXPECT_THAT(g[u].internal_incoming, Eq(2u));
+  EXPECT_THAT(g[w].internal_incoming, Eq(1u));
+  EXPECT_TRUE(g[b].component == b_hpp);
+  EXPECT_TRUE(g[b_hpp].component == b);
+  EXPECT_FALSE(g[a].component);
+
+  EXPECT_THAT(r.sources, ElementsAre(a, b));
+  EXPECT_THAT(r.unguarded_files, UnorderedElementsAre(u));
+  EXPECT_THAT(r.missing_includes, ElementsAre("missing0", "missing1"));
+  EXPECT_TRUE(r.raw_token_costs);
+}
+
+// Test that when two shards include the same guarded header with different
+// macros defined, the files that only the second shard reached through it
+// are not added.
+TEST(Shard, MergeGuardedWithDifferentMacros) {
+  build_graph::result shards[2];
+  {
+    Graph &g = shards[0].graph;
+    const auto a = add_vertex(stamped("a.cpp", "/src/a.cpp"), g);
+    const auto x = add_vertex(
+        stamped("x.hpp", "/src/x.hpp").with_cost(3, 3 * B).set_guarded(true),
+        g);
+    const auto y = add_vertex(
+        stamped("y.hpp", "/src/y.hpp").with_cost(1, 1 * B).set_guarded(true),
+        g);
+    add_edge(a, x, {"\"x.hpp\"", 2}, g);
+    add_edge(x, y, {"\"y.hpp\"", 2}, g);
+    shards[0].sources = {a};
+  }
+  {
+    Graph &g = shards[1].graph;
+    const auto b = add_vertex(stamped("b.cpp", "/src/b.cpp"), g);
+    const auto x = add_vertex(
+        stamped("x.hpp", "/src/x.hpp").with_cost(5, 5 * B).set_guarded(true),
+        g);
+    const auto z = add_vertex(
+        stamped("z.hpp", "/src/z.hpp").with_cost(7, 7 * B).set_guarded(true),
+        g);
+    const auto w = add_vertex(stamped("w.hpp", "/src/w.hpp"), g);
+    add_edge(b, x, {"\"x.hpp\"", 1}, g);
+    add_edge(x, z, {"\"z.hpp\"", 4}, g);
+    add_edge(z, w, {"\"w.hpp\"", 1}, g);
+    shards[1].sources = {b};
+    shards[1].unguarded_files = {w};
+  }
+
+  const build_graph::result r = shard::merge(shards);
+  const Graph &g = r.graph;
+  ASSERT_THAT(paths(g), ElementsAre("a.cpp", "x.hpp", "y.hpp", "b.cpp"));
+  const Graph::vertex_descriptor a = 0, x = 1, y = 2, b = 3;
+  EXPECT_THAT(g[x].underlying_cost, Eq(cost(3, 3 * B)));
+  EXPECT_THAT(children(g, a), ElementsAre("x.hpp"));
+  EXPECT_THAT(children(g, b), ElementsAre("x.hpp"));
+  EXPECT_THAT(children(g, x), ElementsAre("y.hpp"));
+  EXPECT_THAT(g[x].internal_incoming, Eq(2u));
+  EXPECT_THAT(r.sources, ElementsAre(a, b));
+  EXPECT_THAT(r.unguarded_files, SizeIs(0));
+}
+
+} // namespace
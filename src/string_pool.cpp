@@ -0,0 +1,221 @@
+#include "string_pool.hpp"
+
+#include <boost/predef.h>
+
+#include <algorithm>
+#include <bit>
+#include <mutex>
+#include <ostream>
+
+namespace IncludeGuardian {
+
+namespace {
+
+bool is_separator(const char c) {
+  return c == '/' || c == std::filesystem::path::preferred_separator;
+}
+
+// If `rhs` starts with `prefix`, where any run of separators matches any
+// other run of separators, remove the matching part from `rhs` and return
+// `true`.  Otherwise return `false` and leave `rhs` unchanged.
+bool consume(std::string_view &rhs, const std::string_view prefix) {
+  std::size_t i = 0;
+  std::size_t j = 0;
+  while (i != prefix.size()) {
+    if (j == rhs.size()) {
+      return false;
+    }
+
+    if (is_separator(prefix[i])) {
+      if (!is_separator(rhs[j])) {
+        return false;
+      }
+      while (i != prefix.size() && is_separator(prefix[i])) {
+        ++i;
+      }
+      while (j != rhs.size() && is_separator(rhs[j])) {
+        ++j;
+      }
+    } else if (prefix[i++] != rhs[j++]) {
+      return false;
+    }
+  }
+  rhs.remove_prefix(j);
+  return true;
+}
+
+} // namespace
+
+string_pool::string_pool() : m_mutex(), m_chunks(), m_size(0), m_ids() {
+  intern("");
+}
+
+string_pool &string_pool::instance() {
+  static string_pool pool;
+  return pool;
+}
+
+string_pool::id string_pool::intern(const std::string_view s) {
+  {
+    std::shared_lock lock(m_mutex);
+    const auto it = m_ids.find(s);
+    if (it != m_ids.end()) {
+      return it->second;
+    }
+  }
+
+  std::unique_lock lock(m_mutex);
+  const auto it = m_ids.find(s);
+  if (it != m_ids.end()) {
+    return it->second;
+  }
+
+  const std::size_t size = m_size.load(std::memory_order_relaxed);
+  const auto [chunk, index] = locate(id(size));
+  if (!m_chunks[chunk]) {
+    m_chunks[chunk] = std::make_unique<std::string[]>(first_chunk_size
+                                                      << chunk);
+  }
+
+  // Key the lookup with our own copy of the string, which never moves
+  std::string &copy = m_chunks[chunk][index];
+  copy = s;
+  m_size.store(size + 1, std::memory_order_release);
+  return m_ids.emplace(copy, id(size)).first->second;
+}
+
+std::pair<std::size_t, std::size_t> string_pool::locate(const id i) {
+  // Chunk `c` holds `first_chunk_size << c` strings starting from the id
+  // `first_chunk_size * (2^c - 1)`
+  const std::uint64_t n = std::uint64_t(i) / first_chunk_size + 1;
+  const std::size_t chunk = std::bit_width(n) - 1;
+  return {chunk, i - first_chunk_size * ((std::uint64_t(1) << chunk) - 1)};
+}
+
+const std::string &string_pool::get(const id i) const {
+  assert(i < m_size.load(std::memory_order_acquire));
+  const auto [chunk, index] = locate(i);
+  return m_chunks[chunk][index];
+}
+
+std::size_t string_pool::size() const {
+  return m_size.load(std::memory_order_acquire);
+}
+
+interned_string::interned_string(const std::string_view s)
+    : m_id(string_pool::instance().intern(s)) {}
+
+interned_string::interned_string(const std::string &s)
+    : interned_string(std::string_view(s)) {}
+
+interned_string::interned_string(const char *s)
+    : interned_string(std::string_view(s)) {}
+
+bool operator==(const interned_string &lhs, const interned_string &rhs) {
+  return lhs.id() == rhs.id();
+}
+
+bool operator!=(const interned_string &lhs, const interned_string &rhs) {
+  return !(lhs == rhs);
+}
+
+std::ostream &operator<<(std::ostream &out, const interned_string &s) {
+  return out << s.str();
+}
+
+interned_path::interned_path(const std::filesystem::path &p)
+    : m_parent(), m_filename() {
+  const std::string full = p.string();
+  const std::string filename = p.filename().string();
+
+  // `filename` should always be a suffix, but if not we store the entire
+  // path as the filename so that it round trips
+  if (full.size() >= filename.size() &&
+      full.compare(full.size() - filename.size(), filename.size(),
+                   filename) == 0) {
+    m_parent = std::string_view(full).substr(0, full.size() - filename.size());
+    m_filename = filename;
+  } else {
+    m_filename = full;
+  }
+  split_filename();
+}
+
+interned_path::interned_path(const interned_string directory,
+                             const interned_string name)
+    : m_parent(directory), m_filename(name), m_stem(), m_extension() {
+  split_filename();
+}
+
+void interned_path::split_filename() {
+  // Follow `path::stem` and `path::extension`, where the filename may be a
+  // whole path if it could not be split on construction
+  std::string_view name = m_filename.str();
+  const auto last = std::find_if(name.rbegin(), name.rend(), [](char c) {
+    return is_separator(c);
+  });
+  name.remove_prefix(name.rend() - last);
+  const std::size_t dot = name.rfind('.');
+  if (dot == std::string_view::npos || dot == 0 || name == "..") {
+    m_stem = name;
+    m_extension = interned_string();
+  } else {
+    m_stem = name.substr(0, dot);
+    m_extension = name.substr(dot);
+  }
+}
+
+std::filesystem::path interned_path::path() const {
+  return std::filesystem::path(string());
+}
+
+std::string interned_path::string() const {
+  return m_parent.str() + m_filename.str();
+}
+
+std::filesystem::path interned_path::filename() const {
+  return std::filesystem::path(m_filename.str()).filename();
+}
+
+std::filesystem::path interned_path::parent_path() const {
+  return path().parent_path();
+}
+
+bool operator==(const interned_path &lhs, const interned_path &rhs) {
+  return lhs.m_parent == rhs.m_parent && lhs.m_filename == rhs.m_filename;
+}
+
+bool operator!=(const interned_path &lhs, const interned_path &rhs) {
+  return !(lhs == rhs);
+}
+
+bool operator==(const interned_path &lhs, const std::filesystem::path &rhs) {
+#if BOOST_OS_WINDOWS
+  // Paths are wide and may have root names, so build the path to compare
+  return lhs.path() == rhs;
+#else
+  // Compare in place, which gives the same result as comparing each
+  // component of the paths
+  std::string_view r = rhs.native();
+  return consume(r, lhs.m_parent.str()) &&
+         consume(r, lhs.m_filename.str()) && r.empty();
+#endif
+}
+
+bool operator!=(const interned_path &lhs, const std::filesystem::path &rhs) {
+  return !(lhs == rhs);
+}
+
+bool operator==(const std::filesystem::path &lhs, const interned_path &rhs) {
+  return rhs == lhs;
+}
+
+bool operator!=(const std::filesystem::path &lhs, const interned_path &rhs) {
+  return !(rhs == lhs);
+}
+
+std::ostream &operator<<(std::ostream &out, const interned_path &p) {
+  return out << p.path();
+}
+
+} // namespace IncludeGuardian
@@ -0,0 +1,223 @@
+#ifndef INCLUDE_GUARD_D1A3D2B1_246A_4F0E_A06F_960C3DE125B5
+#define INCLUDE_GUARD_D1A3D2B1_246A_4F0E_A06F_960C3DE125B5
+
+// `string_pool` is a process-wide arena of strings where each distinct
+// string is stored only once.  `interned_string` and `interned_path` are
+// small handles into this arena.  Files in a large project share long
+// directory prefixes and the same header is included with the same code
+// from many files, so this removes most of the memory taken by the paths
+// and include directives in a `Graph`.
+//
+// When serialized, each distinct string is written the first time it is
+// seen in an archive and subsequent occurrences write only its index, so
+// the archive contains a single table of strings.
+
+#include <boost/serialization/split_member.hpp>
+#include <boost/serialization/string.hpp>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace IncludeGuardian {
+
+class string_pool {
+public:
+  using id = std::uint32_t;
+
+private:
+  // Strings are stored in chunks that double in size and are never moved,
+  // so that `get` can read them without taking `m_mutex`.  A chunk is
+  // created before any id that it holds is returned from `intern`, so any
+  // thread that has an id can safely read its chunk.
+  static constexpr std::size_t first_chunk_size = 1024;
+  static constexpr std::size_t chunk_count = 23; //< enough for every `id`
+
+  mutable std::shared_mutex m_mutex;
+  std::array<std::unique_ptr<std::string[]>, chunk_count> m_chunks;
+  std::atomic<std::size_t> m_size; //< number of strings
+  std::unordered_map<std::string_view, id> m_ids; //< string -> id
+
+  string_pool();
+
+  // Return the chunk and the index within that chunk of the specified `i`.
+  static std::pair<std::size_t, std::size_t> locate(id i);
+
+public:
+  /// Return the pool shared by the whole process.
+  static string_pool &instance();
+
+  /// Return the id of `s`, adding it to the pool if it is not there.  The
+  /// empty string always has an id of 0.  This is thread safe.
+  id intern(std::string_view s);
+
+  /// Return the string with the specified id.  The reference is valid for
+  /// the lifetime of the process.  This is thread safe and does not lock.
+  const std::string &get(id i) const;
+
+  /// Return the number of distinct strings in the pool.
+  std::size_t size() const;
+};
+
+// Archive helpers to map between `string_pool::id` and the index of a string
+// in the table written to an archive.
+struct string_table_writer {
+  std::unordered_map<string_pool::id, std::uint32_t> indices;
+  static void *key() {
+    static char k;
+    return &k;
+  }
+};
+
+struct string_table_reader {
+  std::vector<string_pool::id> ids;
+  static void *key() {
+    static char k;
+    return &k;
+  }
+};
+
+class interned_string {
+  string_pool::id m_id;
+
+public:
+  interned_string() : m_id(0) {}
+  interned_string(std::string_view s);
+  interned_string(const std::string &s);
+  interned_string(const char *s);
+
+  /// Return the underlying string.
+  const std::string &str() const { return string_pool::instance().get(m_id); }
+  operator const std::string &() const { return str(); }
+
+  string_pool::id id() const { return m_id; }
+  bool empty() const { return m_id == 0; }
+
+  template <typename Archive>
+  void save(Archive &ar, const unsigned version) const {
+    string_table_writer &table =
+        ar.template get_helper<string_table_writer>(string_table_writer::key());
+    const auto [it, inserted] =
+        table.indices.emplace(m_id, std::uint32_t(table.indices.size()));
+    const std::uint32_t index = it->second;
+    ar << index;
+    if (inserted) {
+      ar << str();
+    }
+  }
+
+  template <typename Archive> void load(Archive &ar, const unsigned version) {
+    string_table_reader &table =
+        ar.template get_helper<string_table_reader>(string_table_reader::key());
+    std::uint32_t index;
+    ar >> index;
+    if (index == table.ids.size()) {
+      std::string s;
+      ar >> s;
+      table.ids.push_back(string_pool::instance().intern(s));
+    }
+    assert(index < table.ids.size());
+    m_id = table.ids[index];
+  }
+
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+};
+
+bool operator==(const interned_string &lhs, const interned_string &rhs);
+bool operator!=(const interned_string &lhs, const interned_string &rhs);
+std::ostream &operator<<(std::ostream &out, const interned_string &s);
+
+/// `interned_path` stores a path as the interned directory part (including
+/// the trailing separator) and the interned filename.  The original string
+/// of the path is recreated exactly.  The stem and extension of the filename
+/// are interned on construction so that they can be compared cheaply.
+class interned_path {
+  interned_string m_parent;
+  interned_string m_filename;
+  interned_string m_stem;      //< not serialized
+  interned_string m_extension; //< not serialized
+
+  // Set `m_stem` and `m_extension` from `m_filename`.
+  void split_filename();
+
+public:
+  interned_path() = default;
+  explicit interned_path(const std::filesystem::path &p);
+  interned_path(interned_string directory, interned_string name);
+
+  /// Return the directory part, including any trailing separator.
+  const interned_string &directory() const { return m_parent; }
+
+  /// Return the filename part.
+  const interned_string &name() const { return m_filename; }
+
+  /// Return the full path.  Note that this allocates.
+  std::filesystem::path path() const;
+  operator std::filesystem::path() const { return path(); }
+
+  std::string string() const;
+  std::filesystem::path filename() const;
+  std::filesystem::path parent_path() const;
+  bool empty() const { return m_parent.empty() && m_filename.empty(); }
+
+  /// Return the filename without its extension, as `path::stem`.
+  const interned_string &stem() const { return m_stem; }
+
+  /// Return the extension of the filename, as `path::extension`.
+  const interned_string &extension() const { return m_extension; }
+
+  template <typename Archive>
+  void save(Archive &ar, const unsigned version) const {
+    ar << m_parent;
+    ar << m_filename;
+  }
+
+  template <typename Archive> void load(Archive &ar, const unsigned version) {
+    ar >> m_parent;
+    ar >> m_filename;
+    split_filename();
+  }
+
+  BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+  friend bool operator==(const interned_path &lhs, const interned_path &rhs);
+  friend bool operator==(const interned_path &lhs,
+                         const std::filesystem::path &rhs);
+};
+
+bool operator==(const interned_path &lhs, const interned_path &rhs);
+bool operator!=(const interned_path &lhs, const interned_path &rhs);
+bool operator==(const interned_path &lhs, const std::filesystem::path &rhs);
+bool operator!=(const interned_path &lhs, const std::filesystem::path &rhs);
+bool operator==(const std::filesystem::path &lhs, const interned_path &rhs);
+bool operator!=(const std::filesystem::path &lhs, const interned_path &rhs);
+std::ostream &operator<<(std::ostream &out, const interned_path &p);
+
+} // namespace IncludeGuardian
+
+template <> struct std::hash<IncludeGuardian::interned_string> {
+  std::size_t operator()(const IncludeGuardian::interned_string &s) const {
+    return std::hash<IncludeGuardian::string_pool::id>()(s.id());
+  }
+};
+
+template <> struct std::hash<IncludeGuardian::interned_path> {
+  std::size_t operator()(const IncludeGuardian::interned_path &p) const {
+    return std::hash<std::uint64_t>()(
+        (std::uint64_t(p.directory().id()) << 32) | p.name().id());
+  }
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "string_pool.hpp"
+
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace IncludeGuardian;
+
+namespace {
+
+TEST(StringPool, Intern) {
+  string_pool &pool = string_pool::instance();
+  EXPECT_EQ(pool.intern(""), 0u);
+  const string_pool::id a = pool.intern("string_pool_test_a");
+  const string_pool::id b = pool.intern("string_pool_test_b");
+  EXPECT_NE(a, b);
+  EXPECT_EQ(pool.intern(std::string("string_pool_test_a")), a);
+  EXPECT_EQ(pool.get(a), "string_pool_test_a");
+  EXPECT_EQ(pool.get(b), "string_pool_test_b");
+
+  const interned_string s("string_pool_test_a");
+  EXPECT_EQ(s.id(), a);
+  EXPECT_EQ(s.str(), "string_pool_test_a");
+  EXPECT_EQ(s, interned_string("string_pool_test_a"));
+  EXPECT_NE(s, interned_string("string_pool_test_b"));
+  EXPECT_TRUE(interned_string().empty());
+}
+
+TEST(InternedPath, RoundTrip) {
+  for (const std::filesystem::path &p :
+       {std::filesystem::path("a.hpp"), std::filesystem::path(""),
+        std::filesystem::path("boost") / "foo" / "bar.hpp",
+        std::filesystem::path("boost") / "foo" / "",
+        std::filesystem::path("/usr/include/stdio.h")}) {
+    const interned_path i(p);
+    EXPECT_EQ(i.path(), p);
+    EXPECT_EQ(i.string(), p.string());
+    EXPECT_EQ(i.filename(), p.filename());
+    EXPECT_EQ(i.stem().str(), p.stem().string());
+    EXPECT_EQ(i.extension().str(), p.extension().string());
+    EXPECT_EQ(i.parent_path(), p.parent_path());
+    EXPECT_EQ(i, interned_path(p));
+    EXPECT_EQ(i, p);
+  }
+
+  EXPECT_NE(interned_path(std::filesystem::path("a") / "x.hpp"),
+            interned_path(std::filesystem::path("b") / "x.hpp"));
+}
+
+TEST(InternedPath, StemAndExtension) {
+  for (const std::filesystem::path &p :
+       {std::filesystem::path("a.tar.gz"), std::filesystem::path(".hidden"),
+        std::filesystem::path("."), std::filesystem::path(".."),
+        std::filesystem::path("dir.d") / "noext",
+        std::filesystem::path("trailing.")}) {
+    const interned_path i(p);
+    EXPECT_EQ(i.stem().str(), p.stem().string()) << p;
+    EXPECT_EQ(i.extension().str(), p.extension().string()) << p;
+    EXPECT_EQ(interned_path(i.directory(), i.name()).stem(), i.stem());
+  }
+}
+
+// Test that comparing with a `path` matches comparing each component
+TEST(InternedPath, CompareWithPath) {
+  const std::filesystem::path p = std::filesystem::path("a") / "b" / "c.h";
+  const interned_path i(p);
+  for (const std::filesystem::path &other :
+       {std::filesystem::path("a//b/c.h"), std::filesystem::path("a/b/c.h/"),
+        std::filesystem::path("a/b/c.hpp"), std::filesystem::path("a/b/c"),
+        std::filesystem::path("a/bc.h"), std::filesystem::path("/a/b/c.h"),
+        std::filesystem::path("a/b"), std::filesystem::path("")}) {
+    EXPECT_EQ(i == other, p == other) << other;
+    EXPECT_EQ(other != i, other != p) << other;
+  }
+}
+
+// Test that each distinct string is only written once to an archive
+TEST(InternedString, Serialize) {
+  const std::string repeated = "string_pool_test_repeated_string";
+  std::vector<interned_string> expected;
+  for (int i = 0; i != 10; ++i) {
+    expected.emplace_back(repeated);
+    expected.emplace_back("string_pool_test_" + std::to_string(i % 3));
+  }
+
+  std::ostringstream out;
+  {
+    boost::archive::text_oarchive oa(out);
+    oa << expected;
+  }
+
+  const std::string archive = out.str();
+  std::size_t count = 0;
+  for (std::size_t pos = archive.find(repeated); pos != std::string::npos;
+       pos = archive.find(repeated, pos + 1)) {
+    ++count;
+  }
+  EXPECT_EQ(count, 1u);
+
+  std::vector<interned_string> actual;
+  std::istringstream in(archive);
+  boost::archive::text_iarchive ia(in);
+  ia >> actual;
+  EXPECT_EQ(actual, expected);
+}
+
+} // namespace